@@ -0,0 +1,327 @@
+// Benchmark each public entry point of the library, and the .png and .bmp codecs,
+// on deterministic blocky frames from 0.3 to 100 megapixels, generated in memory.
+// Each is run once to warm up, and then timed several times.
+// Prints JSON to stdout, one result per line, so that runs on different commits can be diffed.
+//
+// usage: bench/frames [--max-mp N] [--repeats N] [--threads N]
+
+extern "C" {
+#include "costella_unblock.h"
+}
+#include "EasyBMP.h"
+#include <png.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using u8 = uint8_t;
+
+// Widths are multiples of 16, as the library prefers.
+static const struct { unsigned w, h; } sizes[] = {
+  {640, 480}, {1920, 1080}, {3840, 2160}, {7680, 4320}, {12288, 8192}};
+
+// An interleaved RGB frame, and three planes for the library's separate arrays.
+struct Frame {
+  unsigned w, h;
+  std::vector<u8> rgb;
+  std::vector<u8> src;  // Planes prepared for an entry point, copied to work before each run.
+  std::vector<u8> work; // Planes that the entry point changes.
+  size_t cb() const { return size_t(w) * h; }
+  u8* plane(std::vector<u8>& v, int i) { return v.data() + i * cb(); }
+};
+
+// Each 8x8 block is a flat color plus a gentle gradient, as a heavily compressed JPEG keeps
+// little more than the DC and lowest AC terms, plus a little noise.  The same for every run.
+static void makeFrame(Frame& f)
+{
+  f.rgb.resize(3 * f.cb());
+  uint32_t seed = 12345u;
+  for (unsigned y = 0; y < f.h; ++y) {
+    auto p = f.rgb.data() + size_t(y) * 3 * f.w;
+    for (unsigned x = 0; x < f.w; ++x) {
+      const uint32_t block = ((x >> 3) * 2654435761u) ^ ((y >> 3) * 40503u);
+      seed = seed * 1664525u + 1013904223u;
+      for (int c = 0; c < 3; ++c) {
+        const int base = (block >> (8 * c)) & 0xff;
+        const int slope = int((block >> (24 + 2 * c)) & 3) - 1;
+        const int v = base + slope * (int(x & 7) + int(y & 7)) + int((seed >> (28 - 2 * c)) & 3);
+        *p++ = u8(std::clamp(v, 0, 255));
+      }
+    }
+  }
+}
+
+// The three planes of f.work (or f.src) as a COSTELLA_IMAGE with full-size chroma.
+static COSTELLA_IMAGE planes(Frame& f, std::vector<u8>& v, bool fRgb)
+{
+  COSTELLA_IMAGE im = {};
+  im.bAlpha = 0;
+  im.bRgb = fRgb;
+  im.bColor = 1;
+  im.bDownsampledChrominance = im.bNonreplicatedDownsampledChrominance = 0;
+  im.udWidth = f.w;
+  im.udHeight = f.h;
+  im.sdRowStride = f.w;
+  im.sdAlphaRowStride = 0;
+  im.sdChrominanceRowStride = 0;
+  im.ic.aubRY = f.plane(v, 0);
+  im.ic.aubGCb = f.plane(v, 1);
+  im.ic.aubBCr = f.plane(v, 2);
+  return im;
+}
+
+// Split f.rgb into R, G and B planes in f.src.
+static void splitRGB(Frame& f)
+{
+  f.src.resize(3 * f.cb());
+  for (size_t i = 0; i < f.cb(); ++i)
+    for (int c = 0; c < 3; ++c)
+      f.plane(f.src, c)[i] = f.rgb[3 * i + c];
+}
+
+static void writePNGData(png_structp pPNG, png_bytep data, png_size_t cb)
+{
+  auto& v = *(std::vector<u8>*)png_get_io_ptr(pPNG);
+  v.insert(v.end(), data, data + cb);
+}
+
+struct ReadPNG {
+  const u8* p;
+  size_t i;
+};
+
+static void readPNGData(png_structp pPNG, png_bytep data, png_size_t cb)
+{
+  auto& r = *(ReadPNG*)png_get_io_ptr(pPNG);
+  memcpy(data, r.p + r.i, cb);
+  r.i += cb;
+}
+
+// Encode f.rgb as a .png, in memory, as unblock does with libpng's default level.
+static bool encodePNG(const Frame& f, std::vector<u8>& out)
+{
+  out.clear();
+  auto pPNG = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  auto pInfo = png_create_info_struct(pPNG);
+  png_set_write_fn(pPNG, &out, writePNGData, NULL);
+  png_set_IHDR(pPNG, pInfo, f.w, f.h, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(pPNG, pInfo);
+  for (unsigned y = 0; y < f.h; ++y)
+    png_write_row(pPNG, (png_bytep)f.rgb.data() + size_t(y) * 3 * f.w);
+  png_write_end(pPNG, NULL);
+  png_destroy_write_struct(&pPNG, &pInfo);
+  return !out.empty();
+}
+
+static bool decodePNG(const std::vector<u8>& in, Frame& f)
+{
+  ReadPNG r = {in.data(), 0};
+  auto pPNG = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  auto pInfo = png_create_info_struct(pPNG);
+  png_set_read_fn(pPNG, &r, readPNGData);
+  png_read_info(pPNG, pInfo);
+  const auto ok = png_get_image_width(pPNG, pInfo) == f.w && png_get_image_height(pPNG, pInfo) == f.h;
+  for (unsigned y = 0; ok && y < f.h; ++y)
+    png_read_row(pPNG, f.work.data() + size_t(y) * 3 * f.w, NULL);
+  png_destroy_read_struct(&pPNG, &pInfo, NULL);
+  return ok;
+}
+
+struct Options {
+  double mpMax = 101.0;
+  int cRepeat = 0; // 0 for as many as fit in a few seconds, at least 3.
+  int cThread = std::max(1u, std::thread::hardware_concurrency());
+};
+
+// Run reset() and then run(), once to warm up and then repeatedly, timing only run().
+// Print the percentiles of the times, and the throughput of the median.
+static bool bench(const char* name, Frame& f, const Options& o, const std::function<void()>& reset, const std::function<bool()>& run)
+{
+  const auto mp = 1e-6 * f.cb();
+  const auto cRepeat = o.cRepeat ? o.cRepeat : std::clamp(int(30.0 / mp), 3, 20);
+  std::vector<double> seconds;
+  for (int i = -1; i < cRepeat; ++i) {
+    reset();
+    const auto t0 = std::chrono::steady_clock::now();
+    if (!run()) {
+      fprintf(stderr, "bench/frames: %s failed on %ux%u.\n", name, f.w, f.h);
+      return false;
+    }
+    const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    if (i >= 0)
+      seconds.push_back(dt.count());
+  }
+  std::sort(seconds.begin(), seconds.end());
+  // Nearest rank.
+  const auto pct = [&](double q) { return seconds[std::max(0, int(std::ceil(q * seconds.size())) - 1)]; };
+  double sum = 0.0;
+  for (auto t: seconds)
+    sum += t;
+  static auto separator = "";
+  printf("%s\n    {\"entry\":\"%s\",\"width\":%u,\"height\":%u,\"megapixels\":%.3f,\"repeats\":%d,"
+    "\"seconds\":{\"min\":%.6f,\"p50\":%.6f,\"p90\":%.6f,\"p99\":%.6f,\"mean\":%.6f},\"megapixels_per_second\":%.2f}",
+    separator, name, f.w, f.h, mp, cRepeat, seconds.front(), pct(0.5), pct(0.9), pct(0.99), sum / seconds.size(), mp / pct(0.5));
+  fflush(stdout);
+  separator = ",";
+  return true;
+}
+
+static bool benchFrame(Frame& f, const Options& o, costella_unblock_context* ctx)
+{
+  const auto cb = f.cb();
+  const auto fPhoto = 0; // As in unblock.
+  COSTELLA_IMAGE im = {};
+  const auto copy = [&](bool fRgb) {
+    f.work = f.src;
+    im = planes(f, f.work, fRgb);
+  };
+  auto ok = true;
+
+  // The whole algorithm on RGB planes, converting, downsampling and upsampling as it goes.
+  splitRGB(f);
+  ok = ok && bench("costella_unblock", f, o, [&]() { copy(true); },
+    [&]() { return costella_unblock(&im, &im, fPhoto, 0, NULL, NULL, stderr); });
+  ok = ok && bench("costella_unblock_mt", f, o, [&]() { copy(true); },
+    [&]() { return costella_unblock_mt(&im, &im, fPhoto, 0, o.cThread, NULL, NULL, stderr); });
+  ok = ok && bench("costella_image_convert_rgb_to_ycbcr", f, o, [&]() { copy(true); },
+    [&]() { return costella_image_convert_rgb_to_ycbcr(&im, &im, NULL, NULL, stderr); });
+
+  // From here on, YCbCr planes.
+  copy(true);
+  ok = ok && costella_image_convert_rgb_to_ycbcr(&im, &im, NULL, NULL, stderr);
+  f.src = f.work;
+  ok = ok && bench("costella_image_convert_ycbcr_to_rgb", f, o, [&]() { copy(false); },
+    [&]() { return costella_image_convert_ycbcr_to_rgb(&im, &im, NULL, NULL, stderr); });
+  ok = ok && bench("costella_image_chrominance_average_downsample_replicate", f, o, [&]() { copy(false); },
+    [&]() { return costella_image_chrominance_average_downsample_replicate(&im, &im, NULL, NULL, stderr); });
+
+  // Replicated downsampled chroma, as downsampling leaves it.
+  copy(false);
+  ok = ok && costella_image_chrominance_average_downsample_replicate(&im, &im, NULL, NULL, stderr);
+  f.src = f.work;
+  const auto copyDownsampled = [&](bool fNonreplicated) {
+    copy(false);
+    im.bDownsampledChrominance = 1;
+    im.bNonreplicatedDownsampledChrominance = fNonreplicated;
+  };
+  ok = ok && bench("costella_image_chrominance_magic_upsample", f, o, [&]() { copyDownsampled(false); },
+    [&]() { return costella_image_chrominance_magic_upsample(&im, &im, NULL, NULL, stderr); });
+  ok = ok && bench("costella_image_chrominance_replicate_eq", f, o, [&]() { copyDownsampled(true); },
+    [&]() { return costella_image_chrominance_replicate_eq(&im, NULL, NULL, stderr); });
+
+  // As unblock does: quarter-size chroma planes, and a context reused from frame to frame.
+  const auto wC = (f.w + 1) / 2;
+  const auto copyQuarter = [&]() {
+    f.work.resize(3 * cb);
+    auto pU = f.plane(f.work, 1), pV = f.plane(f.work, 2);
+    memcpy(f.plane(f.work, 0), f.plane(f.src, 0), cb);
+    for (unsigned y = 0; y < f.h; y += 2)
+      for (unsigned x = 0; x < f.w; x += 2) {
+        pU[(y/2)*wC + x/2] = f.plane(f.src, 1)[size_t(y)*f.w + x];
+        pV[(y/2)*wC + x/2] = f.plane(f.src, 2)[size_t(y)*f.w + x];
+      }
+    im = planes(f, f.work, false);
+    im.bDownsampledChrominance = im.bNonreplicatedDownsampledChrominance = 1;
+    im.sdChrominanceRowStride = wC;
+  };
+  ok = ok && bench("costella_unblock_quarter", f, o, copyQuarter,
+    [&]() { return costella_unblock_quarter(ctx, &im, &im, fPhoto, 0, o.cThread, NULL, NULL, stderr); });
+
+  // The same on interleaved RGB, in place, with the conversion done by the library.
+  ok = ok && bench("costella_unblock_interleaved", f, o, [&]() { f.work = f.rgb; },
+    [&]() { return costella_unblock_interleaved(ctx, f.work.data(), 3 * long(f.w), f.work.data(), 3 * long(f.w),
+      f.w, f.h, 0, fPhoto, 0, o.cThread, NULL, NULL, stderr); });
+
+  // Whole frames of rows, between interleaved RGB and planes.
+  f.work.resize(3 * cb);
+  ok = ok && bench("costella_image_convert_rgb_row_to_ycbcr", f, o, []() {}, [&]() {
+    auto fOk = true;
+    for (unsigned y = 0; y < f.h; ++y) {
+      const auto i = size_t(y) * f.w;
+      fOk = costella_image_convert_rgb_row_to_ycbcr(f.rgb.data() + 3*i, f.w, 0,
+        f.plane(f.work, 0) + i, f.plane(f.work, 1) + i, f.plane(f.work, 2) + i, stderr) && fOk;
+    }
+    return fOk;
+  });
+  std::vector<u8> rgbOut(3 * cb);
+  ok = ok && bench("costella_image_convert_ycbcr_row_to_rgb", f, o, []() {}, [&]() {
+    auto fOk = true;
+    for (unsigned y = 0; y < f.h; ++y) {
+      const auto i = size_t(y) * f.w;
+      fOk = costella_image_convert_ycbcr_row_to_rgb(f.plane(f.work, 0) + i, f.plane(f.work, 1) + i,
+        f.plane(f.work, 2) + i, f.w, 0, rgbOut.data() + 3*i, stderr) && fOk;
+    }
+    return fOk;
+  });
+  rgbOut = std::vector<u8>();
+
+  // The codecs.  .png in memory; .bmp through a file, as EasyBMP has no other interface.
+  std::vector<u8> png;
+  png.reserve(3 * cb);
+  ok = ok && bench("png_encode", f, o, []() {}, [&]() { return encodePNG(f, png); });
+  ok = ok && bench("png_decode", f, o, []() {}, [&]() { return decodePNG(png, f); });
+  png = std::vector<u8>();
+  const std::string nameBMP = "/tmp/bench_frames_" + std::to_string(getpid()) + ".bmp";
+  ok = ok && bench("bmp_encode", f, o, []() {}, [&]() {
+    BMP bmp;
+    if (!bmp.SetSize(f.w, f.h) || !bmp.SetBitDepth(24))
+      return false;
+    for (unsigned y = 0; y < f.h; ++y)
+      bmp.SetRow24(y, f.rgb.data() + size_t(y) * 3 * f.w);
+    return bmp.WriteToFile(nameBMP.c_str());
+  });
+  ok = ok && bench("bmp_decode", f, o, []() {}, [&]() {
+    BMP bmp;
+    if (!bmp.ReadFromFile(nameBMP.c_str()) || bmp.TellWidth() != int(f.w) || bmp.TellHeight() != int(f.h))
+      return false;
+    for (unsigned y = 0; y < f.h; ++y)
+      bmp.GetRow24(y, f.work.data() + size_t(y) * 3 * f.w);
+    return true;
+  });
+  remove(nameBMP.c_str());
+  return ok;
+}
+
+int main(int argc, char** argv)
+{
+  Options o;
+  for (int i = 1; i < argc; i += 2) {
+    if (i + 1 < argc && !strcmp(argv[i], "--max-mp"))
+      o.mpMax = atof(argv[i + 1]);
+    else if (i + 1 < argc && !strcmp(argv[i], "--repeats"))
+      o.cRepeat = std::max(1, atoi(argv[i + 1]));
+    else if (i + 1 < argc && !strcmp(argv[i], "--threads"))
+      o.cThread = std::max(1, atoi(argv[i + 1]));
+    else {
+      fprintf(stderr, "usage: %s [--max-mp N] [--repeats N] [--threads N]\n", argv[0]);
+      return 1;
+    }
+  }
+  SetEasyBMPwarningsOff();
+  costella_unblock_context* ctx = NULL;
+  if (!costella_unblock_initialize(stderr) || !costella_unblock_context_create(&ctx, NULL, NULL, stderr))
+    return 1;
+  printf("{\"benchmark\":\"unblock\",\"threads\":%d,\"results\":[", o.cThread);
+  auto ok = true;
+  for (const auto& s: sizes) {
+    if (1e-6 * s.w * s.h > o.mpMax)
+      break;
+    Frame f;
+    f.w = s.w;
+    f.h = s.h;
+    makeFrame(f);
+    ok = benchFrame(f, o, ctx) && ok;
+  }
+  printf("\n]}\n");
+  costella_unblock_context_destroy(&ctx, stderr);
+  costella_unblock_finalize(stderr);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,334 @@
+/* Copyright (c) 2026 The unblock authors.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a
+** copy of this software and associated documentation files (the "Software")
+** to deal in the Software without restriction, including without limitation
+** the rights to use, copy, modify, merge, publish, distribute, sublicense,
+** and/or sell copies of the Software, and to permit persons to whom the
+** Software is furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included 
+** in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT, OR OTHERWISE, ARISING
+** FROM, OUT OF, OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+** DEALINGS IN THE SOFTWARE.
+**
+**
+** bench/passes.c: 
+**
+**   Time the four internal passes of the UnBlock algorithm on a synthetic
+**   8K frame, so that the horizontal passes can be compared directly with
+**   the vertical ones, and the per-boundary kernels on their own. The 
+**   library source is included here so that its internal functions can be
+**   called.
+**
+**   This version: October 18, 2026.
+**
+**   Written in ANSI C, plus POSIX clock_gettime.
+*/
+
+
+
+/* Include files.
+*/
+
+#include "../costella/costella_unblock.c"
+#include <stdio.h>
+#include <time.h>
+
+
+
+/* Frame dimensions and number of repetitions of each pass.
+*/
+
+#define BENCH_WIDTH 7680
+#define BENCH_HEIGHT 4320
+#define BENCH_REPEATS 5
+
+
+/* Number of boundaries for which the kernels are timed, and number of 
+** distinct columns of pixels that they cycle through.
+*/
+
+#define BENCH_BOUNDARIES 10000000
+#define BENCH_COLUMNS 256
+
+
+
+/* BenchSeconds: 
+**
+**   Return a monotonic time in seconds.
+*/
+
+static double BenchSeconds( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return (double) ts.tv_sec + 1e-9 * (double) ts.tv_nsec;
+}
+
+
+
+/* BenchPasses: 
+**
+**   Build a blocky YCbCr frame, then time each pass BENCH_REPEATS times and
+**   print the best time for each.
+*/
+
+static COSTELLA_FUNCTION( BenchPasses, ( void ) )
+{
+  COSTELLA_UB ubRepeat;
+  COSTELLA_UW uw;
+  COSTELLA_UD udSize, ud, udTotalLuminance, udTotalChrominance;
+  COSTELLA_UB* aubY = 0, * aubCb = 0, * aubCr = 0, * aubAdjusted = 0;
+  COSTELLA_SW* aswBufferY = 0, * aswBufferCb = 0, * aswBufferCr = 0;
+  COSTELLA_UD* aud = 0, * audLanes = 0;
+  COSTELLA_IMAGE i;
+  double adBest[ 4 ], dStart, dTime;
+
+
+  /* Allocate the frame, the buffers, the twelve frequency tables and an 
+  ** adjustment table shared by all channels.
+  */
+
+  udSize = (COSTELLA_UD) BENCH_WIDTH * BENCH_HEIGHT;
+
+  if( COSTELLA_MALLOC( aubY, udSize ) || COSTELLA_MALLOC( aubCb, udSize ) 
+    || COSTELLA_MALLOC( aubCr, udSize ) || COSTELLA_MALLOC( aubAdjusted, 
+    256 ) || COSTELLA_MALLOC( aswBufferY, 16 * COSTELLA_UNBLOCK_STRIP_WIDTH
+    ) || COSTELLA_MALLOC( aswBufferCb, 16 * COSTELLA_UNBLOCK_STRIP_WIDTH ) 
+    || COSTELLA_MALLOC( aswBufferCr, 16 * COSTELLA_UNBLOCK_STRIP_WIDTH ) || 
+    COSTELLA_MALLOC( aud, 12 * 256 ) || COSTELLA_MALLOC( audLanes, 8 * 
+    COSTELLA_UNBLOCK_HISTOGRAM_LANES * 256 ) )
+  {
+    COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
+    COSTELLA_RETURN;
+  }
+
+
+  /* Fill the frame with a pseudo-random value per 8 x 8 block plus a 
+  ** little per-pixel noise, so that every boundary has a discrepancy.
+  */
+
+  for( ud = 0; ud < udSize; ud++ )
+  {
+    uw = (COSTELLA_UW) ( ( ( ud % BENCH_WIDTH ) >> 3 ) * 2654435761u ^ ( ( 
+      ud / BENCH_WIDTH ) >> 3 ) * 40503u );
+
+    aubY[ ud ] = (COSTELLA_UB) ( ( uw >> 8 ) + ( ud * 7 & 3 ) );
+    aubCb[ ud ] = (COSTELLA_UB) ( uw >> 16 );
+    aubCr[ ud ] = (COSTELLA_UB) ( uw >> 24 );
+  }
+
+  for( uw = 0; uw < 256; uw++ )
+  {
+    aubAdjusted[ uw ] = (COSTELLA_UB) ( uw >> 1 );
+  }
+
+
+  /* Describe the frame in the same way as the command-line tool does.
+  */
+
+  i.bAlpha = 0;
+  i.bRgb = 0;
+  i.bColor = i.bDownsampledChrominance = 
+    i.bNonreplicatedDownsampledChrominance = 1;
+  i.udWidth = BENCH_WIDTH;
+  i.udHeight = BENCH_HEIGHT;
+  i.sdRowStride = BENCH_WIDTH;
+  i.sdAlphaRowStride = 0;
+  i.sdChrominanceRowStride = 0;
+  i.ic.aubRY = aubY;
+  i.ic.aubGCb = aubCb;
+  i.ic.aubBCr = aubCr;
+
+
+  /* Time each pass, keeping the best of the repetitions.
+  */
+
+  for( ud = 0; ud < 4; ud++ )
+  {
+    adBest[ ud ] = 1e30;
+  }
+
+  for( ubRepeat = 0; ubRepeat < BENCH_REPEATS; ubRepeat++ )
+  {
+    for( ud = 0; ud < 4; ud++ )
+    {
+      COSTELLA_INITIALIZE_ARRAY( aud, 12 * 256, COSTELLA_UD );
+
+      udTotalLuminance = 0;
+      udTotalChrominance = 0;
+
+      dStart = BenchSeconds();
+
+      if( ( ud == 0 && COSTELLA_CALL( 
+        CostellaUnblockComputeVerticalDiscrepancies( aswBufferY, 
+        aswBufferCb, aswBufferCr, aud, aud + 256, aud + 512, aud + 768, aud
+        + 1024, aud + 1280, aud + 1536, aud + 1792, aud + 2048, aud + 2304, 
+        aud + 2560, aud + 2816, &udTotalLuminance, &udTotalChrominance, &i, 
+        0, 0 ) ) ) || ( ud == 1 && COSTELLA_CALL( 
+        CostellaUnblockComputeHorizontalDiscrepancies( aswBufferY, 
+        aswBufferCb, aswBufferCr, audLanes, aud, aud + 256, aud + 512, aud 
+        + 768, aud + 1024, aud + 1280, aud + 1536, aud + 1792, aud + 2048, 
+        aud + 2304, aud + 2560, aud + 2816, &udTotalLuminance, 
+        &udTotalChrominance, &i, 0, BENCH_HEIGHT, 0, 0 ) ) ) || ( ud == 2 
+        && COSTELLA_CALL( 
+        CostellaUnblockCorrectVerticalDiscrepancies( aswBufferY, 
+        aswBufferCb, aswBufferCr, aubAdjusted, aubAdjusted, aubAdjusted, 
+        aubAdjusted, aubAdjusted, aubAdjusted, &i, &i, 0, 0 ) ) ) || ( ud 
+        == 3 && COSTELLA_CALL( 
+
+        #ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+
+          CostellaUnblockCorrectHorizontalInPlace( aubAdjusted, aubAdjusted,
+          aubAdjusted, aubAdjusted, aubAdjusted, aubAdjusted, &i, 0, 
+          BENCH_HEIGHT, 0, 0 ) 
+
+        #else
+
+          CostellaUnblockCorrectHorizontalDiscrepancies( aswBufferY, 
+          aswBufferCb, aswBufferCr, aubAdjusted, aubAdjusted, aubAdjusted, 
+          aubAdjusted, aubAdjusted, aubAdjusted, &i, &i, 0, 0 ) 
+
+        #endif
+
+        ) ) )
+      {
+        COSTELLA_ERROR( "Running pass" );
+        COSTELLA_RETURN;
+      }
+
+      dTime = BenchSeconds() - dStart;
+
+      if( dTime < adBest[ ud ] )
+      {
+        adBest[ ud ] = dTime;
+      }
+    }
+  }
+
+
+  /* Report.
+  */
+
+  printf( "%ux%u frame, best of %u, strip width %u\n", BENCH_WIDTH, 
+    BENCH_HEIGHT, BENCH_REPEATS, COSTELLA_UNBLOCK_STRIP_WIDTH );
+  printf( "  compute vertical    %8.1f ms\n", 1e3 * adBest[ 0 ] );
+  printf( "  compute horizontal  %8.1f ms  (%.2f x vertical)\n", 1e3 * 
+    adBest[ 1 ], adBest[ 1 ] / adBest[ 0 ] );
+  printf( "  correct vertical    %8.1f ms\n", 1e3 * adBest[ 2 ] );
+  printf( "  correct horizontal  %8.1f ms  (%.2f x vertical)\n", 1e3 * 
+    adBest[ 3 ], adBest[ 3 ] / adBest[ 2 ] );
+
+
+  /* Free memory.
+  */
+
+  if( COSTELLA_FREE( aubY ) || COSTELLA_FREE( aubCb ) || COSTELLA_FREE( 
+    aubCr ) || COSTELLA_FREE( aubAdjusted ) || COSTELLA_FREE( aswBufferY ) 
+    || COSTELLA_FREE( aswBufferCb ) || COSTELLA_FREE( aswBufferCr ) || 
+    COSTELLA_FREE( aud ) || COSTELLA_FREE( audLanes ) )
+  {
+    COSTELLA_FUNDAMENTAL_ERROR( "Freeing" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* BenchBoundaries: 
+**
+**   Time the kernels that the vertical passes run once per boundary and 
+**   column: computing the discrepancies u and v of a column of sixteen 
+**   pixels, and correcting it. Print the best time per boundary.
+*/
+
+static COSTELLA_FUNCTION( BenchBoundaries, ( void ) )
+{
+  static COSTELLA_SW aswColumns[ 16 * BENCH_COLUMNS ];
+  COSTELLA_UB ubRepeat, ubPosition;
+  COSTELLA_SW swU, swV;
+  COSTELLA_SW asw[ 16 ];
+  COSTELLA_UD ud, udSum;
+  double dBest, dStart, dTime;
+
+
+  /* Fill the columns with pseudo-random blocky values.
+  */
+
+  for( ud = 0; ud < 16 * BENCH_COLUMNS; ud++ )
+  {
+    aswColumns[ ud ] = (COSTELLA_SW) ( ( ( ud >> 3 ) * 2654435761u >> 24 ) 
+      + ( ud * 7 & 3 ) ) & 255;
+  }
+
+
+  /* Compute and correct each column, starting afresh from its original 
+  ** values every time.
+  */
+
+  dBest = 1e30;
+  udSum = 0;
+
+  for( ubRepeat = 0; ubRepeat < BENCH_REPEATS; ubRepeat++ )
+  {
+    dStart = BenchSeconds();
+
+    for( ud = 0; ud < BENCH_BOUNDARIES; ud++ )
+    {
+      for( ubPosition = 0; ubPosition < 16; ubPosition++ )
+      {
+        asw[ ubPosition ] = aswColumns[ ( ud % BENCH_COLUMNS ) * 16 + 
+          ubPosition ];
+      }
+
+      costella_unblock_compute_discrepancies( asw + 5, &swU, &swV );
+      costella_unblock_correct_discrepancies( asw, swU >> 1, swV >> 1 );
+
+      udSum += (COSTELLA_UD) ( asw[ 7 ] ^ asw[ 8 ] );
+    }
+
+    dTime = BenchSeconds() - dStart;
+
+    if( dTime < dBest )
+    {
+      dBest = dTime;
+    }
+  }
+
+
+  /* Report. The checksum keeps the compiler from discarding the work.
+  */
+
+  printf( "  boundary kernels    %8.2f ns per boundary  (checksum %lu)\n",
+    1e9 * dBest / BENCH_BOUNDARIES, udSum );
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* main: 
+**
+**   Run the benchmark.
+*/
+
+COSTELLA_ANSI_FUNCTION( main, int, ( void ) )
+{
+  if( COSTELLA_CALL( CostellaUnblockInitialize() ) || COSTELLA_CALL( 
+    BenchPasses() ) || COSTELLA_CALL( BenchBoundaries() ) || COSTELLA_CALL(
+    CostellaUnblockFinalize() ) )
+  {
+    COSTELLA_ERROR_FPRINT( stderr );
+    COSTELLA_ANSI_RETURN( 1 );
+  } 
+}
+COSTELLA_END_ANSI_FUNCTION( 0 )
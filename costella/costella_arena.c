@@ -0,0 +1,281 @@
+/* Copyright (c) 2026 The unblock authors.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a
+** copy of this software and associated documentation files (the "Software")
+** to deal in the Software without restriction, including without limitation
+** the rights to use, copy, modify, merge, publish, distribute, sublicense,
+** and/or sell copies of the Software, and to permit persons to whom the
+** Software is furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included 
+** in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT, OR OTHERWISE, ARISING
+** FROM, OUT OF, OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+** DEALINGS IN THE SOFTWARE.
+**
+**
+** costella_arena.c: 
+**
+**   A bump allocator for the scratch memory of repeated calls, so that 
+**   once it has seen the largest call, it allocates nothing from the heap.
+**
+**   This version: October 18, 2026.
+**
+**   Written in ANSI C.
+*/
+
+
+
+/* Include files.
+*/
+
+#include "costella_arena.h"
+
+
+
+/* Internal constants.
+**
+** COSTELLA_ARENA_ALIGNMENT:  Every allocation starts at a multiple of this
+**   many bytes from the start of its block, which is enough for any type.
+*/
+
+#define COSTELLA_ARENA_ALIGNMENT 16
+
+
+
+/* Start function bodies.
+*/
+
+#include "costella_body.h"
+
+
+
+/* CostellaArenaOpen: 
+**
+**   Set up an empty arena. Its block is allocated by the first call to 
+**   CostellaArenaReset() that follows any allocations.
+**
+**   par:  Pointer to the arena.
+**
+**   pf{Malloc,Free}:  Functions used to allocate and free the arena's 
+**     memory, as for CostellaBaseInitialize().
+*/
+
+COSTELLA_FUNCTION( CostellaArenaOpen, ( COSTELLA_ARENA* par, COSTELLA_O* 
+  (*pfMalloc)( COSTELLA_MC mc ), COSTELLA_B (*pfFree)( COSTELLA_O* po ) ) )
+{
+  /* Check pointers.
+  */
+
+  #ifdef COSTELLA_DEBUG
+  {
+    if( !par || !pfMalloc || !pfFree )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null pointer" );
+      COSTELLA_RETURN;
+    }
+  }
+  #endif
+
+
+  /* Store the allocator, with nothing allocated.
+  */
+
+  par->pfMalloc = pfMalloc;
+  par->pfFree = pfFree;
+  par->aubBlock = 0;
+  par->mcBlock = 0;
+  par->mcUsed = 0;
+  par->mcWanted = 0;
+  par->poOverflow = 0;
+  par->mcAllocated = 0;
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaArenaClose: 
+**
+**   Free all of an arena's memory.
+**
+**   par:  Pointer to the arena.
+*/
+
+COSTELLA_FUNCTION( CostellaArenaClose, ( COSTELLA_ARENA* par ) )
+{
+  /* Release the allocations, then free the block itself.
+  */
+
+  if( COSTELLA_CALL( CostellaArenaReset( par ) ) )
+  {
+    COSTELLA_ERROR( "Resetting" );
+    COSTELLA_RETURN;
+  }
+
+  if( par->aubBlock && !par->pfFree( par->aubBlock ) )
+  {
+    COSTELLA_FUNDAMENTAL_ERROR( "Freeing" );
+    COSTELLA_RETURN;
+  }
+
+  par->aubBlock = 0;
+  par->mcBlock = 0;
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaArenaMalloc: 
+**
+**   Allocate memory from an arena. It stays valid until the arena is 
+**   reset.
+**
+**   par:  Pointer to the arena.
+**
+**   mc:  Number of bytes to allocate.
+**
+**   ppo:  Pointer to the pointer into which the memory is stored.
+*/
+
+COSTELLA_FUNCTION( CostellaArenaMalloc, ( COSTELLA_ARENA* par, COSTELLA_MC 
+  mc, COSTELLA_O** ppo ) )
+{
+  COSTELLA_UB* pub;
+
+
+  /* Check pointers.
+  */
+
+  #ifdef COSTELLA_DEBUG
+  {
+    if( !par || !ppo )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null pointer" );
+      COSTELLA_RETURN;
+    }
+  }
+  #endif
+
+
+  /* Round the size up to keep the next allocation aligned, and count it
+  ** towards what the block should hold.
+  */
+
+  mc = ( mc + COSTELLA_ARENA_ALIGNMENT - 1 ) & ~( (COSTELLA_MC) 
+    COSTELLA_ARENA_ALIGNMENT - 1 );
+  par->mcWanted += mc;
+
+
+  /* Carve the memory out of the block, if it fits.
+  */
+
+  if( par->mcBlock - par->mcUsed >= mc )
+  {
+    *ppo = par->aubBlock + par->mcUsed;
+    par->mcUsed += mc;
+    COSTELLA_RETURN;
+  }
+
+
+  /* Otherwise, take it from the heap, with room at the front to link it 
+  ** into the list of overflow allocations.
+  */
+
+  if( !( pub = (COSTELLA_UB*) par->pfMalloc( mc + COSTELLA_ARENA_ALIGNMENT 
+    ) ) )
+  {
+    COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
+    COSTELLA_RETURN;
+  }
+
+  *(COSTELLA_O**) pub = par->poOverflow;
+  par->poOverflow = pub;
+  par->mcAllocated += mc + COSTELLA_ARENA_ALIGNMENT;
+  *ppo = pub + COSTELLA_ARENA_ALIGNMENT;
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaArenaReset: 
+**
+**   Release everything allocated from an arena. If anything overflowed the
+**   block since the last reset, free it, and grow the block to hold all 
+**   that was allocated.
+**
+**   par:  Pointer to the arena.
+*/
+
+COSTELLA_FUNCTION( CostellaArenaReset, ( COSTELLA_ARENA* par ) )
+{
+  COSTELLA_O* po;
+
+
+  /* Check pointer.
+  */
+
+  #ifdef COSTELLA_DEBUG
+  {
+    if( !par )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null par" );
+      COSTELLA_RETURN;
+    }
+  }
+  #endif
+
+
+  /* Free the overflow allocations.
+  */
+
+  while( ( po = par->poOverflow ) )
+  {
+    par->poOverflow = *(COSTELLA_O**) po;
+
+    if( !par->pfFree( po ) )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Freeing" );
+      COSTELLA_RETURN;
+    }
+  }
+
+
+  /* Grow the block if it was too small.
+  */
+
+  if( par->mcWanted > par->mcBlock )
+  {
+    if( par->aubBlock && !par->pfFree( par->aubBlock ) )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Freeing" );
+      COSTELLA_RETURN;
+    }
+
+    par->mcBlock = 0;
+
+    if( !( par->aubBlock = (COSTELLA_UB*) par->pfMalloc( par->mcWanted ) ) )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
+      COSTELLA_RETURN;
+    }
+
+    par->mcBlock = par->mcWanted;
+    par->mcAllocated += par->mcWanted;
+  }
+
+  par->mcUsed = 0;
+  par->mcWanted = 0;
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* Copyright (c) 2026 The unblock authors.
+**
+** End of file.
+*/
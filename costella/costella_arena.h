@@ -0,0 +1,131 @@
+/* Copyright (c) 2026 The unblock authors.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a
+** copy of this software and associated documentation files (the "Software")
+** to deal in the Software without restriction, including without limitation
+** the rights to use, copy, modify, merge, publish, distribute, sublicense,
+** and/or sell copies of the Software, and to permit persons to whom the
+** Software is furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included 
+** in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT, OR OTHERWISE, ARISING
+** FROM, OUT OF, OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+** DEALINGS IN THE SOFTWARE.
+**
+**
+** costella_arena.h: 
+**
+**   Header file for costella_arena.c.
+**
+**   This version: October 18, 2026.
+**
+**   Written in ANSI C.
+*/
+
+
+
+/* Include file only once.
+*/
+
+#ifndef _COSTELLA_ARENA_H_
+#define _COSTELLA_ARENA_H_
+
+
+
+/* Include files.
+*/
+
+#include "costella_base.h"
+
+
+
+/* Typedefs.
+**
+** COSTELLA_ARENA:  Scratch memory for the calls made with one context. 
+**   Allocations are carved out of one block, and are all released at once
+**   by CostellaArenaReset(). Whatever does not fit in the block comes from
+**   the heap, and the block is then grown to fit everything, so that once
+**   a call has been made, further calls of the same size use no heap at 
+**   all. Not for use by several threads at once. mcAllocated counts the 
+**   bytes taken from the heap since the arena was opened.
+*/
+
+typedef struct
+{
+  COSTELLA_O* (*pfMalloc)( COSTELLA_MC mc );
+  COSTELLA_B (*pfFree)( COSTELLA_O* po );
+  COSTELLA_UB* aubBlock;
+  COSTELLA_MC mcBlock;
+  COSTELLA_MC mcUsed;
+  COSTELLA_MC mcWanted;
+  COSTELLA_O* poOverflow;
+  COSTELLA_MC mcAllocated;
+}
+COSTELLA_ARENA;
+
+
+
+/* Macros.
+*/
+
+/* COSTELLA_ARENA_MALLOC:
+**
+**   Allocate memory for an array of objects from an arena, or from the 
+**   heap if the arena is null. Like COSTELLA_MALLOC, returns true if the 
+**   allocation fails.
+**
+**   lpar:  Pointer to the arena, or null.
+**
+**   lpo:  Pointer to the allocated memory, once allocated.
+**
+**   lmc:  Number of objects to allocate.
+*/
+
+#define COSTELLA_ARENA_MALLOC( lpar, lpo, lmc ) \
+  ( (lpar) ? !!COSTELLA_CALL( CostellaArenaMalloc( (lpar), (COSTELLA_MC) ( \
+  (lmc) * sizeof( *(lpo) ) ), (COSTELLA_O**) &(lpo) ) ) : COSTELLA_MALLOC( \
+  lpo, lmc ) )
+
+
+/* COSTELLA_ARENA_FREE:
+**
+**   Free memory allocated with COSTELLA_ARENA_MALLOC. Memory from an arena
+**   is only released when the arena is reset, so this just forgets the 
+**   pointer. Like COSTELLA_FREE, returns true if freeing fails.
+*/
+
+#define COSTELLA_ARENA_FREE( lpar, lpo ) \
+  ( (lpar) ? !!( (lpo) = 0 ) : !!COSTELLA_FREE( lpo ) )
+
+
+
+/* Function prototypes.
+*/
+
+COSTELLA_FUNCTION( CostellaArenaOpen, ( COSTELLA_ARENA* par, COSTELLA_O* 
+  (*pfMalloc)( COSTELLA_MC mc ), COSTELLA_B (*pfFree)( COSTELLA_O* po ) ) )
+COSTELLA_FUNCTION( CostellaArenaClose, ( COSTELLA_ARENA* par ) )
+
+COSTELLA_FUNCTION( CostellaArenaMalloc, ( COSTELLA_ARENA* par, COSTELLA_MC 
+  mc, COSTELLA_O** ppo ) )
+COSTELLA_FUNCTION( CostellaArenaReset, ( COSTELLA_ARENA* par ) )
+
+
+
+/* File is now included.
+*/
+
+#endif
+
+
+
+/* Copyright (c) 2026 The unblock authors.
+**
+** End of file.
+*/
@@ -76,10 +76,45 @@ COSTELLA_B (*gpfCostellaBaseFree)( COSTELLA_O* po ) =
 /* Internal global variables.
 */
 
+/* Whether the library is initialized. It is only changed through the 
+** macro below, because several threads may initialize or finalize the 
+** library at once.
+*/
+
 static COSTELLA_B gbInitialized = COSTELLA_FALSE;
 
 
 
+/* COSTELLA_BASE_INITIALIZED_SWAP:
+**
+**   Change the initialized flag from one value to the other, and return 
+**   whether this call changed it. Lock-free: if several threads race to 
+**   change it, exactly one of them does.
+**
+**   b{From,To}:  The {expected,new} value of the flag.
+*/
+
+#ifdef __GNUC__
+
+  #define COSTELLA_BASE_INITIALIZED_SWAP( bFrom, bTo ) \
+    __extension__ ( { COSTELLA_B bExpected = (bFrom); \
+    __atomic_compare_exchange_n( &gbInitialized, &bExpected, (bTo), 0, \
+    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ); } )
+
+#else
+
+  /* Without atomic operations, the library must be initialized and 
+  ** finalized by one thread at a time.
+  */
+
+  #define COSTELLA_BASE_INITIALIZED_SWAP( bFrom, bTo ) \
+    ( gbInitialized == (bFrom) ? ( gbInitialized = (bTo), COSTELLA_TRUE ) \
+    : COSTELLA_FALSE )
+
+#endif
+
+
+
 /* Start function bodies.
 */
 
@@ -131,7 +166,10 @@ COSTELLA_END_ANSI_FUNCTION( !0 )
 
 /* CostellaBaseInitialize: 
 **
-**   Initialize the library. Repeated initialization is harmless.
+**   Initialize the library. Repeated initialization is harmless, even from
+**   several threads at once; but the memory functions must be given before
+**   any other thread uses the library, because only the first call 
+**   stores them.
 **
 **   pfMalloc:  Function to be used by all Costella libraries to allocate 
 **     memory. Must return a pointer to the memory block, or null if the 
@@ -151,35 +189,41 @@ COSTELLA_FUNCTION( CostellaBaseInitialize, ( COSTELLA_O* (*pfMalloc)(
   COSTELLA_UB ubSizeMc, ubSizeMi;
 
 
-  /* Do nothing if already initialized.
+  /* Set initialized flag, doing nothing if already initialized.
   */
 
-  if( gbInitialized )
+  if( !COSTELLA_BASE_INITIALIZED_SWAP( COSTELLA_FALSE, COSTELLA_TRUE ) )
   {
     COSTELLA_RETURN;
   }
 
 
-  /* Set initialized flag.
-  */
-
-  gbInitialized = COSTELLA_TRUE;
-
-
   /* Store the function pointers for memory allocation, reallocation, and 
-  ** freeing. If these pointers are null, use the default ANSI functions
+  ** freeing. If these pointers are null, use the default ANSI functions.
+  ** A pointer that is already in place is not written again, so that 
+  ** reinitializing with the defaults cannot race with another thread that
+  ** is allocating.
   */
 
   if( !pfMalloc || !pfRealloc || !pfFree )
   {
-    gpfCostellaBaseMalloc = costella_base_malloc_ansi;
-    gpfCostellaBaseRealloc = costella_base_realloc_ansi;
-    gpfCostellaBaseFree = costella_base_free_ansi;
+    pfMalloc = costella_base_malloc_ansi;
+    pfRealloc = costella_base_realloc_ansi;
+    pfFree = costella_base_free_ansi;
   }
-  else
+
+  if( gpfCostellaBaseMalloc != pfMalloc )
   {
     gpfCostellaBaseMalloc = pfMalloc;
+  }
+
+  if( gpfCostellaBaseRealloc != pfRealloc )
+  {
     gpfCostellaBaseRealloc = pfRealloc;
+  }
+
+  if( gpfCostellaBaseFree != pfFree )
+  {
     gpfCostellaBaseFree = pfFree;
   }
 
@@ -192,7 +236,7 @@ COSTELLA_FUNCTION( CostellaBaseInitialize, ( COSTELLA_O* (*pfMalloc)(
 
   if( ubSizeMc < 4 || ubSizeMi < 4 )
   {
-    gbInitialized = COSTELLA_FALSE;
+    COSTELLA_BASE_INITIALIZED_SWAP( COSTELLA_TRUE, COSTELLA_FALSE );
     COSTELLA_FUNDAMENTAL_ERROR( "Memory model has less than 32 bits" );
     COSTELLA_RETURN;
   }
@@ -208,21 +252,15 @@ COSTELLA_END_FUNCTION
 
 COSTELLA_FUNCTION( CostellaBaseFinalize, ( void ) )
 {
-  /* Do nothing if not initialized. 
+  /* Clear initialization flag, doing nothing if not initialized.
   */
 
-  if( !gbInitialized )
+  if( !COSTELLA_BASE_INITIALIZED_SWAP( COSTELLA_TRUE, COSTELLA_FALSE ) )
   {
     COSTELLA_RETURN;
   }
 
 
-  /* Clear initialization flag.
-  */
-
-  gbInitialized = COSTELLA_FALSE;
-
-
   /* Do something useless with hidden variable to keep compilers happy.
   */
 
@@ -173,6 +173,75 @@ int costella_base_finalize( FILE* pfileError );
 
 
 
+/* COSTELLA_TABLE_256:
+**
+**   Expand to the 256 initializers lf( lm, la, ln ), lf( lm, la, ln + 1 ),
+**   ..., lf( lm, la, ln + 255 ) of a constant lookup table, so that the 
+**   compiler computes the table, and it needs no initialization.
+**
+**   lf:  Macro giving the entry for a value, as a constant expression. 
+**
+**   lm, la:  Parameters passed through to lf, such as the multiplier and
+**     the addend of a linear table.
+**
+**   ln:  First value.
+*/
+
+#define COSTELLA_TABLE_4( lf, lm, la, ln ) \
+  lf( lm, la, (ln) ), lf( lm, la, (ln) + 1 ), lf( lm, la, (ln) + 2 ), \
+  lf( lm, la, (ln) + 3 )
+
+#define COSTELLA_TABLE_16( lf, lm, la, ln ) \
+  COSTELLA_TABLE_4( lf, lm, la, (ln) ), COSTELLA_TABLE_4( lf, lm, la, \
+  (ln) + 4 ), COSTELLA_TABLE_4( lf, lm, la, (ln) + 8 ), \
+  COSTELLA_TABLE_4( lf, lm, la, (ln) + 12 )
+
+#define COSTELLA_TABLE_64( lf, lm, la, ln ) \
+  COSTELLA_TABLE_16( lf, lm, la, (ln) ), COSTELLA_TABLE_16( lf, lm, la, \
+  (ln) + 16 ), COSTELLA_TABLE_16( lf, lm, la, (ln) + 32 ), \
+  COSTELLA_TABLE_16( lf, lm, la, (ln) + 48 )
+
+#define COSTELLA_TABLE_256( lf, lm, la, ln ) \
+  COSTELLA_TABLE_64( lf, lm, la, (ln) ), COSTELLA_TABLE_64( lf, lm, la, \
+  (ln) + 64 ), COSTELLA_TABLE_64( lf, lm, la, (ln) + 128 ), \
+  COSTELLA_TABLE_64( lf, lm, la, (ln) + 192 )
+
+
+/* COSTELLA_TABLE_LINEAR:
+**
+**   Entry of a linear table for COSTELLA_TABLE_256: lm times the value, 
+**   plus la.
+*/
+
+#define COSTELLA_TABLE_LINEAR( lm, la, ln ) \
+  ( (lm) * (ln) + (la) )
+
+
+
+/* COSTELLA_INLINE:
+**
+**   Ask the compiler to inline a small static function that is called in 
+**   an inner loop. Such a function cannot fail, so it is not a 
+**   COSTELLA_FUNCTION, and needs no error node.
+*/
+
+#if defined( __GNUC__ ) || ( defined( __STDC_VERSION__ ) && \
+  __STDC_VERSION__ >= 199901L )
+
+  #define COSTELLA_INLINE inline
+
+#elif defined( _MSC_VER )
+
+  #define COSTELLA_INLINE __inline
+
+#else
+
+  #define COSTELLA_INLINE
+
+#endif
+
+
+
 /* COSTELLA_INITIALIZE_ARRAY: 
 **
 **   Initialize an array to zero. 
@@ -68,13 +68,14 @@
 
 /* COSTELLA_FUNCTION_COMMON:
 **
-**   Common initialization commands for the preceding macros.
+**   Common initialization commands for the preceding macros. The error node
+**   is thread-local, so that functions may be called concurrently.
 */
 
 #define COSTELLA_FUNCTION_COMMON( lfFunctionName ) \
   { \
     static COSTELLA_C i_l_acCostellaFunctionName[] = #lfFunctionName; \
-    static COSTELLA_ERROR_NODE i_l_enCostella; \
+    static COSTELLA_THREAD_LOCAL COSTELLA_ERROR_NODE i_l_enCostella; \
     COSTELLA_B i_l_bCostellaError = COSTELLA_FALSE; \
     \
     i_l_enCostella.acFunctionName = i_l_acCostellaFunctionName; \
@@ -0,0 +1,327 @@
+/* Copyright (c) 2026 The unblock authors.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a
+** copy of this software and associated documentation files (the "Software")
+** to deal in the Software without restriction, including without limitation
+** the rights to use, copy, modify, merge, publish, distribute, sublicense,
+** and/or sell copies of the Software, and to permit persons to whom the
+** Software is furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included
+** in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT, OR OTHERWISE, ARISING
+** FROM, OUT OF, OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+** DEALINGS IN THE SOFTWARE.
+**
+**
+** costella_cpu.c:
+**
+**   Choose the instruction set tier used by the vector kernels: the
+**   highest that both this build and the processor support, or a lower one
+**   named by the environment variable COSTELLA_SIMD, which may be c, sse2,
+**   sse4.1, avx2 or avx512. The tier is chosen when the library is
+**   initialized, or else when a kernel first asks for it.
+**
+**   This version: October 18, 2026.
+**
+**   Written in ANSI C.
+*/
+
+
+
+/* Include files.
+*/
+
+#include "costella_cpu.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+
+/* Internal global variables.
+*/
+
+
+/* The tier in use, or COSTELLA_CPU_NUM_TIERS until one is chosen. It is 
+** only read and written through the macros below, because the first 
+** kernels to run may be on several threads at once.
+*/
+
+static COSTELLA_UB gubCostellaCpuTier = COSTELLA_CPU_NUM_TIERS;
+
+
+
+/* COSTELLA_CPU_TIER_LOAD:
+**
+**   Read the tier in use.
+*/
+
+/* COSTELLA_CPU_TIER_STORE:
+**
+**   Set the tier in use, whether or not one has been chosen.
+**
+**   ubTier:  The tier.
+*/
+
+/* COSTELLA_CPU_TIER_PUBLISH:
+**
+**   Set the tier in use if none has been chosen yet; otherwise leave it 
+**   alone. Lock-free: several threads may race to choose it, and exactly 
+**   one of them wins.
+**
+**   ubTier:  The tier.
+*/
+
+#ifdef __GNUC__
+
+  #define COSTELLA_CPU_TIER_LOAD() \
+    __atomic_load_n( &gubCostellaCpuTier, __ATOMIC_ACQUIRE )
+
+  #define COSTELLA_CPU_TIER_STORE( ubTier ) \
+    __atomic_store_n( &gubCostellaCpuTier, (ubTier), __ATOMIC_RELEASE )
+
+  #define COSTELLA_CPU_TIER_PUBLISH( ubTier ) \
+    __extension__ ( { COSTELLA_UB ubExpected = COSTELLA_CPU_NUM_TIERS; \
+    __atomic_compare_exchange_n( &gubCostellaCpuTier, &ubExpected, \
+    (ubTier), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ); } )
+
+#else
+
+  /* Without atomic operations, the library must be initialized before a 
+  ** second thread calls into it.
+  */
+
+  #define COSTELLA_CPU_TIER_LOAD() \
+    ( gubCostellaCpuTier )
+
+  #define COSTELLA_CPU_TIER_STORE( ubTier ) \
+    ( gubCostellaCpuTier = (ubTier) )
+
+  #define COSTELLA_CPU_TIER_PUBLISH( ubTier ) \
+    ( gubCostellaCpuTier == COSTELLA_CPU_NUM_TIERS ? ( gubCostellaCpuTier \
+    = (ubTier), COSTELLA_TRUE ) : COSTELLA_FALSE )
+
+#endif
+
+
+static const COSTELLA_C* gaacCostellaCpuName[ COSTELLA_CPU_NUM_TIERS ] =
+{
+  "c", "sse2", "sse4.1", "avx2", "avx512"
+};
+
+
+
+/* Internal function prototypes.
+*/
+
+static COSTELLA_UB costella_cpu_choose( void );
+
+
+
+/* Start function bodies.
+*/
+
+#include "costella_body.h"
+
+
+
+/* CostellaCpuInitialize:
+**
+**   Initialize the library, choosing the tier unless one is already in 
+**   use. Keeps no state of its own, so that it may be called from several
+**   threads at once.
+*/
+
+COSTELLA_FUNCTION( CostellaCpuInitialize, ( void ) )
+{
+  /* Initialize other libraries.
+  */
+
+  if( COSTELLA_CALL( CostellaBaseInitialize( 0, 0, 0 ) ) )
+  {
+    COSTELLA_ERROR( "Initialization" );
+    COSTELLA_RETURN;
+  }
+
+
+  /* Choose the tier.
+  */
+
+  COSTELLA_CPU_TIER_PUBLISH( costella_cpu_choose() );
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaCpuFinalize:
+**
+**   Finalize the library. The tier is chosen afresh on the next
+**   initialization, or when a kernel next asks for it.
+*/
+
+COSTELLA_FUNCTION( CostellaCpuFinalize, ( void ) )
+{
+  /* Forget the tier.
+  */
+
+  COSTELLA_CPU_TIER_STORE( COSTELLA_CPU_NUM_TIERS );
+
+
+  /* Finalize other libraries.
+  */
+
+  if( COSTELLA_CALL( CostellaBaseFinalize() ) )
+  {
+    COSTELLA_ERROR( "Finalizing" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaCpuSetTier:
+**
+**   Use a given tier from now on, as the tests do to check every tier in
+**   turn. Not for use while other threads are running kernels.
+**
+**   ubTier:  The tier. Must not be above costella_cpu_supported_tier().
+*/
+
+COSTELLA_FUNCTION( CostellaCpuSetTier, ( COSTELLA_UB ubTier ) )
+{
+  if( ubTier > costella_cpu_supported_tier() )
+  {
+    COSTELLA_FUNDAMENTAL_ERROR( "Tier not supported" );
+    COSTELLA_RETURN;
+  }
+
+  COSTELLA_CPU_TIER_STORE( ubTier );
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* costella_cpu_tier:
+**
+**   Return the tier in use, choosing it if the library has not been
+**   initialized. Safe to call from several threads at once: if they race 
+**   to choose the tier, all of them return the one that was published.
+*/
+
+COSTELLA_UB costella_cpu_tier( void )
+{
+  COSTELLA_UB ubTier;
+
+  ubTier = COSTELLA_CPU_TIER_LOAD();
+
+  if( ubTier == COSTELLA_CPU_NUM_TIERS )
+  {
+    COSTELLA_CPU_TIER_PUBLISH( costella_cpu_choose() );
+    ubTier = COSTELLA_CPU_TIER_LOAD();
+  }
+
+  return ubTier;
+}
+
+
+
+/* costella_cpu_supported_tier:
+**
+**   Return the highest tier that both this build and the processor
+**   support.
+*/
+
+COSTELLA_UB costella_cpu_supported_tier( void )
+{
+  #if defined( COSTELLA_CPU_DETECT )
+  {
+    __builtin_cpu_init();
+
+    if( __builtin_cpu_supports( "avx512f" ) && __builtin_cpu_supports(
+      "avx512bw" ) )
+    {
+      return COSTELLA_CPU_AVX512;
+    }
+
+    if( __builtin_cpu_supports( "avx2" ) )
+    {
+      return COSTELLA_CPU_AVX2;
+    }
+
+    if( __builtin_cpu_supports( "sse4.1" ) )
+    {
+      return COSTELLA_CPU_SSE41;
+    }
+
+    if( __builtin_cpu_supports( "sse2" ) )
+    {
+      return COSTELLA_CPU_SSE2;
+    }
+
+    return COSTELLA_CPU_C;
+  }
+  #elif defined( COSTELLA_CPU_HAS_AVX512 )
+    return COSTELLA_CPU_AVX512;
+  #elif defined( COSTELLA_CPU_HAS_AVX2 )
+    return COSTELLA_CPU_AVX2;
+  #elif defined( COSTELLA_CPU_HAS_SSE41 )
+    return COSTELLA_CPU_SSE41;
+  #elif defined( COSTELLA_CPU_HAS_SSE2 )
+    return COSTELLA_CPU_SSE2;
+  #else
+    return COSTELLA_CPU_C;
+  #endif
+}
+
+
+
+/* costella_cpu_name:
+**
+**   Return the name of a tier, as used in COSTELLA_SIMD.
+*/
+
+const COSTELLA_C* costella_cpu_name( COSTELLA_UB ubTier )
+{
+  return ubTier < COSTELLA_CPU_NUM_TIERS ? gaacCostellaCpuName[ ubTier ] :
+    "unknown";
+}
+
+
+
+/* costella_cpu_choose:
+**
+**   Return the supported tier, or the one named by COSTELLA_SIMD if that is
+**   lower. An unknown name is ignored.
+*/
+
+static COSTELLA_UB costella_cpu_choose( void )
+{
+  COSTELLA_UB ubTier, ubSupported;
+  const COSTELLA_C* acForced;
+
+  ubSupported = costella_cpu_supported_tier();
+  acForced = getenv( "COSTELLA_SIMD" );
+
+  for( ubTier = 0; acForced && ubTier < ubSupported; ubTier++ )
+  {
+    if( !strcmp( acForced, gaacCostellaCpuName[ ubTier ] ) )
+    {
+      return ubTier;
+    }
+  }
+
+  return ubSupported;
+}
+
+
+
+/* Copyright (c) 2026 The unblock authors.
+**
+** End of file.
+*/
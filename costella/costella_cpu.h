@@ -0,0 +1,145 @@
+/* Copyright (c) 2026 The unblock authors.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a
+** copy of this software and associated documentation files (the "Software")
+** to deal in the Software without restriction, including without limitation
+** the rights to use, copy, modify, merge, publish, distribute, sublicense,
+** and/or sell copies of the Software, and to permit persons to whom the
+** Software is furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included
+** in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT, OR OTHERWISE, ARISING
+** FROM, OUT OF, OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+** DEALINGS IN THE SOFTWARE.
+**
+**
+** costella_cpu.h:
+**
+**   Header file for costella_cpu.c.
+**
+**   This version: October 18, 2026.
+**
+**   Written in ANSI C.
+*/
+
+
+
+/* Include file only once.
+*/
+
+#ifndef _COSTELLA_CPU_H_
+#define _COSTELLA_CPU_H_
+
+
+
+/* Include files.
+*/
+
+#include "costella_base.h"
+
+
+
+/* Instruction set tiers, in increasing order. Each tier includes those
+** below it. A kernel without code for a tier uses the code of the highest
+** tier below it that it has.
+*/
+
+#define COSTELLA_CPU_C 0
+#define COSTELLA_CPU_SSE2 1
+#define COSTELLA_CPU_SSE41 2
+#define COSTELLA_CPU_AVX2 3
+#define COSTELLA_CPU_AVX512 4
+
+#define COSTELLA_CPU_NUM_TIERS 5
+
+
+
+/* Which tiers are compiled. With GCC or Clang on x86, every tier is, each
+** kernel being compiled for its instruction set with
+** COSTELLA_CPU_TARGET_{SSE2,SSE41,AVX2,AVX512}, so that one binary can
+** run the best code that each processor supports. With other compilers,
+** only the instruction sets enabled on the command line are compiled.
+** Define COSTELLA_SIMD_NONE to compile only the ANSI C reference code.
+*/
+
+#if defined( COSTELLA_SIMD_NONE )
+
+  /* No vector code.
+  */
+
+#elif defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+
+  #include <immintrin.h>
+
+  #define COSTELLA_CPU_DETECT
+
+  #define COSTELLA_CPU_HAS_SSE2
+  #define COSTELLA_CPU_HAS_SSE41
+  #define COSTELLA_CPU_HAS_AVX2
+  #define COSTELLA_CPU_HAS_AVX512
+
+  #define COSTELLA_CPU_TARGET_SSE2 __attribute__(( target( "sse2" ) ))
+  #define COSTELLA_CPU_TARGET_SSE41 __attribute__(( target( "sse4.1" ) ))
+  #define COSTELLA_CPU_TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+  #define COSTELLA_CPU_TARGET_AVX512 __attribute__(( target( \
+    "avx512f,avx512bw" ) ))
+
+#else
+
+  #if defined( __AVX512BW__ )
+    #define COSTELLA_CPU_HAS_AVX512
+  #endif
+
+  #if defined( __AVX2__ )
+    #define COSTELLA_CPU_HAS_AVX2
+  #endif
+
+  #if defined( __SSE4_1__ ) || defined( __AVX2__ )
+    #define COSTELLA_CPU_HAS_SSE41
+  #endif
+
+  #if defined( __SSE2__ ) || defined( _M_X64 ) || defined( __AVX2__ )
+    #define COSTELLA_CPU_HAS_SSE2
+    #include <immintrin.h>
+  #endif
+
+  #define COSTELLA_CPU_TARGET_SSE2
+  #define COSTELLA_CPU_TARGET_SSE41
+  #define COSTELLA_CPU_TARGET_AVX2
+  #define COSTELLA_CPU_TARGET_AVX512
+
+#endif
+
+
+
+/* Function prototypes.
+*/
+
+COSTELLA_FUNCTION( CostellaCpuInitialize, ( void ) )
+COSTELLA_FUNCTION( CostellaCpuFinalize, ( void ) )
+
+COSTELLA_FUNCTION( CostellaCpuSetTier, ( COSTELLA_UB ubTier ) )
+
+COSTELLA_UB costella_cpu_tier( void );
+COSTELLA_UB costella_cpu_supported_tier( void );
+const COSTELLA_C* costella_cpu_name( COSTELLA_UB ubTier );
+
+
+
+/* File is now included.
+*/
+
+#endif
+
+
+
+/* Copyright (c) 2026 The unblock authors.
+**
+** End of file.
+*/
@@ -35,6 +35,7 @@
 */
 
 #include "costella_image.h"
+#include <string.h>
 
 
 
@@ -55,13 +56,6 @@ COSTELLA_IMAGE_COLOR_PIXEL gicpCostellaImageNull;
 
 
 
-/* Internal global variables.
-*/
-
-static COSTELLA_B gbInitialized = COSTELLA_FALSE;
-
-
-
 /* Start function bodies.
 */
 
@@ -111,70 +105,366 @@ COSTELLA_END_ANSI_FUNCTION( !0 )
 
 COSTELLA_FUNCTION( CostellaImageInitialize, ( void ) )
 {
-  /* Do nothing if already initialized.
+  /* Initialize other libraries.
   */
 
-  if( gbInitialized )
+  if( COSTELLA_CALL( CostellaBaseInitialize( 0, 0, 0 ) ) )
+  {
+    COSTELLA_ERROR( "Initializing" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaImageFinalize: 
+**
+**   Finalize the library. 
+*/
+
+COSTELLA_FUNCTION( CostellaImageFinalize, ( void ) )
+{
+  /* Finalize other libraries.
+  */ 
+
+  if( COSTELLA_CALL( CostellaBaseFinalize() ) )
   {
+    COSTELLA_ERROR( "Finalizing" );
     COSTELLA_RETURN;
   }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaImageRows: 
+**
+**   Set up an image that refers to a horizontal band of the rows of an 
+**   existing image. No pixel data is copied: the band shares the storage of
+**   the original image.
+**
+**   pi:  Pointer to the original image.
+**
+**   udRowFirst:  Index of the first row of the band.
+**
+**   udNumRows:  Number of rows in the band.
+**
+**   piRows:  Pointer to the image to be set up as the band.
+*/
+
+COSTELLA_FUNCTION( CostellaImageRows, ( COSTELLA_IMAGE* pi, COSTELLA_UD 
+  udRowFirst, COSTELLA_UD udNumRows, COSTELLA_IMAGE* piRows ) )
+{
+  /* Check pointers and range.
+  */
+
+  #ifdef COSTELLA_DEBUG
+  {
+    if( !pi )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null pi" );
+      COSTELLA_RETURN;
+    }
+
+    if( !piRows )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null piRows" );
+      COSTELLA_RETURN;
+    }
+
+    if( udRowFirst + udNumRows > pi->udHeight )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Rows out of range" );
+      COSTELLA_RETURN;
+    }
+
+    #ifdef COSTELLA_IMAGE_TILED
+    {
+      if( udRowFirst & 7 )
+      {
+        COSTELLA_FUNDAMENTAL_ERROR( "First row not on a tile boundary" );
+        COSTELLA_RETURN;
+      }
+    }
+    #endif
+  }
+  #endif
 
 
-  /* Set initialized flag.
+  /* Copy the description of the image, and change its height.
   */
 
-  gbInitialized = COSTELLA_TRUE;
+  *piRows = *pi;
+  piRows->udHeight = udNumRows;
 
 
-  /* Initialize other libraries.
+  /* Move the storage pointers down to the first row of the band.
   */
 
-  if( COSTELLA_CALL( CostellaBaseInitialize( 0, 0, 0 ) ) )
+  if( pi->bAlpha )
   {
-    COSTELLA_ERROR( "Initializing" );
-    gbInitialized = COSTELLA_FALSE;
-    COSTELLA_RETURN;
+    COSTELLA_IMAGE_ALPHA_MOVE_DOWN( piRows->ia, (COSTELLA_SD) udRowFirst * 
+      pi->sdAlphaRowStride );
+  }
+
+  if( pi->bColor )
+  {
+    COSTELLA_IMAGE_COLOR_MOVE_DOWN( piRows->ic, (COSTELLA_SD) udRowFirst * 
+      pi->sdRowStride );
+  }
+  else
+  {
+    COSTELLA_IMAGE_GRAY_MOVE_DOWN( piRows->ig, (COSTELLA_SD) udRowFirst * 
+      pi->sdRowStride );
   }
 }
 COSTELLA_END_FUNCTION
 
 
 
-/* CostellaImageFinalize: 
+
+/* CostellaImageColumns: 
 **
-**   Finalize the library. 
+**   Set up an image that refers to a vertical band of the columns of an 
+**   existing image. No pixel data is copied: the band shares the storage of
+**   the original image.
+**
+**   pi:  Pointer to the original image.
+**
+**   udColumnFirst:  Index of the first column of the band.
+**
+**   udNumColumns:  Number of columns in the band.
+**
+**   piColumns:  Pointer to the image to be set up as the band.
 */
 
-COSTELLA_FUNCTION( CostellaImageFinalize, ( void ) )
+COSTELLA_FUNCTION( CostellaImageColumns, ( COSTELLA_IMAGE* pi, COSTELLA_UD 
+  udColumnFirst, COSTELLA_UD udNumColumns, COSTELLA_IMAGE* piColumns ) )
 {
-  /* Do nothing if not initialized.
+  /* Check pointers and range.
   */
 
-  if( !gbInitialized )
+  #ifdef COSTELLA_DEBUG
   {
-    COSTELLA_RETURN;
+    if( !pi )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null pi" );
+      COSTELLA_RETURN;
+    }
+
+    if( !piColumns )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null piColumns" );
+      COSTELLA_RETURN;
+    }
+
+    if( udColumnFirst + udNumColumns > pi->udWidth )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Columns out of range" );
+      COSTELLA_RETURN;
+    }
+
+    #ifdef COSTELLA_IMAGE_TILED
+    {
+      if( udColumnFirst & 7 )
+      {
+        COSTELLA_FUNDAMENTAL_ERROR( "First column not on a tile boundary" );
+        COSTELLA_RETURN;
+      }
+    }
+    #endif
   }
+  #endif
 
 
-  /* Clear initialized flag.
+  /* Copy the description of the image, and change its width.
   */
 
-  gbInitialized = COSTELLA_FALSE;
+  *piColumns = *pi;
+  piColumns->udWidth = udNumColumns;
 
 
-  /* Finalize other libraries.
-  */ 
+  /* Move the storage pointers across to the first column of the band.
+  */
 
-  if( COSTELLA_CALL( CostellaBaseFinalize() ) )
+  if( pi->bAlpha )
   {
-    COSTELLA_ERROR( "Finalizing" );
-    COSTELLA_RETURN;
+    COSTELLA_IMAGE_ALPHA_MOVE_RIGHT( piColumns->ia, udColumnFirst );
+  }
+
+  if( pi->bColor )
+  {
+    COSTELLA_IMAGE_COLOR_MOVE_RIGHT( piColumns->ic, udColumnFirst );
+  }
+  else
+  {
+    COSTELLA_IMAGE_GRAY_MOVE_RIGHT( piColumns->ig, udColumnFirst );
   }
 }
 COSTELLA_END_FUNCTION
 
 
 
+/* CostellaImageTilePlane: 
+**
+**   Copy one channel of an image from rows of bytes into an array of the 
+**   tiled layout, which is how an image enters that layout. The parts of 
+**   the edge tiles beyond the image are left as they are.
+**
+**   aubRows:  The channel, one byte per pixel.
+**
+**   sdRowStride:  Bytes from one row of aubRows to the next.
+**
+**   ud{Width,Height}:  Size of the image.
+**
+**   aubTiles:  The array of the tiled image. Must start on a 
+**     COSTELLA_IMAGE_TILED_ALIGNMENT-byte boundary.
+**
+**   sdTiledRowStride:  Row stride of the tiled image. Must be a multiple of
+**     8, and at least COSTELLA_IMAGE_TILED_ROW_STRIDE( udWidth ).
+*/
+
+#ifdef COSTELLA_IMAGE_TILED
+
+COSTELLA_FUNCTION( CostellaImageTilePlane, ( COSTELLA_UB* aubRows, 
+  COSTELLA_SD sdRowStride, COSTELLA_UD udWidth, COSTELLA_UD udHeight, 
+  COSTELLA_UB* aubTiles, COSTELLA_SD sdTiledRowStride ) )
+{
+  COSTELLA_UD udRow, udColumn;
+  COSTELLA_UB* pubRow, * pubTile;
+
+
+  /* Check pointers and layout.
+  */
+
+  #ifdef COSTELLA_DEBUG
+  {
+    if( !aubRows || !aubTiles )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null array" );
+      COSTELLA_RETURN;
+    }
+
+    if( (COSTELLA_UD) aubTiles % COSTELLA_IMAGE_TILED_ALIGNMENT )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Tiles not aligned" );
+      COSTELLA_RETURN;
+    }
+
+    if( ( sdTiledRowStride & 7 ) || sdTiledRowStride < 
+      COSTELLA_IMAGE_TILED_ROW_STRIDE( udWidth ) )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Bad tiled row stride" );
+      COSTELLA_RETURN;
+    }
+  }
+  #endif
+
+
+  /* Copy each row eight pixels at a time, one tile to the next.
+  */
+
+  for( udRow = 0, pubRow = aubRows; udRow < udHeight; udRow++, pubRow += 
+    sdRowStride )
+  {
+    pubTile = aubTiles + (COSTELLA_SD) ( udRow >> 3 ) * 8 * sdTiledRowStride
+      + ( ( udRow & 7 ) << 3 );
+
+    for( udColumn = 0; udColumn + 8 <= udWidth; udColumn += 8, pubTile += 
+      64 )
+    {
+      memcpy( pubTile, pubRow + udColumn, 8 );
+    }
+
+    if( udColumn < udWidth )
+    {
+      memcpy( pubTile, pubRow + udColumn, udWidth - udColumn );
+    }
+  }
+}
+COSTELLA_END_FUNCTION
+
+#endif
+
+
+
+/* CostellaImageUntilePlane: 
+**
+**   Copy one channel of an image from an array of the tiled layout back to
+**   rows of bytes, which is how an image leaves that layout.
+**
+**   aubTiles, sdTiledRowStride:  As for CostellaImageTilePlane().
+**
+**   ud{Width,Height}:  Size of the image.
+**
+**   aubRows:  The channel, one byte per pixel.
+**
+**   sdRowStride:  Bytes from one row of aubRows to the next.
+*/
+
+#ifdef COSTELLA_IMAGE_TILED
+
+COSTELLA_FUNCTION( CostellaImageUntilePlane, ( COSTELLA_UB* aubTiles, 
+  COSTELLA_SD sdTiledRowStride, COSTELLA_UD udWidth, COSTELLA_UD udHeight, 
+  COSTELLA_UB* aubRows, COSTELLA_SD sdRowStride ) )
+{
+  COSTELLA_UD udRow, udColumn;
+  COSTELLA_UB* pubRow, * pubTile;
+
+
+  /* Check pointers and layout.
+  */
+
+  #ifdef COSTELLA_DEBUG
+  {
+    if( !aubRows || !aubTiles )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null array" );
+      COSTELLA_RETURN;
+    }
+
+    if( (COSTELLA_UD) aubTiles % COSTELLA_IMAGE_TILED_ALIGNMENT )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Tiles not aligned" );
+      COSTELLA_RETURN;
+    }
+
+    if( ( sdTiledRowStride & 7 ) || sdTiledRowStride < 
+      COSTELLA_IMAGE_TILED_ROW_STRIDE( udWidth ) )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Bad tiled row stride" );
+      COSTELLA_RETURN;
+    }
+  }
+  #endif
+
+
+  /* Copy each row eight pixels at a time, one tile to the next.
+  */
+
+  for( udRow = 0, pubRow = aubRows; udRow < udHeight; udRow++, pubRow += 
+    sdRowStride )
+  {
+    pubTile = aubTiles + (COSTELLA_SD) ( udRow >> 3 ) * 8 * sdTiledRowStride
+      + ( ( udRow & 7 ) << 3 );
+
+    for( udColumn = 0; udColumn + 8 <= udWidth; udColumn += 8, pubTile += 
+      64 )
+    {
+      memcpy( pubRow + udColumn, pubTile, 8 );
+    }
+
+    if( udColumn < udWidth )
+    {
+      memcpy( pubRow + udColumn, pubTile, udWidth - udColumn );
+    }
+  }
+}
+COSTELLA_END_FUNCTION
+
+#endif
+
 /* Copyright (c) 2005-2007 John P. Costella.
 **
 ** End of file.
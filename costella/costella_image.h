@@ -61,6 +61,10 @@
 
   #include "costella_image_win32_dib.h" 
 
+#elif defined( COSTELLA_IMAGE_TILED )
+
+  #include "costella_image_tiled.h" 
+
 #else
 
   #include "costella_image_default.h" 
@@ -69,7 +73,12 @@
 
 
 
-/* Structure.
+/* Structure. sdChrominanceRowStride is read only by 
+** CostellaUnblockQuarter(), which takes the Cb and Cr channels of a YCbCr 
+** color image with nonreplicated downsampled chrominance not at the 
+** top-left pixel of each 2 x 2 block, but as arrays of only ( udWidth + 1 )
+** / 2 by ( udHeight + 1 ) / 2 pixels, whose rows are sdChrominanceRowStride
+** apart. Every other function ignores it.
 */
 
 typedef struct
@@ -77,7 +86,7 @@ typedef struct
   COSTELLA_B bAlpha, bColor, bRgb, bDownsampledChrominance,
     bNonreplicatedDownsampledChrominance;
   COSTELLA_UD udWidth, udHeight;
-  COSTELLA_SD sdRowStride, sdAlphaRowStride;
+  COSTELLA_SD sdRowStride, sdAlphaRowStride, sdChrominanceRowStride;
   COSTELLA_IMAGE_ALPHA ia;
   COSTELLA_IMAGE_GRAY ig;
   COSTELLA_IMAGE_COLOR ic;
@@ -99,6 +108,24 @@ int costella_image_finalize( FILE* pfileError );
 
 COSTELLA_FUNCTION( CostellaImageInitialize, ( void ) )
 COSTELLA_FUNCTION( CostellaImageFinalize, ( void ) )
+
+COSTELLA_FUNCTION( CostellaImageRows, ( COSTELLA_IMAGE* pi, COSTELLA_UD 
+  udRowFirst, COSTELLA_UD udNumRows, COSTELLA_IMAGE* piRows ) )
+
+COSTELLA_FUNCTION( CostellaImageColumns, ( COSTELLA_IMAGE* pi, COSTELLA_UD 
+  udColumnFirst, COSTELLA_UD udNumColumns, COSTELLA_IMAGE* piColumns ) )
+
+#ifdef COSTELLA_IMAGE_TILED
+
+  COSTELLA_FUNCTION( CostellaImageTilePlane, ( COSTELLA_UB* aubRows, 
+    COSTELLA_SD sdRowStride, COSTELLA_UD udWidth, COSTELLA_UD udHeight, 
+    COSTELLA_UB* aubTiles, COSTELLA_SD sdTiledRowStride ) )
+
+  COSTELLA_FUNCTION( CostellaImageUntilePlane, ( COSTELLA_UB* aubTiles, 
+    COSTELLA_SD sdTiledRowStride, COSTELLA_UD udWidth, COSTELLA_UD udHeight,
+    COSTELLA_UB* aubRows, COSTELLA_SD sdRowStride ) )
+
+#endif
   
 
 
@@ -40,12 +40,26 @@
 
 
 
+/* Multiplication tables for the magic kernel, computed by the compiler.
+*/
+
+typedef struct
+{
+  COSTELLA_SW aswMult9Add8[ 256 ];
+  COSTELLA_SW aswMult3[ 256 ];
+}
+COSTELLA_IMAGE_CHROMINANCE_TABLES;
+
+
+
 /* Internal global variables.
 */
 
-static COSTELLA_B gbInitialized = COSTELLA_FALSE;
-static COSTELLA_SW* gaswCostellaImageChrominanceMult9Add8 = 0, 
-  * gaswCostellaImageChrominanceMult3 = 0;
+static const COSTELLA_IMAGE_CHROMINANCE_TABLES gtblCostellaImageChrominance =
+{
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, 9, 8, 0 ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, 3, 0, 0 ) }
+};
 
 
 
@@ -105,9 +119,9 @@ COSTELLA_END_ANSI_FUNCTION( !0 )
 **     chrominance.
 */
 
-COSTELLA_ANSI_FUNCTION( costella_image_chrominance_downsample, int, ( 
-  COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* piOut, int (*pfProgress)( void* 
-  pvPassback ), void* pvPassback, FILE* pfileError ) )
+COSTELLA_ANSI_FUNCTION( costella_image_chrominance_average_downsample_replicate,
+  int, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* piOut, int (*pfProgress)( 
+  void* pvPassback ), void* pvPassback, FILE* pfileError ) )
 {
   COSTELLA_WRAP_PROGRESS wp;
 
@@ -146,7 +160,7 @@ COSTELLA_ANSI_FUNCTION( costella_image_chrominance_magic_upsample, int, (
   wp.pfProgress = pfProgress;
   wp.pvPassback = pvPassback;
 
-  if( COSTELLA_CALL( CostellaImageChrominanceMagicUpsample( piIn, piOut, 
+  if( COSTELLA_CALL( CostellaImageChrominanceMagicUpsample( piIn, piOut, 0,
     CostellaWrapProgress, &wp ) ) )
   {
     COSTELLA_ERROR_FPRINT( pfileError );
@@ -195,25 +209,6 @@ COSTELLA_END_ANSI_FUNCTION( !0 )
 
 COSTELLA_FUNCTION( CostellaImageChrominanceInitialize, ( void ) )
 {
-  COSTELLA_SW sw;
-  COSTELLA_SW* pswMult3, * pswMult9Add8;
-
-
-  /* Do nothing if already initialized.
-  */
-
-  if( gbInitialized )
-  {
-    COSTELLA_RETURN;
-  }
-
-
-  /* Set initialized flag.
-  */
-
-  gbInitialized = COSTELLA_TRUE;
-
-
   /* Initialize other libraries.
   */
 
@@ -221,39 +216,8 @@ COSTELLA_FUNCTION( CostellaImageChrominanceInitialize, ( void ) )
     CostellaWrapInitialize() ) )
   {
     COSTELLA_ERROR( "Initializing" );
-    gbInitialized = COSTELLA_FALSE;
     COSTELLA_RETURN;
   }
-
-
-  /* Allocate arrays for the magic kernel. 
-  */
-
-  if( COSTELLA_MALLOC( gaswCostellaImageChrominanceMult9Add8, 256 ) || 
-    COSTELLA_MALLOC( gaswCostellaImageChrominanceMult3, 256 ) )
-  {
-    COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
-
-    if( COSTELLA_FREE( gaswCostellaImageChrominanceMult9Add8 ) || 
-      COSTELLA_FREE( gaswCostellaImageChrominanceMult3 ) )
-    {
-      COSTELLA_CLEANUP_FUNDAMENTAL_ERROR( "Freeing" );
-    }
-
-    COSTELLA_RETURN;
-  }
-
-
-  /* Create the multiplication tables for the magic kernel.
-  */
-
-  for( sw = 0, pswMult3 = gaswCostellaImageChrominanceMult3, pswMult9Add8 = 
-    gaswCostellaImageChrominanceMult9Add8; sw < 256; sw++, pswMult3++, 
-    pswMult9Add8++ )
-  {
-    *pswMult3 = 3 * sw;
-    *pswMult9Add8 = 9 * sw + 8;
-  }
 }
 COSTELLA_END_FUNCTION
 
@@ -266,32 +230,6 @@ COSTELLA_END_FUNCTION
 
 COSTELLA_FUNCTION( CostellaImageChrominanceFinalize, ( void ) )
 {
-  /* Do nothing if not initialized.
-  */
-
-  if( !gbInitialized )
-  {
-    COSTELLA_RETURN;
-  }
-
-
-  /* Clear initialized flag.
-  */
-
-  gbInitialized = COSTELLA_FALSE;
-
-
-  /* Free arrays for the magic kernel.
-  */
-
-  if( COSTELLA_FREE( gaswCostellaImageChrominanceMult9Add8 ) || 
-    COSTELLA_FREE( gaswCostellaImageChrominanceMult3 ) )
-  {
-    COSTELLA_FUNDAMENTAL_ERROR( "Freeing" );
-    COSTELLA_RETURN;
-  }
-
-
   /* Finalize other libraries.
   */ 
 
@@ -344,17 +282,11 @@ COSTELLA_FUNCTION( CostellaImageChrominanceAverageDownsampleReplicate, (
   icpIn = icpInStart = icpOut = icpOutStart = gicpCostellaImageNull;
 
 
-  /* Check initialization and pointers.
+  /* Check pointers.
   */
 
   #ifdef COSTELLA_DEBUG
   {
-    if( !gbInitialized )
-    {
-      COSTELLA_FUNDAMENTAL_ERROR( "Initialization" );
-      COSTELLA_RETURN;
-    }
-
     if( !piIn )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Null piIn" );
@@ -998,11 +930,14 @@ COSTELLA_END_FUNCTION
 **     must have downsampled chrominance (either nonreplicated or 
 **     replicated). The output COSTELLA_IMAGE will be in the YCbCr 
 **     colorspace, and will not have downsampled chrominance.
+**
+**   par:  Arena from which to allocate the row buffers, or null to 
+**     allocate them from the heap.
 */
 
 COSTELLA_FUNCTION( CostellaImageChrominanceMagicUpsample, ( COSTELLA_IMAGE* 
-  piIn, COSTELLA_IMAGE* piOut, COSTELLA_CALLBACK_FUNCTION pfProgress, 
-  COSTELLA_O* poPassback ) )
+  piIn, COSTELLA_IMAGE* piOut, COSTELLA_ARENA* par, 
+  COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* poPassback ) )
 {
   COSTELLA_B bAlpha, bCopyY, bCopyAlpha, bTop, bLeft, bMissingLastColumn;
   COSTELLA_UB ubY, ubCb, ubCr, ubA, ubCbA, ubCbB, ubCbC, ubCbD, ubCrA, 
@@ -1019,6 +954,8 @@ COSTELLA_FUNCTION( CostellaImageChrominanceMagicUpsample, ( COSTELLA_IMAGE*
   COSTELLA_IMAGE_ALPHA_PIXEL iapIn, iapInStart, iapOut, iapOutStart;
   COSTELLA_IMAGE_COLOR_PIXEL icpIn, icpInTarget, icpInStart, icpOut, 
     icpOutStart;
+  const COSTELLA_IMAGE_CHROMINANCE_TABLES* ptbl = 
+    &gtblCostellaImageChrominance;
 
 
   /* Keep GCC happy.
@@ -1033,7 +970,7 @@ COSTELLA_FUNCTION( CostellaImageChrominanceMagicUpsample, ( COSTELLA_IMAGE*
 
   #ifdef COSTELLA_DEBUG
   {
-    if( !gbInitialized )
+    if( !ptbl )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Initialization" );
       COSTELLA_RETURN;
@@ -1191,12 +1128,13 @@ COSTELLA_FUNCTION( CostellaImageChrominanceMagicUpsample, ( COSTELLA_IMAGE*
   /* Allocate buffer memory.
   */
 
-  if( COSTELLA_MALLOC( aubCbBuffer, udBufferWidth ) || COSTELLA_MALLOC( 
-    aubCrBuffer, udBufferWidth ) )
+  if( COSTELLA_ARENA_MALLOC( par, aubCbBuffer, udBufferWidth ) || 
+    COSTELLA_ARENA_MALLOC( par, aubCrBuffer, udBufferWidth ) )
   {
     COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
 
-    if( COSTELLA_FREE( aubCbBuffer ) || COSTELLA_FREE( aubCrBuffer ) )
+    if( COSTELLA_ARENA_FREE( par, aubCbBuffer ) || COSTELLA_ARENA_FREE( par,
+      aubCrBuffer ) )
     {
       COSTELLA_CLEANUP_FUNDAMENTAL_ERROR( "Freeing" );
     }
@@ -1474,15 +1412,11 @@ COSTELLA_FUNCTION( CostellaImageChrominanceMagicUpsample, ( COSTELLA_IMAGE*
       */
 
       ubCb = (COSTELLA_UB) COSTELLA_SHIFT_RIGHT_FLOOR( 
-        gaswCostellaImageChrominanceMult9Add8[ ubCbA ] + 
-        gaswCostellaImageChrominanceMult3[ ubCbB ] + 
-        gaswCostellaImageChrominanceMult3[ ubCbC ] + (COSTELLA_SW) ubCbD, 4 
-        );
+        ptbl->aswMult9Add8[ ubCbA ] + ptbl->aswMult3[ ubCbB ] + 
+        ptbl->aswMult3[ ubCbC ] + (COSTELLA_SW) ubCbD, 4 );
       ubCr = (COSTELLA_UB) COSTELLA_SHIFT_RIGHT_FLOOR( 
-        gaswCostellaImageChrominanceMult9Add8[ ubCrA ] + 
-        gaswCostellaImageChrominanceMult3[ ubCrB ] + 
-        gaswCostellaImageChrominanceMult3[ ubCrC ] + (COSTELLA_SW) ubCrD, 4 
-        );
+        ptbl->aswMult9Add8[ ubCrA ] + ptbl->aswMult3[ ubCrB ] + 
+        ptbl->aswMult3[ ubCrC ] + (COSTELLA_SW) ubCrD, 4 );
 
 
       /* Store the values.
@@ -1569,7 +1503,8 @@ COSTELLA_FUNCTION( CostellaImageChrominanceMagicUpsample, ( COSTELLA_IMAGE*
   /* Free buffers.
   */
 
-  if( COSTELLA_FREE( aubCbBuffer ) || COSTELLA_FREE( aubCrBuffer ) )
+  if( COSTELLA_ARENA_FREE( par, aubCbBuffer ) || COSTELLA_ARENA_FREE( par,
+    aubCrBuffer ) )
   {
     COSTELLA_ERROR( "Freeing" )
     COSTELLA_RETURN;
@@ -1608,17 +1543,11 @@ COSTELLA_FUNCTION( CostellaImageChrominanceReplicateEq, ( COSTELLA_IMAGE*
   icp = icpStart = gicpCostellaImageNull;
 
 
-  /* Check initialization and pointers.
+  /* Check pointers.
   */
 
   #ifdef COSTELLA_DEBUG
   {
-    if( !gbInitialized )
-    {
-      COSTELLA_FUNDAMENTAL_ERROR( "Initialization" );
-      COSTELLA_RETURN;
-    }
-
     if( !pi )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Null image" );
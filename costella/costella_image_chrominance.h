@@ -43,6 +43,7 @@
 
 #include "costella_image.h"
 #include "costella_wrap.h"
+#include "costella_arena.h"
 
 
 
@@ -73,8 +74,8 @@ COSTELLA_FUNCTION( CostellaImageChrominanceAverageDownsampleReplicate, (
   COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* piOut, COSTELLA_CALLBACK_FUNCTION 
   pfProgress, COSTELLA_O* poPassback ) )
 COSTELLA_FUNCTION( CostellaImageChrominanceMagicUpsample, ( COSTELLA_IMAGE* 
-  piIn, COSTELLA_IMAGE* piOut, COSTELLA_CALLBACK_FUNCTION pfProgress, 
-  COSTELLA_O* poPassback ) )
+  piIn, COSTELLA_IMAGE* piOut, COSTELLA_ARENA* par, 
+  COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* poPassback ) )
 COSTELLA_FUNCTION( CostellaImageChrominanceReplicateEq, ( COSTELLA_IMAGE* 
   pi, COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* poPassback ) )
   
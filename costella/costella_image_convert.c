@@ -42,27 +42,172 @@
 */
 
 #include "costella_image_convert.h"
+#include "costella_cpu.h"
 
 
 
-/* Externally visible global variables.
+/* Macros for the vector code.
+**
+**   COSTELLA_IMAGE_CONVERT_PACK_{AVX2,SSE41}:  Pack an array of {two,four}
+**     registers of 32-bit words, each in [0,255] or to be limited to it, 
+**     into one register of sixteen bytes, in order.
+**
+**   COSTELLA_IMAGE_CONVERT_UNPACK_SSE41:  Load sixteen bytes and spread 
+**     them into an array of four registers of 32-bit words.
+**
+**   COSTELLA_IMAGE_CONVERT_INTERLEAVE_SSE41:  Interleave three registers of
+**     sixteen bytes, and store the resulting 48 bytes.
 */
 
-COSTELLA_SW* gaswCostellaImageConvertCrR = 0, 
-  * gaswCostellaImageConvertCbB = 0;
-COSTELLA_SD* gasdCostellaImageConvertRY = 0, 
-  * gasdCostellaImageConvertGY = 0, * gasdCostellaImageConvertBY = 0, 
-  * gasdCostellaImageConvertRCb = 0, * gasdCostellaImageConvertGCb = 0, 
-  * gasdCostellaImageConvertBCb = 0, * gasdCostellaImageConvertRCr = 0, 
-  * gasdCostellaImageConvertGCr = 0, * gasdCostellaImageConvertBCr = 0, 
-  * gasdCostellaImageConvertCbG = 0, * gasdCostellaImageConvertCrG = 0;
+#ifdef COSTELLA_CPU_HAS_AVX2
+
+  #define COSTELLA_IMAGE_CONVERT_PACK_AVX2( lax, lx ) \
+  { \
+    __m256i lxWords; \
+    \
+    lxWords = _mm256_permute4x64_epi64( _mm256_packs_epi32( (lax)[ 0 ], \
+      (lax)[ 1 ] ), 0xd8 ); \
+    (lx) = _mm_packus_epi16( _mm256_castsi256_si128( lxWords ), \
+      _mm256_extracti128_si256( lxWords, 1 ) ); \
+  }
+
+#endif
+
+#ifdef COSTELLA_CPU_HAS_SSE41
+
+  #define COSTELLA_IMAGE_CONVERT_PACK_SSE41( lax, lx ) \
+  { \
+    (lx) = _mm_packus_epi16( _mm_packs_epi32( (lax)[ 0 ], (lax)[ 1 ] ), \
+      _mm_packs_epi32( (lax)[ 2 ], (lax)[ 3 ] ) ); \
+  }
+
+  #define COSTELLA_IMAGE_CONVERT_UNPACK_SSE41( lpub, lax ) \
+  { \
+    __m128i lxBytes; \
+    \
+    lxBytes = _mm_loadu_si128( (__m128i*) (lpub) ); \
+    (lax)[ 0 ] = _mm_cvtepu8_epi32( lxBytes ); \
+    (lax)[ 1 ] = _mm_cvtepu8_epi32( _mm_srli_si128( lxBytes, 4 ) ); \
+    (lax)[ 2 ] = _mm_cvtepu8_epi32( _mm_srli_si128( lxBytes, 8 ) ); \
+    (lax)[ 3 ] = _mm_cvtepu8_epi32( _mm_srli_si128( lxBytes, 12 ) ); \
+  }
+
+  #define COSTELLA_IMAGE_CONVERT_INTERLEAVE_SSE41( lxFirst, lxSecond, \
+    lxThird, lpub ) \
+  { \
+    COSTELLA_UB lubBlock; \
+    const __m128i* lpxMask; \
+    \
+    for( lubBlock = 0, lpxMask = (const __m128i*) \
+      gasbCostellaImageConvertInterleave; lubBlock < 3; lubBlock++, \
+      lpxMask += 3 ) \
+    { \
+      _mm_storeu_si128( (__m128i*) ( (lpub) + 16 * lubBlock ), \
+        _mm_or_si128( _mm_or_si128( _mm_shuffle_epi8( (lxFirst), \
+        _mm_loadu_si128( lpxMask ) ), _mm_shuffle_epi8( (lxSecond), \
+        _mm_loadu_si128( lpxMask + 1 ) ) ), _mm_shuffle_epi8( (lxThird), \
+        _mm_loadu_si128( lpxMask + 2 ) ) ) ); \
+    } \
+  }
+
+#endif
+
+
+
+/* COSTELLA_IMAGE_CONVERT_SHIFTED:
+**
+**   Entry of a table for COSTELLA_TABLE_256 that is already scaled down by
+**   2^16, rounding down.
+*/
+
+#define COSTELLA_IMAGE_CONVERT_SHIFTED( lm, la, ln ) \
+  ( (COSTELLA_SW) COSTELLA_SHIFT_RIGHT_FLOOR( (lm) * (ln) + (la), 16 ) )
+
+
+
+/* Externally visible global variables. The tables are computed by the 
+** compiler; the R-to-Cr table equals the B-to-Cb table.
+*/
+
+const COSTELLA_IMAGE_CONVERT_TABLES gtblCostellaImageConvert =
+{
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, 19595L, 32768L, 0L ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, 38470L, 0L, 0L ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, 7471L, 0L, 0L ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, -11058L, 0L, 0L ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, -21709L, 0L, 0L ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, 32767L, 8421376L, 0L ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, 32767L, 8421376L, 0L ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, -27438L, 0L, 0L ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, -5329L, 0L, 0L ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, -22554L, 8910464L, 0L ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, -46803L, 0L, 0L ) },
+  { COSTELLA_TABLE_256( COSTELLA_IMAGE_CONVERT_SHIFTED, 91885L, -11728512L,
+    0L ) },
+  { COSTELLA_TABLE_256( COSTELLA_IMAGE_CONVERT_SHIFTED, 116134L, 
+    -14832384L, 0L ) }
+};
 
 
 
 /* Internal global variables.
 */
 
-static COSTELLA_B gbInitialized = COSTELLA_FALSE;
+
+/* Shuffles that interleave three registers of sixteen bytes into three 
+** blocks of sixteen bytes: for each block, the shuffles of the first, 
+** second and third register, which are then combined.
+*/
+
+#ifdef COSTELLA_CPU_HAS_SSE41
+
+  static const COSTELLA_SB gasbCostellaImageConvertInterleave[ 9 * 16 ] = 
+  {
+    0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5,
+    -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1,
+    -1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1,
+    -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1,
+    5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10,
+    -1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1,
+    -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1,
+    -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1,
+    10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15
+  };
+
+#endif
+
+
+
+/* Internal function prototypes.
+*/
+
+#ifdef COSTELLA_CPU_HAS_AVX2
+
+  static COSTELLA_CPU_TARGET_AVX2 COSTELLA_UD 
+    costella_image_convert_rgb_row_to_ycbcr_avx2( COSTELLA_UB* aubRgb, 
+    COSTELLA_UD udColumn, COSTELLA_UD udWidth, COSTELLA_UB ubR, COSTELLA_UB 
+    ubB, COSTELLA_UB* aubY, COSTELLA_UB* aubCb, COSTELLA_UB* aubCr );
+
+  static COSTELLA_CPU_TARGET_AVX2 COSTELLA_UD 
+    costella_image_convert_ycbcr_row_to_rgb_avx2( COSTELLA_UB* aubY, 
+    COSTELLA_UB* aubCb, COSTELLA_UB* aubCr, COSTELLA_UD udColumn, 
+    COSTELLA_UD udWidth, COSTELLA_B bBgr, COSTELLA_UB* aubRgb );
+
+#endif
+
+#ifdef COSTELLA_CPU_HAS_SSE41
+
+  static COSTELLA_CPU_TARGET_SSE41 COSTELLA_UD 
+    costella_image_convert_rgb_row_to_ycbcr_sse41( COSTELLA_UB* aubRgb, 
+    COSTELLA_UD udColumn, COSTELLA_UD udWidth, COSTELLA_UB ubR, COSTELLA_UB 
+    ubB, COSTELLA_UB* aubY, COSTELLA_UB* aubCb, COSTELLA_UB* aubCr );
+
+  static COSTELLA_CPU_TARGET_SSE41 COSTELLA_UD 
+    costella_image_convert_ycbcr_row_to_rgb_sse41( COSTELLA_UB* aubY, 
+    COSTELLA_UB* aubCb, COSTELLA_UB* aubCr, COSTELLA_UD udColumn, 
+    COSTELLA_UD udWidth, COSTELLA_B bBgr, COSTELLA_UB* aubRgb );
+
+#endif
 
 
 
@@ -163,125 +308,68 @@ COSTELLA_END_ANSI_FUNCTION( !0 )
 
 
 
-/* CostellaImageConvertInitialize: 
+/* costella_image_convert_rgb_row_to_ycbcr:
 **
-**   Initialize the library. 
+**   Public interface for converting a row of interleaved RGB pixels to 
+**   separate rows of Y, Cb and Cr.
+**
+**   See CostellaImageConvertRgbRowToYcbcr() for the arguments.
 */
 
-COSTELLA_FUNCTION( CostellaImageConvertInitialize, ( void ) )
+COSTELLA_ANSI_FUNCTION( costella_image_convert_rgb_row_to_ycbcr, int, ( 
+  unsigned char* aubRgb, unsigned long udWidth, int bBgr, unsigned char* 
+  aubY, unsigned char* aubCb, unsigned char* aubCr, FILE* pfileError ) )
 {
-  COSTELLA_UW uw;
+  if( COSTELLA_CALL( CostellaImageConvertRgbRowToYcbcr( aubRgb, udWidth, 
+    (COSTELLA_B) bBgr, aubY, aubCb, aubCr ) ) )
+  {
+    COSTELLA_ERROR_FPRINT( pfileError );
+    COSTELLA_ANSI_RETURN( 0 );
+  }
+}
+COSTELLA_END_ANSI_FUNCTION( !0 )
 
 
-  /* Do nothing if already initialized.
-  */
 
-  if( gbInitialized )
+/* costella_image_convert_ycbcr_row_to_rgb:
+**
+**   Public interface for converting separate rows of Y, Cb and Cr to a row
+**   of interleaved RGB pixels.
+**
+**   See CostellaImageConvertYcbcrRowToRgb() for the arguments.
+*/
+
+COSTELLA_ANSI_FUNCTION( costella_image_convert_ycbcr_row_to_rgb, int, ( 
+  unsigned char* aubY, unsigned char* aubCb, unsigned char* aubCr, unsigned
+  long udWidth, int bBgr, unsigned char* aubRgb, FILE* pfileError ) )
+{
+  if( COSTELLA_CALL( CostellaImageConvertYcbcrRowToRgb( aubY, aubCb, aubCr,
+    udWidth, (COSTELLA_B) bBgr, aubRgb ) ) )
   {
-    COSTELLA_RETURN;
+    COSTELLA_ERROR_FPRINT( pfileError );
+    COSTELLA_ANSI_RETURN( 0 );
   }
+}
+COSTELLA_END_ANSI_FUNCTION( !0 )
 
 
-  /* Set initialized flag.
-  */
-
-  gbInitialized = COSTELLA_TRUE;
 
+/* CostellaImageConvertInitialize: 
+**
+**   Initialize the library. 
+*/
 
+COSTELLA_FUNCTION( CostellaImageConvertInitialize, ( void ) )
+{
   /* Initialize other libraries.
   */
 
   if( COSTELLA_CALL( CostellaImageInitialize() ) || COSTELLA_CALL( 
-    CostellaWrapInitialize() ) )
+    CostellaWrapInitialize() ) || COSTELLA_CALL( CostellaCpuInitialize() ) )
   {
     COSTELLA_ERROR( "Initialization" );
-    gbInitialized = COSTELLA_FALSE;
-    COSTELLA_RETURN;
-  }
-
-
-  /* Allocate memory for the lookup tables.
-  */
-
-  if( COSTELLA_MALLOC( gasdCostellaImageConvertRY, 256 ) || COSTELLA_MALLOC(
-    gasdCostellaImageConvertGY, 256 ) || COSTELLA_MALLOC( 
-    gasdCostellaImageConvertBY, 256 ) || COSTELLA_MALLOC( 
-    gasdCostellaImageConvertRCb, 256 ) || COSTELLA_MALLOC( 
-    gasdCostellaImageConvertGCb, 256 ) || COSTELLA_MALLOC( 
-    gasdCostellaImageConvertBCb, 256 ) || COSTELLA_MALLOC( 
-    gasdCostellaImageConvertGCr, 256 ) || COSTELLA_MALLOC( 
-    gasdCostellaImageConvertBCr, 256 ) || COSTELLA_MALLOC( 
-    gasdCostellaImageConvertCbG, 256 ) || COSTELLA_MALLOC( 
-    gasdCostellaImageConvertCrG, 256 ) || COSTELLA_MALLOC( 
-    gaswCostellaImageConvertCrR, 256 ) || COSTELLA_MALLOC( 
-    gaswCostellaImageConvertCbB, 256 ) )
-  {
-    COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
-
-    if( COSTELLA_FREE( gasdCostellaImageConvertRY ) || COSTELLA_FREE( 
-      gasdCostellaImageConvertGY ) || COSTELLA_FREE( 
-      gasdCostellaImageConvertBY ) || COSTELLA_FREE( 
-      gasdCostellaImageConvertRCb ) || COSTELLA_FREE( 
-      gasdCostellaImageConvertGCb ) || COSTELLA_FREE( 
-      gasdCostellaImageConvertBCb ) || COSTELLA_FREE( 
-      gasdCostellaImageConvertGCr ) || COSTELLA_FREE( 
-      gasdCostellaImageConvertBCr ) || COSTELLA_FREE( 
-      gasdCostellaImageConvertCbG ) || COSTELLA_FREE( 
-      gasdCostellaImageConvertCrG ) || COSTELLA_FREE( 
-      gaswCostellaImageConvertCrR ) || COSTELLA_FREE( 
-      gaswCostellaImageConvertCbB ) )
-    {
-      COSTELLA_CLEANUP_FUNDAMENTAL_ERROR( "Freeing" );
-    }
-
     COSTELLA_RETURN;
   }
-
-
-  /* Two of the tables are actually equal, so we did not allocate both. 
-  ** Simply set the pointer to be equal, for clarity.
-  */
-
-  gasdCostellaImageConvertRCr = gasdCostellaImageConvertBCb;
-
-
-  /* Create the RGB to YCbCr conversion tables. 
-  **
-  */
-
-  for( uw = 0; uw < 256; uw++ )
-  {
-    gasdCostellaImageConvertRY[ uw ] = 19595L * (COSTELLA_SD) uw + 32768L;
-    gasdCostellaImageConvertGY[ uw ] = 38470L * (COSTELLA_SD) uw;
-    gasdCostellaImageConvertBY[ uw ] = 7471L * (COSTELLA_SD) uw;
-
-    gasdCostellaImageConvertRCb[ uw ] = -11058L * (COSTELLA_SD) uw;
-    gasdCostellaImageConvertGCb[ uw ] = -21709L * (COSTELLA_SD) uw;
-    gasdCostellaImageConvertBCb[ uw ] = 32767L * (COSTELLA_SD) uw + 
-      8421376L;
-
-    gasdCostellaImageConvertGCr[ uw ] = -27438L * (COSTELLA_SD) uw;
-    gasdCostellaImageConvertBCr[ uw ] = -5329L * (COSTELLA_SD) uw;
-  }
-
-
-  /* Create the YCbCr to RGB conversion tables. 
-  */
-
-  for( uw = 0; uw < 256; uw++ )
-  {
-    gasdCostellaImageConvertCbG[ uw ] = 8910464L - 22554L * (COSTELLA_SD) 
-      uw;
-    gasdCostellaImageConvertCrG[ uw ] = -46803L * (COSTELLA_SD) uw;
-    
-
-    gaswCostellaImageConvertCrR[ uw ] = (COSTELLA_SW) 
-      COSTELLA_SHIFT_RIGHT_FLOOR( 91885L * (COSTELLA_SD) uw - 11728512L, 16
-      );
-    gaswCostellaImageConvertCbB[ uw ] = (COSTELLA_SW) 
-      COSTELLA_SHIFT_RIGHT_FLOOR( 116134L * (COSTELLA_SD) uw - 14832384L, 16
-      );
-  }
 }
 COSTELLA_END_FUNCTION
 
@@ -294,54 +382,11 @@ COSTELLA_END_FUNCTION
 
 COSTELLA_FUNCTION( CostellaImageConvertFinalize, ( void ) )
 {
-  /* Do nothing if not initialized.
-  */
-
-  if( !gbInitialized )
-  {
-    COSTELLA_RETURN;
-  }
-
-
-  /* Clear initialized flag.
-  */
-
-  gbInitialized = COSTELLA_FALSE;
-
-
-  /* Free the memory allocated in initialization.
-  */
-
-  if( COSTELLA_FREE( gasdCostellaImageConvertRY ) || COSTELLA_FREE( 
-    gasdCostellaImageConvertGY ) || COSTELLA_FREE( 
-    gasdCostellaImageConvertBY ) || COSTELLA_FREE( 
-    gasdCostellaImageConvertRCb ) || COSTELLA_FREE( 
-    gasdCostellaImageConvertGCb ) || COSTELLA_FREE( 
-    gasdCostellaImageConvertBCb ) || COSTELLA_FREE( 
-    gasdCostellaImageConvertGCr ) || COSTELLA_FREE( 
-    gasdCostellaImageConvertBCr ) || COSTELLA_FREE( 
-    gasdCostellaImageConvertCbG ) || COSTELLA_FREE( 
-    gasdCostellaImageConvertCrG ) || COSTELLA_FREE( 
-    gaswCostellaImageConvertCrR ) || COSTELLA_FREE( 
-    gaswCostellaImageConvertCbB ) )
-  {
-    COSTELLA_FUNDAMENTAL_ERROR( "Freeing" );
-    COSTELLA_RETURN;
-  }
-
-
-  /* Zero pointer that was set to pointer to allocated array that has now
-  ** been freed.
-  */
-
-  gasdCostellaImageConvertRCr  = 0;
-
-
   /* Finalize other libraries.
   */ 
 
   if( COSTELLA_CALL( CostellaWrapFinalize() ) || COSTELLA_CALL( 
-    CostellaImageFinalize() ) )
+    CostellaImageFinalize() ) || COSTELLA_CALL( CostellaCpuFinalize() ) )
   {
     COSTELLA_ERROR( "Finalizing" );
     COSTELLA_RETURN;
@@ -383,17 +428,11 @@ COSTELLA_FUNCTION( CostellaImageConvertRgbToYcbcr, ( COSTELLA_IMAGE* piIn,
   icpIn = icpInStart = icpOut = icpOutStart = gicpCostellaImageNull;
 
 
-  /* Check initialization and pointers.
+  /* Check pointers.
   */
 
   #ifdef COSTELLA_DEBUG
   {
-    if( !gbInitialized )
-    {
-      COSTELLA_FUNDAMENTAL_ERROR( "Initialization" );
-      COSTELLA_RETURN;
-    }
-
     if( !piIn )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Null piIn" );
@@ -654,17 +693,11 @@ COSTELLA_FUNCTION( CostellaImageConvertYcbcrToRgb, ( COSTELLA_IMAGE* piIn,
   icpIn = icpInStart = icpOut = icpOutStart = gicpCostellaImageNull;
 
 
-  /* Check initialization and pointers.
+  /* Check pointers.
   */
 
   #ifdef COSTELLA_DEBUG
   {
-    if( !gbInitialized )
-    {
-      COSTELLA_FUNDAMENTAL_ERROR( "Initialization" );
-      COSTELLA_RETURN;
-    }
-
     if( !piIn )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Null piIn" );
@@ -914,6 +947,509 @@ COSTELLA_END_FUNCTION
 
 
 
+/* CostellaImageConvertRgbRowToYcbcr: 
+**
+**   Convert a row of interleaved RGB pixels, as read from an image file, to
+**   separate rows of Y, Cb and Cr. The results are exactly those of 
+**   COSTELLA_IMAGE_CONVERT_RGB_TO_YCBCR; the vector code computes the same
+**   sums of products as the lookup tables, in 32-bit integers.
+**
+**   aubRgb:  Row of 3 * udWidth bytes.
+**
+**   udWidth:  Number of pixels in the row.
+**
+**   bBgr:  If nonzero, the bytes of each pixel are in the order blue, 
+**     green, red.
+**
+**   aub{Y,Cb,Cr}:  Output row of udWidth bytes. aubCb and aubCr can both be
+**     null, in which case only the Y channel is computed.
+*/
+
+COSTELLA_FUNCTION( CostellaImageConvertRgbRowToYcbcr, ( COSTELLA_UB* aubRgb,
+  COSTELLA_UD udWidth, COSTELLA_B bBgr, COSTELLA_UB* aubY, COSTELLA_UB* 
+  aubCb, COSTELLA_UB* aubCr ) )
+{
+  COSTELLA_UB ubR, ubB;
+  COSTELLA_UD udColumn;
+  COSTELLA_UB* pubRgb;
+
+
+  /* Check pointers.
+  */
+
+  #ifdef COSTELLA_DEBUG
+  {
+    if( !aubRgb || !aubY || !aubCb != !aubCr )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null row" );
+      COSTELLA_RETURN;
+    }
+  }
+  #endif
+
+
+  /* Find the red and blue bytes of each pixel, and start at the leftmost 
+  ** pixel.
+  */
+
+  ubR = (COSTELLA_UB) ( bBgr ? 2 : 0 );
+  ubB = (COSTELLA_UB) ( 2 - ubR );
+
+  udColumn = 0;
+
+
+  /* Use the vector code of the tier chosen at run time for as many pixels
+  ** as it handles. The AVX-512 tier uses the AVX2 code.
+  */
+
+  #ifdef COSTELLA_CPU_HAS_SSE41
+  {
+    COSTELLA_UB ubTier;
+
+    ubTier = costella_cpu_tier();
+
+    #ifdef COSTELLA_CPU_HAS_AVX2
+    if( ubTier >= COSTELLA_CPU_AVX2 )
+    {
+      udColumn = costella_image_convert_rgb_row_to_ycbcr_avx2( aubRgb, 
+        udColumn, udWidth, ubR, ubB, aubY, aubCb, aubCr );
+    }
+    #endif
+
+    if( ubTier >= COSTELLA_CPU_SSE41 )
+    {
+      udColumn = costella_image_convert_rgb_row_to_ycbcr_sse41( aubRgb, 
+        udColumn, udWidth, ubR, ubB, aubY, aubCb, aubCr );
+    }
+  }
+  #endif
+
+
+  /* The remaining pixels, or all of them without vector instructions, use
+  ** the lookup tables.
+  */
+
+  for( pubRgb = aubRgb + 3 * udColumn; udColumn < udWidth; udColumn++, 
+    pubRgb += 3 )
+  {
+    if( aubCb )
+    {
+      COSTELLA_IMAGE_CONVERT_RGB_TO_YCBCR( pubRgb[ ubR ], pubRgb[ 1 ], 
+        pubRgb[ ubB ], aubY + udColumn, aubCb + udColumn, aubCr + udColumn 
+        );
+    }
+    else
+    {
+      COSTELLA_IMAGE_CONVERT_RGB_TO_Y( pubRgb[ ubR ], pubRgb[ 1 ], pubRgb[ 
+        ubB ], aubY + udColumn );
+    }
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* costella_image_convert_rgb_row_to_ycbcr_avx2:
+**
+**   Convert sixteen pixels at a time with AVX2, as
+**   CostellaImageConvertRgbRowToYcbcr() does. Each 128-bit lane is loaded
+**   with four pixels, whose channels are shuffled out into 32-bit words.
+**   The last load reads four bytes past the sixteenth pixel, so at least
+**   two more pixels must follow.
+**
+**   udColumn:  First pixel to convert.
+**
+**   ub{R,B}:  Position of the {red,blue} byte in each pixel.
+**
+**   Other arguments are as for CostellaImageConvertRgbRowToYcbcr().
+**
+**   Returns the first pixel not converted.
+*/
+
+#ifdef COSTELLA_CPU_HAS_AVX2
+
+static COSTELLA_CPU_TARGET_AVX2 COSTELLA_UD 
+  costella_image_convert_rgb_row_to_ycbcr_avx2( COSTELLA_UB* aubRgb, 
+  COSTELLA_UD udColumn, COSTELLA_UD udWidth, COSTELLA_UB ubR, COSTELLA_UB 
+  ubB, COSTELLA_UB* aubY, COSTELLA_UB* aubCb, COSTELLA_UB* aubCr )
+{
+  COSTELLA_UB ubHalf;
+  COSTELLA_UB* pubRgb;
+  __m256i xPixels, xShuffle, xShuffleR, xShuffleG, xShuffleB, xR, xG, xB,
+    axY[ 2 ], axCb[ 2 ], axCr[ 2 ];
+  __m128i xOut;
+
+  xShuffle = _mm256_setr_epi8( 0, -128, -128, -128, 3, -128, -128, -128,
+    6, -128, -128, -128, 9, -128, -128, -128, 0, -128, -128, -128, 3, 
+    -128, -128, -128, 6, -128, -128, -128, 9, -128, -128, -128 );
+  xShuffleR = _mm256_add_epi8( xShuffle, _mm256_set1_epi8( (char) ubR ) );
+  xShuffleG = _mm256_add_epi8( xShuffle, _mm256_set1_epi8( 1 ) );
+  xShuffleB = _mm256_add_epi8( xShuffle, _mm256_set1_epi8( (char) ubB ) );
+
+  for( ; udColumn + 18 <= udWidth; udColumn += 16 )
+  {
+    for( ubHalf = 0; ubHalf < 2; ubHalf++ )
+    {
+      pubRgb = aubRgb + 3 * ( udColumn + 8 * ubHalf );
+
+      xPixels = _mm256_inserti128_si256( _mm256_castsi128_si256( 
+        _mm_loadu_si128( (__m128i*) pubRgb ) ), _mm_loadu_si128( 
+        (__m128i*) ( pubRgb + 12 ) ), 1 );
+
+      xR = _mm256_shuffle_epi8( xPixels, xShuffleR );
+      xG = _mm256_shuffle_epi8( xPixels, xShuffleG );
+      xB = _mm256_shuffle_epi8( xPixels, xShuffleB );
+
+      axY[ ubHalf ] = _mm256_srai_epi32( _mm256_add_epi32( 
+        _mm256_add_epi32( _mm256_mullo_epi32( xR, _mm256_set1_epi32( 19595
+        ) ), _mm256_mullo_epi32( xG, _mm256_set1_epi32( 38470 ) ) ), 
+        _mm256_add_epi32( _mm256_mullo_epi32( xB, _mm256_set1_epi32( 7471 
+        ) ), _mm256_set1_epi32( 32768 ) ) ), 16 );
+
+      if( aubCb )
+      {
+        axCb[ ubHalf ] = _mm256_srai_epi32( _mm256_sub_epi32( 
+          _mm256_add_epi32( _mm256_mullo_epi32( xB, _mm256_set1_epi32( 
+          32767 ) ), _mm256_set1_epi32( 8421376 ) ), _mm256_add_epi32( 
+          _mm256_mullo_epi32( xR, _mm256_set1_epi32( 11058 ) ), 
+          _mm256_mullo_epi32( xG, _mm256_set1_epi32( 21709 ) ) ) ), 16 );
+        axCr[ ubHalf ] = _mm256_srai_epi32( _mm256_sub_epi32( 
+          _mm256_add_epi32( _mm256_mullo_epi32( xR, _mm256_set1_epi32( 
+          32767 ) ), _mm256_set1_epi32( 8421376 ) ), _mm256_add_epi32( 
+          _mm256_mullo_epi32( xG, _mm256_set1_epi32( 27438 ) ), 
+          _mm256_mullo_epi32( xB, _mm256_set1_epi32( 5329 ) ) ) ), 16 );
+      }
+    }
+
+    COSTELLA_IMAGE_CONVERT_PACK_AVX2( axY, xOut );
+    _mm_storeu_si128( (__m128i*) ( aubY + udColumn ), xOut );
+
+    if( aubCb )
+    {
+      COSTELLA_IMAGE_CONVERT_PACK_AVX2( axCb, xOut );
+      _mm_storeu_si128( (__m128i*) ( aubCb + udColumn ), xOut );
+
+      COSTELLA_IMAGE_CONVERT_PACK_AVX2( axCr, xOut );
+      _mm_storeu_si128( (__m128i*) ( aubCr + udColumn ), xOut );
+    }
+  }
+
+  return udColumn;
+}
+
+#endif
+
+
+
+/* costella_image_convert_rgb_row_to_ycbcr_sse41:
+**
+**   Convert sixteen pixels at a time with SSE4.1, four to each register.
+**   See costella_image_convert_rgb_row_to_ycbcr_avx2().
+**
+**   udColumn:  First pixel to convert.
+**
+**   Other arguments are as for costella_image_convert_rgb_row_to_ycbcr_avx2().
+**
+**   Returns the first pixel not converted.
+*/
+
+#ifdef COSTELLA_CPU_HAS_SSE41
+
+static COSTELLA_CPU_TARGET_SSE41 COSTELLA_UD 
+  costella_image_convert_rgb_row_to_ycbcr_sse41( COSTELLA_UB* aubRgb, 
+  COSTELLA_UD udColumn, COSTELLA_UD udWidth, COSTELLA_UB ubR, COSTELLA_UB 
+  ubB, COSTELLA_UB* aubY, COSTELLA_UB* aubCb, COSTELLA_UB* aubCr )
+{
+  COSTELLA_UB ubQuarter;
+  __m128i xPixels, xShuffle, xShuffleR, xShuffleG, xShuffleB, xR, xG, xB,
+    axY[ 4 ], axCb[ 4 ], axCr[ 4 ], xOut;
+
+  xShuffle = _mm_setr_epi8( 0, -128, -128, -128, 3, -128, -128, -128, 6, 
+    -128, -128, -128, 9, -128, -128, -128 );
+  xShuffleR = _mm_add_epi8( xShuffle, _mm_set1_epi8( (char) ubR ) );
+  xShuffleG = _mm_add_epi8( xShuffle, _mm_set1_epi8( 1 ) );
+  xShuffleB = _mm_add_epi8( xShuffle, _mm_set1_epi8( (char) ubB ) );
+
+  for( ; udColumn + 18 <= udWidth; udColumn += 16 )
+  {
+    for( ubQuarter = 0; ubQuarter < 4; ubQuarter++ )
+    {
+      xPixels = _mm_loadu_si128( (__m128i*) ( aubRgb + 3 * ( udColumn + 4
+        * ubQuarter ) ) );
+
+      xR = _mm_shuffle_epi8( xPixels, xShuffleR );
+      xG = _mm_shuffle_epi8( xPixels, xShuffleG );
+      xB = _mm_shuffle_epi8( xPixels, xShuffleB );
+
+      axY[ ubQuarter ] = _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32( 
+        _mm_mullo_epi32( xR, _mm_set1_epi32( 19595 ) ), _mm_mullo_epi32( 
+        xG, _mm_set1_epi32( 38470 ) ) ), _mm_add_epi32( _mm_mullo_epi32( 
+        xB, _mm_set1_epi32( 7471 ) ), _mm_set1_epi32( 32768 ) ) ), 16 );
+
+      if( aubCb )
+      {
+        axCb[ ubQuarter ] = _mm_srai_epi32( _mm_sub_epi32( _mm_add_epi32( 
+          _mm_mullo_epi32( xB, _mm_set1_epi32( 32767 ) ), _mm_set1_epi32( 
+          8421376 ) ), _mm_add_epi32( _mm_mullo_epi32( xR, _mm_set1_epi32(
+          11058 ) ), _mm_mullo_epi32( xG, _mm_set1_epi32( 21709 ) ) ) ), 
+          16 );
+        axCr[ ubQuarter ] = _mm_srai_epi32( _mm_sub_epi32( _mm_add_epi32( 
+          _mm_mullo_epi32( xR, _mm_set1_epi32( 32767 ) ), _mm_set1_epi32( 
+          8421376 ) ), _mm_add_epi32( _mm_mullo_epi32( xG, _mm_set1_epi32(
+          27438 ) ), _mm_mullo_epi32( xB, _mm_set1_epi32( 5329 ) ) ) ), 16
+          );
+      }
+    }
+
+    COSTELLA_IMAGE_CONVERT_PACK_SSE41( axY, xOut );
+    _mm_storeu_si128( (__m128i*) ( aubY + udColumn ), xOut );
+
+    if( aubCb )
+    {
+      COSTELLA_IMAGE_CONVERT_PACK_SSE41( axCb, xOut );
+      _mm_storeu_si128( (__m128i*) ( aubCb + udColumn ), xOut );
+
+      COSTELLA_IMAGE_CONVERT_PACK_SSE41( axCr, xOut );
+      _mm_storeu_si128( (__m128i*) ( aubCr + udColumn ), xOut );
+    }
+  }
+
+  return udColumn;
+}
+
+#endif
+
+
+
+/* CostellaImageConvertYcbcrRowToRgb: 
+**
+**   Convert separate rows of Y, Cb and Cr to a row of interleaved RGB 
+**   pixels, as written to an image file. The results are exactly those of 
+**   COSTELLA_IMAGE_CONVERT_YCBCR_TO_RGB.
+**
+**   aub{Y,Cb,Cr}:  Input row of udWidth bytes.
+**
+**   udWidth:  Number of pixels in the row.
+**
+**   bBgr:  If nonzero, the bytes of each pixel are written in the order 
+**     blue, green, red.
+**
+**   aubRgb:  Output row of 3 * udWidth bytes.
+*/
+
+COSTELLA_FUNCTION( CostellaImageConvertYcbcrRowToRgb, ( COSTELLA_UB* aubY, 
+  COSTELLA_UB* aubCb, COSTELLA_UB* aubCr, COSTELLA_UD udWidth, COSTELLA_B 
+  bBgr, COSTELLA_UB* aubRgb ) )
+{
+  COSTELLA_UB ubR, ubB;
+  COSTELLA_UD udColumn;
+  COSTELLA_UB* pubRgb;
+
+
+  /* Check pointers.
+  */
+
+  #ifdef COSTELLA_DEBUG
+  {
+    if( !aubY || !aubCb || !aubCr || !aubRgb )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null row" );
+      COSTELLA_RETURN;
+    }
+  }
+  #endif
+
+
+  /* Find the red and blue bytes of each pixel, and start at the leftmost 
+  ** pixel.
+  */
+
+  ubR = (COSTELLA_UB) ( bBgr ? 2 : 0 );
+  ubB = (COSTELLA_UB) ( 2 - ubR );
+
+  udColumn = 0;
+
+
+  /* Use the vector code of the tier chosen at run time for as many pixels
+  ** as it handles. The AVX-512 tier uses the AVX2 code.
+  */
+
+  #ifdef COSTELLA_CPU_HAS_SSE41
+  {
+    COSTELLA_UB ubTier;
+
+    ubTier = costella_cpu_tier();
+
+    #ifdef COSTELLA_CPU_HAS_AVX2
+    if( ubTier >= COSTELLA_CPU_AVX2 )
+    {
+      udColumn = costella_image_convert_ycbcr_row_to_rgb_avx2( aubY, aubCb,
+        aubCr, udColumn, udWidth, bBgr, aubRgb );
+    }
+    #endif
+
+    if( ubTier >= COSTELLA_CPU_SSE41 )
+    {
+      udColumn = costella_image_convert_ycbcr_row_to_rgb_sse41( aubY, aubCb,
+        aubCr, udColumn, udWidth, bBgr, aubRgb );
+    }
+  }
+  #endif
+
+
+  /* The remaining pixels, or all of them without vector instructions, use
+  ** the lookup tables.
+  */
+
+  for( pubRgb = aubRgb + 3 * udColumn; udColumn < udWidth; udColumn++, 
+    pubRgb += 3 )
+  {
+    COSTELLA_IMAGE_CONVERT_YCBCR_TO_RGB( aubY[ udColumn ], aubCb[ udColumn 
+      ], aubCr[ udColumn ], pubRgb + ubR, pubRgb + 1, pubRgb + ubB );
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* costella_image_convert_ycbcr_row_to_rgb_avx2:
+**
+**   Convert sixteen pixels at a time with AVX2, eight to each register,
+**   as CostellaImageConvertYcbcrRowToRgb() does. The channels are packed
+**   to bytes, which also limits their range, and are then interleaved
+**   sixteen bytes at a time.
+**
+**   udColumn:  First pixel to convert.
+**
+**   Other arguments are as for CostellaImageConvertYcbcrRowToRgb().
+**
+**   Returns the first pixel not converted.
+*/
+
+#ifdef COSTELLA_CPU_HAS_AVX2
+
+static COSTELLA_CPU_TARGET_AVX2 COSTELLA_UD 
+  costella_image_convert_ycbcr_row_to_rgb_avx2( COSTELLA_UB* aubY, 
+  COSTELLA_UB* aubCb, COSTELLA_UB* aubCr, COSTELLA_UD udColumn, 
+  COSTELLA_UD udWidth, COSTELLA_B bBgr, COSTELLA_UB* aubRgb )
+{
+  COSTELLA_UB ubHalf;
+  __m256i xY, xCb, xCr, axR[ 2 ], axG[ 2 ], axB[ 2 ];
+  __m128i xR, xG, xB;
+
+  for( ; udColumn + 16 <= udWidth; udColumn += 16 )
+  {
+    for( ubHalf = 0; ubHalf < 2; ubHalf++ )
+    {
+      xY = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (__m128i*) ( aubY + 
+        udColumn + 8 * ubHalf ) ) );
+      xCb = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (__m128i*) ( aubCb + 
+        udColumn + 8 * ubHalf ) ) );
+      xCr = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (__m128i*) ( aubCr + 
+        udColumn + 8 * ubHalf ) ) );
+
+      axR[ ubHalf ] = _mm256_add_epi32( xY, _mm256_srai_epi32( 
+        _mm256_sub_epi32( _mm256_mullo_epi32( xCr, _mm256_set1_epi32( 
+        91885 ) ), _mm256_set1_epi32( 11728512 ) ), 16 ) );
+      axG[ ubHalf ] = _mm256_add_epi32( xY, _mm256_srai_epi32( 
+        _mm256_sub_epi32( _mm256_set1_epi32( 8910464 ), _mm256_add_epi32( 
+        _mm256_mullo_epi32( xCb, _mm256_set1_epi32( 22554 ) ), 
+        _mm256_mullo_epi32( xCr, _mm256_set1_epi32( 46803 ) ) ) ), 16 ) );
+      axB[ ubHalf ] = _mm256_add_epi32( xY, _mm256_srai_epi32( 
+        _mm256_sub_epi32( _mm256_mullo_epi32( xCb, _mm256_set1_epi32( 
+        116134 ) ), _mm256_set1_epi32( 14832384 ) ), 16 ) );
+    }
+
+    COSTELLA_IMAGE_CONVERT_PACK_AVX2( axR, xR );
+    COSTELLA_IMAGE_CONVERT_PACK_AVX2( axG, xG );
+    COSTELLA_IMAGE_CONVERT_PACK_AVX2( axB, xB );
+
+    if( bBgr )
+    {
+      COSTELLA_IMAGE_CONVERT_INTERLEAVE_SSE41( xB, xG, xR, aubRgb + 3 * 
+        udColumn );
+    }
+    else
+    {
+      COSTELLA_IMAGE_CONVERT_INTERLEAVE_SSE41( xR, xG, xB, aubRgb + 3 * 
+        udColumn );
+    }
+  }
+
+  return udColumn;
+}
+
+#endif
+
+
+
+/* costella_image_convert_ycbcr_row_to_rgb_sse41:
+**
+**   Convert sixteen pixels at a time with SSE4.1, four to each register.
+**   See costella_image_convert_ycbcr_row_to_rgb_avx2().
+**
+**   udColumn:  First pixel to convert.
+**
+**   Other arguments are as for CostellaImageConvertYcbcrRowToRgb().
+**
+**   Returns the first pixel not converted.
+*/
+
+#ifdef COSTELLA_CPU_HAS_SSE41
+
+static COSTELLA_CPU_TARGET_SSE41 COSTELLA_UD 
+  costella_image_convert_ycbcr_row_to_rgb_sse41( COSTELLA_UB* aubY, 
+  COSTELLA_UB* aubCb, COSTELLA_UB* aubCr, COSTELLA_UD udColumn, 
+  COSTELLA_UD udWidth, COSTELLA_B bBgr, COSTELLA_UB* aubRgb )
+{
+  COSTELLA_UB ubQuarter;
+  __m128i axY[ 4 ], axCb[ 4 ], axCr[ 4 ], axR[ 4 ], axG[ 4 ], axB[ 4 ], 
+    xR, xG, xB;
+
+  for( ; udColumn + 16 <= udWidth; udColumn += 16 )
+  {
+    COSTELLA_IMAGE_CONVERT_UNPACK_SSE41( aubY + udColumn, axY );
+    COSTELLA_IMAGE_CONVERT_UNPACK_SSE41( aubCb + udColumn, axCb );
+    COSTELLA_IMAGE_CONVERT_UNPACK_SSE41( aubCr + udColumn, axCr );
+
+    for( ubQuarter = 0; ubQuarter < 4; ubQuarter++ )
+    {
+      axR[ ubQuarter ] = _mm_add_epi32( axY[ ubQuarter ], _mm_srai_epi32( 
+        _mm_sub_epi32( _mm_mullo_epi32( axCr[ ubQuarter ], _mm_set1_epi32(
+        91885 ) ), _mm_set1_epi32( 11728512 ) ), 16 ) );
+      axG[ ubQuarter ] = _mm_add_epi32( axY[ ubQuarter ], _mm_srai_epi32( 
+        _mm_sub_epi32( _mm_set1_epi32( 8910464 ), _mm_add_epi32( 
+        _mm_mullo_epi32( axCb[ ubQuarter ], _mm_set1_epi32( 22554 ) ), 
+        _mm_mullo_epi32( axCr[ ubQuarter ], _mm_set1_epi32( 46803 ) ) ) ),
+        16 ) );
+      axB[ ubQuarter ] = _mm_add_epi32( axY[ ubQuarter ], _mm_srai_epi32( 
+        _mm_sub_epi32( _mm_mullo_epi32( axCb[ ubQuarter ], _mm_set1_epi32(
+        116134 ) ), _mm_set1_epi32( 14832384 ) ), 16 ) );
+    }
+
+    COSTELLA_IMAGE_CONVERT_PACK_SSE41( axR, xR );
+    COSTELLA_IMAGE_CONVERT_PACK_SSE41( axG, xG );
+    COSTELLA_IMAGE_CONVERT_PACK_SSE41( axB, xB );
+
+    if( bBgr )
+    {
+      COSTELLA_IMAGE_CONVERT_INTERLEAVE_SSE41( xB, xG, xR, aubRgb + 3 * 
+        udColumn );
+    }
+    else
+    {
+      COSTELLA_IMAGE_CONVERT_INTERLEAVE_SSE41( xR, xG, xB, aubRgb + 3 * 
+        udColumn );
+    }
+  }
+
+  return udColumn;
+}
+
+#endif
+
+
+
 /* Copyright (c) 2005-2007 John P. Costella.
 **
 ** End of file.
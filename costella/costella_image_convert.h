@@ -59,9 +59,31 @@ int costella_image_convert_rgb_to_ycbcr( COSTELLA_IMAGE* piIn,
 int costella_image_convert_ycbcr_to_rgb( COSTELLA_IMAGE* piIn, 
   COSTELLA_IMAGE* piOut, int (*pfProgress)( void* pvPassback ), void* 
   pvPassback, FILE* pfileError );
+
+int costella_image_convert_rgb_row_to_ycbcr( unsigned char* aubRgb, 
+  unsigned long udWidth, int bBgr, unsigned char* aubY, unsigned char* 
+  aubCb, unsigned char* aubCr, FILE* pfileError );
+int costella_image_convert_ycbcr_row_to_rgb( unsigned char* aubY, unsigned 
+  char* aubCb, unsigned char* aubCr, unsigned long udWidth, int bBgr, 
+  unsigned char* aubRgb, FILE* pfileError );
   
 
 
+/* Lookup tables for the conversion macros below. 
+*/
+
+typedef struct
+{
+  COSTELLA_SD asdRY[ 256 ], asdGY[ 256 ], asdBY[ 256 ];
+  COSTELLA_SD asdRCb[ 256 ], asdGCb[ 256 ], asdBCb[ 256 ];
+  COSTELLA_SD asdRCr[ 256 ], asdGCr[ 256 ], asdBCr[ 256 ];
+  COSTELLA_SD asdCbG[ 256 ], asdCrG[ 256 ];
+  COSTELLA_SW aswCrR[ 256 ], aswCbB[ 256 ];
+}
+COSTELLA_IMAGE_CONVERT_TABLES;
+
+
+
 /* Function prototypes.
 */
 
@@ -74,6 +96,13 @@ COSTELLA_FUNCTION( CostellaImageConvertRgbToYcbcr, ( COSTELLA_IMAGE* piIn,
 COSTELLA_FUNCTION( CostellaImageConvertYcbcrToRgb, ( COSTELLA_IMAGE* piIn, 
   COSTELLA_IMAGE* piOut, COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* 
   poPassback ) )
+
+COSTELLA_FUNCTION( CostellaImageConvertRgbRowToYcbcr, ( COSTELLA_UB* aubRgb,
+  COSTELLA_UD udWidth, COSTELLA_B bBgr, COSTELLA_UB* aubY, COSTELLA_UB* 
+  aubCb, COSTELLA_UB* aubCr ) )
+COSTELLA_FUNCTION( CostellaImageConvertYcbcrRowToRgb, ( COSTELLA_UB* aubY, 
+  COSTELLA_UB* aubCb, COSTELLA_UB* aubCr, COSTELLA_UD udWidth, COSTELLA_B 
+  bBgr, COSTELLA_UB* aubRgb ) )
   
 
 
@@ -89,8 +118,9 @@ COSTELLA_FUNCTION( CostellaImageConvertYcbcrToRgb, ( COSTELLA_IMAGE* piIn,
 #define COSTELLA_IMAGE_CONVERT_RGB_TO_Y( lubR, lubG, lubB, lpubY ) \
 { \
   *(lpubY) = (COSTELLA_UB) COSTELLA_SHIFT_RIGHT_FLOOR( \
-    gasdCostellaImageConvertRY[ (lubR) ] + gasdCostellaImageConvertGY[ \
-    (lubG) ] + gasdCostellaImageConvertBY[ (lubB) ], 16 ); \
+    gtblCostellaImageConvert.asdRY[ (lubR) ] + \
+    gtblCostellaImageConvert.asdGY[ (lubG) ] + \
+    gtblCostellaImageConvert.asdBY[ (lubB) ], 16 ); \
 }
 
 
@@ -111,12 +141,14 @@ COSTELLA_FUNCTION( CostellaImageConvertYcbcrToRgb, ( COSTELLA_IMAGE* piIn,
   COSTELLA_IMAGE_CONVERT_RGB_TO_Y( lubR, lubG, lubB, lpubY ); \
   \
   *(lpubCb) = (COSTELLA_UB) COSTELLA_SHIFT_RIGHT_FLOOR( \
-    gasdCostellaImageConvertRCb[ (lubR) ] + gasdCostellaImageConvertGCb[ \
-    (lubG) ] + gasdCostellaImageConvertBCb[ (lubB) ], 16 ); \
+    gtblCostellaImageConvert.asdRCb[ (lubR) ] + \
+    gtblCostellaImageConvert.asdGCb[ (lubG) ] + \
+    gtblCostellaImageConvert.asdBCb[ (lubB) ], 16 ); \
   \
   *(lpubCr) = (COSTELLA_UB) COSTELLA_SHIFT_RIGHT_FLOOR( \
-    gasdCostellaImageConvertRCr[ (lubR) ] + gasdCostellaImageConvertGCr[ \
-    (lubG) ] + gasdCostellaImageConvertBCr[ (lubB) ], 16 ); \
+    gtblCostellaImageConvert.asdRCr[ (lubR) ] + \
+    gtblCostellaImageConvert.asdGCr[ (lubG) ] + \
+    gtblCostellaImageConvert.asdBCr[ (lubB) ], 16 ); \
 }
 
 
@@ -135,11 +167,13 @@ COSTELLA_FUNCTION( CostellaImageConvertYcbcrToRgb, ( COSTELLA_IMAGE* piIn,
 { \
   COSTELLA_SW lswR, lswG, lswB; \
   \
-  lswR = (COSTELLA_SW) (lubY) + gaswCostellaImageConvertCrR[ (lubCr) ];\
+  lswR = (COSTELLA_SW) (lubY) + gtblCostellaImageConvert.aswCrR[ (lubCr) \
+    ]; \
   lswG = (COSTELLA_SW) (lubY) + (COSTELLA_SW) COSTELLA_SHIFT_RIGHT_FLOOR( \
-    gasdCostellaImageConvertCbG[ (lubCb) ] + gasdCostellaImageConvertCrG[ \
-    (lubCr) ], 16 ); \
-  lswB = (COSTELLA_SW) (lubY) + gaswCostellaImageConvertCbB[ (lubCb) ]; \
+    gtblCostellaImageConvert.asdCbG[ (lubCb) ] + \
+    gtblCostellaImageConvert.asdCrG[ (lubCr) ], 16 ); \
+  lswB = (COSTELLA_SW) (lubY) + gtblCostellaImageConvert.aswCbB[ (lubCb) \
+    ]; \
   \
   *(lpubR) = (COSTELLA_UB) COSTELLA_IMAGE_LIMIT_RANGE( lswR ); \
   *(lpubG) = (COSTELLA_UB) COSTELLA_IMAGE_LIMIT_RANGE( lswG ); \
@@ -148,19 +182,14 @@ COSTELLA_FUNCTION( CostellaImageConvertYcbcrToRgb, ( COSTELLA_IMAGE* piIn,
 
 
 
-/* Declaration of global variables defined in costella_image_convert.c.
+/* Declaration of global variables defined in costella_image_convert.c. 
+** The macros above read the tables in gtblCostellaImageConvert, which the
+** compiler computes.
 */
 
 #ifndef _COSTELLA_IMAGE_CONVERT_C_
 
-  extern COSTELLA_SW* gaswCostellaImageConvertCrR, 
-    * gaswCostellaImageConvertCbB;
-  extern COSTELLA_SD* gasdCostellaImageConvertRY, 
-    * gasdCostellaImageConvertGY, * gasdCostellaImageConvertBY, 
-    * gasdCostellaImageConvertRCb, * gasdCostellaImageConvertGCb, 
-    * gasdCostellaImageConvertBCb, * gasdCostellaImageConvertRCr, 
-    * gasdCostellaImageConvertGCr, * gasdCostellaImageConvertBCr, 
-    * gasdCostellaImageConvertCbG, * gasdCostellaImageConvertCrG;
+  extern const COSTELLA_IMAGE_CONVERT_TABLES gtblCostellaImageConvert;
 
 #endif
 
@@ -71,6 +71,26 @@ COSTELLA_IMAGE_COLOR_PIXEL;
   ( (lic1) == (lic2) )
 
 
+#define COSTELLA_IMAGE_GRAY_MOVE_DOWN( lig, lsdOffset ) \
+  ( (lig) += (lsdOffset) )
+
+#define COSTELLA_IMAGE_ALPHA_MOVE_DOWN( lia, lsdOffset ) \
+  ( (lia) += (lsdOffset) )
+
+#define COSTELLA_IMAGE_COLOR_MOVE_DOWN( lic, lsdOffset ) \
+  ( (lic) += (lsdOffset) )
+
+
+#define COSTELLA_IMAGE_GRAY_MOVE_RIGHT( lig, ludColumns ) \
+  ( (lig) += (ludColumns) )
+
+#define COSTELLA_IMAGE_ALPHA_MOVE_RIGHT( lia, ludColumns ) \
+  ( (lia) += (ludColumns) )
+
+#define COSTELLA_IMAGE_COLOR_MOVE_RIGHT( lic, ludColumns ) \
+  ( (lic) += 3 * (ludColumns) )
+
+
 #define COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( ligpRight, ligpLeft ) \
   ( (ligpLeft) = (ligpRight) )
 
@@ -82,6 +82,28 @@ COSTELLA_IMAGE_COLOR_PIXEL;
     (lic1).aubBCr == (lic2).aubBCr )
 
 
+#define COSTELLA_IMAGE_GRAY_MOVE_DOWN( lig, lsdOffset ) \
+  ( (lig) += (lsdOffset) )
+
+#define COSTELLA_IMAGE_ALPHA_MOVE_DOWN( lia, lsdOffset ) \
+  ( (lia) += (lsdOffset) )
+
+#define COSTELLA_IMAGE_COLOR_MOVE_DOWN( lic, lsdOffset ) \
+  ( (lic).aubRY += (lsdOffset), (lic).aubGCb += (lsdOffset), \
+  (lic).aubBCr += (lsdOffset) )
+
+
+#define COSTELLA_IMAGE_GRAY_MOVE_RIGHT( lig, ludColumns ) \
+  ( (lig) += (ludColumns) )
+
+#define COSTELLA_IMAGE_ALPHA_MOVE_RIGHT( lia, ludColumns ) \
+  ( (lia) += (ludColumns) )
+
+#define COSTELLA_IMAGE_COLOR_MOVE_RIGHT( lic, ludColumns ) \
+  ( (lic).aubRY += (ludColumns), (lic).aubGCb += (ludColumns), \
+  (lic).aubBCr += (ludColumns) )
+
+
 #define COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( ligpRight, ligpLeft ) \
   ( (ligpLeft) = (ligpRight) )
 
@@ -204,6 +226,44 @@ COSTELLA_IMAGE_COLOR_PIXEL;
 
 
 
+/* Each channel is a contiguous array of bytes, one per pixel, so that a 
+** row of one channel can be addressed directly. The address macros return 
+** a pointer to the byte holding the channel of a pixel; row strides are 
+** then counts of bytes.
+*/
+
+#define COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+
+
+#define COSTELLA_IMAGE_GRAY_PIXEL_Y_ADDRESS( ligp ) \
+  ( ligp )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_R_Y_ADDRESS( licp ) \
+  ( (licp).pubRY )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_G_CB_ADDRESS( licp ) \
+  ( (licp).pubGCb )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_B_CR_ADDRESS( licp ) \
+  ( (licp).pubBCr )
+
+
+/* Each channel of a color image can also be addressed on its own as a 
+** grayscale image, which is how quarter-size chrominance arrays are 
+** handled.
+*/
+
+#define COSTELLA_IMAGE_COLOR_R_Y_GRAY( lic ) \
+  ( (lic).aubRY )
+
+#define COSTELLA_IMAGE_COLOR_G_CB_GRAY( lic ) \
+  ( (lic).aubGCb )
+
+#define COSTELLA_IMAGE_COLOR_B_CR_GRAY( lic ) \
+  ( (lic).aubBCr )
+
+
+
 /* File is now included.
 */
 
@@ -0,0 +1,332 @@
+/* Copyright (c) 2026 The unblock authors.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a
+** copy of this software and associated documentation files (the "Software")
+** to deal in the Software without restriction, including without limitation
+** the rights to use, copy, modify, merge, publish, distribute, sublicense,
+** and/or sell copies of the Software, and to permit persons to whom the
+** Software is furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included
+** in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT, OR OTHERWISE, ARISING
+** FROM, OUT OF, OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+** DEALINGS IN THE SOFTWARE.
+**
+**
+** costella_image_tiled.h:
+**
+**   Set up pixel structure for three separate arrays of bytes, each stored
+**   as 8 x 8 tiles of 64 bytes. A tile holds its eight rows one after the
+**   other; the tiles of a row of tiles are stored left to right, and the
+**   rows of tiles top to bottom. Every block of the UnBlock algorithm is
+**   then one tile, or four for downsampled chrominance, so that its pixels
+**   share cache lines whichever direction the boundaries run.
+**
+**   The row stride of a tiled image is the width rounded up to a multiple
+**   of 8, so that a row of tiles is eight row strides long. Each array must
+**   start on a 64-byte boundary: the position of a pixel within its tile is
+**   read from the low six bits of its address. An image can only be split
+**   into bands of rows or columns on tile boundaries.
+**
+**   CostellaImageTilePlane() and CostellaImageUntilePlane() copy a channel
+**   between rows of bytes and this layout, once as an image comes in and
+**   once as it goes out.
+**
+**   This version: October 18, 2026.
+**
+**   Written in ANSI C.
+*/
+
+
+
+/* Include file only once.
+*/
+
+#ifndef _COSTELLA_IMAGE_TILED_H_
+#define _COSTELLA_IMAGE_TILED_H_
+
+
+
+/* Typedefs.
+*/
+
+typedef COSTELLA_UB* COSTELLA_IMAGE_GRAY;
+typedef COSTELLA_UB* COSTELLA_IMAGE_ALPHA;
+
+
+typedef struct
+{
+  COSTELLA_UB* aubRY;
+  COSTELLA_UB* aubGCb;
+  COSTELLA_UB* aubBCr;
+}
+COSTELLA_IMAGE_COLOR;
+
+
+typedef COSTELLA_UB* COSTELLA_IMAGE_GRAY_PIXEL;
+typedef COSTELLA_UB* COSTELLA_IMAGE_ALPHA_PIXEL;
+
+
+typedef struct
+{
+  COSTELLA_UB* pubRY;
+  COSTELLA_UB* pubGCb;
+  COSTELLA_UB* pubBCr;
+}
+COSTELLA_IMAGE_COLOR_PIXEL;
+
+
+
+/* Tile geometry. COSTELLA_IMAGE_TILED_ROW_STRIDE() is the row stride of an
+** image of a given width, and COSTELLA_IMAGE_TILED_BYTES() the size of one
+** of its arrays.
+*/
+
+#define COSTELLA_IMAGE_TILED_ALIGNMENT 64
+
+#define COSTELLA_IMAGE_TILED_ROW_STRIDE( ludWidth ) \
+  ( (COSTELLA_SD) ( ( (ludWidth) + 7 ) & ~(COSTELLA_UD) 7 ) )
+
+#define COSTELLA_IMAGE_TILED_BYTES( ludWidth, ludHeight ) \
+  ( (COSTELLA_UD) COSTELLA_IMAGE_TILED_ROW_STRIDE( ludWidth ) * ( ( \
+  (ludHeight) + 7 ) & ~(COSTELLA_UD) 7 ) )
+
+
+/* The column of a pixel within its tile, and eight times its row.
+*/
+
+#define COSTELLA_IMAGE_TILED_COLUMN( lpub ) \
+  ( (COSTELLA_UD) (lpub) & 7 )
+
+#define COSTELLA_IMAGE_TILED_ROW( lpub ) \
+  ( (COSTELLA_UD) (lpub) & 56 )
+
+
+/* The offsets that move a pixel pointer one or two pixels in each
+** direction, crossing into the next tile when it leaves its own.
+*/
+
+#define COSTELLA_IMAGE_TILED_LEFT( lpub ) \
+  ( COSTELLA_IMAGE_TILED_COLUMN( lpub ) ? -1 : -57 )
+
+#define COSTELLA_IMAGE_TILED_RIGHT( lpub ) \
+  ( COSTELLA_IMAGE_TILED_COLUMN( lpub ) < 7 ? 1 : 57 )
+
+#define COSTELLA_IMAGE_TILED_UP( lpub, lsdRowStride ) \
+  ( COSTELLA_IMAGE_TILED_ROW( lpub ) ? -8 : 56 - 8 * (lsdRowStride) )
+
+#define COSTELLA_IMAGE_TILED_DOWN( lpub, lsdRowStride ) \
+  ( COSTELLA_IMAGE_TILED_ROW( lpub ) < 56 ? 8 : 8 * (lsdRowStride) - 56 )
+
+#define COSTELLA_IMAGE_TILED_LEFT_TWO( lpub ) \
+  ( COSTELLA_IMAGE_TILED_COLUMN( lpub ) > 1 ? -2 : -58 )
+
+#define COSTELLA_IMAGE_TILED_RIGHT_TWO( lpub ) \
+  ( COSTELLA_IMAGE_TILED_COLUMN( lpub ) < 6 ? 2 : 58 )
+
+#define COSTELLA_IMAGE_TILED_UP_TWO( lpub, lsdDoubleRowStride ) \
+  ( COSTELLA_IMAGE_TILED_ROW( lpub ) > 8 ? -16 : 48 - 4 * \
+  (lsdDoubleRowStride) )
+
+#define COSTELLA_IMAGE_TILED_DOWN_TWO( lpub, lsdDoubleRowStride ) \
+  ( COSTELLA_IMAGE_TILED_ROW( lpub ) < 48 ? 16 : 4 * (lsdDoubleRowStride) \
+  - 48 )
+
+
+/* Move the three pointers of a color pixel by the offset for the first.
+** It is moved last, so that the offset is the same for all three.
+*/
+
+#define COSTELLA_IMAGE_TILED_COLOR_PIXEL_MOVE( licp, lOFFSET ) \
+  ( (licp).pubGCb += lOFFSET( (licp).pubRY ), (licp).pubBCr += lOFFSET( \
+  (licp).pubRY ), (licp).pubRY += lOFFSET( (licp).pubRY ) )
+
+#define COSTELLA_IMAGE_TILED_COLOR_PIXEL_MOVE_ROWS( licp, lOFFSET, \
+    lsdStride ) \
+  ( (licp).pubGCb += lOFFSET( (licp).pubRY, lsdStride ), (licp).pubBCr += \
+  lOFFSET( (licp).pubRY, lsdStride ), (licp).pubRY += lOFFSET( \
+  (licp).pubRY, lsdStride ) )
+
+
+
+/* Macros. An offset to a band of whole tiles is the same as in the
+** row-major layout: a band starting udRowFirst rows down starts udRowFirst
+** / 8 rows of tiles down, which is udRowFirst row strides, and one
+** starting udColumnFirst columns across starts udColumnFirst / 8 tiles
+** across, which is 8 * udColumnFirst bytes.
+*/
+
+#define COSTELLA_IMAGE_GRAY_IS_SAME( lig1, lig2 ) \
+  ( (lig1) == (lig2) )
+
+#define COSTELLA_IMAGE_ALPHA_IS_SAME( lia1, lia2 ) \
+  ( (lia1) == (lia2) )
+
+#define COSTELLA_IMAGE_COLOR_IS_SAME( lic1, lic2 ) \
+  ( (lic1).aubRY == (lic2).aubRY && (lic1).aubGCb == (lic2).aubGCb && \
+    (lic1).aubBCr == (lic2).aubBCr )
+
+
+#define COSTELLA_IMAGE_GRAY_MOVE_DOWN( lig, lsdOffset ) \
+  ( (lig) += (lsdOffset) )
+
+#define COSTELLA_IMAGE_ALPHA_MOVE_DOWN( lia, lsdOffset ) \
+  ( (lia) += (lsdOffset) )
+
+#define COSTELLA_IMAGE_COLOR_MOVE_DOWN( lic, lsdOffset ) \
+  ( (lic).aubRY += (lsdOffset), (lic).aubGCb += (lsdOffset), \
+  (lic).aubBCr += (lsdOffset) )
+
+
+#define COSTELLA_IMAGE_GRAY_MOVE_RIGHT( lig, ludColumns ) \
+  ( (lig) += 8 * (ludColumns) )
+
+#define COSTELLA_IMAGE_ALPHA_MOVE_RIGHT( lia, ludColumns ) \
+  ( (lia) += 8 * (ludColumns) )
+
+#define COSTELLA_IMAGE_COLOR_MOVE_RIGHT( lic, ludColumns ) \
+  ( (lic).aubRY += 8 * (ludColumns), (lic).aubGCb += 8 * (ludColumns), \
+  (lic).aubBCr += 8 * (ludColumns) )
+
+
+#define COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( ligpRight, ligpLeft ) \
+  ( (ligpLeft) = (ligpRight) )
+
+#define COSTELLA_IMAGE_ALPHA_PIXEL_ASSIGN( liapRight, liapLeft ) \
+  ( (liapLeft) = (liapRight) )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( licpRight, licpLeft ) \
+  ( (licpLeft).pubRY = (licpRight).pubRY, (licpLeft).pubGCb = \
+    (licpRight).pubGCb, (licpLeft).pubBCr = (licpRight).pubBCr )
+
+
+#define COSTELLA_IMAGE_GRAY_PIXEL_SET_TOP_LEFT( ligp, lig, udWidth, \
+    udHeight, sdRowStride ) \
+  ( (ligp) = (lig) )
+
+#define COSTELLA_IMAGE_ALPHA_PIXEL_SET_TOP_LEFT( liap, lia, udWidth, \
+    udHeight, sdRowStride ) \
+  ( (liap) = (lia) )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( licp, lic, udWidth, \
+    udHeight, sdRowStride ) \
+  ( (licp).pubRY = (lic).aubRY, (licp).pubGCb = (lic).aubGCb, \
+  (licp).pubBCr = (lic).aubBCr )
+
+
+#define COSTELLA_IMAGE_GRAY_PIXEL_MOVE_LEFT( ligp ) \
+  ( (ligp) += COSTELLA_IMAGE_TILED_LEFT( ligp ) )
+
+#define COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_LEFT( liap ) \
+  ( (liap) += COSTELLA_IMAGE_TILED_LEFT( liap ) )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_MOVE_LEFT( licp ) \
+  COSTELLA_IMAGE_TILED_COLOR_PIXEL_MOVE( licp, COSTELLA_IMAGE_TILED_LEFT )
+
+
+#define COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( ligp ) \
+  ( (ligp) += COSTELLA_IMAGE_TILED_RIGHT( ligp ) )
+
+#define COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_RIGHT( liap ) \
+  ( (liap) += COSTELLA_IMAGE_TILED_RIGHT( liap ) )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( licp ) \
+  COSTELLA_IMAGE_TILED_COLOR_PIXEL_MOVE( licp, COSTELLA_IMAGE_TILED_RIGHT )
+
+
+#define COSTELLA_IMAGE_GRAY_PIXEL_MOVE_UP( ligp, lsdRowStride ) \
+  ( (ligp) += COSTELLA_IMAGE_TILED_UP( ligp, lsdRowStride ) )
+
+#define COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_UP( liap, lsdRowStride ) \
+  ( (liap) += COSTELLA_IMAGE_TILED_UP( liap, lsdRowStride ) )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_MOVE_UP( licp, lsdRowStride ) \
+  COSTELLA_IMAGE_TILED_COLOR_PIXEL_MOVE_ROWS( licp, \
+  COSTELLA_IMAGE_TILED_UP, lsdRowStride )
+
+
+#define COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( ligp, lsdRowStride ) \
+  ( (ligp) += COSTELLA_IMAGE_TILED_DOWN( ligp, lsdRowStride ) )
+
+#define COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_DOWN( liap, lsdRowStride ) \
+  ( (liap) += COSTELLA_IMAGE_TILED_DOWN( liap, lsdRowStride ) )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( licp, lsdRowStride ) \
+  COSTELLA_IMAGE_TILED_COLOR_PIXEL_MOVE_ROWS( licp, \
+  COSTELLA_IMAGE_TILED_DOWN, lsdRowStride )
+
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_MOVE_LEFT_TWO( licp ) \
+  COSTELLA_IMAGE_TILED_COLOR_PIXEL_MOVE( licp, \
+  COSTELLA_IMAGE_TILED_LEFT_TWO )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( licp ) \
+  COSTELLA_IMAGE_TILED_COLOR_PIXEL_MOVE( licp, \
+  COSTELLA_IMAGE_TILED_RIGHT_TWO )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_MOVE_UP_TWO( licp, lsdDoubleRowStride ) \
+  COSTELLA_IMAGE_TILED_COLOR_PIXEL_MOVE_ROWS( licp, \
+  COSTELLA_IMAGE_TILED_UP_TWO, lsdDoubleRowStride )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( licp, lsdDoubleRowStride \
+    ) \
+  COSTELLA_IMAGE_TILED_COLOR_PIXEL_MOVE_ROWS( licp, \
+  COSTELLA_IMAGE_TILED_DOWN_TWO, lsdDoubleRowStride )
+
+
+#define COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( ligp ) \
+  ( *(ligp) )
+
+#define COSTELLA_IMAGE_ALPHA_PIXEL_GET_A( liap ) \
+  ( *(liap) )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( licp ) \
+  ( *(licp).pubRY )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( licp ) \
+  ( *(licp).pubGCb )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( licp ) \
+  ( *(licp).pubBCr )
+
+
+#define COSTELLA_IMAGE_GRAY_PIXEL_SET_Y( ligp, lubY ) \
+  ( *(ligp) = (lubY) )
+
+#define COSTELLA_IMAGE_ALPHA_PIXEL_SET_A( liap, lubA ) \
+  ( *(liap) = (lubA) )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_SET_R_Y( licp, lubRY ) \
+  ( *(licp).pubRY = (lubRY) )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_SET_G_CB( licp, lubGCb ) \
+  ( *(licp).pubGCb = (lubGCb) )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_SET_B_CR( licp, lubBCr ) \
+  ( *(licp).pubBCr = (lubBCr) )
+
+#define COSTELLA_IMAGE_COLOR_PIXEL_SET_RGB_YCBCR( licp, lubRY, lubGCb, \
+    lubBCr ) \
+  ( COSTELLA_IMAGE_COLOR_PIXEL_SET_R_Y( licp, lubRY ), \
+  COSTELLA_IMAGE_COLOR_PIXEL_SET_G_CB( licp, lubGCb ), \
+  COSTELLA_IMAGE_COLOR_PIXEL_SET_B_CR( licp, lubBCr ) )
+
+
+
+/* File is now included.
+*/
+
+#endif
+
+
+
+/* Copyright (c) 2026 The unblock authors.
+**
+** End of file.
+*/
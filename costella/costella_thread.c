@@ -0,0 +1,403 @@
+/* Copyright (c) 2026 The unblock authors.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a
+** copy of this software and associated documentation files (the "Software")
+** to deal in the Software without restriction, including without limitation
+** the rights to use, copy, modify, merge, publish, distribute, sublicense,
+** and/or sell copies of the Software, and to permit persons to whom the
+** Software is furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included 
+** in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT, OR OTHERWISE, ARISING
+** FROM, OUT OF, OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+** DEALINGS IN THE SOFTWARE.
+**
+**
+** costella_thread.c: 
+**
+**   Run independent jobs concurrently, one thread per job. If the library 
+**   is compiled with COSTELLA_THREAD_NONE defined, or if a thread cannot be
+**   created, jobs are simply run in the calling thread. Also provides the
+**   clock used to time the jobs.
+**
+**   This version: October 18, 2026.
+**
+**   Written in ANSI C, plus POSIX threads.
+*/
+
+
+
+/* Include files.
+*/
+
+#include "costella_thread.h"
+
+#ifndef COSTELLA_THREAD_NONE
+  #include <pthread.h>
+#endif
+
+#include <time.h>
+
+
+
+/* Internal structure.
+*/
+
+typedef struct
+{
+  COSTELLA_FUNCTION_POINTER( pfJob, ( COSTELLA_O* poJob ) );
+  COSTELLA_O* poJob;
+  COSTELLA_ERROR_NODE* penError;
+  COSTELLA_B bStarted, bTimed;
+  COSTELLA_DF dfStart, dfEnd;
+  #ifndef COSTELLA_THREAD_NONE
+    pthread_t thread;
+  #endif
+}
+COSTELLA_THREAD_JOB;
+
+
+
+/* Internal function prototypes.
+*/
+
+static void costella_thread_job( COSTELLA_THREAD_JOB* ptj );
+
+#ifndef COSTELLA_THREAD_NONE
+  static void* costella_thread_start( void* pv );
+#endif
+
+
+
+/* Start function bodies.
+*/
+
+#include "costella_body.h"
+
+
+
+/* CostellaThreadInitialize: 
+**
+**   Initialize the library.
+*/
+
+COSTELLA_FUNCTION( CostellaThreadInitialize, ( void ) )
+{  
+  /* Initialize other libraries.
+  */
+
+  if( COSTELLA_CALL( CostellaBaseInitialize( 0, 0, 0 ) ) )
+  {
+    COSTELLA_ERROR( "Initialization" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaThreadFinalize: 
+**
+**   Finalize the library. 
+*/
+
+COSTELLA_FUNCTION( CostellaThreadFinalize, ( void ) )
+{
+  /* Finalize other libraries.
+  */ 
+
+  if( COSTELLA_CALL( CostellaBaseFinalize() ) )
+  {
+    COSTELLA_ERROR( "Finalizing" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaThreadRun:
+**
+**   Run a number of jobs concurrently, and wait for all of them to finish.
+**   The first job is run in the calling thread; each other job gets a 
+**   thread of its own. The jobs must not call any progress callback, as 
+**   such callbacks need not be reentrant.
+**
+**   pfJob:  Function that performs a job.
+**
+**   aoJobs:  Array of job structures. A pointer to each is passed to pfJob.
+**
+**   mcJobSize:  Size of each job structure, in bytes.
+**
+**   udNumJobs:  Number of jobs.
+**
+**   par:  Arena from which to allocate the job descriptors, or null to 
+**     allocate them from the heap.
+**
+**   pdfWallSeconds:  Null, or a pointer to which is added the time from 
+**     the start of the first job to the end of the last.
+**
+**   pdfThreadSeconds:  Null, or a pointer to which is added the time of 
+**     each job.
+**
+**   If any jobs fail, the error of the first failing job is returned.
+*/
+
+COSTELLA_FUNCTION( CostellaThreadRun, ( COSTELLA_FUNCTION_POINTER( pfJob, 
+  ( COSTELLA_O* poJob ) ), COSTELLA_O* aoJobs, COSTELLA_MC mcJobSize, 
+  COSTELLA_UD udNumJobs, COSTELLA_ARENA* par, COSTELLA_DF* pdfWallSeconds, 
+  COSTELLA_DF* pdfThreadSeconds ) )
+{
+  COSTELLA_UD udJob;
+  COSTELLA_DF dfFirst, dfLast;
+  COSTELLA_ERROR_NODE* penError = 0;
+  COSTELLA_THREAD_JOB* atj = 0;
+
+
+  /* Check pointers.
+  */
+
+  #ifdef COSTELLA_DEBUG
+  {
+    if( !pfJob )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null pfJob" );
+      COSTELLA_RETURN;
+    }
+
+    if( !aoJobs )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null aoJobs" );
+      COSTELLA_RETURN;
+    }
+  }
+  #endif
+
+
+  /* Nothing to do if there are no jobs.
+  */
+
+  if( !udNumJobs )
+  {
+    COSTELLA_RETURN;
+  }
+
+
+  /* Allocate the job descriptors.
+  */
+
+  if( COSTELLA_ARENA_MALLOC( par, atj, udNumJobs ) )
+  {
+    COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
+    COSTELLA_RETURN;
+  }
+
+  for( udJob = 0; udJob < udNumJobs; udJob++ )
+  {
+    atj[ udJob ].pfJob = pfJob;
+    atj[ udJob ].poJob = (COSTELLA_UB*) aoJobs + udJob * mcJobSize;
+    atj[ udJob ].penError = 0;
+    atj[ udJob ].bStarted = COSTELLA_FALSE;
+    atj[ udJob ].bTimed = pdfWallSeconds || pdfThreadSeconds;
+  }
+
+
+  /* Start a thread for every job but the first.
+  */
+
+  #ifndef COSTELLA_THREAD_NONE
+  {
+    for( udJob = 1; udJob < udNumJobs; udJob++ )
+    {
+      atj[ udJob ].bStarted = !pthread_create( &atj[ udJob ].thread, 0, 
+        costella_thread_start, &atj[ udJob ] );
+    }
+  }
+  #endif
+
+
+  /* Run the first job, and any jobs for which no thread could be started,
+  ** in this thread.
+  */
+
+  for( udJob = 0; udJob < udNumJobs; udJob++ )
+  {
+    if( !atj[ udJob ].bStarted )
+    {
+      costella_thread_job( &atj[ udJob ] );
+    }
+  }
+
+
+  /* Wait for the other threads to finish.
+  */
+
+  #ifndef COSTELLA_THREAD_NONE
+  {
+    for( udJob = 1; udJob < udNumJobs; udJob++ )
+    {
+      if( atj[ udJob ].bStarted )
+      {
+        pthread_join( atj[ udJob ].thread, 0 );
+      }
+    }
+  }
+  #endif
+
+
+  /* Add up the times of the jobs, if they were timed.
+  */
+
+  if( atj[ 0 ].bTimed )
+  {
+    dfFirst = atj[ 0 ].dfStart;
+    dfLast = atj[ 0 ].dfEnd;
+
+    for( udJob = 0; udJob < udNumJobs; udJob++ )
+    {
+      if( atj[ udJob ].dfStart < dfFirst )
+      {
+        dfFirst = atj[ udJob ].dfStart;
+      }
+
+      if( atj[ udJob ].dfEnd > dfLast )
+      {
+        dfLast = atj[ udJob ].dfEnd;
+      }
+
+      if( pdfThreadSeconds )
+      {
+        *pdfThreadSeconds += atj[ udJob ].dfEnd - atj[ udJob ].dfStart;
+      }
+    }
+
+    if( pdfWallSeconds )
+    {
+      *pdfWallSeconds += dfLast - dfFirst;
+    }
+  }
+
+
+  /* Keep the error tree of the first failing job, and delete the others.
+  */
+
+  for( udJob = 0; udJob < udNumJobs; udJob++ )
+  {
+    if( atj[ udJob ].penError )
+    {
+      if( penError )
+      {
+        costella_base_error_node_delete( &atj[ udJob ].penError );
+      }
+      else
+      {
+        penError = atj[ udJob ].penError;
+      }
+    }
+  }
+
+
+  /* Clean up.
+  */
+
+  if( COSTELLA_ARENA_FREE( par, atj ) )
+  {
+    COSTELLA_FUNDAMENTAL_ERROR( "Freeing" );
+    COSTELLA_RETURN;
+  }
+
+
+  /* Report the error of the failing job, if any.
+  */
+
+  if( COSTELLA_CALL( penError ) )
+  {
+    COSTELLA_ERROR( "Running job" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* costella_thread_job: 
+**
+**   Run one job, recording when it starts and ends if it is timed.
+**
+**   ptj:  Pointer to the COSTELLA_THREAD_JOB.
+*/
+
+static void costella_thread_job( COSTELLA_THREAD_JOB* ptj )
+{
+  if( ptj->bTimed )
+  {
+    ptj->dfStart = costella_thread_seconds();
+  }
+
+  ptj->penError = ptj->pfJob( ptj->poJob );
+
+  if( ptj->bTimed )
+  {
+    ptj->dfEnd = costella_thread_seconds();
+  }
+}
+
+
+
+/* costella_thread_start: 
+**
+**   Thread entry point. Runs one job.
+**
+**   pv:  Pointer to the COSTELLA_THREAD_JOB.
+*/
+
+#ifndef COSTELLA_THREAD_NONE
+
+  static void* costella_thread_start( void* pv )
+  {
+    costella_thread_job( (COSTELLA_THREAD_JOB*) pv );
+
+    return 0;
+  }
+
+#endif
+
+
+
+/* costella_thread_seconds: 
+**
+**   Return the time in seconds since some fixed point, for timing jobs.
+**   This is wall-clock time from the POSIX monotonic clock, or, if the 
+**   library is compiled with COSTELLA_THREAD_NONE defined, processor time
+**   from the ANSI clock(), which is the same thing for a single thread.
+*/
+
+COSTELLA_DF costella_thread_seconds( void )
+{
+  #ifndef COSTELLA_THREAD_NONE
+  {
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (COSTELLA_DF) ts.tv_sec + 1e-9 * (COSTELLA_DF) ts.tv_nsec;
+  }
+  #else
+  {
+    return (COSTELLA_DF) clock() / CLOCKS_PER_SEC;
+  }
+  #endif
+}
+
+
+
+/* Copyright (c) 2026 The unblock authors.
+**
+** End of file.
+*/
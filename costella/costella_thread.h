@@ -0,0 +1,73 @@
+/* Copyright (c) 2026 The unblock authors.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a
+** copy of this software and associated documentation files (the "Software")
+** to deal in the Software without restriction, including without limitation
+** the rights to use, copy, modify, merge, publish, distribute, sublicense,
+** and/or sell copies of the Software, and to permit persons to whom the
+** Software is furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included 
+** in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT, OR OTHERWISE, ARISING
+** FROM, OUT OF, OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+** DEALINGS IN THE SOFTWARE.
+**
+**
+** costella_thread.h: 
+**
+**   Header file for costella_thread.c.
+**
+**   This version: October 18, 2026.
+**
+**   Written in ANSI C.
+*/
+
+
+
+/* Include file only once.
+*/
+
+#ifndef _COSTELLA_THREAD_H_
+#define _COSTELLA_THREAD_H_
+
+
+
+/* Include files.
+*/
+
+#include "costella_arena.h"
+
+
+
+/* Function prototypes.
+*/
+
+COSTELLA_FUNCTION( CostellaThreadInitialize, ( void ) )
+COSTELLA_FUNCTION( CostellaThreadFinalize, ( void ) )
+
+COSTELLA_FUNCTION( CostellaThreadRun, ( COSTELLA_FUNCTION_POINTER( pfJob, 
+  ( COSTELLA_O* poJob ) ), COSTELLA_O* aoJobs, COSTELLA_MC mcJobSize, 
+  COSTELLA_UD udNumJobs, COSTELLA_ARENA* par, COSTELLA_DF* pdfWallSeconds, 
+  COSTELLA_DF* pdfThreadSeconds ) )
+
+COSTELLA_DF costella_thread_seconds( void );
+
+
+
+/* File is now included.
+*/
+
+#endif
+
+
+
+/* Copyright (c) 2026 The unblock authors.
+**
+** End of file.
+*/
@@ -75,6 +75,36 @@ typedef int COSTELLA_MI;
 
 
 
+/* Storage class for data that must be private to each thread, such as the
+** static error node of each function. Define COSTELLA_THREAD_LOCAL as empty
+** if your compiler supports none of these and you never call the libraries
+** from more than one thread.
+*/
+
+#ifndef COSTELLA_THREAD_LOCAL
+
+  #if defined( __STDC_VERSION__ ) && __STDC_VERSION__ >= 201112L
+
+    #define COSTELLA_THREAD_LOCAL _Thread_local
+
+  #elif defined( __GNUC__ )
+
+    #define COSTELLA_THREAD_LOCAL __thread
+
+  #elif defined( _MSC_VER )
+
+    #define COSTELLA_THREAD_LOCAL __declspec( thread )
+
+  #else
+
+    #define COSTELLA_THREAD_LOCAL
+
+  #endif
+
+#endif
+
+
+
 /* File is now included.
 */
 
@@ -35,8 +35,9 @@
 */
 
 #include "costella_unblock.h"
+#include "costella_cpu.h"
 #include <stdlib.h>
-#include <math.h>
+#include <string.h>
 
 
 
@@ -47,6 +48,181 @@
 
 
 
+/* Number of adjacent columns processed together by the horizontal passes. 
+** Each row of a strip is then read or written as a contiguous run of 
+** pixels, rather than one pixel per row as when walking down a column.
+*/
+
+#ifndef COSTELLA_UNBLOCK_STRIP_WIDTH
+  #define COSTELLA_UNBLOCK_STRIP_WIDTH 32
+#endif
+
+
+/* When each channel is a contiguous array of bytes, the horizontal 
+** discrepancies are corrected in place in the image, and the strip code 
+** is only compiled if COSTELLA_UNBLOCK_STRIP_CORRECTION is defined.
+*/
+
+/* #define COSTELLA_UNBLOCK_STRIP_CORRECTION */
+
+
+
+/* Number of separate copies of each frequency table that are updated in 
+** turn by the horizontal passes, so that consecutive increments never 
+** touch the same memory location. Must be a power of two.
+*/
+
+#define COSTELLA_UNBLOCK_HISTOGRAM_LANES 4
+
+
+
+/* Approximate number of bytes of pixel data in each sub-band of rows that 
+** is carried through all the stages of a sweep before moving on to the 
+** next, chosen so that a sub-band stays in the level 2 cache.
+*/
+
+#ifndef COSTELLA_UNBLOCK_BAND_BYTES
+  #define COSTELLA_UNBLOCK_BAND_BYTES ( 1 << 20 )
+#endif
+
+
+
+/* Internal structure holding the private state of one region of the image,
+** when the three sweeps of the algorithm are split across threads. The 
+** first two sweeps use regions that are bands of rows; the third uses 
+** regions that are bands of columns. If bTimed is nonzero, the band adds 
+** the time it spends in each phase to adfSeconds.
+*/
+
+typedef struct
+{
+  COSTELLA_IMAGE iIn, iOut;
+  COSTELLA_B bColor, bConvert, bDownsample, bReplicate, bConvertBack;
+  COSTELLA_SW aswBufferY[ 16 * COSTELLA_UNBLOCK_STRIP_WIDTH ], 
+    aswBufferCb[ 16 * COSTELLA_UNBLOCK_STRIP_WIDTH ], 
+    aswBufferCr[ 16 * COSTELLA_UNBLOCK_STRIP_WIDTH ];
+  COSTELLA_UD audLanes[ 8 * COSTELLA_UNBLOCK_HISTOGRAM_LANES * 256 ];
+  COSTELLA_UD audYBoundaryU[ 256 ], audYBoundaryV[ 256 ], 
+    audCbBoundaryU[ 256 ], audCbBoundaryV[ 256 ], audCrBoundaryU[ 256 ], 
+    audCrBoundaryV[ 256 ], audYInternalU[ 256 ], audYInternalV[ 256 ], 
+    audCbInternalU[ 256 ], audCbInternalV[ 256 ], audCrInternalU[ 256 ], 
+    audCrInternalV[ 256 ];
+  COSTELLA_UD udTotalLuminance, udTotalChrominance;
+  COSTELLA_UB* aubYAdjustedU, * aubYAdjustedV, * aubCbAdjustedU, 
+    * aubCbAdjustedV, * aubCrAdjustedU, * aubCrAdjustedV;
+  COSTELLA_B bTimed;
+  COSTELLA_DF adfSeconds[ COSTELLA_UNBLOCK_NUM_PHASES ];
+}
+COSTELLA_UNBLOCK_BAND;
+
+
+
+/* Internal structure holding a band of rows of an image of interleaved 
+** pixels, converted to or from the separate channels in the context by 
+** CostellaUnblockInterleaved(). Each band but the last has an even number 
+** of rows, so that each row of quarter-size chrominance falls in one band.
+** The Y rows are udWidth bytes apart, and the Cb and Cr rows half that, 
+** rounded up. aubScratch holds full-size rows of Cb and Cr.
+*/
+
+typedef struct
+{
+  COSTELLA_UB* aubRgb, * aubY, * aubCb, * aubCr, * aubScratch;
+  COSTELLA_SD sdRgbRowStride;
+  COSTELLA_UD udWidth, udNumRows;
+  COSTELLA_B bBgr, bTimed;
+  COSTELLA_DF adfSeconds[ COSTELLA_UNBLOCK_NUM_PHASES ];
+}
+COSTELLA_UNBLOCK_INTERLEAVED_BAND;
+
+
+
+/* Internal structure holding the lookup tables, which the compiler 
+** computes. Each [-255,255] table is stored from index 0, so that it is 
+** looked up at 255 plus the value. Its last entry, for 256, is never read;
+** it just makes the table two runs of COSTELLA_TABLE_256.
+*/
+
+typedef struct
+{
+  COSTELLA_UB aubSquareRoot[ 256 ];
+  COSTELLA_UW auwMult3[ 256 ], auwMult15Add4[ 256 ], auwMult15[ 256 ], 
+    auwMult10[ 256 ], auwMult12Add4[ 256 ];
+  COSTELLA_SW aswMult3Add32[ 512 ], aswMult3Add16[ 512 ], 
+    aswMult5Add16[ 512 ], aswMult15Add32[ 512 ], aswMult21Add32[ 512 ], 
+    aswMult7Add8[ 512 ], aswMultM11Add128[ 512 ], aswMultM31Add128[ 512 ], 
+    aswMultM58Add128[ 512 ], aswMultM57Add128[ 512 ], 
+    aswMultM22Add128[ 512 ], aswMult42Add128[ 512 ], 
+    aswMult138Add128[ 512 ];
+}
+COSTELLA_UNBLOCK_TABLES;
+
+
+/* Entries of the tables for COSTELLA_TABLE_256. 
+**
+** COSTELLA_UNBLOCK_SQUARE_ROOT:  The square root of the value, rounded to 
+**   the nearest integer: the number of k >= 1 with k - 1/2 <= sqrt(ln), 
+**   i.e. with (2k - 1)^2 <= 4 ln.
+**
+** COSTELLA_UNBLOCK_SIGNED:  A linear [-255,255] table entry, converted to
+**   COSTELLA_SW. Entries of aswMult138Add128 that do not fit wrap around, 
+**   as they always have.
+*/
+
+#define COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, lk ) \
+  ( 4 * (ln) >= ( 2 * (lk) - 1 ) * ( 2 * (lk) - 1 ) )
+
+#define COSTELLA_UNBLOCK_SQUARE_ROOT( lm, la, ln ) \
+  ( COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 1 ) + \
+  COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 2 ) + \
+  COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 3 ) + \
+  COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 4 ) + \
+  COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 5 ) + \
+  COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 6 ) + \
+  COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 7 ) + \
+  COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 8 ) + \
+  COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 9 ) + \
+  COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 10 ) + \
+  COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 11 ) + \
+  COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 12 ) + \
+  COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 13 ) + \
+  COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 14 ) + \
+  COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 15 ) + \
+  COSTELLA_UNBLOCK_ROOT_AT_LEAST( ln, 16 ) )
+
+#define COSTELLA_UNBLOCK_SIGNED( lm, la, ln ) \
+  ( (COSTELLA_SW) ( (lm) * (ln) + (la) ) )
+
+#define COSTELLA_UNBLOCK_SIGNED_TABLE( lm, la ) \
+  { COSTELLA_TABLE_256( COSTELLA_UNBLOCK_SIGNED, lm, la, -255 ), \
+  COSTELLA_TABLE_256( COSTELLA_UNBLOCK_SIGNED, lm, la, 1 ) }
+
+
+
+/* Internal structure holding a context: the allocator for its memory, 
+** the adjustment tables, frequency tables and bands that 
+** CostellaUnblockSweeps() reuses from one image to the next, the channels
+** into which CostellaUnblockInterleaved() converts an image, and the 
+** statistics to which each call adds, if any. A context is used by one 
+** caller at a time; callers with their own contexts may run at once.
+*/
+
+struct costella_unblock_context
+{
+  COSTELLA_O* (*pfMalloc)( COSTELLA_MC mc );
+  COSTELLA_B (*pfFree)( COSTELLA_O* po );
+  COSTELLA_UB aubAdjusted[ 6 * 256 ];
+  COSTELLA_UD audFrequencies[ 12 * 256 ];
+  COSTELLA_UNBLOCK_BAND* abnd;
+  COSTELLA_UD udNumBandsAllocated;
+  COSTELLA_UB* aubChannels;
+  COSTELLA_MC mcChannelsAllocated;
+  COSTELLA_ARENA ar;
+  COSTELLA_UNBLOCK_STATS* pstats;
+};
+
+
+
 /* Internal function prototypes.
 */
 
@@ -63,14 +239,15 @@ static COSTELLA_FUNCTION( CostellaUnblockComputeVerticalDiscrepancies, (
 
 static COSTELLA_FUNCTION( CostellaUnblockComputeHorizontalDiscrepancies, ( 
   COSTELLA_SW* aswBufferY, COSTELLA_SW* aswBufferCb, COSTELLA_SW* 
-  aswBufferCr, COSTELLA_UD* audYBoundaryU, COSTELLA_UD* audYBoundaryV, 
-  COSTELLA_UD* audCbBoundaryU, COSTELLA_UD* audCbBoundaryV, COSTELLA_UD* 
-  audCrBoundaryU, COSTELLA_UD* audCrBoundaryV, COSTELLA_UD* audYInternalU, 
-  COSTELLA_UD* audYInternalV, COSTELLA_UD* audCbInternalU, COSTELLA_UD* 
-  audCbInternalV, COSTELLA_UD* audCrInternalU, COSTELLA_UD* audCrInternalV, 
-  COSTELLA_UD* pudTotalLuminance, COSTELLA_UD* pudTotalChrominance, 
-  COSTELLA_IMAGE* pi, COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* 
-  poPassback ) )
+  aswBufferCr, COSTELLA_UD* audLanes, COSTELLA_UD* audYBoundaryU, 
+  COSTELLA_UD* audYBoundaryV, COSTELLA_UD* audCbBoundaryU, COSTELLA_UD* 
+  audCbBoundaryV, COSTELLA_UD* audCrBoundaryU, COSTELLA_UD* audCrBoundaryV, 
+  COSTELLA_UD* audYInternalU, COSTELLA_UD* audYInternalV, COSTELLA_UD* 
+  audCbInternalU, COSTELLA_UD* audCbInternalV, COSTELLA_UD* audCrInternalU, 
+  COSTELLA_UD* audCrInternalV, COSTELLA_UD* pudTotalLuminance, COSTELLA_UD* 
+  pudTotalChrominance, COSTELLA_IMAGE* pi, COSTELLA_UD udRowBoundaryFirst,
+  COSTELLA_UD udRowBoundaryEnd, COSTELLA_CALLBACK_FUNCTION pfProgress, 
+  COSTELLA_O* poPassback ) )
 
 static COSTELLA_FUNCTION( CostellaUnblockCorrectVerticalDiscrepancies, ( 
   COSTELLA_SW* aswBufferY, COSTELLA_SW* aswBufferCb, COSTELLA_SW* 
@@ -80,27 +257,167 @@ static COSTELLA_FUNCTION( CostellaUnblockCorrectVerticalDiscrepancies, (
   COSTELLA_IMAGE* piOut, COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* 
   poPassback ) )
 
-static COSTELLA_FUNCTION( CostellaUnblockCorrectHorizontalDiscrepancies, ( 
-  COSTELLA_SW* aswBufferY, COSTELLA_SW* aswBufferCb, COSTELLA_SW* 
-  aswBufferCr, COSTELLA_UB* aubYAdjustedU, COSTELLA_UB* aubYAdjustedV, 
-  COSTELLA_UB* aubCbAdjustedU, COSTELLA_UB* aubCbAdjustedV, COSTELLA_UB* 
-  aubCrAdjustedU, COSTELLA_UB* aubCrAdjustedV, COSTELLA_IMAGE* piIn, 
-  COSTELLA_IMAGE* piOut, COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* 
-  poPassback ) )
+#if !defined( COSTELLA_IMAGE_CHANNELS_CONTIGUOUS ) || defined( \
+  COSTELLA_UNBLOCK_STRIP_CORRECTION )
+
+  static COSTELLA_FUNCTION( CostellaUnblockCorrectHorizontalDiscrepancies, ( 
+    COSTELLA_SW* aswBufferY, COSTELLA_SW* aswBufferCb, COSTELLA_SW* 
+    aswBufferCr, COSTELLA_UB* aubYAdjustedU, COSTELLA_UB* aubYAdjustedV, 
+    COSTELLA_UB* aubCbAdjustedU, COSTELLA_UB* aubCbAdjustedV, COSTELLA_UB* 
+    aubCrAdjustedU, COSTELLA_UB* aubCrAdjustedV, COSTELLA_IMAGE* piIn, 
+    COSTELLA_IMAGE* piOut, COSTELLA_CALLBACK_FUNCTION pfProgress, 
+    COSTELLA_O* poPassback ) )
+
+#endif
+
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+
+  static COSTELLA_FUNCTION( CostellaUnblockCorrectHorizontalInPlace, ( 
+    COSTELLA_UB* aubYAdjustedU, COSTELLA_UB* aubYAdjustedV, COSTELLA_UB* 
+    aubCbAdjustedU, COSTELLA_UB* aubCbAdjustedV, COSTELLA_UB* 
+    aubCrAdjustedU, COSTELLA_UB* aubCrAdjustedV, COSTELLA_IMAGE* pi, 
+    COSTELLA_UD udRowBoundaryFirst, COSTELLA_UD udRowBoundaryEnd, 
+    COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* poPassback ) )
+
+#endif
+
+static COSTELLA_FUNCTION( CostellaUnblockSplitBands, ( COSTELLA_IMAGE* 
+  piIn, COSTELLA_IMAGE* piOut, COSTELLA_UD udNumThreads, 
+  COSTELLA_UNBLOCK_BAND* abnd, COSTELLA_UD* pudNumBands ) )
+
+static COSTELLA_FUNCTION( CostellaUnblockSplitColumns, ( COSTELLA_IMAGE* 
+  pi, COSTELLA_UD udNumThreads, COSTELLA_UNBLOCK_BAND* abnd, COSTELLA_UD* 
+  pudNumBands ) )
+
+static COSTELLA_FUNCTION( CostellaUnblockFirstSweep, ( COSTELLA_O* poBand 
+  ) )
+
+static COSTELLA_FUNCTION( CostellaUnblockSecondSweep, ( COSTELLA_O* poBand 
+  ) )
+
+static COSTELLA_FUNCTION( CostellaUnblockThirdSweep, ( COSTELLA_O* poBand 
+  ) )
+
+static COSTELLA_FUNCTION( CostellaUnblockMergeBands, ( COSTELLA_UNBLOCK_BAND*
+  abnd, COSTELLA_UD udNumBands, COSTELLA_B bColor, COSTELLA_UD* 
+  audYBoundaryU, COSTELLA_UD* audYBoundaryV, COSTELLA_UD* audCbBoundaryU, 
+  COSTELLA_UD* audCbBoundaryV, COSTELLA_UD* audCrBoundaryU, COSTELLA_UD* 
+  audCrBoundaryV, COSTELLA_UD* audYInternalU, COSTELLA_UD* audYInternalV, 
+  COSTELLA_UD* audCbInternalU, COSTELLA_UD* audCbInternalV, COSTELLA_UD* 
+  audCrInternalU, COSTELLA_UD* audCrInternalV, COSTELLA_UD* 
+  pudTotalLuminance, COSTELLA_UD* pudTotalChrominance ) )
+
+static COSTELLA_FUNCTION( CostellaUnblockSweeps, ( COSTELLA_UNBLOCK_CONTEXT*
+  pctx, COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* piOut, COSTELLA_B 
+  bPhotographic, COSTELLA_B bCartoon, COSTELLA_UD udNumThreads, 
+  COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* poPassback, 
+  COSTELLA_UB* aubHorizontalAdjusted, COSTELLA_B bHorizontalAdjustedGiven )
+  )
+
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+
+  static COSTELLA_FUNCTION( CostellaUnblockQuarterChannel, ( COSTELLA_IMAGE*
+    pi, COSTELLA_UB ubChannel, COSTELLA_IMAGE* piChannel ) )
+
+  static COSTELLA_FUNCTION( CostellaUnblockComputeBandAdjustments, ( 
+    COSTELLA_UNBLOCK_BAND* pbnd, COSTELLA_B bPhotographic, COSTELLA_B 
+    bCartoon, COSTELLA_UB* aubAdjusted ) )
+
+  static COSTELLA_FUNCTION( CostellaUnblockMoveRows, ( COSTELLA_IMAGE* pi, 
+    COSTELLA_UD udRowFirst, COSTELLA_UD udNumRows ) )
+
+  static COSTELLA_FUNCTION( CostellaUnblockConvertInterleaved, ( 
+    COSTELLA_UNBLOCK_CONTEXT* pctx, COSTELLA_IMAGE* pi, COSTELLA_UB* aubRgb,
+    COSTELLA_SD sdRgbRowStride, COSTELLA_B bBgr, COSTELLA_B bToInterleaved, 
+    COSTELLA_UD udNumThreads, COSTELLA_DF* adfSeconds, COSTELLA_DF* 
+    pdfWallSeconds, COSTELLA_DF* pdfThreadSeconds ) )
+
+  static COSTELLA_FUNCTION( CostellaUnblockFromInterleaved, ( COSTELLA_O* 
+    poBand ) )
+
+  static COSTELLA_FUNCTION( CostellaUnblockToInterleaved, ( COSTELLA_O* 
+    poBand ) )
+
+#endif
+
+static COSTELLA_INLINE void costella_unblock_compute_discrepancies( COSTELLA_SW*
+  aswValues, COSTELLA_SW* pswU, COSTELLA_SW* pswV );
+
+static COSTELLA_INLINE void costella_unblock_compute_complete_discrepancies( 
+  COSTELLA_SW* aswValues, COSTELLA_SW* pswU, COSTELLA_SW* pswV );
+
+static COSTELLA_INLINE void costella_unblock_count_discrepancies( COSTELLA_SW* 
+  asw, COSTELLA_B bComplete, COSTELLA_UD* audBoundaryU, COSTELLA_UD* 
+  audBoundaryV, COSTELLA_UD* audInternalU, COSTELLA_UD* audInternalV );
 
-static COSTELLA_FUNCTION( CostellaUnblockComputeDiscrepancies, ( 
-  COSTELLA_SW* aswValues, COSTELLA_SW* pswU, COSTELLA_SW* pswV ) )
+static COSTELLA_INLINE void costella_unblock_compute_strip_discrepancies( 
+  COSTELLA_SW* aswValues, COSTELLA_UD udStride, COSTELLA_UD udCount, 
+  COSTELLA_UB* aubU, COSTELLA_UB* aubV );
+
+#ifdef COSTELLA_CPU_HAS_AVX512
+  static COSTELLA_CPU_TARGET_AVX512 COSTELLA_UD costella_unblock_strip_avx512( 
+    COSTELLA_SW* aswValues, COSTELLA_UD udStride, COSTELLA_UD udColumn, 
+    COSTELLA_UD udCount, COSTELLA_UB* aubU, COSTELLA_UB* aubV );
+#endif
+
+#ifdef COSTELLA_CPU_HAS_AVX2
+  static COSTELLA_CPU_TARGET_AVX2 COSTELLA_UD costella_unblock_strip_avx2( 
+    COSTELLA_SW* aswValues, COSTELLA_UD udStride, COSTELLA_UD udColumn, 
+    COSTELLA_UD udCount, COSTELLA_UB* aubU, COSTELLA_UB* aubV );
+#endif
+
+#ifdef COSTELLA_CPU_HAS_SSE2
+  static COSTELLA_CPU_TARGET_SSE2 COSTELLA_UD costella_unblock_strip_sse2( 
+    COSTELLA_SW* aswValues, COSTELLA_UD udStride, COSTELLA_UD udColumn, 
+    COSTELLA_UD udCount, COSTELLA_UB* aubU, COSTELLA_UB* aubV );
+#endif
+
+static COSTELLA_INLINE void costella_unblock_accumulate_strip( COSTELLA_UB* 
+  aubValues, COSTELLA_UD udCount, COSTELLA_UD* audLanes );
+
+static void costella_unblock_merge_lanes( COSTELLA_UD* audLanes, COSTELLA_UD* 
+  aud );
+
+static COSTELLA_INLINE void costella_unblock_correct_rows_in_place( COSTELLA_UB*
+  pubTop, COSTELLA_SD sdRowStride, COSTELLA_UB ubColumnStep, COSTELLA_UD 
+  udCount, COSTELLA_UB ubNumRows, COSTELLA_UB* aubAdjustedU, COSTELLA_UB* 
+  aubAdjustedV );
+
+#ifdef COSTELLA_CPU_HAS_AVX2
+  static COSTELLA_CPU_TARGET_AVX2 COSTELLA_UD 
+    costella_unblock_correct_rows_avx2( COSTELLA_UB* pubTop, COSTELLA_SD 
+    sdRowStride, COSTELLA_UB ubColumnStep, COSTELLA_UD udColumn, COSTELLA_UD 
+    udCount, COSTELLA_UB ubNumRows, COSTELLA_UB* aubAdjustedU, COSTELLA_UB* 
+    aubAdjustedV );
+#endif
+
+#ifdef COSTELLA_CPU_HAS_SSE2
+  static COSTELLA_CPU_TARGET_SSE2 COSTELLA_UD 
+    costella_unblock_correct_rows_sse2( COSTELLA_UB* pubTop, COSTELLA_SD 
+    sdRowStride, COSTELLA_UB ubColumnStep, COSTELLA_UD udColumn, COSTELLA_UD 
+    udCount, COSTELLA_UB ubNumRows, COSTELLA_UB* aubAdjustedU, COSTELLA_UB* 
+    aubAdjustedV );
+#endif
 
 static COSTELLA_FUNCTION( CostellaUnblockComputeAdjustments, ( COSTELLA_UD* 
   audReference, COSTELLA_UD* audMeasured, COSTELLA_UD udTotal, COSTELLA_B 
   bConservativePhotographic, COSTELLA_B bConservativeCartoon, COSTELLA_UB* 
   aubAdjusted ) )
 
-static COSTELLA_FUNCTION( CostellaUnblockCorrectDiscrepancies, ( 
-  COSTELLA_SW* asw, COSTELLA_SW swU, COSTELLA_SW swV ) )
+static COSTELLA_INLINE void costella_unblock_correct_boundary( COSTELLA_SW* 
+  asw, COSTELLA_B bComplete, COSTELLA_UB* aubAdjustedU, COSTELLA_UB* 
+  aubAdjustedV );
+
+static COSTELLA_INLINE void costella_unblock_correct_discrepancies( COSTELLA_SW*
+  asw, COSTELLA_SW swU, COSTELLA_SW swV );
 
 static COSTELLA_UD costella_unblock_approx_square_root( COSTELLA_UD ud );
 
+static COSTELLA_INLINE void costella_unblock_lap( COSTELLA_B bTimed, 
+  COSTELLA_DF* adfSeconds, COSTELLA_UB ubPhase, COSTELLA_DF* pdfLap );
+
+static COSTELLA_UD costella_unblock_subband_rows( COSTELLA_IMAGE* pi );
+
 
 #ifdef COSTELLA_UNBLOCK_DEBUG_DUMP
 
@@ -121,15 +438,28 @@ static COSTELLA_UD costella_unblock_approx_square_root( COSTELLA_UD ud );
 /* Internal global variables.
 */
 
-static COSTELLA_B gbInitialized = COSTELLA_FALSE;
-static COSTELLA_UB* gaubSquareRoot = 0;
-static COSTELLA_UW* gauwMult3 = 0, * gauwMult15Add4 = 0, * gauwMult15 = 0, 
-  * gauwMult10 = 0, * gauwMult12Add4 = 0;
-static COSTELLA_SW* gaswMultM11Add128 = 0, * gaswMultM31Add128 = 0, 
-  * gaswMultM58Add128 = 0, * gaswMultM57Add128 = 0, * gaswMultM22Add128 = 0,
-  * gaswMult42Add128 = 0, * gaswMult138Add128 = 0, * gaswMult3Add32 = 0, 
-  * gaswMult3Add16 = 0, * gaswMult5Add16 = 0, * gaswMult15Add32 = 0, 
-  * gaswMult21Add32 = 0, * gaswMult7Add8 = 0; 
+static const COSTELLA_UNBLOCK_TABLES gtblCostellaUnblock =
+{
+  { COSTELLA_TABLE_256( COSTELLA_UNBLOCK_SQUARE_ROOT, 0, 0, 0 ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, 3, 0, 0 ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, 15, 4, 0 ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, 15, 0, 0 ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, 10, 0, 0 ) },
+  { COSTELLA_TABLE_256( COSTELLA_TABLE_LINEAR, 12, 4, 0 ) },
+  COSTELLA_UNBLOCK_SIGNED_TABLE( 3, 32 ),
+  COSTELLA_UNBLOCK_SIGNED_TABLE( 3, 16 ),
+  COSTELLA_UNBLOCK_SIGNED_TABLE( 5, 16 ),
+  COSTELLA_UNBLOCK_SIGNED_TABLE( 15, 32 ),
+  COSTELLA_UNBLOCK_SIGNED_TABLE( 21, 32 ),
+  COSTELLA_UNBLOCK_SIGNED_TABLE( 7, 8 ),
+  COSTELLA_UNBLOCK_SIGNED_TABLE( -11, 128 ),
+  COSTELLA_UNBLOCK_SIGNED_TABLE( -31, 128 ),
+  COSTELLA_UNBLOCK_SIGNED_TABLE( -58, 128 ),
+  COSTELLA_UNBLOCK_SIGNED_TABLE( -57, 128 ),
+  COSTELLA_UNBLOCK_SIGNED_TABLE( -22, 128 ),
+  COSTELLA_UNBLOCK_SIGNED_TABLE( 42, 128 ),
+  COSTELLA_UNBLOCK_SIGNED_TABLE( 138, 128 )
+};
 
 
 
@@ -211,198 +541,490 @@ COSTELLA_END_ANSI_FUNCTION( !0 )
 
 
 
-/* CostellaUnblockInitialize: 
+/* costella_unblock_mt:
+**
+**   Public interface for performing the Unblock algorithm on a 
+**   COSTELLA_IMAGE, using several threads. The output is identical to that
+**   of costella_unblock.
 **
-**   Initialize the library. 
+**   iNumThreads:  Maximum number of threads to use. Values less than 2 
+**     give the serial algorithm.
+**
+**   The progress callback is only ever called from the calling thread.
+**
+**   Returns 0 if there is an error, or nonzero if there is no error.
 */
 
-COSTELLA_FUNCTION( CostellaUnblockInitialize, ( void ) )
+COSTELLA_ANSI_FUNCTION( costella_unblock_mt, int, ( COSTELLA_IMAGE* piIn, 
+  COSTELLA_IMAGE* piOut, int bPhotographic, int bCartoon, int iNumThreads, 
+  int (*pfProgress)( void* pvPassback ), void* pvPassback, FILE* pfileError
+  ) )
 {
-  COSTELLA_UW uw;
-  COSTELLA_SW sw;
-
+  COSTELLA_WRAP_PROGRESS wp;
 
-  /* Do nothing if already initialized.
-  */
+  wp.pfProgress = pfProgress;
+  wp.pvPassback = pvPassback;
 
-  if( gbInitialized )
+  if( COSTELLA_CALL( CostellaUnblockMt( piIn, piOut, bPhotographic, 
+    bCartoon, iNumThreads < 1 ? 1 : (COSTELLA_UD) iNumThreads, 
+    CostellaWrapProgress, &wp ) ) )
   {
-    COSTELLA_RETURN;
+    COSTELLA_ERROR_FPRINT( pfileError );
+    COSTELLA_ANSI_RETURN( 0 );
   }
+}
+COSTELLA_END_ANSI_FUNCTION( !0 )
 
 
-  /* Set initialized flag.
-  */
-
-  gbInitialized = COSTELLA_TRUE;
-
 
-  /* Initialize other libraries.
-  */
+/* costella_unblock_context_create:
+**
+**   Public interface for creating a context, which holds the scratch memory
+**   used to unblock one image at a time. Needs no other initialization, and
+**   is safe to call from several threads at once.
+**
+**   ppctx:  Pointer to the pointer into which the context is stored.
+**
+**   pf{Malloc,Free}:  Functions used to allocate and free the memory of the
+**     context, as for costella_base_initialize. If either is null, the 
+**     functions registered there are used.
+**
+**   Returns 0 if there is an error, or nonzero if there is no error.
+*/
 
-  if( COSTELLA_CALL( CostellaImageChrominanceInitialize() ) || 
-    COSTELLA_CALL( CostellaImageConvertInitialize() ) ) 
+COSTELLA_ANSI_FUNCTION( costella_unblock_context_create, int, ( 
+  costella_unblock_context** ppctx, void* (*pfMalloc)( unsigned int 
+  uiNumBytes ), int (*pfFree)( void* pv ), FILE* pfileError ) )
+{
+  if( COSTELLA_CALL( CostellaUnblockContextCreate( pfMalloc, pfFree, ppctx 
+    ) ) )
   {
-    COSTELLA_ERROR( "Initializing" );
-    gbInitialized = COSTELLA_FALSE;
-    COSTELLA_RETURN;
+    COSTELLA_ERROR_FPRINT( pfileError );
+    COSTELLA_ANSI_RETURN( 0 );
   }
+}
+COSTELLA_END_ANSI_FUNCTION( !0 )
 
 
-  /* Allocate memory for global lookup tables. 
-  */
-
-  if( COSTELLA_MALLOC( gaubSquareRoot, 256 ) || COSTELLA_MALLOC( gauwMult3, 
-    256 ) || COSTELLA_MALLOC( gauwMult15Add4, 256 ) || COSTELLA_MALLOC( 
-    gauwMult15, 256 ) || COSTELLA_MALLOC( gauwMult10, 256 ) || 
-    COSTELLA_MALLOC( gauwMult12Add4, 256 ) || COSTELLA_MALLOC_OFFSET( 
-    gaswMult3Add32, -255, +255 ) || COSTELLA_MALLOC_OFFSET( gaswMult3Add16, 
-    -255, +255 ) || COSTELLA_MALLOC_OFFSET( gaswMult5Add16, -255, +255 ) || 
-    COSTELLA_MALLOC_OFFSET( gaswMult15Add32, -255, +255 ) || 
-    COSTELLA_MALLOC_OFFSET( gaswMult21Add32, -255, +255 ) || 
-    COSTELLA_MALLOC_OFFSET( gaswMult7Add8, -255, +255 ) || 
-    COSTELLA_MALLOC_OFFSET( gaswMultM11Add128, -255, +255 ) || 
-    COSTELLA_MALLOC_OFFSET( gaswMultM31Add128, -255, +255 ) || 
-    COSTELLA_MALLOC_OFFSET( gaswMultM58Add128, -255, +255 ) || 
-    COSTELLA_MALLOC_OFFSET( gaswMultM57Add128, -255, +255 ) || 
-    COSTELLA_MALLOC_OFFSET( gaswMultM22Add128, -255, +255 ) || 
-    COSTELLA_MALLOC_OFFSET( gaswMult42Add128, -255, +255 ) || 
-    COSTELLA_MALLOC_OFFSET( gaswMult138Add128, -255, +255 ) ) 
-  {
-    COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
 
-    if( COSTELLA_FREE( gaubSquareRoot ) || COSTELLA_FREE( gauwMult3 ) ||
-      COSTELLA_FREE( gauwMult15Add4 ) || COSTELLA_FREE( gauwMult15 ) ||
-      COSTELLA_FREE( gauwMult10 ) || COSTELLA_FREE( gauwMult12Add4 ) ||
-      COSTELLA_FREE_OFFSET( gaswMult3Add32, -255 ) || COSTELLA_FREE_OFFSET( 
-      gaswMult3Add16, -255 ) || COSTELLA_FREE_OFFSET( gaswMult5Add16, -255 )
-      || COSTELLA_FREE_OFFSET( gaswMult15Add32, -255 ) || 
-      COSTELLA_FREE_OFFSET( gaswMult21Add32, -255 ) || COSTELLA_FREE_OFFSET(
-      gaswMult7Add8, -255 ) || COSTELLA_FREE_OFFSET( gaswMultM11Add128, -255
-      ) || COSTELLA_FREE_OFFSET( gaswMultM31Add128, -255 ) || 
-      COSTELLA_FREE_OFFSET( gaswMultM58Add128, -255 ) || 
-      COSTELLA_FREE_OFFSET( gaswMultM57Add128, -255 ) ||
-      COSTELLA_FREE_OFFSET( gaswMultM22Add128, -255 ) ||
-      COSTELLA_FREE_OFFSET( gaswMult42Add128, -255 ) ||
-      COSTELLA_FREE_OFFSET( gaswMult138Add128, -255 ) )
-    {
-      COSTELLA_CLEANUP_FUNDAMENTAL_ERROR( "Freeing" );
-    }
+/* costella_unblock_context_destroy:
+**
+**   Public interface for freeing a context, and setting the pointer to it 
+**   to null.
+**
+**   Returns 0 if there is an error, or nonzero if there is no error.
+*/
 
-    COSTELLA_RETURN;
+COSTELLA_ANSI_FUNCTION( costella_unblock_context_destroy, int, ( 
+  costella_unblock_context** ppctx, FILE* pfileError ) )
+{
+  if( COSTELLA_CALL( CostellaUnblockContextDestroy( ppctx ) ) )
+  {
+    COSTELLA_ERROR_FPRINT( pfileError );
+    COSTELLA_ANSI_RETURN( 0 );
   }
+}
+COSTELLA_END_ANSI_FUNCTION( !0 )
 
 
-  /* Initialize the [0,255] square-root table and the [0,255] multiplication
-  ** tables. 
-  */
 
-  for( uw = 0; uw < 256; uw++ )
-  {
-    gaubSquareRoot[ uw ] = (COSTELLA_UB) floor( sqrt( (double) uw ) + 0.5 );
+/* costella_unblock_context_stats:
+**
+**   Public interface for gathering statistics of the calls made with a 
+**   context.
+**
+**   pstats:  Pointer to the statistics, to which each later call with the
+**     context adds, or null to stop gathering them. The caller clears them
+**     first.
+**
+**   Returns 0 if there is an error, or nonzero if there is no error.
+*/
 
-    gauwMult3[ uw ] = 3 * uw;
-    gauwMult15Add4[ uw ] = 15 * uw + 4;
-    gauwMult15[ uw ] = 15 * uw;
-    gauwMult10[ uw ] = 10 * uw;
-    gauwMult12Add4[ uw ] = 12 * uw + 4;
+COSTELLA_ANSI_FUNCTION( costella_unblock_context_stats, int, ( 
+  costella_unblock_context* pctx, costella_unblock_stats* pstats, FILE* 
+  pfileError ) )
+{
+  if( COSTELLA_CALL( CostellaUnblockContextStats( pctx, pstats ) ) )
+  {
+    COSTELLA_ERROR_FPRINT( pfileError );
+    COSTELLA_ANSI_RETURN( 0 );
   }
+}
+COSTELLA_END_ANSI_FUNCTION( !0 )
 
 
-  /* Initialize the [-255,255] multiplication tables. 
-  */
 
-  for( sw = -255; sw < 256; sw++ )
+/* costella_unblock_ctx:
+**
+**   Public interface for performing the Unblock algorithm on a 
+**   COSTELLA_IMAGE, as costella_unblock_mt does, with the scratch memory 
+**   of a context. Threads with different contexts may call this at once.
+**
+**   Returns 0 if there is an error, or nonzero if there is no error.
+*/
+
+COSTELLA_ANSI_FUNCTION( costella_unblock_ctx, int, ( costella_unblock_context*
+  pctx, COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* piOut, int bPhotographic, int
+  bCartoon, int iNumThreads, int (*pfProgress)( void* pvPassback ), void* 
+  pvPassback, FILE* pfileError ) )
+{
+  COSTELLA_WRAP_PROGRESS wp;
+
+  wp.pfProgress = pfProgress;
+  wp.pvPassback = pvPassback;
+
+  if( COSTELLA_CALL( CostellaUnblockCtx( pctx, piIn, piOut, bPhotographic, 
+    bCartoon, iNumThreads < 1 ? 1 : (COSTELLA_UD) iNumThreads, 
+    CostellaWrapProgress, &wp ) ) )
   {
-    gaswMult3Add32[ sw ] = 3 * sw + 32;
-    gaswMult3Add16[ sw ] = 3 * sw + 16;
-    gaswMult5Add16[ sw ] = 5 * sw + 16;
-    gaswMult15Add32[ sw ] = 15 * sw + 32;
-    gaswMult21Add32[ sw ] = 21 * sw + 32;
-    gaswMult7Add8[ sw ] = 7 * sw + 8;
-    gaswMultM11Add128[ sw ] = -11 * sw + 128;
-    gaswMultM31Add128[ sw ] = -31 * sw + 128;
-    gaswMultM58Add128[ sw ] = -58 * sw + 128;
-    gaswMultM57Add128[ sw ] = -57 * sw + 128;
-    gaswMultM22Add128[ sw ] = -22 * sw + 128;
-    gaswMult42Add128[ sw ] = 42 * sw + 128;
-    gaswMult138Add128[ sw ] = 138 * sw + 128;
+    COSTELLA_ERROR_FPRINT( pfileError );
+    COSTELLA_ANSI_RETURN( 0 );
   }
 }
-COSTELLA_END_FUNCTION
+COSTELLA_END_ANSI_FUNCTION( !0 )
 
 
 
-/* CostellaUnblockFinalize: 
+/* costella_unblock_quarter:
 **
-**   Finalize the library. 
+**   Public interface for performing the Unblock algorithm with a context on
+**   a YCbCr image whose chrominance is stored in quarter-size arrays.
+**
+**   Returns 0 if there is an error, or nonzero if there is no error.
 */
 
-COSTELLA_FUNCTION( CostellaUnblockFinalize, ( void ) )
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+
+COSTELLA_ANSI_FUNCTION( costella_unblock_quarter, int, ( 
+  costella_unblock_context* pctx, COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* 
+  piOut, int bPhotographic, int bCartoon, int iNumThreads, int 
+  (*pfProgress)( void* pvPassback ), void* pvPassback, FILE* pfileError ) )
 {
-  /* Do nothing if not initialized.
-  */
+  COSTELLA_WRAP_PROGRESS wp;
+
+  wp.pfProgress = pfProgress;
+  wp.pvPassback = pvPassback;
 
-  if( !gbInitialized )
+  if( COSTELLA_CALL( CostellaUnblockQuarter( pctx, piIn, piOut, 
+    bPhotographic, bCartoon, iNumThreads < 1 ? 1 : (COSTELLA_UD) 
+    iNumThreads, CostellaWrapProgress, &wp ) ) )
   {
-    COSTELLA_RETURN;
+    COSTELLA_ERROR_FPRINT( pfileError );
+    COSTELLA_ANSI_RETURN( 0 );
   }
+}
+COSTELLA_END_ANSI_FUNCTION( !0 )
+
+#endif
 
 
-  /* Clear initialized flag.
-  */
 
-  gbInitialized = COSTELLA_FALSE;
+/* costella_unblock_stream:
+**
+**   Public interface for performing the Unblock algorithm on an image that
+**   is read and written a few rows at a time, through a window image of 
+**   COSTELLA_UNBLOCK_STREAM_ROWS rows. The output is identical to that of 
+**   costella_unblock on the whole image.
+**
+**   pfRead:  Callback that fills the rows described by the 
+**     COSTELLA_UNBLOCK_ROWS that it is passed. The image is read three 
+**     times, each time from the top down.
+**
+**   pfWrite:  Callback that is passed each run of finished rows, from the 
+**     top down.
+**
+**   pstats:  Null, or pointer to the statistics to which this call adds, 
+**     as for costella_unblock_context_stats().
+**
+**   Returns 0 if there is an error, or nonzero if there is no error.
+*/
 
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
 
-  /* Free the global memory allocated in initialization.
-  */
+COSTELLA_ANSI_FUNCTION( costella_unblock_stream, int, ( COSTELLA_IMAGE* 
+  piWindow, unsigned long udHeight, int bPhotographic, int bCartoon, int 
+  (*pfRead)( void* pvPassback, void* pvRows ), int (*pfWrite)( void* 
+  pvPassback, void* pvRows ), void* pvPassback, costella_unblock_stats* 
+  pstats, FILE* pfileError ) )
+{
+  COSTELLA_WRAP_CALLBACK wcRead, wcWrite;
 
-  if( COSTELLA_FREE( gaubSquareRoot ) || COSTELLA_FREE( gauwMult3 ) ||
-    COSTELLA_FREE( gauwMult15Add4 ) || COSTELLA_FREE( gauwMult15 ) ||
-    COSTELLA_FREE( gauwMult10 ) || COSTELLA_FREE( gauwMult12Add4 ) ||
-    COSTELLA_FREE_OFFSET( gaswMult3Add32, -255 ) || COSTELLA_FREE_OFFSET( 
-    gaswMult3Add16, -255 ) || COSTELLA_FREE_OFFSET( gaswMult5Add16, -255 ) 
-    || COSTELLA_FREE_OFFSET( gaswMult15Add32, -255 ) || 
-    COSTELLA_FREE_OFFSET( gaswMult21Add32, -255 ) || COSTELLA_FREE_OFFSET( 
-    gaswMult7Add8, -255 ) || COSTELLA_FREE_OFFSET( gaswMultM11Add128, -255 )
-    || COSTELLA_FREE_OFFSET( gaswMultM31Add128, -255 ) ||
-    COSTELLA_FREE_OFFSET( gaswMultM58Add128, -255 ) || COSTELLA_FREE_OFFSET(
-    gaswMultM57Add128, -255 ) || COSTELLA_FREE_OFFSET( gaswMultM22Add128, 
-    -255 ) || COSTELLA_FREE_OFFSET( gaswMult42Add128, -255 ) || 
-    COSTELLA_FREE_OFFSET( gaswMult138Add128, -255 ) )
-  {
-    COSTELLA_FUNDAMENTAL_ERROR( "Freeing" );
-    COSTELLA_RETURN;
-  }
-  
+  wcRead.pfCallback = pfRead;
+  wcRead.pvPassback = pvPassback;
 
-  /* Finalize other libraries.
-  */
+  wcWrite.pfCallback = pfWrite;
+  wcWrite.pvPassback = pvPassback;
 
-  if( COSTELLA_CALL( CostellaImageChrominanceFinalize() ) || COSTELLA_CALL( 
-    CostellaImageConvertFinalize() ) )
+  if( COSTELLA_CALL( CostellaUnblockStream( piWindow, udHeight, 
+    bPhotographic, bCartoon, CostellaWrapCallback, &wcRead, 
+    CostellaWrapCallback, &wcWrite, pstats ) ) )
   {
-    COSTELLA_ERROR( "Finalizing" );
-    COSTELLA_RETURN;
+    COSTELLA_ERROR_FPRINT( pfileError );
+    COSTELLA_ANSI_RETURN( 0 );
   }
 }
-COSTELLA_END_FUNCTION
+COSTELLA_END_ANSI_FUNCTION( !0 )
 
+#endif
 
 
-/* COSTELLA_UNBLOCK_ADJUST_DISCREPANCY: 
-**
-**   Adjust a discrepancy using the lookup tables. Inline macro.
+
+/* costella_unblock_interleaved:
 **
-**   lsw:  Discrepancy value to be adjusted.
+**   Public interface for performing the Unblock algorithm on an image of 
+**   interleaved 8-bit RGB or BGR pixels, such as the rows decoded by libpng
+**   or the pixel data of a .bmp file, as costella_unblock_ctx does. 
 **
-**   laubAdjusted:  Adjustment table to be used.
+**   Returns 0 if there is an error, or nonzero if there is no error.
 */
 
-#define COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( lsw, laubAdjusted ) \
-  ( (lsw) < 0 ? -(COSTELLA_SW) (laubAdjusted)[ -(lsw) ] : (COSTELLA_SW) \
-  (laubAdjusted)[ (lsw) ] )
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+
+COSTELLA_ANSI_FUNCTION( costella_unblock_interleaved, int, ( 
+  costella_unblock_context* pctx, unsigned char* aubIn, long sdInRowStride,
+  unsigned char* aubOut, long sdOutRowStride, unsigned long udWidth, 
+  unsigned long udHeight, int bBgr, int bPhotographic, int bCartoon, int 
+  iNumThreads, int (*pfProgress)( void* pvPassback ), void* pvPassback, 
+  FILE* pfileError ) )
+{
+  COSTELLA_WRAP_PROGRESS wp;
+
+  wp.pfProgress = pfProgress;
+  wp.pvPassback = pvPassback;
+
+  if( COSTELLA_CALL( CostellaUnblockInterleaved( pctx, aubIn, sdInRowStride,
+    aubOut, sdOutRowStride, udWidth, udHeight, bBgr, bPhotographic, 
+    bCartoon, iNumThreads < 1 ? 1 : (COSTELLA_UD) iNumThreads, 
+    CostellaWrapProgress, &wp ) ) )
+  {
+    COSTELLA_ERROR_FPRINT( pfileError );
+    COSTELLA_ANSI_RETURN( 0 );
+  }
+}
+COSTELLA_END_ANSI_FUNCTION( !0 )
+
+#endif
+
+
+
+/* CostellaUnblockInitialize: 
+**
+**   Initialize the library. The tables are constant, so there is nothing of
+**   its own to set up, and it and CostellaUnblockFinalize() may be called 
+**   from several threads at once.
+*/
+
+COSTELLA_FUNCTION( CostellaUnblockInitialize, ( void ) )
+{
+  /* Initialize other libraries.
+  */
+
+  if( COSTELLA_CALL( CostellaImageChrominanceInitialize() ) || 
+    COSTELLA_CALL( CostellaImageConvertInitialize() ) || COSTELLA_CALL( 
+    CostellaThreadInitialize() ) || COSTELLA_CALL( CostellaCpuInitialize() ) 
+    ) 
+  {
+    COSTELLA_ERROR( "Initializing" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaUnblockFinalize: 
+**
+**   Finalize the library. 
+*/
+
+COSTELLA_FUNCTION( CostellaUnblockFinalize, ( void ) )
+{
+  /* Finalize other libraries.
+  */
+
+  if( COSTELLA_CALL( CostellaImageChrominanceFinalize() ) || COSTELLA_CALL( 
+    CostellaImageConvertFinalize() ) || COSTELLA_CALL( 
+    CostellaThreadFinalize() ) || COSTELLA_CALL( CostellaCpuFinalize() ) )
+  {
+    COSTELLA_ERROR( "Finalizing" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaUnblockContextCreate: 
+**
+**   Create a context. Needs no initialization, and is safe to call from 
+**   several threads at once.
+**
+**   pf{Malloc,Free}:  Functions used to allocate and free the memory of the
+**     context, as for CostellaBaseInitialize(). If either is null, the 
+**     functions registered there are used.
+**
+**   ppctx:  Pointer to the pointer into which the context is stored.
+*/
+
+COSTELLA_FUNCTION( CostellaUnblockContextCreate, ( COSTELLA_O* (*pfMalloc)(
+  COSTELLA_MC mc ), COSTELLA_B (*pfFree)( COSTELLA_O* po ), 
+  COSTELLA_UNBLOCK_CONTEXT** ppctx ) )
+{
+  COSTELLA_UNBLOCK_CONTEXT* pctx;
+
+
+  /* Check pointer.
+  */
+
+  #ifdef COSTELLA_DEBUG
+  {
+    if( !ppctx )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null ppctx" );
+      COSTELLA_RETURN;
+    }
+  }
+  #endif
+
+
+  /* Allocate the context with its own allocator.
+  */
+
+  if( !pfMalloc || !pfFree )
+  {
+    pfMalloc = gpfCostellaBaseMalloc;
+    pfFree = gpfCostellaBaseFree;
+  }
+
+  if( !( pctx = (COSTELLA_UNBLOCK_CONTEXT*) pfMalloc( (COSTELLA_MC) sizeof( 
+    COSTELLA_UNBLOCK_CONTEXT ) ) ) )
+  {
+    COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
+    COSTELLA_RETURN;
+  }
+
+  pctx->pfMalloc = pfMalloc;
+  pctx->pfFree = pfFree;
+  pctx->abnd = 0;
+  pctx->udNumBandsAllocated = 0;
+  pctx->aubChannels = 0;
+  pctx->mcChannelsAllocated = 0;
+  pctx->pstats = 0;
+
+  if( COSTELLA_CALL( CostellaArenaOpen( &pctx->ar, pfMalloc, pfFree ) ) )
+  {
+    COSTELLA_ERROR( "Opening arena" );
+
+    if( !pfFree( pctx ) )
+    {
+      COSTELLA_CLEANUP_FUNDAMENTAL_ERROR( "Freeing" );
+    }
+
+    COSTELLA_RETURN;
+  }
+
+  *ppctx = pctx;
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaUnblockContextDestroy: 
+**
+**   Free a context created by CostellaUnblockContextCreate().
+**
+**   ppctx:  Pointer to the pointer to the context, which is set to null. 
+**     Does nothing if the context is null.
+*/
+
+COSTELLA_FUNCTION( CostellaUnblockContextDestroy, ( 
+  COSTELLA_UNBLOCK_CONTEXT** ppctx ) )
+{
+  COSTELLA_UNBLOCK_CONTEXT* pctx;
+
+
+  /* Do nothing if there is no context.
+  */
+
+  if( !ppctx || !( pctx = *ppctx ) )
+  {
+    COSTELLA_RETURN;
+  }
+
+  *ppctx = 0;
+
+
+  /* Free the arena, the bands and the channels, then the context, with 
+  ** its own allocator.
+  */
+
+  if( COSTELLA_CALL( CostellaArenaClose( &pctx->ar ) ) )
+  {
+    COSTELLA_ERROR( "Closing arena" );
+    COSTELLA_RETURN;
+  }
+
+  if( ( pctx->abnd && !pctx->pfFree( pctx->abnd ) ) || ( pctx->aubChannels
+    && !pctx->pfFree( pctx->aubChannels ) ) || !pctx->pfFree( pctx ) )
+  {
+    COSTELLA_FUNDAMENTAL_ERROR( "Freeing" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaUnblockContextStats: 
+**
+**   Gather statistics of the calls made with a context. Without them, 
+**   nothing is timed, so that the cost of each phase is only a test of a 
+**   flag for each sub-band.
+**
+**   pctx:  Pointer to the context.
+**
+**   pstats:  Pointer to the statistics, to which each later call with the
+**     context adds, or null to stop gathering them.
+*/
+
+COSTELLA_FUNCTION( CostellaUnblockContextStats, ( COSTELLA_UNBLOCK_CONTEXT*
+  pctx, COSTELLA_UNBLOCK_STATS* pstats ) )
+{
+  /* Check pointer.
+  */
+
+  #ifdef COSTELLA_DEBUG
+  {
+    if( !pctx )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null context" );
+      COSTELLA_RETURN;
+    }
+  }
+  #endif
+
+
+  /* Store the pointer.
+  */
+
+  pctx->pstats = pstats;
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* COSTELLA_UNBLOCK_ADJUST_DISCREPANCY: 
+**
+**   Adjust a discrepancy using the lookup tables. Inline macro.
+**
+**   lsw:  Discrepancy value to be adjusted.
+**
+**   laubAdjusted:  Adjustment table to be used.
+*/
+
+#define COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( lsw, laubAdjusted ) \
+  ( (lsw) < 0 ? -(COSTELLA_SW) (laubAdjusted)[ -(lsw) ] : (COSTELLA_SW) \
+  (laubAdjusted)[ (lsw) ] )
 
 
 
@@ -429,24 +1051,15 @@ COSTELLA_END_FUNCTION
 
 
 
-/* COSTELLA_UNBLOCK_CLEANUP: 
-** 
-**   Clean up in case of error.
+/* COSTELLA_UNBLOCK_STREAM_CLEANUP: 
+**
+**   Cleanup macro for CostellaUnblockStream().
 */
 
-#define COSTELLA_UNBLOCK_CLEANUP \
+#define COSTELLA_UNBLOCK_STREAM_CLEANUP \
 { \
-  if( COSTELLA_FREE( aubYAdjustedU ) || COSTELLA_FREE( aubYAdjustedV ) || \
-    COSTELLA_FREE( aubCbAdjustedU ) || COSTELLA_FREE( aubCbAdjustedV ) || \
-    COSTELLA_FREE( aubCrAdjustedU ) || COSTELLA_FREE( aubCrAdjustedV ) || \
-    COSTELLA_FREE( aswBufferY ) || COSTELLA_FREE( aswBufferCb ) || \
-    COSTELLA_FREE( aswBufferCr ) || COSTELLA_FREE( audYInternalU ) || \
-    COSTELLA_FREE( audYBoundaryU ) || COSTELLA_FREE( audYInternalV ) || \
-    COSTELLA_FREE( audYBoundaryV ) || COSTELLA_FREE( audCbInternalU ) || \
-    COSTELLA_FREE( audCbBoundaryU ) || COSTELLA_FREE( audCbInternalV ) || \
-    COSTELLA_FREE( audCbBoundaryV ) || COSTELLA_FREE( audCrInternalU ) || \
-    COSTELLA_FREE( audCrBoundaryU ) || COSTELLA_FREE( audCrInternalV ) || \
-    COSTELLA_FREE( audCrBoundaryV ) ) \
+  if( COSTELLA_FREE( aubVertical ) || COSTELLA_FREE( aubHorizontal ) || \
+    COSTELLA_FREE( pbnd ) ) \
   { \
     COSTELLA_CLEANUP_FUNDAMENTAL_ERROR( "Freeing" ); \
   } \
@@ -479,40 +1092,187 @@ COSTELLA_FUNCTION( CostellaUnblock, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE*
   piOut, COSTELLA_B bPhotographic, COSTELLA_B bCartoon, 
   COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* poPassback ) )
 {
-  COSTELLA_B bColor, bSmoothlyUpsampleChrominance, bInYCbCr, bOutYCbCr;
-  COSTELLA_UB* aubYAdjustedU = 0, * aubYAdjustedV = 0, * aubCbAdjustedU = 0,
-    * aubCbAdjustedV = 0, * aubCrAdjustedU = 0, * aubCrAdjustedV = 0;
-  COSTELLA_SW* aswBufferY = 0, * aswBufferCb = 0, * aswBufferCr = 0;
-  COSTELLA_UD udTotalLuminance, udTotalChrominance;
-  COSTELLA_UD* audYInternalU = 0, * audYBoundaryU = 0, * audYInternalV = 0, 
-    * audYBoundaryV = 0, * audCrInternalU = 0, * audCrBoundaryU = 0, 
-    * audCrInternalV = 0, * audCrBoundaryV = 0, * audCbInternalU = 0, 
-    * audCbBoundaryU = 0, * audCbInternalV = 0, * audCbBoundaryV = 0;
+  if( COSTELLA_CALL( CostellaUnblockMt( piIn, piOut, bPhotographic, 
+    bCartoon, 1, pfProgress, poPassback ) ) )
+  {
+    COSTELLA_ERROR( "Unblocking" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaUnblockMt: 
+**
+**   Perform the UnBlock algorithm, splitting the work across threads. The 
+**   algorithm is performed in three sweeps over the image, separated by the
+**   computation of the adjustment tables, which needs the frequencies of 
+**   the whole image:
+**
+**     1. Conversion to YCbCr, downsampling of the chrominance, and the 
+**        analysis of the vertical discrepancies.
+**
+**     2. Correction of the vertical discrepancies, and the analysis of the 
+**        horizontal discrepancies.
+**
+**     3. Correction of the horizontal discrepancies, replication of the 
+**        chrominance, and conversion back to RGB.
+**
+**   Each sweep carries a sub-band of rows of about 
+**   COSTELLA_UNBLOCK_BAND_BYTES through all of its stages before moving on
+**   to the next, so that the image passes through the cache only three 
+**   times. The first two sweeps give each thread its own band of rows, and
+**   the third its own band of columns, with private buffers and frequency
+**   tables; the tables are merged before the adjustments are computed, so
+**   that the output is identical to that of the serial algorithm for any 
+**   number of threads.
+**
+**   udNumThreads:  Maximum number of threads to use. A value of 1 gives the
+**     serial algorithm.
+**
+**   Other arguments are as for CostellaUnblock. The progress callback is 
+**   only ever called from the calling thread.
+**
+**   The scratch memory is held in a context that lasts for this call only;
+**   see CostellaUnblockCtx() to keep it from one image to the next.
+*/
+
+COSTELLA_FUNCTION( CostellaUnblockMt, ( COSTELLA_IMAGE* piIn, 
+  COSTELLA_IMAGE* piOut, COSTELLA_B bPhotographic, COSTELLA_B bCartoon, 
+  COSTELLA_UD udNumThreads, COSTELLA_CALLBACK_FUNCTION pfProgress, 
+  COSTELLA_O* poPassback ) )
+{
+  COSTELLA_UNBLOCK_CONTEXT* pctx = 0;
+
+
+  /* Unblock the image with a temporary context.
+  */
+
+  if( COSTELLA_CALL( CostellaUnblockContextCreate( 0, 0, &pctx ) ) )
+  {
+    COSTELLA_ERROR( "Creating context" );
+    COSTELLA_RETURN;
+  }
+
+  if( COSTELLA_CALL( CostellaUnblockSweeps( pctx, piIn, piOut, 
+    bPhotographic, bCartoon, udNumThreads, pfProgress, poPassback, 0, 
+    COSTELLA_FALSE ) ) )
+  {
+    COSTELLA_ERROR( "Unblocking" );
+
+    if( COSTELLA_CLEANUP_CALL( CostellaUnblockContextDestroy( &pctx ) ) )
+    {
+      COSTELLA_CLEANUP_ERROR( "Destroying context" );
+    }
+
+    COSTELLA_RETURN;
+  }
+
+  if( COSTELLA_CALL( CostellaUnblockContextDestroy( &pctx ) ) )
+  {
+    COSTELLA_ERROR( "Destroying context" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaUnblockCtx: 
+**
+**   Perform the UnBlock algorithm as CostellaUnblockMt() does, with the 
+**   scratch memory of a context, which is allocated for the first image and
+**   reused for later ones. Needs no initialization other than the creation
+**   of the context. Callers with different contexts may run at once, in 
+**   different threads, on different images.
+**
+**   pctx:  Pointer to a context created by CostellaUnblockContextCreate().
+**
+**   Other arguments are as for CostellaUnblockMt.
+*/
+
+COSTELLA_FUNCTION( CostellaUnblockCtx, ( COSTELLA_UNBLOCK_CONTEXT* pctx, 
+  COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* piOut, COSTELLA_B bPhotographic, 
+  COSTELLA_B bCartoon, COSTELLA_UD udNumThreads, COSTELLA_CALLBACK_FUNCTION
+  pfProgress, COSTELLA_O* poPassback ) )
+{
+  if( COSTELLA_CALL( CostellaUnblockSweeps( pctx, piIn, piOut, 
+    bPhotographic, bCartoon, udNumThreads, pfProgress, poPassback, 0, 
+    COSTELLA_FALSE ) ) )
+  {
+    COSTELLA_ERROR( "Unblocking" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
 
 
-  /* Check initialization and pointers.
+
+/* CostellaUnblockSweeps: 
+**
+**   Internal function that performs the three sweeps described for 
+**   CostellaUnblockMt(). 
+**
+**   aubHorizontalAdjusted:  Null, or an array of 2 * 256 bytes holding the 
+**     horizontal adjustment tables of a grayscale image, U followed by V. 
+**     This lets one chrominance channel stored in its own array share the 
+**     tables of another; see CostellaUnblockQuarter().
+**
+**   bHorizontalAdjustedGiven:  If nonzero, the tables are used in place of 
+**     those computed for the image; otherwise they are filled in.
+**
+**   Other arguments are as for CostellaUnblockMt.
+*/
+
+static COSTELLA_FUNCTION( CostellaUnblockSweeps, ( COSTELLA_UNBLOCK_CONTEXT*
+  pctx, COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* piOut, COSTELLA_B 
+  bPhotographic, COSTELLA_B bCartoon, COSTELLA_UD udNumThreads, 
+  COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* poPassback, 
+  COSTELLA_UB* aubHorizontalAdjusted, COSTELLA_B bHorizontalAdjustedGiven )
+  )
+{
+  COSTELLA_B bColor, bSmoothlyUpsampleChrominance, bInYCbCr, bOutYCbCr, 
+    bDownsample;
+  COSTELLA_UB* aubYAdjustedU, * aubYAdjustedV, * aubCbAdjustedU, 
+    * aubCbAdjustedV, * aubCrAdjustedU, * aubCrAdjustedV;
+  COSTELLA_UD udTotalLuminance, udTotalChrominance;
+  COSTELLA_UD* audYInternalU, * audYBoundaryU, * audYInternalV, 
+    * audYBoundaryV, * audCrInternalU, * audCrBoundaryU, * audCrInternalV, 
+    * audCrBoundaryV, * audCbInternalU, * audCbBoundaryU, * audCbInternalV,
+    * audCbBoundaryV;
+  COSTELLA_UD udNumBands, udBand, udRowBand;
+  COSTELLA_UNBLOCK_BAND* abnd, * pbnd;
+  COSTELLA_UNBLOCK_STATS* pstats;
+  COSTELLA_B bTimed;
+  COSTELLA_UB ubPhase, ubSweep;
+  COSTELLA_DF dfLap = 0;
+  COSTELLA_DF adfSeconds[ COSTELLA_UNBLOCK_NUM_PHASES ], adfWallSeconds[ 
+    COSTELLA_UNBLOCK_NUM_SWEEPS ], adfThreadSeconds[ 
+    COSTELLA_UNBLOCK_NUM_SWEEPS ];
+  COSTELLA_MC mcArena, mcBands = 0;
+
+
+  /* Check pointers.
   */
 
   #ifdef COSTELLA_DEBUG
   {
-    if( !gbInitialized )
+    if( !pctx )
     {
-      COSTELLA_FUNDAMENTAL_ERROR( "Initialization" );
-      COSTELLA_UNBLOCK_CLEANUP;
+      COSTELLA_FUNDAMENTAL_ERROR( "Null context" );
       COSTELLA_RETURN;
     }
 
     if( !piIn )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Null input image" );
-      COSTELLA_UNBLOCK_CLEANUP;
       COSTELLA_RETURN;
     }
 
     if( !piOut )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Null output image" );
-      COSTELLA_UNBLOCK_CLEANUP;
       COSTELLA_RETURN;
     }
   }
@@ -534,21 +1294,22 @@ COSTELLA_FUNCTION( CostellaUnblock, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE*
     if( !piIn->udWidth )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Zero width" );
-      COSTELLA_UNBLOCK_CLEANUP;
       COSTELLA_RETURN;
     }
 
     if( !piIn->udHeight )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Zero height" );
-      COSTELLA_UNBLOCK_CLEANUP;
       COSTELLA_RETURN;
     }
   }
   #endif
 
 
-  /* Extract flags.
+  /* Extract flags. If we have a color image, we are assuming that its 
+  ** chrominance channels have been downsampled, and need to downsample them
+  ** if not. Note that conversion to YCbCr keeps the downsampling flags of 
+  ** the input image.
   */
   
   if( bColor )
@@ -556,92 +1317,210 @@ COSTELLA_FUNCTION( CostellaUnblock, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE*
     bSmoothlyUpsampleChrominance = !piOut->bDownsampledChrominance;
     bInYCbCr = !piIn->bRgb;
     bOutYCbCr = !piOut->bRgb;
+    bDownsample = !piIn->bDownsampledChrominance;
   }
   else
   {
     bSmoothlyUpsampleChrominance = COSTELLA_FALSE;
     bInYCbCr = COSTELLA_FALSE;
     bOutYCbCr = COSTELLA_FALSE;
+    bDownsample = COSTELLA_FALSE;
   }
 
 
-  /* Allocate memory.
+  /* Start gathering the statistics of this call, if the context has any:
+  ** the time spent in each phase in this thread, the time of each sweep, 
+  ** and the memory taken from the heap.
+  */
+
+  pstats = pctx->pstats;
+  bTimed = pstats != 0;
+  mcArena = pctx->ar.mcAllocated;
+
+  COSTELLA_INITIALIZE_ARRAY( adfSeconds, COSTELLA_UNBLOCK_NUM_PHASES, 
+    COSTELLA_DF );
+  COSTELLA_INITIALIZE_ARRAY( adfWallSeconds, COSTELLA_UNBLOCK_NUM_SWEEPS, 
+    COSTELLA_DF );
+  COSTELLA_INITIALIZE_ARRAY( adfThreadSeconds, COSTELLA_UNBLOCK_NUM_SWEEPS,
+    COSTELLA_DF );
+
+
+  /* Release the context's arena, in case an earlier call failed before 
+  ** releasing it.
   */
 
-  if( COSTELLA_MALLOC( aubYAdjustedU, 256 ) || COSTELLA_MALLOC( 
-    aubYAdjustedV, 256 ) || COSTELLA_MALLOC( aubCbAdjustedU, 256 ) || 
-    COSTELLA_MALLOC( aubCbAdjustedV, 256 ) || COSTELLA_MALLOC( 
-    aubCrAdjustedU, 256 ) || COSTELLA_MALLOC( aubCrAdjustedV, 256 ) || 
-    COSTELLA_MALLOC( aswBufferY, 16 ) || COSTELLA_MALLOC( aswBufferCb, 16 
-    ) || COSTELLA_MALLOC( aswBufferCr, 16 ) || COSTELLA_MALLOC( 
-    audYInternalU, 256 ) || COSTELLA_MALLOC( audYBoundaryU, 256 ) || 
-    COSTELLA_MALLOC( audYInternalV, 256 ) || COSTELLA_MALLOC( 
-    audYBoundaryV, 256 ) || COSTELLA_MALLOC( audCbInternalU, 256 ) || 
-    COSTELLA_MALLOC( audCbBoundaryU, 256 ) || COSTELLA_MALLOC( 
-    audCbInternalV, 256 ) || COSTELLA_MALLOC( audCbBoundaryV, 256 ) || 
-    COSTELLA_MALLOC( audCrInternalU, 256 ) || COSTELLA_MALLOC( 
-    audCrBoundaryU, 256 ) || COSTELLA_MALLOC( audCrInternalV, 256 ) || 
-    COSTELLA_MALLOC( audCrBoundaryV, 256 ) )
+  if( COSTELLA_CALL( CostellaArenaReset( &pctx->ar ) ) )
   {
-    COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
-    COSTELLA_UNBLOCK_CLEANUP;
+    COSTELLA_ERROR( "Resetting arena" );
     COSTELLA_RETURN;
   }
 
 
-  /* If we have a color image, then we need the input image to be in YCbCr 
-  ** format. Check if we have a color input image not in YCbCr format.
+  /* Take the adjustment and frequency tables from the context, and at 
+  ** least one band, growing the context's bands if it has too few.
   */
 
-  if( bColor && !bInYCbCr )
+  if( !udNumThreads )
   {
-    /* We have a color image that is not yet in YCbCr format. Convert it 
-    ** now.
-    */
+    udNumThreads = 1;
+  }
 
-    if( COSTELLA_CALL( CostellaImageConvertRgbToYcbcr( piIn, piOut, 
-      pfProgress, poPassback ) ) )
+  aubYAdjustedU = pctx->aubAdjusted;
+  aubYAdjustedV = aubYAdjustedU + 256;
+  aubCbAdjustedU = aubYAdjustedV + 256;
+  aubCbAdjustedV = aubCbAdjustedU + 256;
+  aubCrAdjustedU = aubCbAdjustedV + 256;
+  aubCrAdjustedV = aubCrAdjustedU + 256;
+
+  audYInternalU = pctx->audFrequencies;
+  audYBoundaryU = audYInternalU + 256;
+  audYInternalV = audYBoundaryU + 256;
+  audYBoundaryV = audYInternalV + 256;
+  audCbInternalU = audYBoundaryV + 256;
+  audCbBoundaryU = audCbInternalU + 256;
+  audCbInternalV = audCbBoundaryU + 256;
+  audCbBoundaryV = audCbInternalV + 256;
+  audCrInternalU = audCbBoundaryV + 256;
+  audCrBoundaryU = audCrInternalU + 256;
+  audCrInternalV = audCrBoundaryU + 256;
+  audCrBoundaryV = audCrInternalV + 256;
+
+  if( pctx->udNumBandsAllocated < udNumThreads )
+  {
+    if( pctx->abnd && !pctx->pfFree( pctx->abnd ) )
     {
-      COSTELLA_ERROR( "Converting to YCbCr" );
-      COSTELLA_UNBLOCK_CLEANUP;
+      COSTELLA_FUNDAMENTAL_ERROR( "Freeing" );
       COSTELLA_RETURN;
     }
-  }
 
+    pctx->udNumBandsAllocated = 0;
 
-  /* If we have a color image, we are assuming that its chrominance channels
-  ** have been downsampled. Check whether that is true.
-  */
-  
-  if( bColor )
-  {
-    if( !( ( bInYCbCr ? piIn : piOut )->bDownsampledChrominance ) )
+    if( !( pctx->abnd = (COSTELLA_UNBLOCK_BAND*) pctx->pfMalloc( 
+      (COSTELLA_MC) ( udNumThreads * sizeof( COSTELLA_UNBLOCK_BAND ) ) ) ) )
     {
-      if( COSTELLA_CALL( CostellaImageChrominanceAverageDownsampleReplicate(
-        bInYCbCr ? piIn : piOut, piOut, pfProgress, poPassback ) ) )
-      {
-        COSTELLA_ERROR( "Downsampling chrominance" );
-        COSTELLA_UNBLOCK_CLEANUP;
-        COSTELLA_RETURN;
-      }
+      COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
+      COSTELLA_RETURN;
     }
+
+    pctx->udNumBandsAllocated = udNumThreads;
+    mcBands = udNumThreads * sizeof( COSTELLA_UNBLOCK_BAND );
   }
 
+  abnd = pctx->abnd;
+
 
-  /* Analyze the vertical discrepancies in the image. Note that a grayscale 
-  ** image is still contained in the input image, whereas a color image is 
-  ** in the output image.
+  /* Tell each band what to do, and whether to time it, and give it the 
+  ** adjustment tables, which are filled in before they are used.
   */
 
-  if( COSTELLA_CALL( CostellaUnblockComputeVerticalDiscrepancies( 
-    aswBufferY, aswBufferCb,aswBufferCr, audYBoundaryU, audYBoundaryV, 
-    audCbBoundaryU, audCbBoundaryV, audCrBoundaryU, audCrBoundaryV, 
-    audYInternalU, audYInternalV, audCbInternalU, audCbInternalV, 
-    audCrInternalU, audCrInternalV, &udTotalLuminance, &udTotalChrominance, 
-    bColor ? piOut :piIn, pfProgress, poPassback ) ) )
+  for( udBand = 0, pbnd = abnd; udBand < udNumThreads; udBand++, pbnd++ )
   {
-    COSTELLA_ERROR( "Computing vertical discrepancies" );
-    COSTELLA_UNBLOCK_CLEANUP;
+    pbnd->bTimed = bTimed;
+
+    COSTELLA_INITIALIZE_ARRAY( pbnd->adfSeconds, 
+      COSTELLA_UNBLOCK_NUM_PHASES, COSTELLA_DF );
+
+    pbnd->bColor = bColor;
+    pbnd->bConvert = bColor && !bInYCbCr;
+    pbnd->bDownsample = bDownsample;
+    pbnd->bReplicate = bColor && !bSmoothlyUpsampleChrominance;
+    pbnd->bConvertBack = pbnd->bReplicate && !bOutYCbCr;
+
+    pbnd->aubYAdjustedU = aubYAdjustedU;
+    pbnd->aubYAdjustedV = aubYAdjustedV;
+    pbnd->aubCbAdjustedU = aubCbAdjustedU;
+    pbnd->aubCbAdjustedV = aubCbAdjustedV;
+    pbnd->aubCrAdjustedU = aubCrAdjustedU;
+    pbnd->aubCrAdjustedV = aubCrAdjustedV;
+  }
+
+
+  /* Split the image into bands of rows for the first two sweeps.
+  */
+
+  if( COSTELLA_CALL( CostellaUnblockSplitBands( piIn, piOut, udNumThreads,
+    abnd, &udNumBands ) ) )
+  {
+    COSTELLA_ERROR( "Splitting into bands" );
+    COSTELLA_RETURN;
+  }
+
+
+
+  /* First sweep: convert and downsample the image, if necessary, and 
+  ** analyze its vertical discrepancies, each band in its own thread.
+  */
+
+  if( COSTELLA_CALL( CostellaThreadRun( CostellaUnblockFirstSweep, abnd, 
+    sizeof( COSTELLA_UNBLOCK_BAND ), udNumBands, &pctx->ar, bTimed ? 
+    &adfWallSeconds[ COSTELLA_UNBLOCK_SWEEP_FIRST ] : 0, bTimed ? 
+    &adfThreadSeconds[ COSTELLA_UNBLOCK_SWEEP_FIRST ] : 0 ) ) )
+  {
+    COSTELLA_ERROR( "Computing vertical discrepancies of bands" );
+    COSTELLA_RETURN;
+  }
+
+  dfLap = bTimed ? costella_thread_seconds() : 0;
+
+
+  /* Record in the output image what the first sweep has done to it, as the
+  ** whole-image conversion and downsampling functions would have.
+  */
+
+  if( bColor && !bInYCbCr )
+  {
+    piOut->bRgb = COSTELLA_FALSE;
+    piOut->bDownsampledChrominance = piIn->bDownsampledChrominance;
+    piOut->bNonreplicatedDownsampledChrominance = 
+      piIn->bNonreplicatedDownsampledChrominance;
+  }
+
+  if( bDownsample )
+  {
+    piOut->bRgb = COSTELLA_FALSE;
+    piOut->bDownsampledChrominance = COSTELLA_TRUE;
+    piOut->bNonreplicatedDownsampledChrominance = COSTELLA_FALSE;
+  }
+
+
+  /* Merge the frequency tables and totals of the bands.
+  */
+
+  COSTELLA_INITIALIZE_ARRAY( audYBoundaryU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audYBoundaryV, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audYInternalU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audYInternalV, 256, COSTELLA_UD );
+
+  COSTELLA_INITIALIZE_ARRAY( audCbBoundaryU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audCbBoundaryV, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audCbInternalU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audCbInternalV, 256, COSTELLA_UD );
+
+  COSTELLA_INITIALIZE_ARRAY( audCrBoundaryU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audCrBoundaryV, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audCrInternalU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audCrInternalV, 256, COSTELLA_UD );
+
+  udTotalLuminance = 0;
+  udTotalChrominance = 0;
+
+  if( COSTELLA_CALL( CostellaUnblockMergeBands( abnd, udNumBands, bColor, 
+    audYBoundaryU, audYBoundaryV, audCbBoundaryU, audCbBoundaryV, 
+    audCrBoundaryU, audCrBoundaryV, audYInternalU, audYInternalV, 
+    audCbInternalU, audCbInternalV, audCrInternalU, audCrInternalV, 
+    &udTotalLuminance, &udTotalChrominance ) ) )
+  {
+    COSTELLA_ERROR( "Merging vertical frequencies" );
+    COSTELLA_RETURN;
+  }
+
+
+  /* Progress callback.
+  */
+
+  if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
+  {
+    COSTELLA_ERROR( "Progress callback" );
     COSTELLA_RETURN;
   }
 
@@ -656,7 +1535,6 @@ COSTELLA_FUNCTION( CostellaUnblock, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE*
     ) ) )
   {
     COSTELLA_ERROR( "Computing vertical Y adjustments" );
-    COSTELLA_UNBLOCK_CLEANUP;
     COSTELLA_RETURN;
   }
 
@@ -669,7 +1547,6 @@ COSTELLA_FUNCTION( CostellaUnblock, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE*
       udTotalChrominance, bPhotographic, bCartoon, aubCbAdjustedV ) ) ) 
     {
       COSTELLA_ERROR( "Computing vertical Cb adjustments" );
-      COSTELLA_UNBLOCK_CLEANUP;
       COSTELLA_RETURN;
     }
 
@@ -680,11 +1557,13 @@ COSTELLA_FUNCTION( CostellaUnblock, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE*
       udTotalChrominance, bPhotographic, bCartoon, aubCrAdjustedV ) ) )
     {
       COSTELLA_ERROR( "Computing vertical Cr adjustments" );
-      COSTELLA_UNBLOCK_CLEANUP;
       COSTELLA_RETURN;
     }
   }
 
+  costella_unblock_lap( bTimed, adfSeconds, 
+    COSTELLA_UNBLOCK_PHASE_VERTICAL_COMPUTE, &dfLap );
+
 
   /* Progress callback.
   */
@@ -692,7 +1571,6 @@ COSTELLA_FUNCTION( CostellaUnblock, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE*
   if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
   {
     COSTELLA_ERROR( "Progress callback" );
-    COSTELLA_UNBLOCK_CLEANUP;
     COSTELLA_RETURN;
   }
 
@@ -712,34 +1590,82 @@ COSTELLA_FUNCTION( CostellaUnblock, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE*
   #endif
 
 
-  /* Correct the vertical discrepancies. Note that a grayscale image is 
-  ** still in the input image, whereas a color image is in the output image.
+  /* Second sweep: correct the vertical discrepancies, and analyze the 
+  ** horizontal discrepancies, each band in its own thread.
   */
 
-  if( COSTELLA_CALL( CostellaUnblockCorrectVerticalDiscrepancies( 
-    aswBufferY, aswBufferCb, aswBufferCr, aubYAdjustedU, aubYAdjustedV, 
-    aubCbAdjustedU, aubCbAdjustedV, aubCrAdjustedU, aubCrAdjustedV, bColor ?
-    piOut : piIn, piOut, pfProgress, poPassback ) ) )
+  if( COSTELLA_CALL( CostellaThreadRun( CostellaUnblockSecondSweep, abnd, 
+    sizeof( COSTELLA_UNBLOCK_BAND ), udNumBands, &pctx->ar, bTimed ? 
+    &adfWallSeconds[ COSTELLA_UNBLOCK_SWEEP_SECOND ] : 0, bTimed ? 
+    &adfThreadSeconds[ COSTELLA_UNBLOCK_SWEEP_SECOND ] : 0 ) ) )
   {
-    COSTELLA_ERROR( "Correcting vertical discrepancies" );
-    COSTELLA_UNBLOCK_CLEANUP;
+    COSTELLA_ERROR( "Correcting vertical discrepancies of bands" );
     COSTELLA_RETURN;
   }
 
+  dfLap = bTimed ? costella_thread_seconds() : 0;
+
 
-  /* Compute the horizontal discrepancies. The image is now in the output
-  ** image, regardless of type.
+  /* Merge the frequency tables and totals of the bands.
   */
-  
-  if( COSTELLA_CALL( CostellaUnblockComputeHorizontalDiscrepancies( 
-    aswBufferY, aswBufferCb, aswBufferCb, audYBoundaryU, audYBoundaryV, 
-    audCbBoundaryU, audCbBoundaryV, audCrBoundaryU, audCrBoundaryV, 
-    audYInternalU, audYInternalV, audCbInternalU, audCbInternalV, 
-    audCrInternalU, audCrInternalV, &udTotalLuminance, &udTotalChrominance, 
-    piOut, pfProgress, poPassback ) ) )
-  {
-    COSTELLA_ERROR( "Computing horizontal discrepancies" );
-    COSTELLA_UNBLOCK_CLEANUP;
+
+  COSTELLA_INITIALIZE_ARRAY( audYBoundaryU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audYBoundaryV, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audYInternalU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audYInternalV, 256, COSTELLA_UD );
+
+  COSTELLA_INITIALIZE_ARRAY( audCbBoundaryU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audCbBoundaryV, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audCbInternalU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audCbInternalV, 256, COSTELLA_UD );
+
+  COSTELLA_INITIALIZE_ARRAY( audCrBoundaryU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audCrBoundaryV, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audCrInternalU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audCrInternalV, 256, COSTELLA_UD );
+
+  udTotalLuminance = 0;
+  udTotalChrominance = 0;
+
+  if( COSTELLA_CALL( CostellaUnblockMergeBands( abnd, udNumBands, bColor, 
+    audYBoundaryU, audYBoundaryV, audCbBoundaryU, audCbBoundaryV, 
+    audCrBoundaryU, audCrBoundaryV, audYInternalU, audYInternalV, 
+    audCbInternalU, audCbInternalV, audCrInternalU, audCrInternalV, 
+    &udTotalLuminance, &udTotalChrominance ) ) )
+  {
+    COSTELLA_ERROR( "Merging horizontal frequencies" );
+    COSTELLA_RETURN;
+  }
+
+
+  /* Analyze the horizontal boundary at the top of each band but the first,
+  ** which needs the corrected rows of the band above it. The image is now 
+  ** in the output image, regardless of type.
+  */
+
+  for( udBand = 1, udRowBand = abnd->iOut.udHeight, pbnd = abnd + 1; udBand
+    < udNumBands; udBand++, udRowBand += pbnd->iOut.udHeight, pbnd++ )
+  {
+    if( COSTELLA_CALL( CostellaUnblockComputeHorizontalDiscrepancies( 
+      abnd->aswBufferY, abnd->aswBufferCb, abnd->aswBufferCb, 
+      abnd->audLanes, audYBoundaryU, audYBoundaryV, audCbBoundaryU, 
+      audCbBoundaryV, audCrBoundaryU, audCrBoundaryV, audYInternalU, 
+      audYInternalV, audCbInternalU, audCbInternalV, audCrInternalU, 
+      audCrInternalV, &udTotalLuminance, &udTotalChrominance, piOut, 
+      udRowBand, udRowBand + 1, 0, 0 ) ) )
+    {
+      COSTELLA_ERROR( "Computing horizontal discrepancies between bands" );
+      COSTELLA_RETURN;
+    }
+  }
+
+
+  /* Progress callback.
+  */
+
+  if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
+  {
+    COSTELLA_ERROR( "Progress callback" );
     COSTELLA_RETURN;
   }
 
@@ -754,10 +1680,23 @@ COSTELLA_FUNCTION( CostellaUnblock, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE*
     ) ) )
   {
     COSTELLA_ERROR( "Computing Y horizontal adjustments" );
-    COSTELLA_UNBLOCK_CLEANUP;
     COSTELLA_RETURN;
   }
 
+  if( aubHorizontalAdjusted )
+  {
+    if( bHorizontalAdjustedGiven )
+    {
+      memcpy( aubYAdjustedU, aubHorizontalAdjusted, 256 );
+      memcpy( aubYAdjustedV, aubHorizontalAdjusted + 256, 256 );
+    }
+    else
+    {
+      memcpy( aubHorizontalAdjusted, aubYAdjustedU, 256 );
+      memcpy( aubHorizontalAdjusted + 256, aubYAdjustedV, 256 );
+    }
+  }
+
   if( bColor )
   {
     if( COSTELLA_CALL( CostellaUnblockComputeAdjustments( audCbInternalU, 
@@ -767,7 +1706,6 @@ COSTELLA_FUNCTION( CostellaUnblock, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE*
       udTotalChrominance, bPhotographic, bCartoon, aubCbAdjustedV ) ) )
     {
       COSTELLA_ERROR( "Computing Cb horizontal adjustments" );
-      COSTELLA_UNBLOCK_CLEANUP;
       COSTELLA_RETURN;
     }
 
@@ -778,11 +1716,13 @@ COSTELLA_FUNCTION( CostellaUnblock, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE*
       udTotalChrominance, bPhotographic, bCartoon, aubCrAdjustedV ) ) )
     {
       COSTELLA_ERROR( "Computing Cr horizontal adjustments" );
-      COSTELLA_UNBLOCK_CLEANUP;
       COSTELLA_RETURN;
     }
   }
 
+  costella_unblock_lap( bTimed, adfSeconds, 
+    COSTELLA_UNBLOCK_PHASE_HORIZONTAL_COMPUTE, &dfLap );
+
 
   /* Progress callback.
   */
@@ -790,7 +1730,6 @@ COSTELLA_FUNCTION( CostellaUnblock, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE*
   if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
   {
     COSTELLA_ERROR( "Progress callback" );
-    COSTELLA_UNBLOCK_CLEANUP;
     COSTELLA_RETURN;
   }
 
@@ -809,17 +1748,36 @@ COSTELLA_FUNCTION( CostellaUnblock, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE*
   #endif
 
 
-  /* Correct the horizontal boundary discrepancies. All images are now 
-  ** contained in the output image, regardless of type.
+  /* Third sweep: correct the horizontal discrepancies, each band of columns
+  ** in its own thread. Unless we want to smoothly upsample the chrominance,
+  ** which needs the neighbouring rows and columns of each pixel, the bands 
+  ** also replicate the chrominance and convert back to RGB as they go. All 
+  ** images are now contained in the output image, regardless of type.
   */
 
-  if( COSTELLA_CALL( CostellaUnblockCorrectHorizontalDiscrepancies( 
-    aswBufferY, aswBufferCb, aswBufferCr, aubYAdjustedU, aubYAdjustedV, 
-    aubCbAdjustedU, aubCbAdjustedV, aubCrAdjustedU, aubCrAdjustedV, piOut, 
-    piOut, pfProgress, poPassback ) ) )
+  if( COSTELLA_CALL( CostellaUnblockSplitColumns( piOut, udNumThreads, 
+    abnd, &udNumBands ) ) )
   {
-    COSTELLA_ERROR( "Correcting horizontal discrepancies" );
-    COSTELLA_UNBLOCK_CLEANUP;
+    COSTELLA_ERROR( "Splitting into bands of columns" );
+    COSTELLA_RETURN;
+  }
+
+  if( COSTELLA_CALL( CostellaThreadRun( CostellaUnblockThirdSweep, abnd, 
+    sizeof( COSTELLA_UNBLOCK_BAND ), udNumBands, &pctx->ar, bTimed ? 
+    &adfWallSeconds[ COSTELLA_UNBLOCK_SWEEP_THIRD ] : 0, bTimed ? 
+    &adfThreadSeconds[ COSTELLA_UNBLOCK_SWEEP_THIRD ] : 0 ) ) )
+  {
+    COSTELLA_ERROR( "Correcting horizontal discrepancies of bands" );
+    COSTELLA_RETURN;
+  }
+
+
+  /* Progress callback.
+  */
+
+  if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
+  {
+    COSTELLA_ERROR( "Progress callback" );
     COSTELLA_RETURN;
   }
 
@@ -840,2300 +1798,5700 @@ COSTELLA_FUNCTION( CostellaUnblock, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE*
       /* We want to upsample the chrominance. Do it.
       */
 
+      dfLap = bTimed ? costella_thread_seconds() : 0;
+
       if( COSTELLA_CALL( CostellaImageChrominanceMagicUpsample( piOut, 
-        piOut, pfProgress, poPassback ) ) )
+        piOut, &pctx->ar, pfProgress, poPassback ) ) )
       {
         COSTELLA_ERROR( "Upsampling chrominance" );
-        COSTELLA_UNBLOCK_CLEANUP;
         COSTELLA_RETURN;
       }
-    }
-    else
-    {
-      /* We don't want to upsample the chrominance. However, in the above we
-      ** have only stored the chrominance values in the top-left pixels of
-      ** the 2 x 2 blocks. We need to replicate these into the other three
-      ** positions in each 2 x 2 block.
+
+      costella_unblock_lap( bTimed, adfSeconds, 
+        COSTELLA_UNBLOCK_PHASE_UPSAMPLE, &dfLap );
+
+
+      /* Check if we want our output in RGB space. If so, convert it.
       */
 
-      if( COSTELLA_CALL( CostellaImageChrominanceReplicateEq( piOut, 
-        pfProgress, poPassback ) ) )
+      if( !bOutYCbCr && COSTELLA_CALL( CostellaImageConvertYcbcrToRgb( 
+        piOut, piOut, pfProgress, poPassback ) ) ) 
       {
-        COSTELLA_ERROR( "Replicating chrominance" );
-        COSTELLA_UNBLOCK_CLEANUP;
+        COSTELLA_ERROR( "Converting to RGB" );
         COSTELLA_RETURN;
       }
-    }
-
 
-    /* Check if we want our output in RGB space.
-    */
-
-    if( !bOutYCbCr )
+      costella_unblock_lap( bTimed, adfSeconds, 
+        COSTELLA_UNBLOCK_PHASE_YCBCR_TO_RGB, &dfLap );
+    }
+    else
     {
-      /* We want the output to be in RGB space. Convert it.
+      /* The bands have replicated the chrominance, and converted it to RGB
+      ** if required. Record this in the output image.
       */
 
-      if( COSTELLA_CALL( CostellaImageConvertYcbcrToRgb( piOut, piOut, 
-        pfProgress, poPassback ) ) ) 
+      piOut->bNonreplicatedDownsampledChrominance = COSTELLA_FALSE;
+
+      if( !bOutYCbCr )
       {
-        COSTELLA_ERROR( "Converting to RGB" );
-        COSTELLA_UNBLOCK_CLEANUP;
-        COSTELLA_RETURN;
+        piOut->bRgb = COSTELLA_TRUE;
       }
     }
   }
 
 
-  /* Clean up.
+  /* Release the arena. If this call overflowed it, it grows to fit, so 
+  ** that the next call of this size allocates nothing from the heap.
   */
 
-  if( COSTELLA_FREE( aubYAdjustedU ) || COSTELLA_FREE( aubYAdjustedV ) || 
-    COSTELLA_FREE( aubCbAdjustedU ) || COSTELLA_FREE( aubCbAdjustedV ) || 
-    COSTELLA_FREE( aubCrAdjustedU ) || COSTELLA_FREE( aubCrAdjustedV ) || 
-    COSTELLA_FREE( aswBufferY ) || COSTELLA_FREE( aswBufferCb ) || 
-    COSTELLA_FREE( aswBufferCr ) || COSTELLA_FREE( audYInternalU ) || 
-    COSTELLA_FREE( audYBoundaryU ) || COSTELLA_FREE( audYInternalV ) || 
-    COSTELLA_FREE( audYBoundaryV ) || COSTELLA_FREE( audCbInternalU ) || 
-    COSTELLA_FREE( audCbBoundaryU ) || COSTELLA_FREE( audCbInternalV ) || 
-    COSTELLA_FREE( audCbBoundaryV ) || COSTELLA_FREE( audCrInternalU ) || 
-    COSTELLA_FREE( audCrBoundaryU ) || COSTELLA_FREE( audCrInternalV ) || 
-    COSTELLA_FREE( audCrBoundaryV ) ) 
+  if( COSTELLA_CALL( CostellaArenaReset( &pctx->ar ) ) )
   {
-    COSTELLA_FUNDAMENTAL_ERROR( "Freeing" );
+    COSTELLA_ERROR( "Resetting arena" );
     COSTELLA_RETURN;
   }
+
+
+  /* Add the statistics of this call and its bands to those of the context.
+  */
+
+  if( pstats )
+  {
+    for( udBand = 0, pbnd = abnd; udBand < udNumThreads; udBand++, pbnd++ )
+    {
+      for( ubPhase = 0; ubPhase < COSTELLA_UNBLOCK_NUM_PHASES; ubPhase++ )
+      {
+        adfSeconds[ ubPhase ] += pbnd->adfSeconds[ ubPhase ];
+      }
+    }
+
+    for( ubPhase = 0; ubPhase < COSTELLA_UNBLOCK_NUM_PHASES; ubPhase++ )
+    {
+      pstats->adfSeconds[ ubPhase ] += adfSeconds[ ubPhase ];
+    }
+
+    for( ubSweep = 0; ubSweep < COSTELLA_UNBLOCK_NUM_SWEEPS; ubSweep++ )
+    {
+      pstats->adfSweepWallSeconds[ ubSweep ] += adfWallSeconds[ ubSweep ];
+      pstats->adfSweepThreadSeconds[ ubSweep ] += adfThreadSeconds[ ubSweep
+        ];
+    }
+
+    pstats->udBytesAllocated += (unsigned long) ( mcBands + 
+      pctx->ar.mcAllocated - mcArena );
+  }
 }
 COSTELLA_END_FUNCTION
 
 
 
-/* CostellaUnblockComputeVerticalDiscrepancies: 
-**
-**   Internal function that computes the vertical discrepancies in an image.
-**
-**   aswBuffer{Y,Cb,Cr}:  Buffer for the {Y,Cb,Cr} channel.
+/* CostellaUnblockQuarter: 
 **
-**   aud{Y,Cb,Cr}{Boundary,Internal}{U,V}:  Array to hold the frequencies 
-**     for the {U,V} discrepancies {at block boundaries, internal to each
-**     block} for the {Y,Cb,Cr} channel.
+**   Perform the UnBlock algorithm as CostellaUnblockCtx() does, on a color 
+**   image whose chrominance is stored in quarter-size arrays, as described
+**   for COSTELLA_IMAGE. This is the only function that accepts that layout,
+**   so that a caller must ask for it explicitly. The analysis and 
+**   correction of a downsampled chrominance channel are those of a 
+**   grayscale image of half the width and height: its blocks are 8 x 8 
+**   downsampled pixels, counted only if they have a boundary to their 
+**   right or below. Each channel is therefore processed as a grayscale 
+**   image, touching only the pixels that hold data. 
 **
-**   pudTotal{Luminance,Chrominance}:  Pointer to a COSTELLA_UD, into 
-**     which will be written the sum of all the {luminance,chrominance} 
-**     values of the image.
+**   The one exception is that the analysis of the horizontal boundaries 
+**   fills the Cb and Cr values into the same buffer, so that the Cb 
+**   horizontal adjustment tables are those of the Cr channel. The Cr 
+**   channel is processed first and its tables given to the Cb channel, so
+**   that the results are identical to those for chrominance stored in the
+**   top-left pixel of each 2 x 2 block.
 **
-**   pi:  Pointer to the image to be analyzed.
+**   Arguments are as for CostellaUnblockCtx. The input image must be in 
+**   YCbCr format with nonreplicated downsampled chrominance, and the output
+**   image is taken to have quarter-size chrominance too.
 */
 
-static COSTELLA_FUNCTION( CostellaUnblockComputeVerticalDiscrepancies, ( 
-  COSTELLA_SW* aswBufferY, COSTELLA_SW* aswBufferCb, COSTELLA_SW* 
-  aswBufferCr, COSTELLA_UD* audYBoundaryU, COSTELLA_UD* audYBoundaryV, 
-  COSTELLA_UD* audCbBoundaryU, COSTELLA_UD* audCbBoundaryV, COSTELLA_UD* 
-  audCrBoundaryU, COSTELLA_UD* audCrBoundaryV, COSTELLA_UD* audYInternalU, 
-  COSTELLA_UD* audYInternalV, COSTELLA_UD* audCbInternalU, COSTELLA_UD* 
-  audCbInternalV, COSTELLA_UD* audCrInternalU, COSTELLA_UD* audCrInternalV, 
-  COSTELLA_UD* pudTotalLuminance, COSTELLA_UD* pudTotalChrominance, 
-  COSTELLA_IMAGE* pi, COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* 
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+
+COSTELLA_FUNCTION( CostellaUnblockQuarter, ( 
+  COSTELLA_UNBLOCK_CONTEXT* pctx, COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* 
+  piOut, COSTELLA_B bPhotographic, COSTELLA_B bCartoon, COSTELLA_UD 
+  udNumThreads, COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* 
   poPassback ) )
 {
-  COSTELLA_B bColor;
-  COSTELLA_UB ubPosition;
-  COSTELLA_SW swYBoundaryU, swYBoundaryV, swYInternalU, swYInternalV, 
-    swCbBoundaryU, swCbBoundaryV, swCbInternalU, swCbInternalV, 
-    swCrBoundaryU, swCrBoundaryV, swCrInternalU, swCrInternalV;
-  COSTELLA_SW* pswBufferY, * pswBufferYOld, * pswBufferCb, * pswBufferCr, 
-    * pswBufferCbOld, * pswBufferCrOld;
-  COSTELLA_SD sdRowStride, sdDoubleRowStride;
-  COSTELLA_UD udWidth, udHeight, udRow, udColumn, udColumnRight, 
-    udTotalLuminance, udTotalChrominance;
-  COSTELLA_IMAGE_GRAY* pig;
-  COSTELLA_IMAGE_COLOR* pic;
-  COSTELLA_IMAGE_COLOR_PIXEL icp={0}, icpStart={0};
-  COSTELLA_IMAGE_GRAY_PIXEL igp=NULL, igpStart=NULL;
+  COSTELLA_UB ubStep, ubChannel;
+  COSTELLA_UB aubCrAdjusted[ 2 * 256 ];
+  COSTELLA_IMAGE iIn, iOut;
 
 
-  /* Extract information.
+  /* Check pointers.
   */
 
-  bColor = pi->bColor;
+  #ifdef COSTELLA_DEBUG
+  {
+    if( !pctx || !piIn || !piOut )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Null pointer" );
+      COSTELLA_RETURN;
+    }
+  }
+  #endif
 
-  udWidth = pi->udWidth;
-  udHeight = pi->udHeight;
 
-  sdRowStride = pi->sdRowStride;
+  /* Check the formats of the images.
+  */
 
-  pig = &pi->ig;
-  pic = &pi->ic;
+  if( !piIn->bColor || piIn->bRgb || !piIn->bDownsampledChrominance || 
+    !piIn->bNonreplicatedDownsampledChrominance )
+  {
+    COSTELLA_FUNDAMENTAL_ERROR( "Quarter-size chrominance not in YCbCr "
+      "format with nonreplicated downsampled chrominance" );
+    COSTELLA_RETURN;
+  }
+
+  if( !piOut->bColor )
+  {
+    COSTELLA_FUNDAMENTAL_ERROR( "Output image not color" );
+    COSTELLA_RETURN;
+  }
 
 
-  /* Compute double the row stride.
+  /* Process the Y, Cr and Cb channels in turn.
   */
 
-  sdDoubleRowStride = sdRowStride << 1;
+  for( ubStep = 0; ubStep < 3; ubStep++ )
+  {
+    ubChannel = ubStep ? 3 - ubStep : 0;
+
+    if( COSTELLA_CALL( CostellaUnblockQuarterChannel( piIn, ubChannel, 
+      &iIn ) ) || COSTELLA_CALL( CostellaUnblockQuarterChannel( piOut, 
+      ubChannel, &iOut ) ) || COSTELLA_CALL( CostellaUnblockSweeps( pctx, 
+      &iIn, &iOut, bPhotographic, bCartoon, udNumThreads, pfProgress, 
+      poPassback, ubChannel ? aubCrAdjusted : 0, ubChannel == 1 ) ) )
+    {
+      COSTELLA_ERROR( "Unblocking channel" );
+      COSTELLA_RETURN;
+    }
+  }
 
 
-  /* Initialize totals.
+  /* The output image has the same format as the input image.
   */
 
-  udTotalLuminance = 0;
-  udTotalChrominance = 0;
-
+  piOut->bRgb = COSTELLA_FALSE;
+  piOut->bDownsampledChrominance = COSTELLA_TRUE;
+  piOut->bNonreplicatedDownsampledChrominance = COSTELLA_TRUE;
+}
+COSTELLA_END_FUNCTION
 
-  /* Start by initializing the frequency tables.
-  */
+#endif
 
-  COSTELLA_INITIALIZE_ARRAY( audYBoundaryU, 256, COSTELLA_UD );
-  COSTELLA_INITIALIZE_ARRAY( audYBoundaryV, 256, COSTELLA_UD );
 
-  COSTELLA_INITIALIZE_ARRAY( audYInternalU, 256, COSTELLA_UD );
-  COSTELLA_INITIALIZE_ARRAY( audYInternalV, 256, COSTELLA_UD );
 
-  if( bColor )
-  {
-    COSTELLA_INITIALIZE_ARRAY( audCbBoundaryU, 256, COSTELLA_UD );
-    COSTELLA_INITIALIZE_ARRAY( audCbBoundaryV, 256, COSTELLA_UD );
+/* CostellaUnblockQuarterChannel: 
+**
+**   Internal function that sets up a grayscale image that refers to one 
+**   channel of a color image with quarter-size chrominance arrays.
+**
+**   pi:  Pointer to the color image.
+**
+**   ubChannel:  0, 1 or 2 for the Y, Cb or Cr channel.
+**
+**   piChannel:  Pointer to the image to be set up.
+*/
 
-    COSTELLA_INITIALIZE_ARRAY( audCrBoundaryU, 256, COSTELLA_UD );
-    COSTELLA_INITIALIZE_ARRAY( audCrBoundaryV, 256, COSTELLA_UD );
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
 
-    COSTELLA_INITIALIZE_ARRAY( audCbInternalU, 256, COSTELLA_UD );
-    COSTELLA_INITIALIZE_ARRAY( audCbInternalV, 256, COSTELLA_UD );
+static COSTELLA_FUNCTION( CostellaUnblockQuarterChannel, ( COSTELLA_IMAGE* 
+  pi, COSTELLA_UB ubChannel, COSTELLA_IMAGE* piChannel ) )
+{
+  /* Copy the description of the image, as a grayscale image.
+  */
 
-    COSTELLA_INITIALIZE_ARRAY( audCrInternalU, 256, COSTELLA_UD );
-    COSTELLA_INITIALIZE_ARRAY( audCrInternalV, 256, COSTELLA_UD );
-  }
+  *piChannel = *pi;
+  piChannel->bColor = COSTELLA_FALSE;
+  piChannel->bRgb = COSTELLA_FALSE;
+  piChannel->bDownsampledChrominance = COSTELLA_FALSE;
+  piChannel->bNonreplicatedDownsampledChrominance = COSTELLA_FALSE;
 
 
-  /* First we analyze the luminance channel. Start at top-left of image.
+  /* The luminance is the size of the image, and keeps any alpha channel.
   */
 
-  if( bColor )
-  {
-    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpStart, *pic, udWidth, 
-      udHeight, sdRowStride );
-  }
-  else
+  if( !ubChannel )
   {
-    COSTELLA_IMAGE_GRAY_PIXEL_SET_TOP_LEFT( igpStart, *pig, udWidth, 
-      udHeight, sdRowStride );
+    piChannel->ig = COSTELLA_IMAGE_COLOR_R_Y_GRAY( pi->ic );
+    COSTELLA_RETURN;
   }
 
-    
-  /* Walk through the rows of the image.
+
+  /* A chrominance array is half the width and height, rounded up.
   */
 
-  for( udRow = 0; udRow < udHeight; udRow++ )
-  {
-    /* Progress callback.
-    */
+  piChannel->bAlpha = COSTELLA_FALSE;
+  piChannel->udWidth = ( pi->udWidth + 1 ) >> 1;
+  piChannel->udHeight = ( pi->udHeight + 1 ) >> 1;
+  piChannel->sdRowStride = pi->sdChrominanceRowStride;
+  piChannel->ig = ubChannel == 1 ? COSTELLA_IMAGE_COLOR_G_CB_GRAY( pi->ic )
+    : COSTELLA_IMAGE_COLOR_B_CR_GRAY( pi->ic );
+}
+COSTELLA_END_FUNCTION
 
-    if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
-    {
-      COSTELLA_ERROR( "Progress callback" );
-      COSTELLA_RETURN;
-    }
+#endif
 
 
-    /* Start off at the pixel to the right of the leftmost pixel of this 
-    ** row, i.e., at x = 1, where the leftmost pixel is x = 0. 
-    */
 
-    if( bColor )
-    {
-      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpStart, icp );
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icp );
-    }
-    else
-    {
-      COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpStart, igp );
-      COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igp );
-    }
+/* CostellaUnblockStream: 
+**
+**   Perform the UnBlock algorithm on an image that is read and written a 
+**   few rows at a time, so that memory use is proportional to the width of
+**   the image rather than its area. The image is read three times, once 
+**   for each of the sweeps described for CostellaUnblockMt(), 16 rows at a
+**   time into a window that also holds the 16 rows above them. The first
+**   sweep analyzes the vertical discrepancies; the second corrects them and
+**   analyzes the horizontal discrepancies; the third corrects both, and 
+**   writes out the rows above the window as they are finished. The output 
+**   is identical to that of CostellaUnblock().
+**
+**   piWindow:  Pointer to an image of the width of the image to be 
+**     processed, and at least COSTELLA_UNBLOCK_STREAM_ROWS rows, that is 
+**     used as the window. Its flags describe the image to be processed, 
+**     which must be in YCbCr format if it is a color image; its chrominance
+**     is treated as downsampled and nonreplicated, and is replicated in the
+**     output.
+**
+**   udHeight:  Number of rows in the image to be processed.
+**
+**   pfRead:  Callback function that reads rows of the image. It is passed 
+**     a pointer to a COSTELLA_UNBLOCK_ROWS, whose image is the part of the 
+**     window into which rows are to be read, starting at the row 
+**     udRowFirst of the image to be processed.
+**
+**   poReadPassback:  Passback object for pfRead.
+**
+**   pfWrite:  Callback function that writes rows of the output image. It 
+**     is passed a pointer to a COSTELLA_UNBLOCK_ROWS, as for pfRead.
+**
+**   poWritePassback:  Passback object for pfWrite.
+**
+**   pstats:  Null, or pointer to the statistics to which this call adds, 
+**     as a context's calls add to those of CostellaUnblockContextStats().
+**     The time spent in the callbacks is left out of the phases, but not 
+**     out of the sweeps.
+**
+**   Other arguments are as for CostellaUnblock.
+*/
 
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
 
-    /* We start off by filling positions 8 and 9 of the values array from 
-    ** the x = 1 and x = 2 columns of this image. These will be shifted back
-    ** to the start of the values array in the first step below.
-    **
-    ** Switch on image type.
-    */
+COSTELLA_FUNCTION( CostellaUnblockStream, ( COSTELLA_IMAGE* piWindow, 
+  COSTELLA_UD udHeight, COSTELLA_B bPhotographic, COSTELLA_B bCartoon, 
+  COSTELLA_FUNCTION_POINTER( pfRead, ( COSTELLA_O* poPassback, COSTELLA_O* 
+  po ) ), COSTELLA_O* poReadPassback, COSTELLA_FUNCTION_POINTER( pfWrite, (
+  COSTELLA_O* poPassback, COSTELLA_O* po ) ), COSTELLA_O* poWritePassback, 
+  COSTELLA_UNBLOCK_STATS* pstats ) )
+{
+  COSTELLA_B bColor, bLast, bTimed;
+  COSTELLA_UB ubSweep, ubPhase;
+  COSTELLA_DF dfLap = 0, dfSweep = 0;
+  COSTELLA_DF adfSeconds[ COSTELLA_UNBLOCK_NUM_PHASES ], adfSweepSeconds[ 
+    COSTELLA_UNBLOCK_NUM_SWEEPS ];
+  COSTELLA_UD udRowFirst, udNumRows, udRowWindow, udRowBoundaryFirst, 
+    udRowBoundaryEnd = 0;
+  COSTELLA_IMAGE iWindow, iView;
+  COSTELLA_UNBLOCK_ROWS r;
+  COSTELLA_UB* aubVertical = 0, * aubHorizontal = 0;
+  COSTELLA_UNBLOCK_BAND* pbnd = 0;
+
+
+  /* Check pointers and the window.
+  */
 
-    if( bColor )
+  #ifdef COSTELLA_DEBUG
+  {
+    if( !piWindow || !pfRead || !pfWrite )
     {
-      for( ubPosition = 0, pswBufferY = aswBufferY + 8; ubPosition < 2; 
-        ubPosition++, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icp ) )
-      {
-        *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( 
-          icp );
-      }
+      COSTELLA_FUNDAMENTAL_ERROR( "Null pointer" );
+      COSTELLA_RETURN;
     }
-    else
+
+    if( piWindow->udHeight < COSTELLA_UNBLOCK_STREAM_ROWS )
     {
-      for( ubPosition = 0, pswBufferY = aswBufferY + 8; ubPosition < 2; 
-        ubPosition++, COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igp ) )
-      {
-        *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( igp 
-          ); 
-        }
+      COSTELLA_FUNDAMENTAL_ERROR( "Window too small" );
+      COSTELLA_RETURN;
     }
 
-
-    /* Walk through the vertical boundaries. We only measure discrepancies 
-    ** for a block if it has a right boundary, i.e., at least one pixel to 
-    ** its right; this ensures that the total counts for internal and 
-    ** boundary discrepancies will be identically equal. We ensure this by
-    ** checking if the column that is eight pixels to the right of our block
-    ** is within the image.
-    */
-
-    for( udColumnRight = 8; udColumnRight < udWidth; udColumnRight += 8 )
+    if( piWindow->bColor && piWindow->bRgb )
     {
-      /* Get the first two pixels from what is already in the array. 
-      */
+      COSTELLA_FUNDAMENTAL_ERROR( "Window not in YCbCr format" );
+      COSTELLA_RETURN;
+    }
+  }
+  #endif
 
-      for( ubPosition = 0, pswBufferY = aswBufferY, pswBufferYOld = 
-        aswBufferY + 8; ubPosition < 2; ubPosition++ )
-      {
-        *pswBufferY++ = *pswBufferYOld++;
-      }
 
+  /* Allocate memory. The vertical and horizontal adjustment tables are 
+  ** both needed in the last sweep; each set holds the six tables of 
+  ** CostellaUnblockComputeBandAdjustments(). A single band holds the 
+  ** buffers and the frequency tables.
+  */
 
-      /* Extract the next eight pixels from the image. Need to make sure 
-      ** that we don't go past the right edge of the image. Switch on image 
-      ** type.
-      */
+  if( COSTELLA_MALLOC( aubVertical, 6 * 256 ) || COSTELLA_MALLOC( 
+    aubHorizontal, 6 * 256 ) || COSTELLA_MALLOC( pbnd, 1 ) )
+  {
+    COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
+    COSTELLA_UNBLOCK_STREAM_CLEANUP;
+    COSTELLA_RETURN;
+  }
 
-      if( bColor )
-      {
-        for( udColumn = udColumnRight - 5; ubPosition < 10 && udColumn < 
-          udWidth; udColumn++, ubPosition++, 
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icp ) )
-        {
-          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( 
-            icp );
-        }
-      }
-      else
-      {
-        for( udColumn = udColumnRight - 5; ubPosition < 10 && udColumn < 
-          udWidth; udColumn++, ubPosition++, 
-          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igp ) )
-        {
-          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( igp
-            );
-        }
-      }
 
+  /* Set up the window, with downsampled and nonreplicated chrominance.
+  */
 
-      /* Fill any unfilled entries with -1, which the discrepancy function
-      ** recognizes as missing entries.
-      */
+  bColor = piWindow->bColor;
+  pbnd->bColor = bColor;
 
-      for( ; ubPosition < 10; ubPosition++ )
-      {
-        *pswBufferY++ = -1;
-      }
+  iWindow = *piWindow;
+  iWindow.bDownsampledChrominance = bColor;
+  iWindow.bNonreplicatedDownsampledChrominance = bColor;
 
 
-      /* Compute discrepancies. 
-      */
+  /* Start gathering the statistics of this call, if asked for, as 
+  ** CostellaUnblockSweeps() does.
+  */
 
-      if( COSTELLA_CALL( CostellaUnblockComputeDiscrepancies( aswBufferY + 
-        4, &swYBoundaryU, &swYBoundaryV ) ) || 
-        COSTELLA_CALL( CostellaUnblockComputeDiscrepancies( aswBufferY, 
-        &swYInternalU, &swYInternalV ) ) )
-      {
-        COSTELLA_ERROR( "Computing Y discrepancies" );
-        COSTELLA_RETURN;
-      }
-    
+  bTimed = pstats != 0;
+
+  COSTELLA_INITIALIZE_ARRAY( adfSeconds, COSTELLA_UNBLOCK_NUM_PHASES, 
+    COSTELLA_DF );
+  COSTELLA_INITIALIZE_ARRAY( adfSweepSeconds, COSTELLA_UNBLOCK_NUM_SWEEPS, 
+    COSTELLA_DF );
 
-      /* Take absolute values.
-      */
 
-      swYBoundaryU = abs( swYBoundaryU );
-      swYBoundaryV = abs( swYBoundaryV );
+  /* Perform the three sweeps.
+  */
 
-      swYInternalU = abs( swYInternalU );
-      swYInternalV = abs( swYInternalV );
+  for( ubSweep = 0; ubSweep < 3; ubSweep++ )
+  {
+    /* Clear the frequency tables and totals.
+    */
 
+    COSTELLA_INITIALIZE_ARRAY( pbnd->audYBoundaryU, 256, COSTELLA_UD );
+    COSTELLA_INITIALIZE_ARRAY( pbnd->audYBoundaryV, 256, COSTELLA_UD );
+    COSTELLA_INITIALIZE_ARRAY( pbnd->audYInternalU, 256, COSTELLA_UD );
+    COSTELLA_INITIALIZE_ARRAY( pbnd->audYInternalV, 256, COSTELLA_UD );
 
-      /* Update frequency tables.
-      */
+    COSTELLA_INITIALIZE_ARRAY( pbnd->audCbBoundaryU, 256, COSTELLA_UD );
+    COSTELLA_INITIALIZE_ARRAY( pbnd->audCbBoundaryV, 256, COSTELLA_UD );
+    COSTELLA_INITIALIZE_ARRAY( pbnd->audCbInternalU, 256, COSTELLA_UD );
+    COSTELLA_INITIALIZE_ARRAY( pbnd->audCbInternalV, 256, COSTELLA_UD );
 
-      audYBoundaryU[ swYBoundaryU ]++;        
-      audYBoundaryV[ swYBoundaryV ]++;        
+    COSTELLA_INITIALIZE_ARRAY( pbnd->audCrBoundaryU, 256, COSTELLA_UD );
+    COSTELLA_INITIALIZE_ARRAY( pbnd->audCrBoundaryV, 256, COSTELLA_UD );
+    COSTELLA_INITIALIZE_ARRAY( pbnd->audCrInternalU, 256, COSTELLA_UD );
+    COSTELLA_INITIALIZE_ARRAY( pbnd->audCrInternalV, 256, COSTELLA_UD );
 
-      audYInternalU[ swYInternalU ]++;        
-      audYInternalV[ swYInternalV ]++;        
+    pbnd->udTotalLuminance = 0;
+    pbnd->udTotalChrominance = 0;
 
-      udTotalLuminance++;
-    }
+    dfSweep = bTimed ? costella_thread_seconds() : 0;
 
 
-    /* Walk down to the next row.
+    /* Walk down the image 16 rows at a time. The window starts 16 rows 
+    ** above the rows being read, except at the top of the image.
     */
 
-    if( bColor ) 
-    {
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpStart, sdRowStride );
-    }
-    else
+    for( udRowFirst = 0, udRowBoundaryFirst = 0; udRowFirst < udHeight; 
+      udRowFirst += 16, udRowBoundaryFirst = udRowBoundaryEnd )
     {
-      COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpStart, sdRowStride );
-    }
-  }
-
-
-  /* If we have a color image, we now analyze the discrepancies for the
-  ** downsampled chrominance components.
-  */
-
-  if( bColor )
-  {
-    /* Start at the top-left of the image. 
-    */
+      udNumRows = udHeight - udRowFirst;
+      bLast = udNumRows <= 16;
 
-    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpStart, *pic, udWidth, 
-      udHeight, sdRowStride );
+      if( !bLast )
+      {
+        udNumRows = 16;
+      }
 
+      udRowWindow = udRowFirst ? udRowFirst - 16 : 0;
 
-    /* Walk through those rows that contain chrominance data.
-    */
 
-    for( udRow = 0; udRow < udHeight; udRow += 2 )
-    {
-      /* Progress callback.
+      /* Read the rows into the window.
       */
 
-      if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
+      r.udRowFirst = udRowFirst;
+
+      if( COSTELLA_CALL( CostellaImageRows( &iWindow, udRowFirst - 
+        udRowWindow, udNumRows, &r.i ) ) || COSTELLA_CALL( pfRead( 
+        poReadPassback, &r ) ) )
       {
-        COSTELLA_ERROR( "Progress callback" );
+        COSTELLA_ERROR( "Reading rows" );
+        COSTELLA_UNBLOCK_STREAM_CLEANUP;
         COSTELLA_RETURN;
       }
 
+      dfLap = bTimed ? costella_thread_seconds() : 0;
 
-      /* Start off at the pixel to the right of the leftmost downsampled 
-      ** pixel of this row, i.e., at x = 2, where the leftmost downsampled
-      ** pixel is x = 0.
+
+      /* In the first sweep, just analyze the vertical discrepancies of the
+      ** rows.
       */
 
-      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpStart, icp );
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icp );
+      if( !ubSweep )
+      {
+        if( COSTELLA_CALL( CostellaUnblockComputeVerticalDiscrepancies( 
+          pbnd->aswBufferY, pbnd->aswBufferCb, pbnd->aswBufferCr, 
+          pbnd->audYBoundaryU, pbnd->audYBoundaryV, pbnd->audCbBoundaryU, 
+          pbnd->audCbBoundaryV, pbnd->audCrBoundaryU, pbnd->audCrBoundaryV,
+          pbnd->audYInternalU, pbnd->audYInternalV, pbnd->audCbInternalU, 
+          pbnd->audCbInternalV, pbnd->audCrInternalU, pbnd->audCrInternalV,
+          &pbnd->udTotalLuminance, &pbnd->udTotalChrominance, &r.i, 0, 0 ) 
+          ) )
+        {
+          COSTELLA_ERROR( "Computing vertical discrepancies" );
+          COSTELLA_UNBLOCK_STREAM_CLEANUP;
+          COSTELLA_RETURN;
+        }
 
+        costella_unblock_lap( bTimed, adfSeconds, 
+          COSTELLA_UNBLOCK_PHASE_VERTICAL_COMPUTE, &dfLap );
 
-      /* We start off by filling positions 8 and 9 of the values arrays from
-      ** the xd = 1 and xd = 2 downsampled columns of this image, i.e., from
-      ** x = 2 and x = 4 of the actual image. These will be shifted back to 
-      ** the start of the values arrays in the first step below. Switch on
-      ** image type.
+        continue;
+      }
+
+
+      /* Otherwise, correct the vertical discrepancies of the rows, and set 
+      ** up a view of the window down to the bottom of the rows.
       */
 
-      for( ubPosition = 0, pswBufferCb = aswBufferCb + 8, pswBufferCr = 
-        aswBufferCr + 8; ubPosition < 2; ubPosition++, 
-        COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icp ) )
+      if( COSTELLA_CALL( CostellaUnblockCorrectVerticalDiscrepancies( 
+        pbnd->aswBufferY, pbnd->aswBufferCb, pbnd->aswBufferCr, aubVertical,
+        aubVertical + 256, aubVertical + 512, aubVertical + 768, aubVertical
+        + 1024, aubVertical + 1280, &r.i, &r.i, 0, 0 ) ) || COSTELLA_CALL( 
+        CostellaImageRows( &iWindow, 0, udRowFirst - udRowWindow + 
+        udNumRows, &iView ) ) )
       {
-        *pswBufferCb++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( 
-          icp );
-        *pswBufferCr++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( 
-          icp );
+        COSTELLA_ERROR( "Correcting vertical discrepancies" );
+        COSTELLA_UNBLOCK_STREAM_CLEANUP;
+        COSTELLA_RETURN;
       }
 
+      costella_unblock_lap( bTimed, adfSeconds, 
+        COSTELLA_UNBLOCK_PHASE_VERTICAL_CORRECT, &dfLap );
 
-      /* Walk through the vertical boundaries. See above comments re only
-      ** using blocks with a right boundary.
+
+      /* In the second sweep, analyze the horizontal boundaries that no 
+      ** longer need any rows below these, which reach at most four rows 
+      ** below the boundary, or all of the remaining boundaries at the 
+      ** bottom of the image. Boundaries are numbered within the window.
       */
 
-      for( udColumnRight = 16; udColumnRight < udWidth; udColumnRight += 16 
-        )
+      if( ubSweep == 1 )
       {
-        /* Get the first two pixels from what is already in the array. 
-        */
-
-        for( ubPosition = 0, pswBufferCb = aswBufferCb, pswBufferCbOld = 
-          aswBufferCb + 8, pswBufferCr = aswBufferCr, pswBufferCrOld = 
-          aswBufferCr + 8; ubPosition < 2; ubPosition++ )
+        udRowBoundaryEnd = bLast ? udHeight : udRowFirst + 12;
+
+        if( COSTELLA_CALL( CostellaUnblockComputeHorizontalDiscrepancies( 
+          pbnd->aswBufferY, pbnd->aswBufferCb, pbnd->aswBufferCb, 
+          pbnd->audLanes, pbnd->audYBoundaryU, pbnd->audYBoundaryV, 
+          pbnd->audCbBoundaryU, pbnd->audCbBoundaryV, pbnd->audCrBoundaryU,
+          pbnd->audCrBoundaryV, pbnd->audYInternalU, pbnd->audYInternalV, 
+          pbnd->audCbInternalU, pbnd->audCbInternalV, pbnd->audCrInternalU,
+          pbnd->audCrInternalV, &pbnd->udTotalLuminance, 
+          &pbnd->udTotalChrominance, &iView, udRowBoundaryFirst - 
+          udRowWindow, udRowBoundaryEnd - udRowWindow, 0, 0 ) ) )
         {
-          *pswBufferCb++ = *pswBufferCbOld++;
-          *pswBufferCr++ = *pswBufferCrOld++;
+          COSTELLA_ERROR( "Computing horizontal discrepancies" );
+          COSTELLA_UNBLOCK_STREAM_CLEANUP;
+          COSTELLA_RETURN;
         }
 
+        costella_unblock_lap( bTimed, adfSeconds, 
+          COSTELLA_UNBLOCK_PHASE_HORIZONTAL_COMPUTE, &dfLap );
+      }
 
-        /* Extract the next eight downsampled pixels from the image. Need to
-        ** make sure that we don't go past the right edge of the image. 
-        ** Switch on image type.
-        */
 
-        for( udColumn = udColumnRight - 10; ubPosition < 10 && udColumn < 
-          udWidth; udColumn += 2, ubPosition++, 
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icp ) )
+      /* In the third sweep, correct the horizontal boundaries in these 
+      ** rows. The next chrominance boundary changes the 16 rows above it, 
+      ** so that the rows above these are now finished, or all rows at the 
+      ** bottom of the image. Replicate their chrominance and write them.
+      */
+
+      else
+      {
+        if( COSTELLA_CALL( CostellaUnblockCorrectHorizontalInPlace( 
+          aubHorizontal, aubHorizontal + 256, aubHorizontal + 512, 
+          aubHorizontal + 768, aubHorizontal + 1024, aubHorizontal + 1280, 
+          &iView, udRowFirst - udRowWindow, iView.udHeight, 0, 0 ) ) )
         {
-          *pswBufferCb++ = (COSTELLA_SW) 
-            COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icp );
-          *pswBufferCr++ = (COSTELLA_SW) 
-            COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icp );
+          COSTELLA_ERROR( "Correcting horizontal discrepancies" );
+          COSTELLA_UNBLOCK_STREAM_CLEANUP;
+          COSTELLA_RETURN;
         }
 
+        costella_unblock_lap( bTimed, adfSeconds, 
+          COSTELLA_UNBLOCK_PHASE_HORIZONTAL_CORRECT, &dfLap );
 
-        /* Fill any unfilled entries with -1, which the discrepancy function
-        ** recognizes as missing entries.
-        */
+        r.udRowFirst = udRowWindow;
 
-        for( ; ubPosition < 10; ubPosition++ )
+        if( ( bLast || udRowFirst ) && ( COSTELLA_CALL( CostellaImageRows( 
+          &iView, 0, bLast ? iView.udHeight : 16, &r.i ) ) || ( bColor && 
+          COSTELLA_CALL( CostellaImageChrominanceReplicateEq( &r.i, 0, 0 ) ) 
+          ) ) )
         {
-          *pswBufferCb++ = -1;
-          *pswBufferCr++ = -1;
+          COSTELLA_ERROR( "Replicating chrominance" );
+          COSTELLA_UNBLOCK_STREAM_CLEANUP;
+          COSTELLA_RETURN;
         }
 
+        costella_unblock_lap( bTimed, adfSeconds, 
+          COSTELLA_UNBLOCK_PHASE_UPSAMPLE, &dfLap );
 
-        /* Compute discrepancies.
-        */
-
-        if( COSTELLA_CALL( CostellaUnblockComputeDiscrepancies( aswBufferCb 
-          + 4, &swCbBoundaryU, &swCbBoundaryV ) ) || COSTELLA_CALL(
-          CostellaUnblockComputeDiscrepancies( aswBufferCr + 4, 
-          &swCrBoundaryU, &swCrBoundaryV ) ) || COSTELLA_CALL( 
-          CostellaUnblockComputeDiscrepancies( aswBufferCb, &swCbInternalU, 
-          &swCbInternalV ) ) || COSTELLA_CALL( 
-          CostellaUnblockComputeDiscrepancies( aswBufferCr, &swCrInternalU, 
-          &swCrInternalV ) ) )
+        if( ( bLast || udRowFirst ) && COSTELLA_CALL( pfWrite( 
+          poWritePassback, &r ) ) )
         {
-          COSTELLA_ERROR( "Computing Cb or Cr discrepancies" );
+          COSTELLA_ERROR( "Writing rows" );
+          COSTELLA_UNBLOCK_STREAM_CLEANUP;
           COSTELLA_RETURN;
         }
+      }
 
 
-        /* Take absolute values.
-        */
-
-        swCbBoundaryU = abs( swCbBoundaryU );
-        swCrBoundaryU = abs( swCrBoundaryU );
-
-        swCbBoundaryV = abs( swCbBoundaryV );
-        swCrBoundaryV = abs( swCrBoundaryV );
-
-        swCbInternalU = abs( swCbInternalU );
-        swCrInternalU = abs( swCrInternalU );
+      /* Move the rows just read to the top of the window, where they will 
+      ** be the rows above the next ones.
+      */
 
-        swCbInternalV = abs( swCbInternalV );
-        swCrInternalV = abs( swCrInternalV );
+      if( udRowFirst && !bLast && COSTELLA_CALL( CostellaUnblockMoveRows( 
+        &iWindow, 16, 16 ) ) )
+      {
+        COSTELLA_ERROR( "Moving rows" );
+        COSTELLA_UNBLOCK_STREAM_CLEANUP;
+        COSTELLA_RETURN;
+      }
+    }
 
 
-        /* Update totals.
-        */
+    /* After each of the first two sweeps, compute the adjustment tables.
+    ** As in CostellaUnblockSweeps(), this is counted in the compute phase
+    ** of the sweep, but not in the sweep itself.
+    */
 
-        audCbBoundaryU[ swCbBoundaryU ]++;        
-        audCrBoundaryU[ swCrBoundaryU ]++;        
+    if( bTimed )
+    {
+      dfLap = costella_thread_seconds();
+      adfSweepSeconds[ COSTELLA_UNBLOCK_SWEEP_FIRST + ubSweep ] += dfLap - 
+        dfSweep;
+    }
 
-        audCbBoundaryV[ swCbBoundaryV ]++;        
-        audCrBoundaryV[ swCrBoundaryV ]++;        
+    if( ubSweep < 2 && COSTELLA_CALL( CostellaUnblockComputeBandAdjustments(
+      pbnd, bPhotographic, bCartoon, ubSweep ? aubHorizontal : aubVertical 
+      ) ) )
+    {
+      COSTELLA_ERROR( "Computing adjustments" );
+      COSTELLA_UNBLOCK_STREAM_CLEANUP;
+      COSTELLA_RETURN;
+    }
 
-        audCbInternalU[ swCbInternalU ]++;        
-        audCrInternalU[ swCrInternalU ]++;        
-      
-        audCbInternalV[ swCbInternalV ]++;        
-        audCrInternalV[ swCrInternalV ]++;        
+    if( ubSweep < 2 )
+    {
+      costella_unblock_lap( bTimed, adfSeconds, ubSweep ? 
+        COSTELLA_UNBLOCK_PHASE_HORIZONTAL_COMPUTE : 
+        COSTELLA_UNBLOCK_PHASE_VERTICAL_COMPUTE, &dfLap );
+    }
+  }
 
-        udTotalChrominance++;
-      }
 
+  /* Add the statistics of this call. With one band, each sweep's 
+  ** thread-seconds are its wall-clock seconds.
+  */
 
-      /* Walk down to the next downsampled row.
-      */
+  if( pstats )
+  {
+    for( ubPhase = 0; ubPhase < COSTELLA_UNBLOCK_NUM_PHASES; ubPhase++ )
+    {
+      pstats->adfSeconds[ ubPhase ] += adfSeconds[ ubPhase ];
+    }
 
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpStart, sdDoubleRowStride 
-        );
+    for( ubSweep = 0; ubSweep < COSTELLA_UNBLOCK_NUM_SWEEPS; ubSweep++ )
+    {
+      pstats->adfSweepWallSeconds[ ubSweep ] += adfSweepSeconds[ ubSweep ];
+      pstats->adfSweepThreadSeconds[ ubSweep ] += adfSweepSeconds[ ubSweep ];
     }
+
+    pstats->udBytesAllocated += (unsigned long) ( 12 * 256 + sizeof( 
+      COSTELLA_UNBLOCK_BAND ) );
   }
 
 
-  /* Store the totals.
+  /* Clean up.
   */
 
-  *pudTotalLuminance = udTotalLuminance;
-  *pudTotalChrominance = udTotalChrominance;
+  if( COSTELLA_FREE( aubVertical ) || COSTELLA_FREE( aubHorizontal ) || 
+    COSTELLA_FREE( pbnd ) )
+  {
+    COSTELLA_FUNDAMENTAL_ERROR( "Freeing" );
+    COSTELLA_RETURN;
+  }
 }
 COSTELLA_END_FUNCTION
 
+#endif
 
 
-/* CostellaUnblockComputeHorizontalDiscrepancies: 
+
+/* CostellaUnblockComputeBandAdjustments: 
 **
-**   Internal function that computes the horizontal discrepancies in an 
-**   image.
+**   Internal function that computes the six adjustment tables from the 
+**   frequency tables and totals of a band, as CostellaUnblockMt() does 
+**   from the merged tables.
 **
-**   aud{Y,Cb,Cr}{Boundary,Internal}{U,V}:  Array to hold the frequencies 
-**     for the {U,V} discrepancies {at block boundaries, internal to each
-**     block} for the {Y,Cb,Cr} channel.
+**   pbnd:  Pointer to the band.
 **
-**   pudTotal{Luminance,Chrominance}:  Pointer to a COSTELLA_UD, into 
-**     which will be written the sum of all the {luminance,chrominance} 
-**     values of the image.
+**   aubAdjusted:  Array of 6 * 256 bytes, into which are written the 
+**     tables aub{Y,Cb,Cr}Adjusted{U,V}, in that order. The chrominance 
+**     tables are only written for a color image.
 **
-**   pi:  Pointer to the image to be analyzed.
+**   Other arguments are as for CostellaUnblock.
 */
 
-static COSTELLA_FUNCTION( CostellaUnblockComputeHorizontalDiscrepancies, ( 
-  COSTELLA_SW* aswBufferY, COSTELLA_SW* aswBufferCb, COSTELLA_SW* 
-  aswBufferCr, COSTELLA_UD* audYBoundaryU, COSTELLA_UD* audYBoundaryV, 
-  COSTELLA_UD* audCbBoundaryU, COSTELLA_UD* audCbBoundaryV, COSTELLA_UD* 
-  audCrBoundaryU, COSTELLA_UD* audCrBoundaryV, COSTELLA_UD* audYInternalU, 
-  COSTELLA_UD* audYInternalV, COSTELLA_UD* audCbInternalU, COSTELLA_UD* 
-  audCbInternalV, COSTELLA_UD* audCrInternalU, COSTELLA_UD* audCrInternalV, 
-  COSTELLA_UD* pudTotalLuminance, COSTELLA_UD* pudTotalChrominance, 
-  COSTELLA_IMAGE* pi, COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* 
-  poPassback ) )
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+
+static COSTELLA_FUNCTION( CostellaUnblockComputeBandAdjustments, ( 
+  COSTELLA_UNBLOCK_BAND* pbnd, COSTELLA_B bPhotographic, COSTELLA_B 
+  bCartoon, COSTELLA_UB* aubAdjusted ) )
 {
-  COSTELLA_B bColor;
-  COSTELLA_UB ubPosition;
-  COSTELLA_SW swYBoundaryU, swYBoundaryV, swYInternalU, swYInternalV, 
-    swCbBoundaryU, swCbBoundaryV, swCbInternalU, swCbInternalV, 
-    swCrBoundaryU, swCrBoundaryV, swCrInternalU, swCrInternalV;
-  COSTELLA_SW* pswBufferY, * pswBufferYOld, * pswBufferCb, * pswBufferCr, 
-    * pswBufferCbOld, * pswBufferCrOld;
-  COSTELLA_SD sdRowStride, sdDoubleRowStride;
-  COSTELLA_UD udWidth, udHeight, udRow, udColumn, udRowBottom, 
-    udTotalLuminance, udTotalChrominance;
-  COSTELLA_IMAGE_GRAY* pig;
-  COSTELLA_IMAGE_COLOR* pic;
-  COSTELLA_IMAGE_COLOR_PIXEL icp={0}, icpStart={0};
-  COSTELLA_IMAGE_GRAY_PIXEL igp=NULL, igpStart=NULL;
+  /* Compute the luminance tables.
+  */
+
+  if( COSTELLA_CALL( CostellaUnblockComputeAdjustments( pbnd->audYInternalU,
+    pbnd->audYBoundaryU, pbnd->udTotalLuminance, bPhotographic, bCartoon, 
+    aubAdjusted ) ) || COSTELLA_CALL( CostellaUnblockComputeAdjustments( 
+    pbnd->audYInternalV, pbnd->audYBoundaryV, pbnd->udTotalLuminance, 
+    bPhotographic, bCartoon, aubAdjusted + 256 ) ) )
+  {
+    COSTELLA_ERROR( "Computing Y adjustments" );
+    COSTELLA_RETURN;
+  }
 
 
-  /* Extract information.
+  /* Compute the chrominance tables of a color image.
   */
 
-  bColor = pi->bColor;
+  if( pbnd->bColor )
+  {
+    if( COSTELLA_CALL( CostellaUnblockComputeAdjustments( 
+      pbnd->audCbInternalU, pbnd->audCbBoundaryU, pbnd->udTotalChrominance, 
+      bPhotographic, bCartoon, aubAdjusted + 512 ) ) || COSTELLA_CALL( 
+      CostellaUnblockComputeAdjustments( pbnd->audCbInternalV, 
+      pbnd->audCbBoundaryV, pbnd->udTotalChrominance, bPhotographic, 
+      bCartoon, aubAdjusted + 768 ) ) )
+    {
+      COSTELLA_ERROR( "Computing Cb adjustments" );
+      COSTELLA_RETURN;
+    }
 
-  udWidth = pi->udWidth;
-  udHeight = pi->udHeight;
+    if( COSTELLA_CALL( CostellaUnblockComputeAdjustments( 
+      pbnd->audCrInternalU, pbnd->audCrBoundaryU, pbnd->udTotalChrominance, 
+      bPhotographic, bCartoon, aubAdjusted + 1024 ) ) || COSTELLA_CALL( 
+      CostellaUnblockComputeAdjustments( pbnd->audCrInternalV, 
+      pbnd->audCrBoundaryV, pbnd->udTotalChrominance, bPhotographic, 
+      bCartoon, aubAdjusted + 1280 ) ) )
+    {
+      COSTELLA_ERROR( "Computing Cr adjustments" );
+      COSTELLA_RETURN;
+    }
+  }
+}
+COSTELLA_END_FUNCTION
 
-  sdRowStride = pi->sdRowStride;
+#endif
 
-  pig = &pi->ig;
-  pic = &pi->ic;
 
 
-  /* Compute double the row stride.
-  */
+/* CostellaUnblockMoveRows: 
+**
+**   Internal function that moves rows of an image up to its top row, when 
+**   each channel is stored as a contiguous array of bytes.
+**
+**   pi:  Pointer to the image.
+**
+**   udRowFirst:  First row to be moved.
+**
+**   udNumRows:  Number of rows to be moved.
+*/
 
-  sdDoubleRowStride = sdRowStride << 1;
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+
+static COSTELLA_FUNCTION( CostellaUnblockMoveRows, ( COSTELLA_IMAGE* pi, 
+  COSTELLA_UD udRowFirst, COSTELLA_UD udNumRows ) )
+{
+  COSTELLA_SD sdRowStride, sdOffset;
+  COSTELLA_UD udWidth, udRow;
+  COSTELLA_IMAGE_COLOR_PIXEL icp={0};
+  COSTELLA_IMAGE_GRAY_PIXEL igp=NULL;
 
 
-  /* Initialize totals.
+  /* Extract information.
   */
 
-  udTotalLuminance = 0;
-  udTotalChrominance = 0;
+  udWidth = pi->udWidth;
+
+  sdRowStride = pi->sdRowStride;
+  sdOffset = (COSTELLA_SD) udRowFirst * sdRowStride;
 
 
-  /* Initialize the frequency tables.
+  /* Copy each row of each channel, from the top down, so that rows are 
+  ** never overwritten before they are moved.
   */
 
-  COSTELLA_INITIALIZE_ARRAY( audYBoundaryU, 256, COSTELLA_UD );
-  COSTELLA_INITIALIZE_ARRAY( audYBoundaryV, 256, COSTELLA_UD );
+  if( pi->bColor )
+  {
+    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icp, pi->ic, udWidth, 
+      pi->udHeight, sdRowStride );
 
-  COSTELLA_INITIALIZE_ARRAY( audYInternalU, 256, COSTELLA_UD );
-  COSTELLA_INITIALIZE_ARRAY( audYInternalV, 256, COSTELLA_UD );
+    for( udRow = 0; udRow < udNumRows; udRow++ )
+    {
+      memmove( COSTELLA_IMAGE_COLOR_PIXEL_R_Y_ADDRESS( icp ), 
+        COSTELLA_IMAGE_COLOR_PIXEL_R_Y_ADDRESS( icp ) + sdOffset, udWidth );
+      memmove( COSTELLA_IMAGE_COLOR_PIXEL_G_CB_ADDRESS( icp ), 
+        COSTELLA_IMAGE_COLOR_PIXEL_G_CB_ADDRESS( icp ) + sdOffset, udWidth );
+      memmove( COSTELLA_IMAGE_COLOR_PIXEL_B_CR_ADDRESS( icp ), 
+        COSTELLA_IMAGE_COLOR_PIXEL_B_CR_ADDRESS( icp ) + sdOffset, udWidth );
 
-  if( bColor )
+      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icp, sdRowStride );
+    }
+  }
+  else
   {
-    COSTELLA_INITIALIZE_ARRAY( audCbBoundaryU, 256, COSTELLA_UD );
-    COSTELLA_INITIALIZE_ARRAY( audCbBoundaryV, 256, COSTELLA_UD );
-
-    COSTELLA_INITIALIZE_ARRAY( audCrBoundaryU, 256, COSTELLA_UD );
-    COSTELLA_INITIALIZE_ARRAY( audCrBoundaryV, 256, COSTELLA_UD );
+    COSTELLA_IMAGE_GRAY_PIXEL_SET_TOP_LEFT( igp, pi->ig, udWidth, 
+      pi->udHeight, sdRowStride );
 
-    COSTELLA_INITIALIZE_ARRAY( audCbInternalU, 256, COSTELLA_UD );
-    COSTELLA_INITIALIZE_ARRAY( audCbInternalV, 256, COSTELLA_UD );
+    for( udRow = 0; udRow < udNumRows; udRow++ )
+    {
+      memmove( COSTELLA_IMAGE_GRAY_PIXEL_Y_ADDRESS( igp ), 
+        COSTELLA_IMAGE_GRAY_PIXEL_Y_ADDRESS( igp ) + sdOffset, udWidth );
 
-    COSTELLA_INITIALIZE_ARRAY( audCrInternalU, 256, COSTELLA_UD );
-    COSTELLA_INITIALIZE_ARRAY( audCrInternalV, 256, COSTELLA_UD );
+      COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igp, sdRowStride );
+    }
   }
+}
+COSTELLA_END_FUNCTION
+
+#endif
 
 
-  /* First we analyze the luminance channel. Start at the top-left of the
-  ** image.
-  */
 
-  if( bColor )
-  {
-    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpStart, *pic, udWidth, 
-      udHeight, sdRowStride );
-  }
-  else
-  {
-    COSTELLA_IMAGE_GRAY_PIXEL_SET_TOP_LEFT( igpStart, *pig, udWidth, 
-      udHeight, sdRowStride );
-  }
-  
+/* CostellaUnblockInterleaved:
+**
+**   Perform the UnBlock algorithm as CostellaUnblockCtx() does, on an image
+**   of interleaved 8-bit RGB or BGR pixels whose rows may be any distance
+**   apart, such as the rows decoded by libpng or the pixel data of a .bmp
+**   file, without the caller copying it into separate channels. Each band
+**   of rows is converted, in its own thread, into YCbCr channels held by
+**   the context, with the chrominance of the top-left pixel of each 2 x 2
+**   block stored in quarter-size arrays. After these are unblocked, each
+**   band is converted back, replicating the chrominance.
+**
+**   aub{In,Out}:  Pointer to the first pixel of the top row of the
+**     {in,out}put image. May be the same, to unblock the image in place.
+**
+**   sd{In,Out}RowStride:  Number of bytes from the start of one row of the
+**     {in,out}put image to the start of the next. May be negative, for an
+**     image stored from the bottom up.
+**
+**   ud{Width,Height}:  Size of the image, in pixels.
+**
+**   bBgr:  If nonzero, the bytes of each pixel of both images are in the
+**     order blue, green, red.
+**
+**   Other arguments are as for CostellaUnblockMt.
+*/
+
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+
+COSTELLA_FUNCTION( CostellaUnblockInterleaved, ( COSTELLA_UNBLOCK_CONTEXT*
+  pctx, COSTELLA_UB* aubIn, COSTELLA_SD sdInRowStride, COSTELLA_UB* aubOut,
+  COSTELLA_SD sdOutRowStride, COSTELLA_UD udWidth, COSTELLA_UD udHeight,
+  COSTELLA_B bBgr, COSTELLA_B bPhotographic, COSTELLA_B bCartoon,
+  COSTELLA_UD udNumThreads, COSTELLA_CALLBACK_FUNCTION pfProgress,
+  COSTELLA_O* poPassback ) )
+{
+  COSTELLA_UD udChrominanceWidth, udChannelsSize;
+  COSTELLA_UB ubPhase, ubSweep;
+  COSTELLA_DF adfSeconds[ COSTELLA_UNBLOCK_NUM_PHASES ], adfWallSeconds[ 
+    COSTELLA_UNBLOCK_NUM_SWEEPS ], adfThreadSeconds[ 
+    COSTELLA_UNBLOCK_NUM_SWEEPS ];
+  COSTELLA_MC mcArena, mcAllocated = 0;
+  COSTELLA_UNBLOCK_STATS* pstats;
+  COSTELLA_IMAGE i;
+
 
-  /* Walk through the columns of the image.
+  /* Check pointers and size.
   */
 
-  for( udColumn = 0; udColumn < udWidth; udColumn++ )
+  #ifdef COSTELLA_DEBUG
   {
-    /* Progress callback.
-    */
-
-    if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
+    if( !pctx )
     {
-      COSTELLA_ERROR( "Progress callback" );
+      COSTELLA_FUNDAMENTAL_ERROR( "Null context" );
       COSTELLA_RETURN;
     }
 
-
-    /* Start off at the pixel below the topmost pixel of this column, i.e., 
-    ** at y = 1, where the topmost pixel is y = 0.
-    */
-
-    if( bColor )
+    if( !aubIn )
     {
-      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpStart, icp );
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icp, sdRowStride );
+      COSTELLA_FUNDAMENTAL_ERROR( "Null input image" );
+      COSTELLA_RETURN;
     }
-    else
+
+    if( !aubOut )
     {
-      COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpStart, igp );
-      COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igp, sdRowStride );
+      COSTELLA_FUNDAMENTAL_ERROR( "Null output image" );
+      COSTELLA_RETURN;
     }
 
-
-    /* We start off by filling positions 8 and 9 of the values arrays from 
-    ** the y = 1 and y = 2 rows of this image. These will be shifted back to
-    ** the start of the values arrays in the first step below. Switch on 
-    ** image type.
-    */
-
-    if( bColor )
+    if( !udWidth || !udHeight )
     {
-      for( ubPosition = 0, pswBufferY = aswBufferY + 8; ubPosition < 2; 
-        ubPosition++, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icp, sdRowStride
-        ) )
-      {
-        *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( 
-          icp );
-      }
+      COSTELLA_FUNDAMENTAL_ERROR( "Empty image" );
+      COSTELLA_RETURN;
     }
-    else
+
+    if( (COSTELLA_UD) ( sdInRowStride < 0 ? -sdInRowStride : sdInRowStride )
+      < 3 * udWidth || (COSTELLA_UD) ( sdOutRowStride < 0 ? -sdOutRowStride
+      : sdOutRowStride ) < 3 * udWidth )
     {
-      for( ubPosition = 0, pswBufferY = aswBufferY + 8; ubPosition < 2; 
-        ubPosition++, COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igp, sdRowStride 
-        ) )
-      {
-        *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( igp 
-          );
-      }
+      COSTELLA_FUNDAMENTAL_ERROR( "Rows overlap" );
+      COSTELLA_RETURN;
     }
+  }
+  #endif
 
 
-    /* Walk through the horizontal boundaries. See above comments.
-    */
+  /* Start gathering the statistics of this call, if the context has any,
+  ** as CostellaUnblockSweeps() does.
+  */
 
-    for( udRowBottom = 8; udRowBottom < udHeight; udRowBottom += 8 )
-    {
-      /* Get the first two pixels from what is already in the array. 
-      */
+  pstats = pctx->pstats;
+  mcArena = pctx->ar.mcAllocated;
 
-      for( ubPosition = 0, pswBufferY = aswBufferY, pswBufferYOld = 
-        aswBufferY + 8; ubPosition < 2; ubPosition++ )
-      {
-        *pswBufferY++ = *pswBufferYOld++;
-      }
+  COSTELLA_INITIALIZE_ARRAY( adfSeconds, COSTELLA_UNBLOCK_NUM_PHASES,
+    COSTELLA_DF );
+  COSTELLA_INITIALIZE_ARRAY( adfWallSeconds, COSTELLA_UNBLOCK_NUM_SWEEPS, 
+    COSTELLA_DF );
+  COSTELLA_INITIALIZE_ARRAY( adfThreadSeconds, COSTELLA_UNBLOCK_NUM_SWEEPS,
+    COSTELLA_DF );
 
 
-      /* Extract the next eight pixels from the image. Need to make sure 
-      ** that we don't go past the bottom of the image. Switch on image 
-      ** type.
-      */
+  /* Grow the context's channels if they are too small for the image: the
+  ** luminance at full size, followed by the Cb and Cr at quarter size.
+  */
 
-      if( bColor )
-      {
-        for( udRow = udRowBottom - 5; ubPosition < 10 && udRow < udHeight; 
-          udRow++, ubPosition++, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icp, 
-          sdRowStride ) )
-        {
-          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( 
-            icp );
-        }
-      }
-      else
-      {
-        for( udRow = udRowBottom - 5; ubPosition < 10 && udRow < udHeight; 
-          udRow++, ubPosition++, COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igp, 
-          sdRowStride ) )
-        {
-          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( igp
-            );
-        }
-      }
+  udChrominanceWidth = ( udWidth + 1 ) >> 1;
+  udChannelsSize = udWidth * udHeight + 2 * udChrominanceWidth * ( (
+    udHeight + 1 ) >> 1 );
 
+  if( (COSTELLA_UD) (COSTELLA_MC) udChannelsSize != udChannelsSize )
+  {
+    COSTELLA_FUNDAMENTAL_ERROR( "Image too large" );
+    COSTELLA_RETURN;
+  }
 
-      /* Fill any unfilled entries with -1, which the discrepancy function
-      ** recognizes as missing entries.
-      */
+  if( pctx->mcChannelsAllocated < udChannelsSize )
+  {
+    if( pctx->aubChannels && !pctx->pfFree( pctx->aubChannels ) )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Freeing" );
+      COSTELLA_RETURN;
+    }
 
-      for( ; ubPosition < 10; ubPosition++ )
-      {
-        *pswBufferY++ = -1;
-      }
+    pctx->mcChannelsAllocated = 0;
 
+    if( !( pctx->aubChannels = (COSTELLA_UB*) pctx->pfMalloc( (COSTELLA_MC)
+      udChannelsSize ) ) )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
+      COSTELLA_RETURN;
+    }
 
-      /* Compute discrepancies. 
-      */
+    pctx->mcChannelsAllocated = (COSTELLA_MC) udChannelsSize;
+    mcAllocated = (COSTELLA_MC) udChannelsSize;
+  }
 
-      if( COSTELLA_CALL( CostellaUnblockComputeDiscrepancies( aswBufferY + 
-        4, &swYBoundaryU, &swYBoundaryV ) ) || COSTELLA_CALL( 
-        CostellaUnblockComputeDiscrepancies( aswBufferY, &swYInternalU, 
-        &swYInternalV ) ) )
-      {
-        COSTELLA_ERROR( "Computing Y discrepancies" );
-        COSTELLA_RETURN;
-      }
 
+  /* Describe the channels as an image in YCbCr format, with quarter-size
+  ** chrominance that is downsampled but not replicated.
+  */
 
-      /* Take absolute values.
-      */
+  i.bAlpha = COSTELLA_FALSE;
+  i.bColor = COSTELLA_TRUE;
+  i.bRgb = COSTELLA_FALSE;
+  i.bDownsampledChrominance = COSTELLA_TRUE;
+  i.bNonreplicatedDownsampledChrominance = COSTELLA_TRUE;
 
-      swYBoundaryU = abs( swYBoundaryU );
-      swYBoundaryV = abs( swYBoundaryV );
+  i.udWidth = udWidth;
+  i.udHeight = udHeight;
 
-      swYInternalU = abs( swYInternalU );
-      swYInternalV = abs( swYInternalV );
+  i.sdRowStride = (COSTELLA_SD) udWidth;
+  i.sdAlphaRowStride = 0;
+  i.sdChrominanceRowStride = (COSTELLA_SD) udChrominanceWidth;
 
+  i.ic.aubRY = pctx->aubChannels;
+  i.ic.aubGCb = i.ic.aubRY + udWidth * udHeight;
+  i.ic.aubBCr = i.ic.aubGCb + udChrominanceWidth * ( ( udHeight + 1 ) >>
+    1 );
 
-      /* Update totals.
-      */
 
-      audYBoundaryU[ swYBoundaryU ]++;        
-      audYBoundaryV[ swYBoundaryV ]++;        
+  /* Convert the input image into the channels, unblock them, and convert
+  ** them into the output image.
+  */
 
-      audYInternalU[ swYInternalU ]++;        
-      audYInternalV[ swYInternalV ]++;        
+  if( COSTELLA_CALL( CostellaUnblockConvertInterleaved( pctx, &i, aubIn,
+    sdInRowStride, bBgr, COSTELLA_FALSE, udNumThreads, pstats ? adfSeconds
+    : 0, &adfWallSeconds[ COSTELLA_UNBLOCK_SWEEP_DEINTERLEAVE ], 
+    &adfThreadSeconds[ COSTELLA_UNBLOCK_SWEEP_DEINTERLEAVE ] ) ) )
+  {
+    COSTELLA_ERROR( "Converting input image" );
+    COSTELLA_RETURN;
+  }
 
-      udTotalLuminance++;
-    }
+  mcAllocated += pctx->ar.mcAllocated - mcArena;
 
+  if( COSTELLA_CALL( CostellaUnblockQuarter( pctx, &i, &i, bPhotographic,
+    bCartoon, udNumThreads, pfProgress, poPassback ) ) )
+  {
+    COSTELLA_ERROR( "Unblocking" );
+    COSTELLA_RETURN;
+  }
 
-    /* Walk across to the next column.
-    */
+  mcArena = pctx->ar.mcAllocated;
 
-    if( bColor )
+  if( COSTELLA_CALL( CostellaUnblockConvertInterleaved( pctx, &i, aubOut,
+    sdOutRowStride, bBgr, COSTELLA_TRUE, udNumThreads, pstats ? adfSeconds
+    : 0, &adfWallSeconds[ COSTELLA_UNBLOCK_SWEEP_INTERLEAVE ], 
+    &adfThreadSeconds[ COSTELLA_UNBLOCK_SWEEP_INTERLEAVE ] ) ) )
+  {
+    COSTELLA_ERROR( "Converting output image" );
+    COSTELLA_RETURN;
+  }
+
+  mcAllocated += pctx->ar.mcAllocated - mcArena;
+
+
+  /* Add the statistics of the conversions to those of the context;
+  ** CostellaUnblockSweeps() has added its own.
+  */
+
+  if( pstats )
+  {
+    for( ubPhase = 0; ubPhase < COSTELLA_UNBLOCK_NUM_PHASES; ubPhase++ )
     {
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpStart );
+      pstats->adfSeconds[ ubPhase ] += adfSeconds[ ubPhase ];
     }
-    else
+
+    for( ubSweep = 0; ubSweep < COSTELLA_UNBLOCK_NUM_SWEEPS; ubSweep++ )
     {
-      COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpStart );
+      pstats->adfSweepWallSeconds[ ubSweep ] += adfWallSeconds[ ubSweep ];
+      pstats->adfSweepThreadSeconds[ ubSweep ] += adfThreadSeconds[ ubSweep
+        ];
     }
+
+    pstats->udBytesAllocated += (unsigned long) mcAllocated;
   }
+}
+COSTELLA_END_FUNCTION
 
+#endif
 
-  /* If we have a color image, analyze the discrepancies for the downsampled
-  ** chrominance channels. 
-  */
-  
-  if( bColor )
-  {
-    /* Start at the top-left of the image. 
-    */
 
-    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpStart, *pic, udWidth, 
-      udHeight, sdRowStride );
 
-      
-    /* Walk through those columns of the image that contain chrominance 
-    ** data.
-    */
+/* CostellaUnblockConvertInterleaved:
+**
+**   Internal function that converts an image of interleaved pixels into
+**   the channels of CostellaUnblockInterleaved(), or back, splitting it
+**   into bands of rows, one for each thread. The bands and their scratch
+**   rows are taken from the context's arena, which is then reset.
+**
+**   pi:  Pointer to the image describing the channels.
+**
+**   aubRgb:  Pointer to the first pixel of the top row of the image of
+**     interleaved pixels.
+**
+**   sdRgbRowStride:  Number of bytes from the start of one of its rows to
+**     the start of the next.
+**
+**   bBgr:  If nonzero, the bytes of each pixel are in the order blue,
+**     green, red.
+**
+**   bToInterleaved:  If nonzero, the channels are converted into the image
+**     of interleaved pixels; if zero, the other way round.
+**
+**   udNumThreads:  Maximum number of bands.
+**
+**   adfSeconds:  Null, or an array to which the time spent in each phase
+**     by each band is added.
+**
+**   pdf{Wall,Thread}Seconds:  Pointers to which the {wall-clock,thread}
+**     seconds of the sweep are added, if adfSeconds is not null.
+*/
 
-    for( udColumn = 0; udColumn < udWidth; udColumn += 2 )
-    {
-      /* Progress callback.
-      */
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
 
-      if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
-      {
-        COSTELLA_ERROR( "Progress callback" );
-        COSTELLA_RETURN;
-      }
+static COSTELLA_FUNCTION( CostellaUnblockConvertInterleaved, (
+  COSTELLA_UNBLOCK_CONTEXT* pctx, COSTELLA_IMAGE* pi, COSTELLA_UB* aubRgb,
+  COSTELLA_SD sdRgbRowStride, COSTELLA_B bBgr, COSTELLA_B bToInterleaved,
+  COSTELLA_UD udNumThreads, COSTELLA_DF* adfSeconds, COSTELLA_DF* 
+  pdfWallSeconds, COSTELLA_DF* pdfThreadSeconds ) )
+{
+  COSTELLA_UD udHeight, udRowsPerBand, udRowFirst, udNumBands, udBand,
+    udScratchSize;
+  COSTELLA_UB ubPhase;
+  COSTELLA_UB* aubScratch;
+  COSTELLA_UNBLOCK_INTERLEAVED_BAND* aibnd, * pibnd;
 
 
-      /* Start off at the downsampled pixel below the topmost pixel of this 
-      ** column, i.e., at y = 2, where the topmost downsampled pixel is 
-      ** y = 0.
-      */
+  /* Compute the number of rows in each band, rounded up to a multiple of
+  ** 2, and the number of bands.
+  */
 
-      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpStart, icp );
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icp, sdDoubleRowStride );
+  udHeight = pi->udHeight;
 
+  udRowsPerBand = ( udHeight + udNumThreads - 1 ) / udNumThreads;
+  udRowsPerBand = ( udRowsPerBand + 1 ) & ~(COSTELLA_UD) 1;
 
-      /* We start off by filling positions 8 and 9 of the values arrays from
-      ** the yd = 1 and yd = 2 downsampled pixel rows of this image, i.e., 
-      ** at y = 2 and y = 4 in the actual image. These will be shifted back 
-      ** to the start of the values arrays in the first step below. Switch 
-      ** on image type.
-      */
+  udNumBands = ( udHeight + udRowsPerBand - 1 ) / udRowsPerBand;
 
-      for( ubPosition = 0, pswBufferCb = aswBufferCb + 8, pswBufferCr = 
-        aswBufferCr + 8; ubPosition < 2; ubPosition++, 
-        COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icp, sdDoubleRowStride ) )
-      {
-        *pswBufferCb++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( 
-          icp );
-        *pswBufferCr++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( 
-          icp );
-      }
 
+  /* Allocate the bands, and two rows of scratch for each.
+  */
 
-      /* Walk through the horizontal boundaries. See above comments.
-      */
+  udScratchSize = 2 * pi->udWidth * udNumBands;
 
-      for( udRowBottom = 16; udRowBottom < udHeight; udRowBottom += 16 )
-      {
-        /* Get the first two pixels from what is already in the array. 
-        */
+  if( COSTELLA_ARENA_MALLOC( &pctx->ar, aibnd, udNumBands ) ||
+    COSTELLA_ARENA_MALLOC( &pctx->ar, aubScratch, udScratchSize ) )
+  {
+    COSTELLA_ERROR( "Allocating bands" );
+    COSTELLA_RETURN;
+  }
 
-        for( ubPosition = 0, pswBufferCb = aswBufferCb, pswBufferCbOld = 
-          aswBufferCb + 8, pswBufferCr = aswBufferCr, pswBufferCrOld = 
-          aswBufferCr + 8; ubPosition < 2; ubPosition++ )
-        {
-          *pswBufferCb++ = *pswBufferCbOld++;
-          *pswBufferCr++ = *pswBufferCrOld++;
-        }
 
+  /* Set up the bands.
+  */
 
-        /* Extract the next eight pixels from the image. Need to make sure 
-        ** that we don't go past the bottom edge of the image. Switch on 
-        ** image type.
-        */
+  for( udRowFirst = 0, pibnd = aibnd; udRowFirst < udHeight; udRowFirst +=
+    udRowsPerBand, pibnd++ )
+  {
+    pibnd->aubRgb = aubRgb + (COSTELLA_SD) udRowFirst * sdRgbRowStride;
+    pibnd->sdRgbRowStride = sdRgbRowStride;
 
-        for( udRow = udRowBottom - 10; ubPosition < 10 && udRow < 
-          udHeight; udRow += 2, ubPosition++, 
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icp, sdDoubleRowStride )
-          )
-        {
-          *pswBufferCb++ = (COSTELLA_SW) 
-            COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icp );
-          *pswBufferCr++ = (COSTELLA_SW) 
-            COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icp );
-        }
+    pibnd->aubY = pi->ic.aubRY + (COSTELLA_SD) udRowFirst *
+      pi->sdRowStride;
+    pibnd->aubCb = pi->ic.aubGCb + (COSTELLA_SD) ( udRowFirst >> 1 ) *
+      pi->sdChrominanceRowStride;
+    pibnd->aubCr = pi->ic.aubBCr + (COSTELLA_SD) ( udRowFirst >> 1 ) *
+      pi->sdChrominanceRowStride;
+    pibnd->aubScratch = aubScratch + 2 * pi->udWidth * ( pibnd - aibnd );
 
+    pibnd->udWidth = pi->udWidth;
+    pibnd->udNumRows = udHeight - udRowFirst;
 
-        /* Fill any unfilled entries with -1, which the discrepancy function
-        ** recognizes as missing entries.
-        */
+    if( pibnd->udNumRows > udRowsPerBand )
+    {
+      pibnd->udNumRows = udRowsPerBand;
+    }
 
-        for( ; ubPosition < 10; ubPosition++ )
-        {
-          *pswBufferCb++ = -1;
-          *pswBufferCr++ = -1;
-        }
+    pibnd->bBgr = bBgr;
+    pibnd->bTimed = adfSeconds != 0;
 
+    COSTELLA_INITIALIZE_ARRAY( pibnd->adfSeconds,
+      COSTELLA_UNBLOCK_NUM_PHASES, COSTELLA_DF );
+  }
 
-        /* Compute discrepancies. 
-        */
 
-        if( COSTELLA_CALL( CostellaUnblockComputeDiscrepancies( aswBufferCb 
-          + 4, &swCbBoundaryU, &swCbBoundaryV ) ) || COSTELLA_CALL( 
-          CostellaUnblockComputeDiscrepancies( aswBufferCr + 4, 
-          &swCrBoundaryU, &swCrBoundaryV ) ) || COSTELLA_CALL(
-          CostellaUnblockComputeDiscrepancies( aswBufferCb, &swCbInternalU, 
-          &swCbInternalV ) ) || COSTELLA_CALL(
-          CostellaUnblockComputeDiscrepancies( aswBufferCr, &swCrInternalU, 
-          &swCrInternalV ) ) )
-        {
-          COSTELLA_ERROR( "Computing Cb or Cr discrepancies" );
-          COSTELLA_RETURN;
-        }
+  /* Convert each band in its own thread.
+  */
 
+  if( COSTELLA_CALL( CostellaThreadRun( bToInterleaved ?
+    CostellaUnblockToInterleaved : CostellaUnblockFromInterleaved, aibnd,
+    sizeof( COSTELLA_UNBLOCK_INTERLEAVED_BAND ), udNumBands, &pctx->ar, 
+    adfSeconds ? pdfWallSeconds : 0, adfSeconds ? pdfThreadSeconds : 0 ) ) 
+    )
+  {
+    COSTELLA_ERROR( "Converting bands" );
+    COSTELLA_RETURN;
+  }
 
-        /* Take absolute values.
-        */
 
-        swCbBoundaryU = abs( swCbBoundaryU );
-        swCrBoundaryU = abs( swCrBoundaryU );
+  /* Add up the times of the bands, then release the arena.
+  */
+
+  for( udBand = 0, pibnd = aibnd; adfSeconds && udBand < udNumBands;
+    udBand++, pibnd++ )
+  {
+    for( ubPhase = 0; ubPhase < COSTELLA_UNBLOCK_NUM_PHASES; ubPhase++ )
+    {
+      adfSeconds[ ubPhase ] += pibnd->adfSeconds[ ubPhase ];
+    }
+  }
 
-        swCbBoundaryV = abs( swCbBoundaryV );
-        swCrBoundaryV = abs( swCrBoundaryV );
+  if( COSTELLA_CALL( CostellaArenaReset( &pctx->ar ) ) )
+  {
+    COSTELLA_ERROR( "Resetting arena" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
 
-        swCbInternalU = abs( swCbInternalU );
-        swCrInternalU = abs( swCrInternalU );
+#endif
 
-        swCbInternalV = abs( swCbInternalV );
-        swCrInternalV = abs( swCrInternalV );
 
 
-        /* Update totals.
-        */
+/* CostellaUnblockFromInterleaved:
+**
+**   Internal function, run by CostellaThreadRun(), that converts a band of
+**   interleaved pixels into the channels of CostellaUnblockInterleaved().
+**   The results are exactly those of CostellaImageConvertRgbRowToYcbcr(),
+**   with the chrominance of each even row taken from its even pixels.
+**
+**   poBand:  Pointer to the COSTELLA_UNBLOCK_INTERLEAVED_BAND.
+*/
 
-        audCbBoundaryU[ swCbBoundaryU ]++;        
-        audCrBoundaryU[ swCrBoundaryU ]++;        
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
 
-        audCbBoundaryV[ swCbBoundaryV ]++;        
-        audCrBoundaryV[ swCrBoundaryV ]++;        
+static COSTELLA_FUNCTION( CostellaUnblockFromInterleaved, ( COSTELLA_O*
+  poBand ) )
+{
+  COSTELLA_UB* aubRgb, * aubY, * aubCb, * aubCr, * aubScratchCb,
+    * aubScratchCr;
+  COSTELLA_UD udRow, udColumn, udWidth;
+  COSTELLA_DF dfLap;
+  COSTELLA_UNBLOCK_INTERLEAVED_BAND* pibnd =
+    (COSTELLA_UNBLOCK_INTERLEAVED_BAND*) poBand;
 
-        audCbInternalU[ swCbInternalU ]++;        
-        audCrInternalU[ swCrInternalU ]++;        
 
-        audCbInternalV[ swCbInternalV ]++;        
-        audCrInternalV[ swCrInternalV ]++;        
+  /* Extract information.
+  */
 
-        udTotalChrominance++;
-      }
+  aubRgb = pibnd->aubRgb;
+  aubY = pibnd->aubY;
+  aubCb = pibnd->aubCb;
+  aubCr = pibnd->aubCr;
 
+  udWidth = pibnd->udWidth;
 
-      /* Walk across to the next downsampled column.
-      */
+  aubScratchCb = pibnd->aubScratch;
+  aubScratchCr = aubScratchCb + udWidth;
 
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpStart );
-    }
-  }
+  dfLap = pibnd->bTimed ? costella_thread_seconds() : 0;
 
 
-  /* Store totals.
+  /* Convert each row, with its chrominance if it is an even row, and
+  ** downsample the chrominance.
   */
 
-  *pudTotalLuminance = udTotalLuminance;
-  *pudTotalChrominance = udTotalChrominance;
+  for( udRow = 0; udRow < pibnd->udNumRows; udRow++ )
+  {
+    if( COSTELLA_CALL( CostellaImageConvertRgbRowToYcbcr( aubRgb, udWidth,
+      pibnd->bBgr, aubY, udRow & 1 ? 0 : aubScratchCb, udRow & 1 ? 0 :
+      aubScratchCr ) ) )
+    {
+      COSTELLA_ERROR( "Converting row" );
+      COSTELLA_RETURN;
+    }
+
+    costella_unblock_lap( pibnd->bTimed, pibnd->adfSeconds,
+      COSTELLA_UNBLOCK_PHASE_RGB_TO_YCBCR, &dfLap );
+
+    if( !( udRow & 1 ) )
+    {
+      for( udColumn = 0; udColumn < udWidth; udColumn += 2 )
+      {
+        aubCb[ udColumn >> 1 ] = aubScratchCb[ udColumn ];
+        aubCr[ udColumn >> 1 ] = aubScratchCr[ udColumn ];
+      }
+
+      aubCb += ( udWidth + 1 ) >> 1;
+      aubCr += ( udWidth + 1 ) >> 1;
+
+      costella_unblock_lap( pibnd->bTimed, pibnd->adfSeconds,
+        COSTELLA_UNBLOCK_PHASE_DOWNSAMPLE, &dfLap );
+    }
+
+    aubRgb += pibnd->sdRgbRowStride;
+    aubY += udWidth;
+  }
 }
 COSTELLA_END_FUNCTION
 
+#endif
 
 
-/* CostellaUnblockCorrectVerticalDiscrepancies: 
-**
-**   Correct the vertical discrepancies in an image, based on the supplied 
-**   adjustment tables. 
-**
-**   aswBuffer{Y,Cb,Cr}:  Buffer for the {Y,Cb,Cr} channel.
+
+/* CostellaUnblockToInterleaved:
 **
-**   aub{Y,Cb,Cr}Adjusted{U,V}:  Adjustment tables.
+**   Internal function, run by CostellaThreadRun(), that replicates the
+**   chrominance of a band of the channels of CostellaUnblockInterleaved(),
+**   and converts it into interleaved pixels.
 **
-**   pi{In,Out}:  Pointer to the {in,out}put image.
+**   poBand:  Pointer to the COSTELLA_UNBLOCK_INTERLEAVED_BAND.
 */
 
-static COSTELLA_FUNCTION( CostellaUnblockCorrectVerticalDiscrepancies, ( 
-  COSTELLA_SW* aswBufferY, COSTELLA_SW* aswBufferCb, COSTELLA_SW* 
-  aswBufferCr, COSTELLA_UB* aubYAdjustedU, COSTELLA_UB* aubYAdjustedV, 
-  COSTELLA_UB* aubCbAdjustedU, COSTELLA_UB* aubCbAdjustedV, COSTELLA_UB* 
-  aubCrAdjustedU, COSTELLA_UB* aubCrAdjustedV, COSTELLA_IMAGE* piIn, 
-  COSTELLA_IMAGE* piOut, COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* 
-  poPassback ) )
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+
+static COSTELLA_FUNCTION( CostellaUnblockToInterleaved, ( COSTELLA_O*
+  poBand ) )
 {
-  COSTELLA_B bAlpha, bCopyAlpha, bColor;
-  COSTELLA_UB ubPosition, ubY, ubCb, ubCr, ubA;
-  COSTELLA_SW swYU, swYV, swCbU, swCbV, swCrU, swCrV;
-  COSTELLA_SW* pswBufferY, * pswBufferYOld, * pswBufferCb, * pswBufferCbOld,
-    * pswBufferCr, * pswBufferCrOld;
-  COSTELLA_UD udWidth, udHeight, udRow, udColumn, udColumnBoundaryRight;
-  COSTELLA_SD sdRowStrideIn, sdRowStrideOut, sdDoubleRowStrideIn, 
-    sdDoubleRowStrideOut, sdAlphaRowStrideIn, sdAlphaRowStrideOut;
-  COSTELLA_IMAGE_ALPHA* piaIn, * piaOut;
-  COSTELLA_IMAGE_GRAY* pigIn, * pigOut;
-  COSTELLA_IMAGE_COLOR* picIn, * picOut;
-  COSTELLA_IMAGE_ALPHA_PIXEL iapInStart=NULL, iapOutStart=NULL, iapIn=NULL, iapOut=NULL;
-  COSTELLA_IMAGE_GRAY_PIXEL igpInStart=NULL, igpOutStart=NULL, igpIn=NULL, igpOut=NULL;
-  COSTELLA_IMAGE_COLOR_PIXEL icpInStart={0}, icpOutStart={0}, icpIn={0}, icpOut={0};
+  COSTELLA_UB* aubRgb, * aubY, * aubCb, * aubCr, * aubScratchCb,
+    * aubScratchCr;
+  COSTELLA_UD udRow, udColumn, udWidth;
+  COSTELLA_DF dfLap;
+  COSTELLA_UNBLOCK_INTERLEAVED_BAND* pibnd =
+    (COSTELLA_UNBLOCK_INTERLEAVED_BAND*) poBand;
 
 
   /* Extract information.
   */
 
-  bAlpha = piIn->bAlpha;
-  bColor = piIn->bColor;
-
-  udWidth = piIn->udWidth;
-  udHeight = piIn->udHeight;
-
-  sdRowStrideIn = piIn->sdRowStride;
-  sdRowStrideOut = piOut->sdRowStride;
-
-  sdAlphaRowStrideIn = piIn->sdAlphaRowStride;
-  sdAlphaRowStrideOut = piOut->sdAlphaRowStride;
+  aubRgb = pibnd->aubRgb;
+  aubY = pibnd->aubY;
+  aubCb = pibnd->aubCb;
+  aubCr = pibnd->aubCr;
 
-  piaIn = &piIn->ia;
-  piaOut = &piOut->ia;
+  udWidth = pibnd->udWidth;
 
-  pigIn = &piIn->ig;
-  pigOut = &piOut->ig;
+  aubScratchCb = pibnd->aubScratch;
+  aubScratchCr = aubScratchCb + udWidth;
 
-  picIn = &piIn->ic;
-  picOut = &piOut->ic;
+  dfLap = pibnd->bTimed ? costella_thread_seconds() : 0;
 
 
-  /* Check that the output image is consistent.
+  /* Replicate the chrominance of each even row, which serves the odd row
+  ** below it too, and convert each row.
   */
 
-  #ifdef COSTELLA_DEBUG
+  for( udRow = 0; udRow < pibnd->udNumRows; udRow++ )
   {
-    if( !piOut->bAlpha != !bAlpha )
+    if( !( udRow & 1 ) )
     {
-      COSTELLA_FUNDAMENTAL_ERROR( "Alpha flag disagrees" );
-      COSTELLA_RETURN;
+      for( udColumn = 0; udColumn < udWidth; udColumn++ )
+      {
+        aubScratchCb[ udColumn ] = aubCb[ udColumn >> 1 ];
+        aubScratchCr[ udColumn ] = aubCr[ udColumn >> 1 ];
+      }
+
+      aubCb += ( udWidth + 1 ) >> 1;
+      aubCr += ( udWidth + 1 ) >> 1;
+
+      costella_unblock_lap( pibnd->bTimed, pibnd->adfSeconds,
+        COSTELLA_UNBLOCK_PHASE_UPSAMPLE, &dfLap );
     }
 
-    if( !piOut->bColor != !bColor )
+    if( COSTELLA_CALL( CostellaImageConvertYcbcrRowToRgb( aubY,
+      aubScratchCb, aubScratchCr, udWidth, pibnd->bBgr, aubRgb ) ) )
     {
-      COSTELLA_FUNDAMENTAL_ERROR( "Color flag disagrees" );
+      COSTELLA_ERROR( "Converting row" );
       COSTELLA_RETURN;
     }
 
-    if( piOut->udWidth != udWidth )
+    costella_unblock_lap( pibnd->bTimed, pibnd->adfSeconds,
+      COSTELLA_UNBLOCK_PHASE_YCBCR_TO_RGB, &dfLap );
+
+    aubRgb += pibnd->sdRgbRowStride;
+    aubY += udWidth;
+  }
+}
+COSTELLA_END_FUNCTION
+
+#endif
+
+
+
+/* CostellaUnblockSplitBands: 
+**
+**   Internal function that splits an image into horizontal bands of rows, 
+**   one for each thread, for the first two sweeps. Each band starts on a 
+**   multiple of 16 rows, so that the chrominance rows and the horizontal 
+**   block boundaries of each band are the same as those of the whole image.
+**
+**   pi{In,Out}:  Pointer to the {in,out}put image.
+**
+**   udNumThreads:  Maximum number of bands.
+**
+**   abnd:  Array of at least udNumThreads bands to be set up.
+**
+**   pudNumBands:  Pointer to a COSTELLA_UD, into which will be written the
+**     number of bands actually used.
+*/
+
+static COSTELLA_FUNCTION( CostellaUnblockSplitBands, ( COSTELLA_IMAGE* 
+  piIn, COSTELLA_IMAGE* piOut, COSTELLA_UD udNumThreads, 
+  COSTELLA_UNBLOCK_BAND* abnd, COSTELLA_UD* pudNumBands ) )
+{
+  COSTELLA_UD udHeight, udRowsPerBand, udRowFirst, udNumRows, udNumBands;
+  COSTELLA_UNBLOCK_BAND* pbnd;
+
+
+  /* Compute the number of rows in each band, rounded up to a multiple of 
+  ** 16.
+  */
+
+  udHeight = piIn->udHeight;
+
+  udRowsPerBand = ( udHeight + udNumThreads - 1 ) / udNumThreads;
+  udRowsPerBand = ( udRowsPerBand + 15 ) & ~(COSTELLA_UD) 15;
+
+
+  /* Set up the bands.
+  */
+
+  for( udRowFirst = 0, udNumBands = 0, pbnd = abnd; udRowFirst < udHeight;
+    udRowFirst += udRowsPerBand, udNumBands++, pbnd++ )
+  {
+    udNumRows = udHeight - udRowFirst;
+
+    if( udNumRows > udRowsPerBand )
     {
-      COSTELLA_FUNDAMENTAL_ERROR( "Width disagrees" );
-      COSTELLA_RETURN;
+      udNumRows = udRowsPerBand;
     }
 
-    if( piOut->udHeight != udHeight )
+    if( COSTELLA_CALL( CostellaImageRows( piIn, udRowFirst, udNumRows, 
+      &pbnd->iIn ) ) || COSTELLA_CALL( CostellaImageRows( piOut, udRowFirst,
+      udNumRows, &pbnd->iOut ) ) )
     {
-      COSTELLA_FUNDAMENTAL_ERROR( "Height disagrees" );
+      COSTELLA_ERROR( "Setting up band" );
       COSTELLA_RETURN;
     }
   }
-  #endif
 
 
-  /* Determine whether we need to copy across alpha values.
+  /* Store the number of bands.
   */
 
-  bCopyAlpha = bAlpha && !COSTELLA_IMAGE_ALPHA_IS_SAME( piaIn, piaOut );
+  *pudNumBands = udNumBands;
+}
+COSTELLA_END_FUNCTION
 
 
-  /* Compute the double row strides.
-  */
 
-  sdDoubleRowStrideIn = sdRowStrideIn << 1;
-  sdDoubleRowStrideOut = sdRowStrideOut << 1;
+/* CostellaUnblockSplitColumns: 
+**
+**   Internal function that splits an image into vertical bands of columns,
+**   one for each thread, for the third sweep. Each band starts on a 
+**   multiple of 16 columns, so that the chrominance columns of each band 
+**   are the same as those of the whole image.
+**
+**   pi:  Pointer to the image, which is used as both the input and output 
+**     image of each band.
+**
+**   udNumThreads:  Maximum number of bands.
+**
+**   abnd:  Array of at least udNumThreads bands to be set up.
+**
+**   pudNumBands:  Pointer to a COSTELLA_UD, into which will be written the
+**     number of bands actually used.
+*/
+
+static COSTELLA_FUNCTION( CostellaUnblockSplitColumns, ( COSTELLA_IMAGE* 
+  pi, COSTELLA_UD udNumThreads, COSTELLA_UNBLOCK_BAND* abnd, COSTELLA_UD* 
+  pudNumBands ) )
+{
+  COSTELLA_UD udWidth, udColumnsPerBand, udColumnFirst, udNumColumns, 
+    udNumBands;
+  COSTELLA_UNBLOCK_BAND* pbnd;
 
 
-  /* Start with the luminance channel. Start at top-left of the input and
-  ** output images. 
+  /* Compute the number of columns in each band, rounded up to a multiple 
+  ** of 16.
   */
 
-  if( bColor )
-  {
-    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpInStart, *picIn, udWidth, 
-      udHeight, sdRowStrideIn );
-    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpOutStart, *picOut, udWidth, 
-      udHeight, sdRowStrideOut );
-  }
-  else
-  {
-    COSTELLA_IMAGE_GRAY_PIXEL_SET_TOP_LEFT( igpInStart, *pigIn, udWidth, 
-      udHeight, sdRowStrideIn );
-    COSTELLA_IMAGE_GRAY_PIXEL_SET_TOP_LEFT( igpOutStart, *pigOut, udWidth, 
-      udHeight, sdRowStrideOut );
-  }
-  
-  if( bCopyAlpha )     
-  {
-    COSTELLA_IMAGE_ALPHA_PIXEL_SET_TOP_LEFT( iapInStart, *piaIn, udWidth, 
-      udHeight, sdAlphaRowStrideIn );
-    COSTELLA_IMAGE_ALPHA_PIXEL_SET_TOP_LEFT( iapOutStart, *piaOut, udWidth, 
-      udHeight, sdAlphaRowStrideOut );
-  }
+  udWidth = pi->udWidth;
 
+  udColumnsPerBand = ( udWidth + udNumThreads - 1 ) / udNumThreads;
+  udColumnsPerBand = ( udColumnsPerBand + 15 ) & ~(COSTELLA_UD) 15;
 
-  /* Walk through the rows of the image.
+
+  /* Set up the bands.
   */
 
-  for( udRow = 0; udRow < udHeight; udRow++ )
+  for( udColumnFirst = 0, udNumBands = 0, pbnd = abnd; udColumnFirst < 
+    udWidth; udColumnFirst += udColumnsPerBand, udNumBands++, pbnd++ )
   {
-    /* Progress callback.
-    */
+    udNumColumns = udWidth - udColumnFirst;
 
-    if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
+    if( udNumColumns > udColumnsPerBand )
     {
-      COSTELLA_ERROR( "Progress callback" );
-      COSTELLA_RETURN;
+      udNumColumns = udColumnsPerBand;
     }
 
-
-    /* If there is an alpha channel, copy it across for the whole row now.
-    */
-
-    if( bCopyAlpha )
+    if( COSTELLA_CALL( CostellaImageColumns( pi, udColumnFirst, 
+      udNumColumns, &pbnd->iOut ) ) )
     {
-      COSTELLA_IMAGE_ALPHA_PIXEL_ASSIGN( iapInStart, iapIn );
-      COSTELLA_IMAGE_ALPHA_PIXEL_ASSIGN( iapOutStart, iapOut );
-      
-      for( udColumn = 0; udColumn < udWidth; udColumn++, 
-        COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_RIGHT( iapIn ), 
-        COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_RIGHT( iapOut ) )
-      {
-        ubA = COSTELLA_IMAGE_ALPHA_PIXEL_GET_A( iapIn );
-        COSTELLA_IMAGE_ALPHA_PIXEL_SET_A( iapOut, ubA );
-      }
+      COSTELLA_ERROR( "Setting up band" );
+      COSTELLA_RETURN;
     }
 
+    pbnd->iIn = pbnd->iOut;
+  }
 
-    /* Start off at the leftmost pixel of this row, for both input and 
-    ** output images. 
-    */
 
-    if( bColor )
-    {
-      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpInStart, icpIn );
-      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpOutStart, icpOut );
-    }
-    else
-    {
-      COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpInStart, igpIn );
-      COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpOutStart, igpOut );
-    }
+  /* Store the number of bands.
+  */
 
+  *pudNumBands = udNumBands;
+}
+COSTELLA_END_FUNCTION
 
-    /* If the width of the image is less than 9 pixels, then there are no
+
+
+/* CostellaUnblockFirstSweep: 
+**
+**   Internal job function that performs the first sweep over one band of 
+**   rows: conversion to YCbCr and downsampling of the chrominance, where 
+**   required, and the analysis of the vertical discrepancies. The band is 
+**   processed a sub-band of rows at a time, each sub-band going through all
+**   of these stages while it is still in the cache. The frequency tables of
+**   the band are cleared first.
+**
+**   poBand:  Pointer to the COSTELLA_UNBLOCK_BAND.
+*/
+
+static COSTELLA_FUNCTION( CostellaUnblockFirstSweep, ( COSTELLA_O* poBand 
+  ) )
+{
+  COSTELLA_UD udHeight, udRowsPerSubband, udRowFirst, udNumRows;
+  COSTELLA_DF dfLap;
+  COSTELLA_IMAGE iIn, iOut;
+  COSTELLA_UNBLOCK_BAND* pbnd = (COSTELLA_UNBLOCK_BAND*) poBand;
+
+
+  /* Clear the frequency tables and totals.
+  */
+
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audYBoundaryU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audYBoundaryV, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audYInternalU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audYInternalV, 256, COSTELLA_UD );
+
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCbBoundaryU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCbBoundaryV, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCbInternalU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCbInternalV, 256, COSTELLA_UD );
+
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCrBoundaryU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCrBoundaryV, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCrInternalU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCrInternalV, 256, COSTELLA_UD );
+
+  pbnd->udTotalLuminance = 0;
+  pbnd->udTotalChrominance = 0;
+
+
+  /* Walk through the sub-bands.
+  */
+
+  udHeight = pbnd->iIn.udHeight;
+  udRowsPerSubband = costella_unblock_subband_rows( &pbnd->iIn );
+
+  for( udRowFirst = 0; udRowFirst < udHeight; udRowFirst += 
+    udRowsPerSubband )
+  {
+    /* Set up the sub-band.
+    */
+
+    udNumRows = udHeight - udRowFirst;
+
+    if( udNumRows > udRowsPerSubband )
+    {
+      udNumRows = udRowsPerSubband;
+    }
+
+    if( COSTELLA_CALL( CostellaImageRows( &pbnd->iIn, udRowFirst, udNumRows,
+      &iIn ) ) || COSTELLA_CALL( CostellaImageRows( &pbnd->iOut, udRowFirst,
+      udNumRows, &iOut ) ) )
+    {
+      COSTELLA_ERROR( "Setting up sub-band" );
+      COSTELLA_RETURN;
+    }
+
+    dfLap = pbnd->bTimed ? costella_thread_seconds() : 0;
+
+
+    /* Convert a color image to YCbCr format, if it is not already.
+    */
+
+    if( pbnd->bConvert && COSTELLA_CALL( CostellaImageConvertRgbToYcbcr( 
+      &iIn, &iOut, 0, 0 ) ) )
+    {
+      COSTELLA_ERROR( "Converting to YCbCr" );
+      COSTELLA_RETURN;
+    }
+
+    costella_unblock_lap( pbnd->bTimed, pbnd->adfSeconds, 
+      COSTELLA_UNBLOCK_PHASE_RGB_TO_YCBCR, &dfLap );
+
+
+    /* Downsample the chrominance, if it is not already.
+    */
+
+    if( pbnd->bDownsample && COSTELLA_CALL( 
+      CostellaImageChrominanceAverageDownsampleReplicate( pbnd->bConvert ? 
+      &iOut : &iIn, &iOut, 0, 0 ) ) )
+    {
+      COSTELLA_ERROR( "Downsampling chrominance" );
+      COSTELLA_RETURN;
+    }
+
+    costella_unblock_lap( pbnd->bTimed, pbnd->adfSeconds, 
+      COSTELLA_UNBLOCK_PHASE_DOWNSAMPLE, &dfLap );
+
+
+    /* Analyze the vertical discrepancies. Note that a grayscale image is 
+    ** still contained in the input image, whereas a color image is in the
+    ** output image.
+    */
+
+    if( COSTELLA_CALL( CostellaUnblockComputeVerticalDiscrepancies( 
+      pbnd->aswBufferY, pbnd->aswBufferCb, pbnd->aswBufferCr, 
+      pbnd->audYBoundaryU, pbnd->audYBoundaryV, pbnd->audCbBoundaryU, 
+      pbnd->audCbBoundaryV, pbnd->audCrBoundaryU, pbnd->audCrBoundaryV, 
+      pbnd->audYInternalU, pbnd->audYInternalV, pbnd->audCbInternalU, 
+      pbnd->audCbInternalV, pbnd->audCrInternalU, pbnd->audCrInternalV, 
+      &pbnd->udTotalLuminance, &pbnd->udTotalChrominance, pbnd->bColor ? 
+      &iOut : &iIn, 0, 0 ) ) )
+    {
+      COSTELLA_ERROR( "Computing vertical discrepancies" );
+      COSTELLA_RETURN;
+    }
+
+    costella_unblock_lap( pbnd->bTimed, pbnd->adfSeconds, 
+      COSTELLA_UNBLOCK_PHASE_VERTICAL_COMPUTE, &dfLap );
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaUnblockSecondSweep: 
+**
+**   Internal job function that performs the second sweep over one band of 
+**   rows: the correction of the vertical discrepancies, and the analysis of
+**   the horizontal discrepancies. Each sub-band of rows is corrected, and 
+**   then every horizontal boundary whose rows are now all corrected is 
+**   analyzed. The boundary at the top of the band needs rows of the band 
+**   above, and is left to the caller. The frequency tables of the band are 
+**   cleared first.
+**
+**   poBand:  Pointer to the COSTELLA_UNBLOCK_BAND.
+*/
+
+static COSTELLA_FUNCTION( CostellaUnblockSecondSweep, ( COSTELLA_O* poBand 
+  ) )
+{
+  COSTELLA_UD udHeight, udRowsPerSubband, udRowFirst, udNumRows, 
+    udRowBoundaryFirst, udRowBoundaryEnd;
+  COSTELLA_DF dfLap;
+  COSTELLA_IMAGE iIn, iOut;
+  COSTELLA_UNBLOCK_BAND* pbnd = (COSTELLA_UNBLOCK_BAND*) poBand;
+
+
+  /* Clear the frequency tables and totals.
+  */
+
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audYBoundaryU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audYBoundaryV, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audYInternalU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audYInternalV, 256, COSTELLA_UD );
+
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCbBoundaryU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCbBoundaryV, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCbInternalU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCbInternalV, 256, COSTELLA_UD );
+
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCrBoundaryU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCrBoundaryV, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCrInternalU, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( pbnd->audCrInternalV, 256, COSTELLA_UD );
+
+  pbnd->udTotalLuminance = 0;
+  pbnd->udTotalChrominance = 0;
+
+
+  /* Walk through the sub-bands.
+  */
+
+  udHeight = pbnd->iOut.udHeight;
+  udRowsPerSubband = costella_unblock_subband_rows( &pbnd->iOut );
+
+  for( udRowFirst = 0, udRowBoundaryFirst = 0; udRowFirst < udHeight; 
+    udRowFirst += udRowsPerSubband, udRowBoundaryFirst = udRowBoundaryEnd )
+  {
+    /* Set up the sub-band.
+    */
+
+    udNumRows = udHeight - udRowFirst;
+
+    if( udNumRows > udRowsPerSubband )
+    {
+      udNumRows = udRowsPerSubband;
+    }
+
+    if( COSTELLA_CALL( CostellaImageRows( &pbnd->iIn, udRowFirst, udNumRows,
+      &iIn ) ) || COSTELLA_CALL( CostellaImageRows( &pbnd->iOut, udRowFirst,
+      udNumRows, &iOut ) ) )
+    {
+      COSTELLA_ERROR( "Setting up sub-band" );
+      COSTELLA_RETURN;
+    }
+
+    dfLap = pbnd->bTimed ? costella_thread_seconds() : 0;
+
+
+    /* Correct the vertical discrepancies. Note that a grayscale image is 
+    ** still in the input image, whereas a color image is in the output 
+    ** image.
+    */
+
+    if( COSTELLA_CALL( CostellaUnblockCorrectVerticalDiscrepancies( 
+      pbnd->aswBufferY, pbnd->aswBufferCb, pbnd->aswBufferCr, 
+      pbnd->aubYAdjustedU, pbnd->aubYAdjustedV, pbnd->aubCbAdjustedU, 
+      pbnd->aubCbAdjustedV, pbnd->aubCrAdjustedU, pbnd->aubCrAdjustedV, 
+      pbnd->bColor ? &iOut : &iIn, &iOut, 0, 0 ) ) )
+    {
+      COSTELLA_ERROR( "Correcting vertical discrepancies" );
+      COSTELLA_RETURN;
+    }
+
+    costella_unblock_lap( pbnd->bTimed, pbnd->adfSeconds, 
+      COSTELLA_UNBLOCK_PHASE_VERTICAL_CORRECT, &dfLap );
+
+
+    /* Analyze the horizontal boundaries that no longer need any rows 
+    ** below this sub-band, which reach at most four rows below the 
+    ** boundary, or all of the remaining boundaries if this is the last 
+    ** sub-band. The image is now in the output image, regardless of type.
+    */
+
+    udRowBoundaryEnd = udHeight - udRowFirst > udRowsPerSubband ? 
+      udRowFirst + udRowsPerSubband - 4 : udHeight;
+
+    if( COSTELLA_CALL( CostellaUnblockComputeHorizontalDiscrepancies( 
+      pbnd->aswBufferY, pbnd->aswBufferCb, pbnd->aswBufferCb, 
+      pbnd->audLanes, pbnd->audYBoundaryU, pbnd->audYBoundaryV, 
+      pbnd->audCbBoundaryU, pbnd->audCbBoundaryV, pbnd->audCrBoundaryU, 
+      pbnd->audCrBoundaryV, pbnd->audYInternalU, pbnd->audYInternalV, 
+      pbnd->audCbInternalU, pbnd->audCbInternalV, pbnd->audCrInternalU, 
+      pbnd->audCrInternalV, &pbnd->udTotalLuminance, 
+      &pbnd->udTotalChrominance, &pbnd->iOut, udRowBoundaryFirst, 
+      udRowBoundaryEnd, 0, 0 ) ) )
+    {
+      COSTELLA_ERROR( "Computing horizontal discrepancies" );
+      COSTELLA_RETURN;
+    }
+
+    costella_unblock_lap( pbnd->bTimed, pbnd->adfSeconds, 
+      COSTELLA_UNBLOCK_PHASE_HORIZONTAL_COMPUTE, &dfLap );
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaUnblockThirdSweep: 
+**
+**   Internal job function that performs the third sweep over one band of 
+**   columns: the correction of the horizontal discrepancies, and the 
+**   replication of the chrominance and conversion back to RGB format, 
+**   where required. The boundaries are corrected a sub-band of rows at a 
+**   time, from the top down; the rows that no later boundary will change 
+**   are then finished while they are still in the cache.
+**
+**   poBand:  Pointer to the COSTELLA_UNBLOCK_BAND.
+*/
+
+static COSTELLA_FUNCTION( CostellaUnblockThirdSweep, ( COSTELLA_O* poBand 
+  ) )
+{
+  COSTELLA_UD udHeight, udRowsPerSubband, udRowFirst, udRowEnd, 
+    udRowFinished, udRowDone;
+  COSTELLA_DF dfLap;
+  COSTELLA_IMAGE i;
+  COSTELLA_UNBLOCK_BAND* pbnd = (COSTELLA_UNBLOCK_BAND*) poBand;
+
+
+  /* Extract information.
+  */
+
+  udHeight = pbnd->iOut.udHeight;
+  udRowsPerSubband = costella_unblock_subband_rows( &pbnd->iOut );
+  dfLap = pbnd->bTimed ? costella_thread_seconds() : 0;
+
+
+  /* Without contiguous channels, the horizontal discrepancies are 
+  ** corrected for the whole band at once.
+  */
+
+  #ifndef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+  {
+    if( COSTELLA_CALL( CostellaUnblockCorrectHorizontalDiscrepancies( 
+      pbnd->aswBufferY, pbnd->aswBufferCb, pbnd->aswBufferCr, 
+      pbnd->aubYAdjustedU, pbnd->aubYAdjustedV, pbnd->aubCbAdjustedU, 
+      pbnd->aubCbAdjustedV, pbnd->aubCrAdjustedU, pbnd->aubCrAdjustedV, 
+      &pbnd->iOut, &pbnd->iOut, 0, 0 ) ) )
+    {
+      COSTELLA_ERROR( "Correcting horizontal discrepancies" );
+      COSTELLA_RETURN;
+    }
+
+    costella_unblock_lap( pbnd->bTimed, pbnd->adfSeconds, 
+      COSTELLA_UNBLOCK_PHASE_HORIZONTAL_CORRECT, &dfLap );
+  }
+  #endif
+
+
+  /* Walk through the sub-bands.
+  */
+
+  for( udRowFirst = 0, udRowDone = 0; udRowFirst < udHeight; udRowFirst += 
+    udRowsPerSubband )
+  {
+    /* Correct the boundaries in this sub-band.
+    */
+
+    udRowEnd = udHeight - udRowFirst > udRowsPerSubband ? udRowFirst + 
+      udRowsPerSubband : udHeight;
+
+    #ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+    {
+      if( COSTELLA_CALL( CostellaUnblockCorrectHorizontalInPlace( 
+        pbnd->aubYAdjustedU, pbnd->aubYAdjustedV, pbnd->aubCbAdjustedU, 
+        pbnd->aubCbAdjustedV, pbnd->aubCrAdjustedU, pbnd->aubCrAdjustedV, 
+        &pbnd->iOut, udRowFirst, udRowEnd, 0, 0 ) ) )
+      {
+        COSTELLA_ERROR( "Correcting horizontal discrepancies" );
+        COSTELLA_RETURN;
+      }
+
+      costella_unblock_lap( pbnd->bTimed, pbnd->adfSeconds, 
+        COSTELLA_UNBLOCK_PHASE_HORIZONTAL_CORRECT, &dfLap );
+    }
+    #endif
+
+
+    /* The next chrominance boundary changes the 16 rows above it, so all 
+    ** rows above those are now finished, or all rows if this is the last 
+    ** sub-band. Check if there is anything to do with them.
+    */
+
+    udRowFinished = udRowEnd < udHeight ? udRowEnd - 16 : udHeight;
+
+    if( !pbnd->bReplicate || udRowFinished <= udRowDone )
+    {
+      continue;
+    }
+
+    if( COSTELLA_CALL( CostellaImageRows( &pbnd->iOut, udRowDone, 
+      udRowFinished - udRowDone, &i ) ) )
+    {
+      COSTELLA_ERROR( "Setting up finished rows" );
+      COSTELLA_RETURN;
+    }
+
+    udRowDone = udRowFinished;
+
+
+    /* Replicate the chrominance values, which have only been stored in the
+    ** top-left pixels of the 2 x 2 blocks, into the other three positions 
+    ** in each block.
+    */
+
+    if( COSTELLA_CALL( CostellaImageChrominanceReplicateEq( &i, 0, 0 ) ) )
+    {
+      COSTELLA_ERROR( "Replicating chrominance" );
+      COSTELLA_RETURN;
+    }
+
+    costella_unblock_lap( pbnd->bTimed, pbnd->adfSeconds, 
+      COSTELLA_UNBLOCK_PHASE_UPSAMPLE, &dfLap );
+
+
+    /* Convert the output to RGB format, if required.
+    */
+
+    if( pbnd->bConvertBack && COSTELLA_CALL( CostellaImageConvertYcbcrToRgb(
+      &i, &i, 0, 0 ) ) )
+    {
+      COSTELLA_ERROR( "Converting to RGB" );
+      COSTELLA_RETURN;
+    }
+
+    costella_unblock_lap( pbnd->bTimed, pbnd->adfSeconds, 
+      COSTELLA_UNBLOCK_PHASE_YCBCR_TO_RGB, &dfLap );
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaUnblockMergeBands: 
+**
+**   Internal function that adds the frequency tables and totals of the 
+**   bands to those of the whole image.
+**
+**   abnd:  Array of bands.
+**
+**   udNumBands:  Number of bands.
+**
+**   bColor:  Nonzero if the image is a color image.
+**
+**   aud{Y,Cb,Cr}{Boundary,Internal}{U,V}:  Array of frequencies for the 
+**     {U,V} discrepancies {at block boundaries, internal to each block} for
+**     the {Y,Cb,Cr} channel, to which those of the bands are added.
+**
+**   pudTotal{Luminance,Chrominance}:  Pointer to a COSTELLA_UD, to which 
+**     will be added the totals of the bands.
+*/
+
+static COSTELLA_FUNCTION( CostellaUnblockMergeBands, ( COSTELLA_UNBLOCK_BAND*
+  abnd, COSTELLA_UD udNumBands, COSTELLA_B bColor, COSTELLA_UD* 
+  audYBoundaryU, COSTELLA_UD* audYBoundaryV, COSTELLA_UD* audCbBoundaryU, 
+  COSTELLA_UD* audCbBoundaryV, COSTELLA_UD* audCrBoundaryU, COSTELLA_UD* 
+  audCrBoundaryV, COSTELLA_UD* audYInternalU, COSTELLA_UD* audYInternalV, 
+  COSTELLA_UD* audCbInternalU, COSTELLA_UD* audCbInternalV, COSTELLA_UD* 
+  audCrInternalU, COSTELLA_UD* audCrInternalV, COSTELLA_UD* 
+  pudTotalLuminance, COSTELLA_UD* pudTotalChrominance ) )
+{
+  COSTELLA_UD udBand;
+  COSTELLA_UW uw;
+  COSTELLA_UNBLOCK_BAND* pbnd;
+
+
+  /* Walk through the bands.
+  */
+
+  for( udBand = 0, pbnd = abnd; udBand < udNumBands; udBand++, pbnd++ )
+  {
+    for( uw = 0; uw < 256; uw++ )
+    {
+      audYBoundaryU[ uw ] += pbnd->audYBoundaryU[ uw ];
+      audYBoundaryV[ uw ] += pbnd->audYBoundaryV[ uw ];
+      audYInternalU[ uw ] += pbnd->audYInternalU[ uw ];
+      audYInternalV[ uw ] += pbnd->audYInternalV[ uw ];
+    }
+
+    *pudTotalLuminance += pbnd->udTotalLuminance;
+
+    if( bColor )
+    {
+      for( uw = 0; uw < 256; uw++ )
+      {
+        audCbBoundaryU[ uw ] += pbnd->audCbBoundaryU[ uw ];
+        audCbBoundaryV[ uw ] += pbnd->audCbBoundaryV[ uw ];
+        audCbInternalU[ uw ] += pbnd->audCbInternalU[ uw ];
+        audCbInternalV[ uw ] += pbnd->audCbInternalV[ uw ];
+
+        audCrBoundaryU[ uw ] += pbnd->audCrBoundaryU[ uw ];
+        audCrBoundaryV[ uw ] += pbnd->audCrBoundaryV[ uw ];
+        audCrInternalU[ uw ] += pbnd->audCrInternalU[ uw ];
+        audCrInternalV[ uw ] += pbnd->audCrInternalV[ uw ];
+      }
+
+      *pudTotalChrominance += pbnd->udTotalChrominance;
+    }
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaUnblockComputeVerticalDiscrepancies: 
+**
+**   Internal function that computes the vertical discrepancies in an image.
+**
+**   aswBuffer{Y,Cb,Cr}:  Buffer for the {Y,Cb,Cr} channel.
+**
+**   aud{Y,Cb,Cr}{Boundary,Internal}{U,V}:  Array of frequencies for the 
+**     {U,V} discrepancies {at block boundaries, internal to each block} for
+**     the {Y,Cb,Cr} channel, to which the frequencies found are added.
+**
+**   pudTotal{Luminance,Chrominance}:  Pointer to a COSTELLA_UD, to which 
+**     will be added the number of {luminance,chrominance} discrepancies 
+**     counted.
+**
+**   pi:  Pointer to the image to be analyzed.
+*/
+
+static COSTELLA_FUNCTION( CostellaUnblockComputeVerticalDiscrepancies, ( 
+  COSTELLA_SW* aswBufferY, COSTELLA_SW* aswBufferCb, COSTELLA_SW* 
+  aswBufferCr, COSTELLA_UD* audYBoundaryU, COSTELLA_UD* audYBoundaryV, 
+  COSTELLA_UD* audCbBoundaryU, COSTELLA_UD* audCbBoundaryV, COSTELLA_UD* 
+  audCrBoundaryU, COSTELLA_UD* audCrBoundaryV, COSTELLA_UD* audYInternalU, 
+  COSTELLA_UD* audYInternalV, COSTELLA_UD* audCbInternalU, COSTELLA_UD* 
+  audCbInternalV, COSTELLA_UD* audCrInternalU, COSTELLA_UD* audCrInternalV, 
+  COSTELLA_UD* pudTotalLuminance, COSTELLA_UD* pudTotalChrominance, 
+  COSTELLA_IMAGE* pi, COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* 
+  poPassback ) )
+{
+  COSTELLA_B bColor;
+  COSTELLA_UB ubPosition;
+  COSTELLA_SW* pswBufferY, * pswBufferYOld, * pswBufferCb, * pswBufferCr, 
+    * pswBufferCbOld, * pswBufferCrOld;
+  COSTELLA_SD sdRowStride, sdDoubleRowStride;
+  COSTELLA_UD udWidth, udHeight, udRow, udColumn, udColumnRight, 
+    udTotalLuminance, udTotalChrominance;
+  COSTELLA_IMAGE_GRAY* pig;
+  COSTELLA_IMAGE_COLOR* pic;
+  COSTELLA_IMAGE_COLOR_PIXEL icp={0}, icpStart={0};
+  COSTELLA_IMAGE_GRAY_PIXEL igp=NULL, igpStart=NULL;
+
+
+  /* Extract information.
+  */
+
+  bColor = pi->bColor;
+
+  udWidth = pi->udWidth;
+  udHeight = pi->udHeight;
+
+  sdRowStride = pi->sdRowStride;
+
+  pig = &pi->ig;
+  pic = &pi->ic;
+
+
+  /* Compute double the row stride.
+  */
+
+  sdDoubleRowStride = sdRowStride << 1;
+
+
+  /* Initialize totals.
+  */
+
+  udTotalLuminance = 0;
+  udTotalChrominance = 0;
+
+
+  /* First we analyze the luminance channel. Start at top-left of image.
+  */
+
+  if( bColor )
+  {
+    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpStart, *pic, udWidth, 
+      udHeight, sdRowStride );
+  }
+  else
+  {
+    COSTELLA_IMAGE_GRAY_PIXEL_SET_TOP_LEFT( igpStart, *pig, udWidth, 
+      udHeight, sdRowStride );
+  }
+
+    
+  /* Walk through the rows of the image.
+  */
+
+  for( udRow = 0; udRow < udHeight; udRow++ )
+  {
+    /* Progress callback.
+    */
+
+    if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
+    {
+      COSTELLA_ERROR( "Progress callback" );
+      COSTELLA_RETURN;
+    }
+
+
+    /* Start off at the pixel to the right of the leftmost pixel of this 
+    ** row, i.e., at x = 1, where the leftmost pixel is x = 0. 
+    */
+
+    if( bColor )
+    {
+      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpStart, icp );
+      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icp );
+    }
+    else
+    {
+      COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpStart, igp );
+      COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igp );
+    }
+
+
+    /* We start off by filling positions 8 and 9 of the values array from 
+    ** the x = 1 and x = 2 columns of this image. These will be shifted back
+    ** to the start of the values array in the first step below.
+    **
+    ** Switch on image type.
+    */
+
+    if( bColor )
+    {
+      for( ubPosition = 0, pswBufferY = aswBufferY + 8; ubPosition < 2; 
+        ubPosition++, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icp ) )
+      {
+        *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( 
+          icp );
+      }
+    }
+    else
+    {
+      for( ubPosition = 0, pswBufferY = aswBufferY + 8; ubPosition < 2; 
+        ubPosition++, COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igp ) )
+      {
+        *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( igp 
+          ); 
+        }
+    }
+
+
+    /* Walk through the vertical boundaries. We only measure discrepancies 
+    ** for a block if it has a right boundary, i.e., at least one pixel to 
+    ** its right; this ensures that the total counts for internal and 
+    ** boundary discrepancies will be identically equal. We ensure this by
+    ** checking if the column that is eight pixels to the right of our block
+    ** is within the image.
+    */
+
+    for( udColumnRight = 8; udColumnRight + 3 <= udWidth; udColumnRight += 
+      8 )
+    {
+      /* The interior boundaries have all ten pixels. Get the first two 
+      ** pixels from what is already in the array. 
+      */
+
+      for( ubPosition = 0, pswBufferY = aswBufferY, pswBufferYOld = 
+        aswBufferY + 8; ubPosition < 2; ubPosition++ )
+      {
+        *pswBufferY++ = *pswBufferYOld++;
+      }
+
+
+      /* Extract the next eight pixels from the image. Switch on image type.
+      */
+
+      if( bColor )
+      {
+        for( ; ubPosition < 10; ubPosition++, 
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icp ) )
+        {
+          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( 
+            icp );
+        }
+      }
+      else
+      {
+        for( ; ubPosition < 10; ubPosition++, 
+          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igp ) )
+        {
+          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( igp
+            );
+        }
+      }
+
+
+      /* Compute discrepancies and update frequency tables.
+      */
+
+      costella_unblock_count_discrepancies( aswBufferY, COSTELLA_TRUE, 
+        audYBoundaryU, audYBoundaryV, audYInternalU, audYInternalV );
+
+      udTotalLuminance++;
+    }
+
+
+    /* The last boundary may lack the last one or two pixels.
+    */
+
+    if( udColumnRight < udWidth )
+    {
+      /* Get the first two pixels from what is already in the array. 
+      */
+
+      for( ubPosition = 0, pswBufferY = aswBufferY, pswBufferYOld = 
+        aswBufferY + 8; ubPosition < 2; ubPosition++ )
+      {
+        *pswBufferY++ = *pswBufferYOld++;
+      }
+
+
+      /* Extract the pixels up to the right edge of the image. Switch on 
+      ** image type.
+      */
+
+      if( bColor )
+      {
+        for( udColumn = udColumnRight - 5; udColumn < udWidth; udColumn++, 
+          ubPosition++, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icp ) )
+        {
+          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( 
+            icp );
+        }
+      }
+      else
+      {
+        for( udColumn = udColumnRight - 5; udColumn < udWidth; udColumn++, 
+          ubPosition++, COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igp ) )
+        {
+          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( igp
+            );
+        }
+      }
+
+
+      /* Fill the unfilled entries with -1, which the discrepancy function
+      ** recognizes as missing entries.
+      */
+
+      for( ; ubPosition < 10; ubPosition++ )
+      {
+        *pswBufferY++ = -1;
+      }
+
+
+      /* Compute discrepancies and update frequency tables.
+      */
+
+      costella_unblock_count_discrepancies( aswBufferY, COSTELLA_FALSE, 
+        audYBoundaryU, audYBoundaryV, audYInternalU, audYInternalV );
+
+      udTotalLuminance++;
+    }
+
+
+    /* Walk down to the next row.
+    */
+
+    if( bColor ) 
+    {
+      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpStart, sdRowStride );
+    }
+    else
+    {
+      COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpStart, sdRowStride );
+    }
+  }
+
+
+  /* If we have a color image, we now analyze the discrepancies for the
+  ** downsampled chrominance components.
+  */
+
+  if( bColor )
+  {
+    /* Start at the top-left of the image. 
+    */
+
+    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpStart, *pic, udWidth, 
+      udHeight, sdRowStride );
+
+
+    /* Walk through those rows that contain chrominance data.
+    */
+
+    for( udRow = 0; udRow < udHeight; udRow += 2 )
+    {
+      /* Progress callback.
+      */
+
+      if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
+      {
+        COSTELLA_ERROR( "Progress callback" );
+        COSTELLA_RETURN;
+      }
+
+
+      /* Start off at the pixel to the right of the leftmost downsampled 
+      ** pixel of this row, i.e., at x = 2, where the leftmost downsampled
+      ** pixel is x = 0.
+      */
+
+      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpStart, icp );
+      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icp );
+
+
+      /* We start off by filling positions 8 and 9 of the values arrays from
+      ** the xd = 1 and xd = 2 downsampled columns of this image, i.e., from
+      ** x = 2 and x = 4 of the actual image. These will be shifted back to 
+      ** the start of the values arrays in the first step below. Switch on
+      ** image type.
+      */
+
+      for( ubPosition = 0, pswBufferCb = aswBufferCb + 8, pswBufferCr = 
+        aswBufferCr + 8; ubPosition < 2; ubPosition++, 
+        COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icp ) )
+      {
+        *pswBufferCb++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( 
+          icp );
+        *pswBufferCr++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( 
+          icp );
+      }
+
+
+      /* Walk through the vertical boundaries. See above comments re only
+      ** using blocks with a right boundary.
+      */
+
+      for( udColumnRight = 16; udColumnRight + 5 <= udWidth; udColumnRight 
+        += 16 )
+      {
+        /* The interior boundaries have all ten downsampled pixels. Get the 
+        ** first two pixels from what is already in the array. 
+        */
+
+        for( ubPosition = 0, pswBufferCb = aswBufferCb, pswBufferCbOld = 
+          aswBufferCb + 8, pswBufferCr = aswBufferCr, pswBufferCrOld = 
+          aswBufferCr + 8; ubPosition < 2; ubPosition++ )
+        {
+          *pswBufferCb++ = *pswBufferCbOld++;
+          *pswBufferCr++ = *pswBufferCrOld++;
+        }
+
+
+        /* Extract the next eight downsampled pixels from the image.
+        */
+
+        for( ; ubPosition < 10; ubPosition++, 
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icp ) )
+        {
+          *pswBufferCb++ = (COSTELLA_SW) 
+            COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icp );
+          *pswBufferCr++ = (COSTELLA_SW) 
+            COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icp );
+        }
+
+
+        /* Compute discrepancies and update totals.
+        */
+
+        costella_unblock_count_discrepancies( aswBufferCb, COSTELLA_TRUE, 
+          audCbBoundaryU, audCbBoundaryV, audCbInternalU, audCbInternalV );
+        costella_unblock_count_discrepancies( aswBufferCr, COSTELLA_TRUE, 
+          audCrBoundaryU, audCrBoundaryV, audCrInternalU, audCrInternalV );
+
+        udTotalChrominance++;
+      }
+
+
+      /* The last boundary may lack the last one or two downsampled pixels.
+      */
+
+      if( udColumnRight < udWidth )
+      {
+        /* Get the first two pixels from what is already in the array. 
+        */
+
+        for( ubPosition = 0, pswBufferCb = aswBufferCb, pswBufferCbOld = 
+          aswBufferCb + 8, pswBufferCr = aswBufferCr, pswBufferCrOld = 
+          aswBufferCr + 8; ubPosition < 2; ubPosition++ )
+        {
+          *pswBufferCb++ = *pswBufferCbOld++;
+          *pswBufferCr++ = *pswBufferCrOld++;
+        }
+
+
+        /* Extract the downsampled pixels up to the right edge of the image.
+        */
+
+        for( udColumn = udColumnRight - 10; udColumn < udWidth; udColumn += 
+          2, ubPosition++, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icp ) )
+        {
+          *pswBufferCb++ = (COSTELLA_SW) 
+            COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icp );
+          *pswBufferCr++ = (COSTELLA_SW) 
+            COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icp );
+        }
+
+
+        /* Fill the unfilled entries with -1, which the discrepancy function
+        ** recognizes as missing entries.
+        */
+
+        for( ; ubPosition < 10; ubPosition++ )
+        {
+          *pswBufferCb++ = -1;
+          *pswBufferCr++ = -1;
+        }
+
+
+        /* Compute discrepancies and update totals.
+        */
+
+        costella_unblock_count_discrepancies( aswBufferCb, COSTELLA_FALSE, 
+          audCbBoundaryU, audCbBoundaryV, audCbInternalU, audCbInternalV );
+        costella_unblock_count_discrepancies( aswBufferCr, COSTELLA_FALSE, 
+          audCrBoundaryU, audCrBoundaryV, audCrInternalU, audCrInternalV );
+
+        udTotalChrominance++;
+      }
+
+
+      /* Walk down to the next downsampled row.
+      */
+
+      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpStart, sdDoubleRowStride 
+        );
+    }
+  }
+
+
+  /* Add to the totals.
+  */
+
+  *pudTotalLuminance += udTotalLuminance;
+  *pudTotalChrominance += udTotalChrominance;
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaUnblockComputeHorizontalDiscrepancies: 
+**
+**   Internal function that computes the horizontal discrepancies in an 
+**   image, for the boundaries within a given range of rows. The image is 
+**   processed in vertical strips of COSTELLA_UNBLOCK_STRIP_WIDTH columns, 
+**   so that the pixels are read a row segment at a time rather than walking
+**   down each column.
+**
+**   aswBuffer{Y,Cb,Cr}:  Buffer for the {Y,Cb,Cr} channel, holding 16 
+**     rows of COSTELLA_UNBLOCK_STRIP_WIDTH values, so that each position 
+**     in the values arrays is contiguous across the columns of a strip. 
+**     The Cb and Cr buffers may be the same, in which case the Cr values 
+**     replace the Cb values.
+**
+**   audLanes:  Scratch array of 8 * COSTELLA_UNBLOCK_HISTOGRAM_LANES * 256 
+**     frequencies.
+**
+**   aud{Y,Cb,Cr}{Boundary,Internal}{U,V}:  Array of frequencies for the 
+**     {U,V} discrepancies {at block boundaries, internal to each block} for
+**     the {Y,Cb,Cr} channel, to which the frequencies found are added.
+**
+**   pudTotal{Luminance,Chrominance}:  Pointer to a COSTELLA_UD, to which 
+**     will be added the number of {luminance,chrominance} discrepancies 
+**     counted.
+**
+**   pi:  Pointer to the image to be analyzed.
+**
+**   udRowBoundary{First,End}:  The boundaries analyzed are those whose 
+**     bottom block starts on a row y with udRowBoundaryFirst <= y < 
+**     udRowBoundaryEnd. Each such boundary uses the rows from seven (or, 
+**     for the chrominance channels, fourteen) above it to two (four) below
+**     it, which must already be final.
+*/
+
+static COSTELLA_FUNCTION( CostellaUnblockComputeHorizontalDiscrepancies, ( 
+  COSTELLA_SW* aswBufferY, COSTELLA_SW* aswBufferCb, COSTELLA_SW* 
+  aswBufferCr, COSTELLA_UD* audLanes, COSTELLA_UD* audYBoundaryU, 
+  COSTELLA_UD* audYBoundaryV, COSTELLA_UD* audCbBoundaryU, COSTELLA_UD* 
+  audCbBoundaryV, COSTELLA_UD* audCrBoundaryU, COSTELLA_UD* audCrBoundaryV, 
+  COSTELLA_UD* audYInternalU, COSTELLA_UD* audYInternalV, COSTELLA_UD* 
+  audCbInternalU, COSTELLA_UD* audCbInternalV, COSTELLA_UD* audCrInternalU, 
+  COSTELLA_UD* audCrInternalV, COSTELLA_UD* pudTotalLuminance, COSTELLA_UD* 
+  pudTotalChrominance, COSTELLA_IMAGE* pi, COSTELLA_UD udRowBoundaryFirst,
+  COSTELLA_UD udRowBoundaryEnd, COSTELLA_CALLBACK_FUNCTION pfProgress, 
+  COSTELLA_O* poPassback ) )
+{
+  COSTELLA_B bColor;
+  COSTELLA_UB ubPosition;
+  COSTELLA_UB aubU[ COSTELLA_UNBLOCK_STRIP_WIDTH ], aubV[ 
+    COSTELLA_UNBLOCK_STRIP_WIDTH ];
+  COSTELLA_SW* pswBufferY, * pswBufferCb, * pswBufferCr;
+  COSTELLA_SD sdRowStride, sdDoubleRowStride;
+  COSTELLA_UD udWidth, udHeight, udRow, udColumn, udColumnLeft, 
+    udStripWidth, udRowBottom, udRowTop, udRowStop, udTotalLuminance, 
+    udTotalChrominance, udLanesSize;
+  COSTELLA_UD* audLanesBoundaryU, * audLanesBoundaryV, * audLanesInternalU,
+    * audLanesInternalV, * audLanesCrBoundaryU, * audLanesCrBoundaryV, 
+    * audLanesCrInternalU, * audLanesCrInternalV;
+  COSTELLA_IMAGE_GRAY* pig;
+  COSTELLA_IMAGE_COLOR* pic;
+  COSTELLA_IMAGE_COLOR_PIXEL icp={0}, icpRow={0}, icpStart={0};
+  COSTELLA_IMAGE_GRAY_PIXEL igp=NULL, igpRow=NULL, igpStart=NULL;
+
+
+  /* Extract information.
+  */
+
+  bColor = pi->bColor;
+
+  udWidth = pi->udWidth;
+  udHeight = pi->udHeight;
+
+  sdRowStride = pi->sdRowStride;
+
+  pig = &pi->ig;
+  pic = &pi->ic;
+
+
+  /* Compute double the row stride.
+  */
+
+  sdDoubleRowStride = sdRowStride << 1;
+
+
+  /* Find the first luminance boundary in the range, and the row at which 
+  ** the range stops.
+  */
+
+  udRowTop = ( udRowBoundaryFirst + 7 ) & ~(COSTELLA_UD) 7;
+
+  if( udRowTop < 8 )
+  {
+    udRowTop = 8;
+  }
+
+  udRowStop = udRowBoundaryEnd < udHeight ? udRowBoundaryEnd : udHeight;
+
+
+  /* Initialize totals.
+  */
+
+  udTotalLuminance = 0;
+  udTotalChrominance = 0;
+
+
+  /* Divide up the scratch array into multi-lane frequency tables. The 
+  ** luminance channel uses the first four; the chrominance channels use all
+  ** eight.
+  */
+
+  udLanesSize = COSTELLA_UNBLOCK_HISTOGRAM_LANES * 256;
+
+  audLanesBoundaryU = audLanes;
+  audLanesBoundaryV = audLanesBoundaryU + udLanesSize;
+  audLanesInternalU = audLanesBoundaryV + udLanesSize;
+  audLanesInternalV = audLanesInternalU + udLanesSize;
+  audLanesCrBoundaryU = audLanesInternalV + udLanesSize;
+  audLanesCrBoundaryV = audLanesCrBoundaryU + udLanesSize;
+  audLanesCrInternalU = audLanesCrBoundaryV + udLanesSize;
+  audLanesCrInternalV = audLanesCrInternalU + udLanesSize;
+
+  COSTELLA_INITIALIZE_ARRAY( audLanes, 4 * udLanesSize, COSTELLA_UD );
+
+
+  /* First we analyze the luminance channel. Start at the left of the row
+  ** seven above the first boundary, i.e., at y = 1 for the first boundary 
+  ** of the image, where the topmost row is y = 0. Step down one row at a 
+  ** time, as a pixel may only move to a neighboring row in some layouts.
+  */
+
+  if( bColor )
+  {
+    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpStart, *pic, udWidth, 
+      udHeight, sdRowStride );
+
+    for( udRow = 7; udRow < udRowTop && udRowTop < udRowStop; udRow++ )
+    {
+      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpStart, sdRowStride );
+    }
+  }
+  else
+  {
+    COSTELLA_IMAGE_GRAY_PIXEL_SET_TOP_LEFT( igpStart, *pig, udWidth, 
+      udHeight, sdRowStride );
+
+    for( udRow = 7; udRow < udRowTop && udRowTop < udRowStop; udRow++ )
+    {
+      COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpStart, sdRowStride );
+    }
+  }
+  
+
+  /* Walk through the strips of the image, unless there are no boundaries 
+  ** in the range.
+  */
+
+  for( udColumnLeft = 0; udRowTop < udRowStop && udColumnLeft < udWidth; 
+    udColumnLeft += COSTELLA_UNBLOCK_STRIP_WIDTH )
+  {
+    /* Progress callback.
+    */
+
+    if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
+    {
+      COSTELLA_ERROR( "Progress callback" );
+      COSTELLA_RETURN;
+    }
+
+
+    /* Compute the width of this strip.
+    */
+
+    udStripWidth = udWidth - udColumnLeft;
+
+    if( udStripWidth > COSTELLA_UNBLOCK_STRIP_WIDTH )
+    {
+      udStripWidth = COSTELLA_UNBLOCK_STRIP_WIDTH;
+    }
+
+
+    /* Start off at the top of the strip.
+    */
+
+    if( bColor )
+    {
+      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpStart, icpRow );
+    }
+    else
+    {
+      COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpStart, igpRow );
+    }
+
+
+    /* We start off by filling positions 8 and 9 of the values arrays of 
+    ** each column from the two rows seven and six above the first boundary
+    ** (y = 1 and y = 2 for the first boundary of the image). These will be
+    ** shifted back to the start of the values arrays in the first step 
+    ** below. Switch on image type.
+    */
+
+    for( ubPosition = 8; ubPosition < 10; ubPosition++ )
+    {
+      pswBufferY = aswBufferY + ubPosition * COSTELLA_UNBLOCK_STRIP_WIDTH;
+
+      if( bColor )
+      {
+        COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpRow, icp );
+
+        for( udColumn = 0; udColumn < udStripWidth; udColumn++, 
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icp ) )
+        {
+          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( 
+            icp );
+        }
+
+        COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpRow, sdRowStride );
+      }
+      else
+      {
+        COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpRow, igp );
+
+        for( udColumn = 0; udColumn < udStripWidth; udColumn++, 
+          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igp ) )
+        {
+          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( igp 
+            );
+        }
+
+        COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpRow, sdRowStride );
+      }
+    }
+
+
+    /* Walk through the horizontal boundaries. See above comments.
+    */
+
+    for( udRowBottom = udRowTop; udRowBottom < udRowStop; udRowBottom += 8 
+      )
+    {
+      /* Get the first two rows of the values arrays from what is already in
+      ** them. 
+      */
+
+      for( udColumn = 0, pswBufferY = aswBufferY; udColumn < 2 * 
+        COSTELLA_UNBLOCK_STRIP_WIDTH; udColumn++, pswBufferY++ )
+      {
+        *pswBufferY = pswBufferY[ 8 * COSTELLA_UNBLOCK_STRIP_WIDTH ];
+      }
+
+
+      /* Extract the next eight rows of the strip from the image. Fill any 
+      ** rows past the bottom of the image with -1, which the discrepancy 
+      ** functions recognize as missing entries. Switch on image type.
+      */
+
+      for( ubPosition = 2, udRow = udRowBottom - 5; ubPosition < 10; 
+        ubPosition++, udRow++ )
+      {
+        pswBufferY = aswBufferY + ubPosition * COSTELLA_UNBLOCK_STRIP_WIDTH;
+
+        if( udRow >= udHeight )
+        {
+          for( udColumn = 0; udColumn < udStripWidth; udColumn++ )
+          {
+            *pswBufferY++ = -1;
+          }
+        }
+        else if( bColor )
+        {
+          COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpRow, icp );
+
+          for( udColumn = 0; udColumn < udStripWidth; udColumn++, 
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icp ) )
+          {
+            *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y(
+              icp );
+          }
+
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpRow, sdRowStride );
+        }
+        else
+        {
+          COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpRow, igp );
+
+          for( udColumn = 0; udColumn < udStripWidth; udColumn++, 
+            COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igp ) )
+          {
+            *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( igp
+              );
+          }
+
+          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpRow, sdRowStride );
+        }
+      }
+
+
+      /* Compute the absolute discrepancies for all columns of the strip at
+      ** once, and update the frequency tables.
+      */
+
+      costella_unblock_compute_strip_discrepancies( aswBufferY + 4 * 
+        COSTELLA_UNBLOCK_STRIP_WIDTH, COSTELLA_UNBLOCK_STRIP_WIDTH, 
+        udStripWidth, aubU, aubV );
+      costella_unblock_accumulate_strip( aubU, udStripWidth, 
+        audLanesBoundaryU );
+      costella_unblock_accumulate_strip( aubV, udStripWidth, 
+        audLanesBoundaryV );
+
+      costella_unblock_compute_strip_discrepancies( aswBufferY, 
+        COSTELLA_UNBLOCK_STRIP_WIDTH, udStripWidth, aubU, aubV );
+      costella_unblock_accumulate_strip( aubU, udStripWidth, 
+        audLanesInternalU );
+      costella_unblock_accumulate_strip( aubV, udStripWidth, 
+        audLanesInternalV );
+
+      udTotalLuminance += udStripWidth;
+    }
+
+
+    /* Walk across to the next strip.
+    */
+
+    for( udColumn = 0; udColumn < udStripWidth; udColumn++ )
+    {
+      if( bColor )
+      {
+        COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpStart );
+      }
+      else
+      {
+        COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpStart );
+      }
+    }
+  }
+
+
+  /* Merge the luminance frequency tables.
+  */
+
+  costella_unblock_merge_lanes( audLanesBoundaryU, audYBoundaryU );
+  costella_unblock_merge_lanes( audLanesBoundaryV, audYBoundaryV );
+  costella_unblock_merge_lanes( audLanesInternalU, audYInternalU );
+  costella_unblock_merge_lanes( audLanesInternalV, audYInternalV );
+
+
+  /* If we have a color image, analyze the discrepancies for the downsampled
+  ** chrominance channels. The strips contain COSTELLA_UNBLOCK_STRIP_WIDTH
+  ** downsampled columns. Find the first chrominance boundary in the range.
+  */
+  
+  if( bColor )
+  {
+    udRowTop = ( udRowBoundaryFirst + 15 ) & ~(COSTELLA_UD) 15;
+
+    if( udRowTop < 16 )
+    {
+      udRowTop = 16;
+    }
+
+
+    /* Reuse the scratch array for the Cb tables and use the rest for the 
+    ** Cr tables.
+    */
+
+    COSTELLA_INITIALIZE_ARRAY( audLanes, 8 * udLanesSize, COSTELLA_UD );
+
+
+    /* Start at the left of the downsampled row seven above the first 
+    ** boundary, i.e., at y = 2 for the first boundary of the image, where 
+    ** the topmost downsampled row is y = 0, stepping down as for the 
+    ** luminance.
+    */
+
+    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpStart, *pic, udWidth, 
+      udHeight, sdRowStride );
+
+    for( udRow = 14; udRow < udRowTop && udRowTop < udRowStop; udRow += 2 )
+    {
+      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpStart, sdDoubleRowStride 
+        );
+    }
+
+      
+    /* Walk through the strips of the image.
+    */
+
+    for( udColumnLeft = 0; udRowTop < udRowStop && udColumnLeft < udWidth; 
+      udColumnLeft += COSTELLA_UNBLOCK_STRIP_WIDTH << 1 )
+    {
+      /* Progress callback.
+      */
+
+      if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
+      {
+        COSTELLA_ERROR( "Progress callback" );
+        COSTELLA_RETURN;
+      }
+
+
+      /* Compute the number of downsampled columns in this strip.
+      */
+
+      udStripWidth = ( udWidth - udColumnLeft + 1 ) >> 1;
+
+      if( udStripWidth > COSTELLA_UNBLOCK_STRIP_WIDTH )
+      {
+        udStripWidth = COSTELLA_UNBLOCK_STRIP_WIDTH;
+      }
+
+
+      /* Start off at the top of the strip.
+      */
+
+      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpStart, icpRow );
+
+
+      /* We start off by filling positions 8 and 9 of the values arrays from
+      ** the downsampled rows seven and six above the first boundary (yd = 1
+      ** and yd = 2 for the first boundary of the image, i.e., y = 2 and 
+      ** y = 4 in the actual image). These will be shifted back to the start
+      ** of the values arrays in the first step below.
+      */
+
+      for( ubPosition = 8; ubPosition < 10; ubPosition++ )
+      {
+        pswBufferCb = aswBufferCb + ubPosition * COSTELLA_UNBLOCK_STRIP_WIDTH;
+        pswBufferCr = aswBufferCr + ubPosition * COSTELLA_UNBLOCK_STRIP_WIDTH;
+
+        COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpRow, icp );
+
+        for( udColumn = 0; udColumn < udStripWidth; udColumn++, 
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icp ) )
+        {
+          *pswBufferCb++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB(
+            icp );
+          *pswBufferCr++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR(
+            icp );
+        }
+
+        COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpRow, sdDoubleRowStride 
+          );
+      }
+
+
+      /* Walk through the horizontal boundaries. See above comments.
+      */
+
+      for( udRowBottom = udRowTop; udRowBottom < udRowStop; udRowBottom += 
+        16 )
+      {
+        /* Get the first two rows of the values arrays from what is already 
+        ** in them. 
+        */
+
+        for( udColumn = 0, pswBufferCb = aswBufferCb, pswBufferCr = 
+          aswBufferCr; udColumn < 2 * COSTELLA_UNBLOCK_STRIP_WIDTH; 
+          udColumn++, pswBufferCb++, pswBufferCr++ )
+        {
+          *pswBufferCb = pswBufferCb[ 8 * COSTELLA_UNBLOCK_STRIP_WIDTH ];
+          *pswBufferCr = pswBufferCr[ 8 * COSTELLA_UNBLOCK_STRIP_WIDTH ];
+        }
+
+
+        /* Extract the next eight downsampled rows of the strip from the 
+        ** image. Fill any rows past the bottom of the image with -1, which 
+        ** the discrepancy functions recognize as missing entries.
+        */
+
+        for( ubPosition = 2, udRow = udRowBottom - 10; ubPosition < 10; 
+          ubPosition++, udRow += 2 )
+        {
+          pswBufferCb = aswBufferCb + ubPosition * 
+            COSTELLA_UNBLOCK_STRIP_WIDTH;
+          pswBufferCr = aswBufferCr + ubPosition * 
+            COSTELLA_UNBLOCK_STRIP_WIDTH;
+
+          if( udRow >= udHeight )
+          {
+            for( udColumn = 0; udColumn < udStripWidth; udColumn++ )
+            {
+              *pswBufferCb++ = -1;
+              *pswBufferCr++ = -1;
+            }
+          }
+          else
+          {
+            COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpRow, icp );
+
+            for( udColumn = 0; udColumn < udStripWidth; udColumn++, 
+              COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icp ) )
+            {
+              *pswBufferCb++ = (COSTELLA_SW) 
+                COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icp );
+              *pswBufferCr++ = (COSTELLA_SW) 
+                COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icp );
+            }
+
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpRow, 
+              sdDoubleRowStride );
+          }
+        }
+
+
+        /* Compute the absolute discrepancies for all columns of the strip 
+        ** at once, and update the frequency tables.
+        */
+
+        costella_unblock_compute_strip_discrepancies( aswBufferCb + 4 * 
+          COSTELLA_UNBLOCK_STRIP_WIDTH, COSTELLA_UNBLOCK_STRIP_WIDTH, 
+          udStripWidth, aubU, aubV );
+        costella_unblock_accumulate_strip( aubU, udStripWidth, 
+          audLanesBoundaryU );
+        costella_unblock_accumulate_strip( aubV, udStripWidth, 
+          audLanesBoundaryV );
+        costella_unblock_compute_strip_discrepancies( aswBufferCr + 4 * 
+          COSTELLA_UNBLOCK_STRIP_WIDTH, COSTELLA_UNBLOCK_STRIP_WIDTH, 
+          udStripWidth, aubU, aubV );
+        costella_unblock_accumulate_strip( aubU, udStripWidth, 
+          audLanesCrBoundaryU );
+        costella_unblock_accumulate_strip( aubV, udStripWidth, 
+          audLanesCrBoundaryV );
+
+        costella_unblock_compute_strip_discrepancies( aswBufferCb, 
+          COSTELLA_UNBLOCK_STRIP_WIDTH, udStripWidth, aubU, aubV );
+        costella_unblock_accumulate_strip( aubU, udStripWidth, 
+          audLanesInternalU );
+        costella_unblock_accumulate_strip( aubV, udStripWidth, 
+          audLanesInternalV );
+        costella_unblock_compute_strip_discrepancies( aswBufferCr, 
+          COSTELLA_UNBLOCK_STRIP_WIDTH, udStripWidth, aubU, aubV );
+        costella_unblock_accumulate_strip( aubU, udStripWidth, 
+          audLanesCrInternalU );
+        costella_unblock_accumulate_strip( aubV, udStripWidth, 
+          audLanesCrInternalV );
+
+        udTotalChrominance += udStripWidth;
+      }
+
+
+      /* Walk across to the next strip.
+      */
+
+      for( udColumn = 0; udColumn < udStripWidth; udColumn++ )
+      {
+        COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpStart );
+      }
+    }
+
+
+    /* Merge the chrominance frequency tables.
+    */
+
+    costella_unblock_merge_lanes( audLanesBoundaryU, audCbBoundaryU );
+    costella_unblock_merge_lanes( audLanesBoundaryV, audCbBoundaryV );
+    costella_unblock_merge_lanes( audLanesInternalU, audCbInternalU );
+    costella_unblock_merge_lanes( audLanesInternalV, audCbInternalV );
+    costella_unblock_merge_lanes( audLanesCrBoundaryU, audCrBoundaryU );
+    costella_unblock_merge_lanes( audLanesCrBoundaryV, audCrBoundaryV );
+    costella_unblock_merge_lanes( audLanesCrInternalU, audCrInternalU );
+    costella_unblock_merge_lanes( audLanesCrInternalV, audCrInternalV );
+  }
+
+
+  /* Add to the totals.
+  */
+
+  *pudTotalLuminance += udTotalLuminance;
+  *pudTotalChrominance += udTotalChrominance;
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaUnblockCorrectVerticalDiscrepancies: 
+**
+**   Correct the vertical discrepancies in an image, based on the supplied 
+**   adjustment tables. 
+**
+**   aswBuffer{Y,Cb,Cr}:  Buffer for the {Y,Cb,Cr} channel.
+**
+**   aub{Y,Cb,Cr}Adjusted{U,V}:  Adjustment tables.
+**
+**   pi{In,Out}:  Pointer to the {in,out}put image.
+*/
+
+static COSTELLA_FUNCTION( CostellaUnblockCorrectVerticalDiscrepancies, ( 
+  COSTELLA_SW* aswBufferY, COSTELLA_SW* aswBufferCb, COSTELLA_SW* 
+  aswBufferCr, COSTELLA_UB* aubYAdjustedU, COSTELLA_UB* aubYAdjustedV, 
+  COSTELLA_UB* aubCbAdjustedU, COSTELLA_UB* aubCbAdjustedV, COSTELLA_UB* 
+  aubCrAdjustedU, COSTELLA_UB* aubCrAdjustedV, COSTELLA_IMAGE* piIn, 
+  COSTELLA_IMAGE* piOut, COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* 
+  poPassback ) )
+{
+  COSTELLA_B bAlpha, bCopyAlpha, bColor;
+  COSTELLA_UB ubPosition, ubY, ubCb, ubCr, ubA;
+  COSTELLA_SW* pswBufferY, * pswBufferYOld, * pswBufferCb, * pswBufferCbOld,
+    * pswBufferCr, * pswBufferCrOld;
+  COSTELLA_UD udWidth, udHeight, udRow, udColumn, udColumnBoundaryRight;
+  COSTELLA_SD sdRowStrideIn, sdRowStrideOut, sdDoubleRowStrideIn, 
+    sdDoubleRowStrideOut, sdAlphaRowStrideIn, sdAlphaRowStrideOut;
+  COSTELLA_IMAGE_ALPHA* piaIn, * piaOut;
+  COSTELLA_IMAGE_GRAY* pigIn, * pigOut;
+  COSTELLA_IMAGE_COLOR* picIn, * picOut;
+  COSTELLA_IMAGE_ALPHA_PIXEL iapInStart=NULL, iapOutStart=NULL, iapIn=NULL, iapOut=NULL;
+  COSTELLA_IMAGE_GRAY_PIXEL igpInStart=NULL, igpOutStart=NULL, igpIn=NULL, igpOut=NULL;
+  COSTELLA_IMAGE_COLOR_PIXEL icpInStart={0}, icpOutStart={0}, icpIn={0}, icpOut={0};
+
+
+  /* Extract information.
+  */
+
+  bAlpha = piIn->bAlpha;
+  bColor = piIn->bColor;
+
+  udWidth = piIn->udWidth;
+  udHeight = piIn->udHeight;
+
+  sdRowStrideIn = piIn->sdRowStride;
+  sdRowStrideOut = piOut->sdRowStride;
+
+  sdAlphaRowStrideIn = piIn->sdAlphaRowStride;
+  sdAlphaRowStrideOut = piOut->sdAlphaRowStride;
+
+  piaIn = &piIn->ia;
+  piaOut = &piOut->ia;
+
+  pigIn = &piIn->ig;
+  pigOut = &piOut->ig;
+
+  picIn = &piIn->ic;
+  picOut = &piOut->ic;
+
+
+  /* Check that the output image is consistent.
+  */
+
+  #ifdef COSTELLA_DEBUG
+  {
+    if( !piOut->bAlpha != !bAlpha )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Alpha flag disagrees" );
+      COSTELLA_RETURN;
+    }
+
+    if( !piOut->bColor != !bColor )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Color flag disagrees" );
+      COSTELLA_RETURN;
+    }
+
+    if( piOut->udWidth != udWidth )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Width disagrees" );
+      COSTELLA_RETURN;
+    }
+
+    if( piOut->udHeight != udHeight )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Height disagrees" );
+      COSTELLA_RETURN;
+    }
+  }
+  #endif
+
+
+  /* Determine whether we need to copy across alpha values.
+  */
+
+  bCopyAlpha = bAlpha && !COSTELLA_IMAGE_ALPHA_IS_SAME( piaIn, piaOut );
+
+
+  /* Compute the double row strides.
+  */
+
+  sdDoubleRowStrideIn = sdRowStrideIn << 1;
+  sdDoubleRowStrideOut = sdRowStrideOut << 1;
+
+
+  /* Start with the luminance channel. Start at top-left of the input and
+  ** output images. 
+  */
+
+  if( bColor )
+  {
+    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpInStart, *picIn, udWidth, 
+      udHeight, sdRowStrideIn );
+    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpOutStart, *picOut, udWidth, 
+      udHeight, sdRowStrideOut );
+  }
+  else
+  {
+    COSTELLA_IMAGE_GRAY_PIXEL_SET_TOP_LEFT( igpInStart, *pigIn, udWidth, 
+      udHeight, sdRowStrideIn );
+    COSTELLA_IMAGE_GRAY_PIXEL_SET_TOP_LEFT( igpOutStart, *pigOut, udWidth, 
+      udHeight, sdRowStrideOut );
+  }
+  
+  if( bCopyAlpha )     
+  {
+    COSTELLA_IMAGE_ALPHA_PIXEL_SET_TOP_LEFT( iapInStart, *piaIn, udWidth, 
+      udHeight, sdAlphaRowStrideIn );
+    COSTELLA_IMAGE_ALPHA_PIXEL_SET_TOP_LEFT( iapOutStart, *piaOut, udWidth, 
+      udHeight, sdAlphaRowStrideOut );
+  }
+
+
+  /* Walk through the rows of the image.
+  */
+
+  for( udRow = 0; udRow < udHeight; udRow++ )
+  {
+    /* Progress callback.
+    */
+
+    if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
+    {
+      COSTELLA_ERROR( "Progress callback" );
+      COSTELLA_RETURN;
+    }
+
+
+    /* If there is an alpha channel, copy it across for the whole row now.
+    */
+
+    if( bCopyAlpha )
+    {
+      COSTELLA_IMAGE_ALPHA_PIXEL_ASSIGN( iapInStart, iapIn );
+      COSTELLA_IMAGE_ALPHA_PIXEL_ASSIGN( iapOutStart, iapOut );
+      
+      for( udColumn = 0; udColumn < udWidth; udColumn++, 
+        COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_RIGHT( iapIn ), 
+        COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_RIGHT( iapOut ) )
+      {
+        ubA = COSTELLA_IMAGE_ALPHA_PIXEL_GET_A( iapIn );
+        COSTELLA_IMAGE_ALPHA_PIXEL_SET_A( iapOut, ubA );
+      }
+    }
+
+
+    /* Start off at the leftmost pixel of this row, for both input and 
+    ** output images. 
+    */
+
+    if( bColor )
+    {
+      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpInStart, icpIn );
+      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpOutStart, icpOut );
+    }
+    else
+    {
+      COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpInStart, igpIn );
+      COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpOutStart, igpOut );
+    }
+
+
+    /* If the width of the image is less than 9 pixels, then there are no
     ** boundaries. Simply copy the row across.
     */
 
-    if( udWidth < 9 )
+    if( udWidth < 9 )
+    {
+      if( bColor )
+      {
+        for( udColumn = 0; udColumn < udWidth; udColumn++, 
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpIn ), 
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpOut ) )
+        {
+          ubY = COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( icpIn );
+          COSTELLA_IMAGE_COLOR_PIXEL_SET_R_Y( icpOut, ubY );
+        }
+      }
+      else
+      {
+        for( udColumn = 0; udColumn < udWidth; udColumn++, 
+          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpIn ), 
+          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpOut ) )
+        {
+          ubY = COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( igpIn );
+          COSTELLA_IMAGE_GRAY_PIXEL_SET_Y( igpOut, ubY );
+        }
+      }
+    }
+    else
+    {
+      /* There are boundaries. Load the values of the first eight input 
+      ** pixels of the row into the right block of the values array. This 
+      ** will automatically be shifted to the left block in the first step 
+      ** below. Switch on image type.
+      */
+
+      if( bColor )
+      {
+        for( ubPosition = 0, pswBufferY = aswBufferY + 8; ubPosition < 8; 
+          ubPosition++, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpIn ) )
+        {
+          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( 
+            icpIn );
+        }
+      }
+      else
+      {
+        for( ubPosition = 0, pswBufferY = aswBufferY + 8; ubPosition < 8; 
+          ubPosition++, COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpIn ) )
+        {
+          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( 
+            igpIn );
+        }
+      }
+
+
+      /* Walk through all vertical boundaries. See above comments.
+      */
+
+      for( udColumnBoundaryRight = 8; udColumnBoundaryRight + 8 <= udWidth;
+        udColumnBoundaryRight += 8 )
+      {
+        /* The interior boundaries have two complete blocks. Shift the right
+        ** block in the array to the left block. 
+        */
+
+        for( ubPosition = 0, pswBufferY = aswBufferY, pswBufferYOld = 
+          aswBufferY + 8; ubPosition < 8; ubPosition++ )
+        {
+          *pswBufferY++ = *pswBufferYOld++;
+        }
+
+
+        /* Extract the next eight pixels from the image. Switch on image 
+        ** type.
+        */
+
+        if( bColor )
+        {
+          for( ; ubPosition < 16; ubPosition++, 
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpIn ) )
+          {
+            *pswBufferY++ = (COSTELLA_SW) 
+              COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( icpIn ); 
+          }
+        }
+        else
+        {
+          for( ; ubPosition < 16; ubPosition++, 
+            COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpIn ) )
+          {
+            *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( 
+              igpIn );
+          }
+        }
+
+
+        /* Compute, adjust and correct the discrepancies at the boundary.
+        */
+
+        costella_unblock_correct_boundary( aswBufferY, COSTELLA_TRUE, 
+          aubYAdjustedU, aubYAdjustedV );
+
+
+        /* Write the left block pixels to the output image. Switch on image 
+        ** type.
+        */
+
+        if( bColor )
+        {
+          for( ubPosition = 0, pswBufferY = aswBufferY; ubPosition < 8; 
+            ubPosition++, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpOut ) )
+          {
+            ubY = (COSTELLA_UB) *pswBufferY++;
+            COSTELLA_IMAGE_COLOR_PIXEL_SET_R_Y( icpOut, ubY );
+          }
+        }
+        else
+        {
+          for( ubPosition = 0, pswBufferY = aswBufferY; ubPosition < 8; 
+            ubPosition++, COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpOut ) )
+          {
+            ubY = (COSTELLA_UB) *pswBufferY++;
+            COSTELLA_IMAGE_GRAY_PIXEL_SET_Y( igpOut, ubY );
+          }
+        }
+      }
+
+
+      /* The last boundary may have a partial block to its right. It is 
+      ** handled as above, but stops at the right edge of the image. 
+      */
+
+      if( udColumnBoundaryRight < udWidth )
+      {
+        for( ubPosition = 0, pswBufferY = aswBufferY, pswBufferYOld = 
+          aswBufferY + 8; ubPosition < 8; ubPosition++ )
+        {
+          *pswBufferY++ = *pswBufferYOld++;
+        }
+
+
+        /* Extract the pixels up to the right edge of the image. Switch on 
+        ** image type.
+        */
+
+        if( bColor )
+        {
+          for( udColumn = udColumnBoundaryRight; udColumn < udWidth; 
+            udColumn++, ubPosition++, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( 
+            icpIn ) )
+          {
+            *pswBufferY++ = (COSTELLA_SW) 
+              COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( icpIn ); 
+          }
+        }
+        else
+        {
+          for( udColumn = udColumnBoundaryRight; udColumn < udWidth; 
+            udColumn++, ubPosition++, COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( 
+            igpIn ) )
+          {
+            *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( 
+              igpIn );
+          }
+        }
+
+
+        /* Fill the unfilled entries with -1, which the discrepancy and
+        ** correction functions recognize as missing entries.
+        */
+
+        for( ; ubPosition < 16; ubPosition++ )
+        {
+          *pswBufferY++ = -1;
+        }
+
+
+        /* Compute, adjust and correct the discrepancies at the boundary.
+        */
+
+        costella_unblock_correct_boundary( aswBufferY, COSTELLA_FALSE, 
+          aubYAdjustedU, aubYAdjustedV );
+
+
+        /* Write the left block pixels to the output image. Switch on image 
+        ** type.
+        */
+
+        if( bColor )
+        {
+          for( ubPosition = 0, pswBufferY = aswBufferY; ubPosition < 8; 
+            ubPosition++, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpOut ) )
+          {
+            ubY = (COSTELLA_UB) *pswBufferY++;
+            COSTELLA_IMAGE_COLOR_PIXEL_SET_R_Y( icpOut, ubY );
+          }
+        }
+        else
+        {
+          for( ubPosition = 0, pswBufferY = aswBufferY; ubPosition < 8; 
+            ubPosition++, COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpOut ) )
+          {
+            ubY = (COSTELLA_UB) *pswBufferY++;
+            COSTELLA_IMAGE_GRAY_PIXEL_SET_Y( igpOut, ubY );
+          }
+        }
+
+        udColumnBoundaryRight += 8;
+      }
+
+
+      /* Write out any remaining pixels in the row. We subtract 8 from the 
+      ** right boundary x value because it was incremented before the above 
+      ** loop dropped out. Switch on image type.
+      */
+
+      if( bColor )
+      {
+        for( udColumn = udColumnBoundaryRight - 8; ubPosition < 16 && 
+          udColumn < udWidth; udColumn++, ubPosition++, 
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpOut ) )
+        {
+          ubY = (COSTELLA_UB) *pswBufferY++;
+          COSTELLA_IMAGE_COLOR_PIXEL_SET_R_Y( icpOut, ubY );
+        }
+      }
+      else
+      {
+        for( udColumn = udColumnBoundaryRight - 8; ubPosition < 16 && 
+          udColumn < udWidth; udColumn++, ubPosition++, 
+          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpOut ) )
+        {
+          ubY = (COSTELLA_UB) *pswBufferY++;
+          COSTELLA_IMAGE_GRAY_PIXEL_SET_Y( igpOut, ubY );
+        }
+      }
+    }
+
+
+    /* Walk down to the next row.
+    */
+
+    if( bColor )
+    {
+      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpInStart, sdRowStrideIn );
+      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpOutStart, sdRowStrideOut );
+    }
+    else
+    {
+      COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpInStart, sdRowStrideIn );
+      COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpOutStart, sdRowStrideOut );
+    }
+
+    if( bCopyAlpha )
+    {
+      COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_DOWN( iapInStart, sdAlphaRowStrideIn 
+        );
+      COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_DOWN( iapOutStart, sdAlphaRowStrideOut
+        );
+    }
+  }
+
+
+  /* If we have a color image, we now correct the vertical boundaries of
+  ** the chrominance channels. 
+  */
+
+  if( bColor )
+  {
+    /* Start at the top-left of the image. 
+    */
+
+    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpInStart, *picIn, udWidth, 
+      udHeight, sdRowStrideIn );
+    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpOutStart, *picOut, udWidth, 
+      udHeight, sdRowStrideOut );
+    
+
+    /* Walk through those rows of the image that contain chrominance data.
+    */
+
+    for( udRow = 0; udRow < udHeight; udRow += 2 )
+    {
+      /* Progress callback.
+      */
+
+      if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
+      {
+        COSTELLA_ERROR( "Progress callback" );
+        COSTELLA_RETURN;
+      }
+
+
+      /* Start off at the leftmost downsampled pixel of the row, for both 
+      ** the input and the output.
+      */
+
+      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpInStart, icpIn );
+      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpOutStart, icpOut );
+
+
+      /* If the width of the image is less than 17 pixels, then there are no
+      ** boundaries. Simply copy the row across.
+      */
+
+      if( udWidth < 17 )
+      {
+        for( udColumn = 0; udColumn < udWidth; udColumn += 2, 
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpIn ), 
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpOut ) )
+        {
+          ubCb = COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icpIn );
+          ubCr = COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icpIn );
+
+          COSTELLA_IMAGE_COLOR_PIXEL_SET_G_CB( icpOut, ubCb );
+          COSTELLA_IMAGE_COLOR_PIXEL_SET_B_CR( icpOut, ubCr );
+        }
+      }
+      else
+      {
+        /* There are boundaries. Load the values of the first eight 
+        ** downsampled pixels of the row into the right blocks of the values
+        ** arrays. This will automatically be shifted to the left block in 
+        ** the first step below. Switch on image type.
+        */
+
+        for( ubPosition = 0, pswBufferCb = aswBufferCb + 8, pswBufferCr = 
+          aswBufferCr + 8; ubPosition < 8; ubPosition++,      
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpIn ) )
+        {
+          *pswBufferCb++ = (COSTELLA_SW) 
+            COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icpIn );
+          *pswBufferCr++ = (COSTELLA_SW) 
+            COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icpIn );
+        }
+
+
+        /* Walk through all vertical boundaries. See above comments.
+        */
+
+        for( udColumnBoundaryRight = 16; udColumnBoundaryRight + 15 <= 
+          udWidth; udColumnBoundaryRight += 16 )
+        {
+          /* The interior boundaries have two complete blocks. Shift the 
+          ** right block in the array to the left block. 
+          */
+
+          for( ubPosition = 0, pswBufferCb = aswBufferCb, pswBufferCbOld = 
+            aswBufferCb + 8, pswBufferCr = aswBufferCr, pswBufferCrOld = 
+            aswBufferCr + 8; ubPosition < 8; ubPosition++ )
+          {
+            *pswBufferCb++ = *pswBufferCbOld++;
+            *pswBufferCr++ = *pswBufferCrOld++;
+          }
+
+
+          /* Extract the next eight downsampled pixels from the image.
+          */
+
+          for( ; ubPosition < 16; ubPosition++, 
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpIn ) )
+          {
+            *pswBufferCb++ = (COSTELLA_SW) 
+              COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icpIn );
+            *pswBufferCr++ = (COSTELLA_SW) 
+              COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icpIn );
+          }
+
+
+          /* Compute, adjust and correct the discrepancies at the boundary.
+          */
+
+          costella_unblock_correct_boundary( aswBufferCb, COSTELLA_TRUE, 
+            aubCbAdjustedU, aubCbAdjustedV );
+          costella_unblock_correct_boundary( aswBufferCr, COSTELLA_TRUE, 
+            aubCrAdjustedU, aubCrAdjustedV );
+
+
+          /* Write the left block pixels back to the image.
+          */
+
+          for( ubPosition = 0, pswBufferCb = aswBufferCb, pswBufferCr = 
+            aswBufferCr; ubPosition < 8; ubPosition++, 
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpOut ) )
+          {
+            ubCb = (COSTELLA_UB) *pswBufferCb++;
+            ubCr = (COSTELLA_UB) *pswBufferCr++;
+
+            COSTELLA_IMAGE_COLOR_PIXEL_SET_G_CB( icpOut, ubCb );
+            COSTELLA_IMAGE_COLOR_PIXEL_SET_B_CR( icpOut, ubCr );
+          }
+        }
+
+
+        /* The last boundary may have a partial block to its right. It is 
+        ** handled as above, but stops at the right edge of the image. 
+        */
+
+        if( udColumnBoundaryRight < udWidth )
+        {
+          for( ubPosition = 0, pswBufferCb = aswBufferCb, pswBufferCbOld = 
+            aswBufferCb + 8, pswBufferCr = aswBufferCr, pswBufferCrOld = 
+            aswBufferCr + 8; ubPosition < 8; ubPosition++ )
+          {
+            *pswBufferCb++ = *pswBufferCbOld++;
+            *pswBufferCr++ = *pswBufferCrOld++;
+          }
+
+
+          /* Extract the downsampled pixels up to the right edge of the 
+          ** image.
+          */
+
+          for( udColumn = udColumnBoundaryRight; udColumn < udWidth; udColumn
+            += 2, ubPosition++, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( 
+            icpIn ) )
+          {
+            *pswBufferCb++ = (COSTELLA_SW) 
+              COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icpIn );
+            *pswBufferCr++ = (COSTELLA_SW) 
+              COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icpIn );
+          }
+
+
+          /* Fill the unfilled entries with -1, which the discrepancy and
+          ** correction functions recognize as missing entries.
+          */
+
+          for( ; ubPosition < 16; ubPosition++ )
+          {
+            *pswBufferCb++ = -1;
+            *pswBufferCr++ = -1;
+          }
+
+
+          /* Compute, adjust and correct the discrepancies at the boundary.
+          */
+
+          costella_unblock_correct_boundary( aswBufferCb, COSTELLA_FALSE, 
+            aubCbAdjustedU, aubCbAdjustedV );
+          costella_unblock_correct_boundary( aswBufferCr, COSTELLA_FALSE, 
+            aubCrAdjustedU, aubCrAdjustedV );
+
+
+          /* Write the left block pixels back to the image.
+          */
+
+          for( ubPosition = 0, pswBufferCb = aswBufferCb, pswBufferCr = 
+            aswBufferCr; ubPosition < 8; ubPosition++, 
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpOut ) )
+          {
+            ubCb = (COSTELLA_UB) *pswBufferCb++;
+            ubCr = (COSTELLA_UB) *pswBufferCr++;
+
+            COSTELLA_IMAGE_COLOR_PIXEL_SET_G_CB( icpOut, ubCb );
+            COSTELLA_IMAGE_COLOR_PIXEL_SET_B_CR( icpOut, ubCr );
+          }
+
+          udColumnBoundaryRight += 16;
+        }
+
+
+        /* Write out any remaining pixels in the row. Walk through the 
+        ** remaining pixels. We subtract 16 from the right boundary x value 
+        ** because it was incremented before the above loop dropped out.
+        ** Switch on image type.
+        */
+
+        for( udColumn = udColumnBoundaryRight - 16; ubPosition < 16 && 
+          udColumn < udWidth; udColumn += 2, ubPosition++,             
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpOut ) )
+        {
+          ubCb = (COSTELLA_UB) *pswBufferCb++;
+          ubCr = (COSTELLA_UB) *pswBufferCr++;
+
+          COSTELLA_IMAGE_COLOR_PIXEL_SET_G_CB( icpOut, ubCb );
+          COSTELLA_IMAGE_COLOR_PIXEL_SET_B_CR( icpOut, ubCr );
+        }
+      }
+    
+
+      /* Walk down to the next downsampled row.
+      */
+
+      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpInStart, 
+        sdDoubleRowStrideIn );
+      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpOutStart, 
+        sdDoubleRowStrideOut );
+    }
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* CostellaUnblockCorrectHorizontalDiscrepancies: 
+**
+**   Internal function that corrects the horizontal discrepancies in an 
+**   image, based on the supplied adjustment tables. The image is processed
+**   in vertical strips of COSTELLA_UNBLOCK_STRIP_WIDTH columns, so that the
+**   pixels are read and written a row segment at a time.
+**
+**   aswBuffer{Y,Cb,Cr}:  Buffer for the {Y,Cb,Cr} channel, holding 16 
+**     values for each column of a strip.
+**
+**   aub{Y,Cb,Cr}Adjusted{U,V}:  Adjustment tables.
+**
+**   pi{In,Out}:  Pointer to the {in,out}put image.
+*/
+
+#if !defined( COSTELLA_IMAGE_CHANNELS_CONTIGUOUS ) || defined( \
+  COSTELLA_UNBLOCK_STRIP_CORRECTION )
+
+static COSTELLA_FUNCTION( CostellaUnblockCorrectHorizontalDiscrepancies, ( 
+  COSTELLA_SW* aswBufferY, COSTELLA_SW* aswBufferCb, COSTELLA_SW* 
+  aswBufferCr, COSTELLA_UB* aubYAdjustedU, COSTELLA_UB* aubYAdjustedV, 
+  COSTELLA_UB* aubCbAdjustedU, COSTELLA_UB* aubCbAdjustedV, COSTELLA_UB* 
+  aubCrAdjustedU, COSTELLA_UB* aubCrAdjustedV, COSTELLA_IMAGE* piIn, 
+  COSTELLA_IMAGE* piOut, COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* 
+  poPassback ) )
+
+{
+  COSTELLA_B bAlpha, bCopyAlpha, bColor;
+  COSTELLA_UB ubPosition, ubY, ubCb, ubCr, ubA;
+  COSTELLA_SW* pswBufferY, * pswBufferCb, * pswBufferCr;
+  COSTELLA_SD sdRowStrideIn, sdRowStrideOut, sdDoubleRowStrideIn, 
+    sdDoubleRowStrideOut, sdAlphaRowStrideIn, sdAlphaRowStrideOut;
+  COSTELLA_UD udWidth, udHeight, udRow, udColumn, udColumnLeft, 
+    udStripWidth, udRowBoundaryBottom;
+  COSTELLA_IMAGE_ALPHA* piaIn, * piaOut;
+  COSTELLA_IMAGE_GRAY* pigIn, * pigOut;
+  COSTELLA_IMAGE_COLOR* picIn, * picOut;
+  COSTELLA_IMAGE_ALPHA_PIXEL iapInRow, iapOutRow, iapIn, iapOut;
+  COSTELLA_IMAGE_GRAY_PIXEL igpInStart=NULL, igpOutStart=NULL, 
+    igpInRow=NULL, igpOutRow=NULL, igpIn=NULL, igpOut=NULL;
+  COSTELLA_IMAGE_COLOR_PIXEL icpInStart={0}, icpOutStart={0}, 
+    icpInRow={0}, icpOutRow={0}, icpIn={0}, icpOut={0};
+  
+
+  /* Extract information.
+  */
+
+  bAlpha = piIn->bAlpha;
+  bColor = piIn->bColor;
+
+  udWidth = piIn->udWidth;
+  udHeight = piIn->udHeight;
+
+  sdRowStrideIn = piIn->sdRowStride;
+  sdRowStrideOut = piOut->sdRowStride;
+
+  sdAlphaRowStrideIn = piIn->sdAlphaRowStride;
+  sdAlphaRowStrideOut = piOut->sdAlphaRowStride;
+
+  piaIn = &piIn->ia;
+  piaOut = &piOut->ia;
+
+  pigIn = &piIn->ig;
+  pigOut = &piOut->ig;
+
+  picIn = &piIn->ic;
+  picOut = &piOut->ic;
+
+
+  /* Check that the output image is consistent.
+  */
+
+  #ifdef COSTELLA_DEBUG
+  {
+    if( !piOut->bAlpha != !bAlpha )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Alpha flag disagrees" );
+      COSTELLA_RETURN;
+    }
+
+    if( !piOut->bColor != !bColor )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Color flag disagrees" );
+      COSTELLA_RETURN;
+    }
+
+    if( piOut->udWidth != udWidth )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Width disagrees" );
+      COSTELLA_RETURN;
+    }
+
+    if( piOut->udHeight != udHeight )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Height disagrees" );
+      COSTELLA_RETURN;
+    }
+  }
+  #endif
+
+
+  /* Determine whether we need to copy across alpha values.
+  */
+
+  bCopyAlpha = bAlpha && !COSTELLA_IMAGE_ALPHA_IS_SAME( piaIn, piaOut );
+
+
+  /* Compute the double row strides.
+  */
+
+  sdDoubleRowStrideIn = sdRowStrideIn << 1;
+  sdDoubleRowStrideOut = sdRowStrideOut << 1;
+
+
+  /* If there is an alpha channel, copy it across now, a row at a time.
+  */
+
+  if( bCopyAlpha )
+  {
+    COSTELLA_IMAGE_ALPHA_PIXEL_SET_TOP_LEFT( iapInRow, *piaIn, udWidth, 
+      udHeight, sdAlphaRowStrideIn );
+    COSTELLA_IMAGE_ALPHA_PIXEL_SET_TOP_LEFT( iapOutRow, *piaOut, udWidth, 
+      udHeight, sdAlphaRowStrideOut );
+
+    for( udRow = 0; udRow < udHeight; udRow++, 
+      COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_DOWN( iapInRow, sdAlphaRowStrideIn ), 
+      COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_DOWN( iapOutRow, sdAlphaRowStrideOut )
+      )
+    {
+      COSTELLA_IMAGE_ALPHA_PIXEL_ASSIGN( iapInRow, iapIn );
+      COSTELLA_IMAGE_ALPHA_PIXEL_ASSIGN( iapOutRow, iapOut );
+
+      for( udColumn = 0; udColumn < udWidth; udColumn++, 
+        COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_RIGHT( iapIn ), 
+        COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_RIGHT( iapOut ) )
+      {
+        ubA = COSTELLA_IMAGE_ALPHA_PIXEL_GET_A( iapIn );
+        COSTELLA_IMAGE_ALPHA_PIXEL_SET_A( iapOut, ubA );
+      }
+    }
+  }
+
+
+  /* Start with the luminance channel. Start at the top-left of the image. 
+  */
+
+  if( bColor )
+  {
+    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpInStart, *picIn, udWidth, 
+      udHeight, sdRowStrideIn );
+    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpOutStart, *picOut, udWidth,
+      udHeight, sdRowStrideOut );
+  }
+  else
+  {
+    COSTELLA_IMAGE_GRAY_PIXEL_SET_TOP_LEFT( igpInStart, *pigIn, udWidth, 
+      udHeight, sdRowStrideIn );
+    COSTELLA_IMAGE_GRAY_PIXEL_SET_TOP_LEFT( igpOutStart, *pigOut, udWidth, 
+      udHeight, sdRowStrideOut );
+  }
+
+  
+  /* Walk through the strips of the image.
+  */
+
+  for( udColumnLeft = 0; udColumnLeft < udWidth; udColumnLeft += 
+    COSTELLA_UNBLOCK_STRIP_WIDTH )
+  {
+    /* Progress callback.
+    */
+
+    if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
+    {
+      COSTELLA_ERROR( "Progress callback" );
+      COSTELLA_RETURN;
+    }
+
+
+    /* Compute the width of this strip.
+    */
+
+    udStripWidth = udWidth - udColumnLeft;
+
+    if( udStripWidth > COSTELLA_UNBLOCK_STRIP_WIDTH )
+    {
+      udStripWidth = COSTELLA_UNBLOCK_STRIP_WIDTH;
+    }
+
+
+    /* Start off at the topmost row of this strip, for both input and
+    ** output.
+    */
+
+    if( bColor )
+    {
+      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpInStart, icpInRow );
+      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpOutStart, icpOutRow );
+    }
+    else
+    {
+      COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpInStart, igpInRow );
+      COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpOutStart, igpOutRow );
+    }
+
+  
+    /* If the height of the image is less than 9 pixels, then there are no
+    ** boundaries. Simply copy the strip across.
+    */
+
+    if( udHeight < 9 )
+    {
+      for( udRow = 0; udRow < udHeight; udRow++ )
+      {
+        if( bColor )
+        {
+          COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpInRow, icpIn );
+          COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpOutRow, icpOut );
+
+          for( udColumn = 0; udColumn < udStripWidth; udColumn++, 
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpIn ), 
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpOut ) )
+          {
+            ubY = COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( icpIn );
+            COSTELLA_IMAGE_COLOR_PIXEL_SET_R_Y( icpOut, ubY );
+          }
+
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpInRow, sdRowStrideIn );
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpOutRow, sdRowStrideOut );
+        }
+        else
+        {
+          COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpInRow, igpIn );
+          COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpOutRow, igpOut );
+
+          for( udColumn = 0; udColumn < udStripWidth; udColumn++, 
+            COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpIn ), 
+            COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpOut ) )
+          {
+            ubY = COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( igpIn );
+            COSTELLA_IMAGE_GRAY_PIXEL_SET_Y( igpOut, ubY );
+          }
+
+          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpInRow, sdRowStrideIn );
+          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpOutRow, sdRowStrideOut );
+        }
+      }
+    }
+    else
+    {
+      /* There are boundaries. Load the first eight rows of the strip into 
+      ** the bottom block of the values arrays. This will automatically be 
+      ** shifted to the top block in the first step below. Switch on image 
+      ** type.
+      */
+
+      for( ubPosition = 8; ubPosition < 16; ubPosition++ )
+      {
+        if( bColor )
+        {
+          COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpInRow, icpIn );
+
+          for( udColumn = 0, pswBufferY = aswBufferY + ubPosition; udColumn
+            < udStripWidth; udColumn++, pswBufferY += 16, 
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpIn ) )
+          {
+            *pswBufferY = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( 
+              icpIn );
+          }
+
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpInRow, sdRowStrideIn );
+        }
+        else
+        {
+          COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpInRow, igpIn );
+
+          for( udColumn = 0, pswBufferY = aswBufferY + ubPosition; udColumn
+            < udStripWidth; udColumn++, pswBufferY += 16, 
+            COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpIn ) )
+          {
+            *pswBufferY = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( 
+              igpIn );
+          }
+
+          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpInRow, sdRowStrideIn );
+        }
+      }
+
+
+      /* Walk through all horizontal boundaries. See above comments.
+      */
+
+      for( udRowBoundaryBottom = 8; udRowBoundaryBottom < udHeight; 
+        udRowBoundaryBottom += 8 )
+      {
+        /* Shift the bottom block of each values array to the top block. 
+        */
+
+        for( udColumn = 0, pswBufferY = aswBufferY; udColumn < udStripWidth;
+          udColumn++, pswBufferY += 16 )
+        {
+          for( ubPosition = 0; ubPosition < 8; ubPosition++ )
+          {
+            pswBufferY[ ubPosition ] = pswBufferY[ ubPosition + 8 ];
+          }
+        }
+
+
+        /* Extract the next eight rows of the strip from the image. Fill any
+        ** rows past the bottom of the image with -1, which the discrepancy 
+        ** and correction functions recognize as missing entries. Switch on
+        ** image type.
+        */
+
+        for( ubPosition = 8, udRow = udRowBoundaryBottom; ubPosition < 16; 
+          ubPosition++, udRow++ )
+        {
+          if( udRow >= udHeight )
+          {
+            for( udColumn = 0, pswBufferY = aswBufferY + ubPosition; 
+              udColumn < udStripWidth; udColumn++, pswBufferY += 16 )
+            {
+              *pswBufferY = -1;
+            }
+          }
+          else if( bColor )
+          {
+            COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpInRow, icpIn );
+
+            for( udColumn = 0, pswBufferY = aswBufferY + ubPosition; 
+              udColumn < udStripWidth; udColumn++, pswBufferY += 16, 
+              COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpIn ) )
+            {
+              *pswBufferY = (COSTELLA_SW) 
+                COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( icpIn );
+            }
+
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpInRow, sdRowStrideIn );
+          }
+          else
+          {
+            COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpInRow, igpIn );
+
+            for( udColumn = 0, pswBufferY = aswBufferY + ubPosition; 
+              udColumn < udStripWidth; udColumn++, pswBufferY += 16, 
+              COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpIn ) )
+            {
+              *pswBufferY = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( 
+                igpIn );
+            }
+
+            COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpInRow, sdRowStrideIn );
+          }
+        }
+
+
+        /* Correct each column of the strip. Only the last boundary can 
+        ** lack the rows needed to compute its discrepancies.
+        */
+
+        if( udRowBoundaryBottom + 3 <= udHeight )
+        {
+          for( udColumn = 0, pswBufferY = aswBufferY; udColumn < 
+            udStripWidth; udColumn++, pswBufferY += 16 )
+          {
+            costella_unblock_correct_boundary( pswBufferY, COSTELLA_TRUE, 
+              aubYAdjustedU, aubYAdjustedV );
+          }
+        }
+        else
+        {
+          for( udColumn = 0, pswBufferY = aswBufferY; udColumn < 
+            udStripWidth; udColumn++, pswBufferY += 16 )
+          {
+            costella_unblock_correct_boundary( pswBufferY, COSTELLA_FALSE, 
+              aubYAdjustedU, aubYAdjustedV );
+          }
+        }
+
+
+        /* Write the top block rows back to the image. Switch on image type.
+        */
+
+        for( ubPosition = 0; ubPosition < 8; ubPosition++ )
+        {
+          if( bColor )
+          {
+            COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpOutRow, icpOut );
+
+            for( udColumn = 0, pswBufferY = aswBufferY + ubPosition; 
+              udColumn < udStripWidth; udColumn++, pswBufferY += 16, 
+              COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpOut ) )
+            {
+              ubY = (COSTELLA_UB) *pswBufferY;
+              COSTELLA_IMAGE_COLOR_PIXEL_SET_R_Y( icpOut, ubY );
+            }
+
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpOutRow, sdRowStrideOut 
+              );
+          }
+          else
+          {
+            COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpOutRow, igpOut );
+
+            for( udColumn = 0, pswBufferY = aswBufferY + ubPosition; 
+              udColumn < udStripWidth; udColumn++, pswBufferY += 16, 
+              COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpOut ) )
+            {
+              ubY = (COSTELLA_UB) *pswBufferY;
+              COSTELLA_IMAGE_GRAY_PIXEL_SET_Y( igpOut, ubY );
+            }
+
+            COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpOutRow, sdRowStrideOut );
+          }
+        }
+      }
+
+
+      /* Write out any remaining rows of the strip. We subtract 8 from the 
+      ** bottom boundary y value because it was incremented before the above
+      ** loop dropped out. Switch on image type.
+      */
+
+      for( udRow = udRowBoundaryBottom - 8, ubPosition = 8; udRow < 
+        udHeight; udRow++, ubPosition++ )
+      {
+        if( bColor )
+        {
+          COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpOutRow, icpOut );
+
+          for( udColumn = 0, pswBufferY = aswBufferY + ubPosition; udColumn
+            < udStripWidth; udColumn++, pswBufferY += 16, 
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpOut ) )
+          {
+            ubY = (COSTELLA_UB) *pswBufferY;
+            COSTELLA_IMAGE_COLOR_PIXEL_SET_R_Y( icpOut, ubY );
+          }
+
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpOutRow, sdRowStrideOut );
+        }
+        else
+        {
+          COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpOutRow, igpOut );
+
+          for( udColumn = 0, pswBufferY = aswBufferY + ubPosition; udColumn
+            < udStripWidth; udColumn++, pswBufferY += 16, 
+            COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpOut ) )
+          {
+            ubY = (COSTELLA_UB) *pswBufferY;
+            COSTELLA_IMAGE_GRAY_PIXEL_SET_Y( igpOut, ubY );
+          }
+
+          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpOutRow, sdRowStrideOut );
+        }
+      }
+    }
+
+
+    /* Walk across to the next strip.
+    */
+
+    for( udColumn = 0; udColumn < udStripWidth; udColumn++ )
+    {
+      if( bColor )
+      {
+        COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpInStart );
+        COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpOutStart );
+      }
+      else
+      {
+        COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpInStart );
+        COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpOutStart );
+      }
+    }
+  }
+
+
+  /* If we have a color image, correct the horizontal boundary discrepancies
+  ** for the chrominance channels. The strips contain 
+  ** COSTELLA_UNBLOCK_STRIP_WIDTH downsampled columns.
+  */
+
+  if( bColor )
+  {
+    /* Start at top-left of image. 
+    */
+
+    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpInStart, *picIn, udWidth, 
+      udHeight, sdRowStrideIn );
+    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpOutStart, *picOut, udWidth, 
+      udHeight, sdRowStrideOut );
+
+
+    /* Walk through the strips of the image.
+    */
+
+    for( udColumnLeft = 0; udColumnLeft < udWidth; udColumnLeft += 
+      COSTELLA_UNBLOCK_STRIP_WIDTH << 1 )
+    {
+      /* Progress callback.
+      */
+
+      if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
+      {
+        COSTELLA_ERROR( "Progress callback" );
+        COSTELLA_RETURN;
+      }
+
+
+      /* Compute the number of downsampled columns in this strip.
+      */
+
+      udStripWidth = ( udWidth - udColumnLeft + 1 ) >> 1;
+
+      if( udStripWidth > COSTELLA_UNBLOCK_STRIP_WIDTH )
+      {
+        udStripWidth = COSTELLA_UNBLOCK_STRIP_WIDTH;
+      }
+
+
+      /* Start off at the topmost downsampled row of this strip, for both
+      ** input and output.
+      */
+
+      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpInStart, icpInRow );
+      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpOutStart, icpOutRow );
+
+
+      /* If the height of the image is less than 17 pixels, then there are 
+      ** no boundaries. Simply copy the strip across.
+      */
+
+      if( udHeight < 17 )
+      {
+        for( udRow = 0; udRow < udHeight; udRow += 2, 
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpInRow, 
+          sdDoubleRowStrideIn ), COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( 
+          icpOutRow, sdDoubleRowStrideOut ) )
+        {
+          COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpInRow, icpIn );
+          COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpOutRow, icpOut );
+
+          for( udColumn = 0; udColumn < udStripWidth; udColumn++, 
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpIn ), 
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpOut ) )
+          {
+            ubCb = COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icpIn );
+            ubCr = COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icpIn );
+
+            COSTELLA_IMAGE_COLOR_PIXEL_SET_G_CB( icpOut, ubCb );
+            COSTELLA_IMAGE_COLOR_PIXEL_SET_B_CR( icpOut, ubCr );
+          }
+        }
+      }
+      else
+      {
+        /* There are boundaries. Load the first eight downsampled rows of 
+        ** the strip into the bottom block of the values arrays. This will 
+        ** automatically be shifted to the top block in the first step 
+        ** below.
+        */
+
+        for( ubPosition = 8; ubPosition < 16; ubPosition++, 
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpInRow, 
+          sdDoubleRowStrideIn ) )
+        {
+          COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpInRow, icpIn );
+
+          for( udColumn = 0, pswBufferCb = aswBufferCb + ubPosition, 
+            pswBufferCr = aswBufferCr + ubPosition; udColumn < udStripWidth;
+            udColumn++, pswBufferCb += 16, pswBufferCr += 16, 
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpIn ) )
+          {
+            *pswBufferCb = COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icpIn );
+            *pswBufferCr = COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icpIn );
+          }
+        }
+
+
+        /* Walk through all horizontal boundaries. See above comments.
+        */
+
+        for( udRowBoundaryBottom = 16; udRowBoundaryBottom < udHeight; 
+          udRowBoundaryBottom += 16 )
+        {
+          /* Shift the bottom block of each values array to the top block. 
+          */
+
+          for( udColumn = 0, pswBufferCb = aswBufferCb, pswBufferCr = 
+            aswBufferCr; udColumn < udStripWidth; udColumn++, pswBufferCb 
+            += 16, pswBufferCr += 16 )
+          {
+            for( ubPosition = 0; ubPosition < 8; ubPosition++ )
+            {
+              pswBufferCb[ ubPosition ] = pswBufferCb[ ubPosition + 8 ];
+              pswBufferCr[ ubPosition ] = pswBufferCr[ ubPosition + 8 ];
+            }
+          }
+
+
+          /* Extract the next eight downsampled rows of the strip from the 
+          ** image. Fill any rows past the bottom of the image with -1, 
+          ** which the discrepancy and correction functions recognize as 
+          ** missing entries.
+          */
+
+          for( ubPosition = 8, udRow = udRowBoundaryBottom; ubPosition < 16;
+            ubPosition++, udRow += 2 )
+          {
+            if( udRow >= udHeight )
+            {
+              for( udColumn = 0, pswBufferCb = aswBufferCb + ubPosition, 
+                pswBufferCr = aswBufferCr + ubPosition; udColumn < 
+                udStripWidth; udColumn++, pswBufferCb += 16, pswBufferCr += 
+                16 )
+              {
+                *pswBufferCb = -1;
+                *pswBufferCr = -1;
+              }
+            }
+            else
+            {
+              COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpInRow, icpIn );
+
+              for( udColumn = 0, pswBufferCb = aswBufferCb + ubPosition, 
+                pswBufferCr = aswBufferCr + ubPosition; udColumn < 
+                udStripWidth; udColumn++, pswBufferCb += 16, pswBufferCr += 
+                16, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpIn ) )
+              {
+                *pswBufferCb = COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icpIn );
+                *pswBufferCr = COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icpIn );
+              }
+
+              COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpInRow, 
+                sdDoubleRowStrideIn );
+            }
+          }
+
+
+          /* Correct each column of the strip. See above comments.
+          */
+
+          if( udRowBoundaryBottom + 5 <= udHeight )
+          {
+            for( udColumn = 0, pswBufferCb = aswBufferCb, pswBufferCr = 
+              aswBufferCr; udColumn < udStripWidth; udColumn++, pswBufferCb 
+              += 16, pswBufferCr += 16 )
+            {
+              costella_unblock_correct_boundary( pswBufferCb, COSTELLA_TRUE, 
+                aubCbAdjustedU, aubCbAdjustedV );
+              costella_unblock_correct_boundary( pswBufferCr, COSTELLA_TRUE, 
+                aubCrAdjustedU, aubCrAdjustedV );
+            }
+          }
+          else
+          {
+            for( udColumn = 0, pswBufferCb = aswBufferCb, pswBufferCr = 
+              aswBufferCr; udColumn < udStripWidth; udColumn++, pswBufferCb 
+              += 16, pswBufferCr += 16 )
+            {
+              costella_unblock_correct_boundary( pswBufferCb, COSTELLA_FALSE, 
+                aubCbAdjustedU, aubCbAdjustedV );
+              costella_unblock_correct_boundary( pswBufferCr, COSTELLA_FALSE, 
+                aubCrAdjustedU, aubCrAdjustedV );
+            }
+          }
+
+
+          /* Write the top block rows back to the image.
+          */
+
+          for( ubPosition = 0; ubPosition < 8; ubPosition++, 
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpOutRow, 
+            sdDoubleRowStrideOut ) )
+          {
+            COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpOutRow, icpOut );
+
+            for( udColumn = 0, pswBufferCb = aswBufferCb + ubPosition, 
+              pswBufferCr = aswBufferCr + ubPosition; udColumn < 
+              udStripWidth; udColumn++, pswBufferCb += 16, pswBufferCr += 
+              16, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpOut ) )
+            {
+              ubCb = (COSTELLA_UB) *pswBufferCb;
+              ubCr = (COSTELLA_UB) *pswBufferCr;
+
+              COSTELLA_IMAGE_COLOR_PIXEL_SET_G_CB( icpOut, ubCb );
+              COSTELLA_IMAGE_COLOR_PIXEL_SET_B_CR( icpOut, ubCr );
+            }
+          }
+        }        
+
+
+        /* Write out any remaining rows of the strip. We subtract 16 from 
+        ** the bottom boundary y value because it was incremented before the
+        ** above loop dropped out.
+        */
+
+        for( udRow = udRowBoundaryBottom - 16, ubPosition = 8; udRow < 
+          udHeight; udRow += 2, ubPosition++, 
+          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpOutRow, 
+          sdDoubleRowStrideOut ) )
+        {
+          COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpOutRow, icpOut );
+
+          for( udColumn = 0, pswBufferCb = aswBufferCb + ubPosition, 
+            pswBufferCr = aswBufferCr + ubPosition; udColumn < udStripWidth;
+            udColumn++, pswBufferCb += 16, pswBufferCr += 16, 
+            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpOut ) )
+          {
+            ubCb = (COSTELLA_UB) *pswBufferCb;
+            ubCr = (COSTELLA_UB) *pswBufferCr;
+
+            COSTELLA_IMAGE_COLOR_PIXEL_SET_G_CB( icpOut, ubCb );
+            COSTELLA_IMAGE_COLOR_PIXEL_SET_B_CR( icpOut, ubCr );
+          }
+        }
+      }
+
+    
+      /* Walk across to the next strip.
+      */
+
+      for( udColumn = 0; udColumn < udStripWidth; udColumn++ )
+      {
+        COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpInStart );
+        COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpOutStart );
+      }
+    }
+  }
+}
+COSTELLA_END_FUNCTION
+
+#endif
+
+
+
+/* CostellaUnblockCorrectHorizontalInPlace: 
+**
+**   Internal function that corrects the horizontal discrepancies in an 
+**   image in place, a whole row segment at a time, when each channel is 
+**   stored as a contiguous array of bytes. The results are identical to 
+**   those of CostellaUnblockCorrectHorizontalDiscrepancies() with the same 
+**   input and output image.
+**
+**   aub{Y,Cb,Cr}Adjusted{U,V}:  Adjustment tables.
+**
+**   pi:  Pointer to the image.
+**
+**   udRowBoundary{First,End}:  The boundaries corrected are those whose 
+**     bottom block starts on a row y with udRowBoundaryFirst <= y < 
+**     udRowBoundaryEnd. Boundaries must be corrected from the top down, as
+**     each one sees the corrections made by the one above it.
+*/
+
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+
+static COSTELLA_FUNCTION( CostellaUnblockCorrectHorizontalInPlace, ( 
+  COSTELLA_UB* aubYAdjustedU, COSTELLA_UB* aubYAdjustedV, COSTELLA_UB* 
+  aubCbAdjustedU, COSTELLA_UB* aubCbAdjustedV, COSTELLA_UB* aubCrAdjustedU, 
+  COSTELLA_UB* aubCrAdjustedV, COSTELLA_IMAGE* pi, COSTELLA_UD 
+  udRowBoundaryFirst, COSTELLA_UD udRowBoundaryEnd, 
+  COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* poPassback ) )
+{
+  COSTELLA_B bColor;
+  COSTELLA_UB ubNumRows;
+  COSTELLA_SD sdRowStride, sdDoubleRowStride;
+  COSTELLA_UD udWidth, udHeight, udRowBoundaryBottom, udRowTop, udRowStop;
+  COSTELLA_IMAGE_COLOR_PIXEL icp={0};
+  COSTELLA_IMAGE_GRAY_PIXEL igp=NULL;
+
+
+  /* Extract information.
+  */
+
+  bColor = pi->bColor;
+
+  udWidth = pi->udWidth;
+  udHeight = pi->udHeight;
+
+  sdRowStride = pi->sdRowStride;
+  sdDoubleRowStride = sdRowStride << 1;
+
+
+  /* Find the first luminance boundary in the range, and the row at which 
+  ** the range stops.
+  */
+
+  udRowTop = ( udRowBoundaryFirst + 7 ) & ~(COSTELLA_UD) 7;
+
+  if( udRowTop < 8 )
+  {
+    udRowTop = 8;
+  }
+
+  udRowStop = udRowBoundaryEnd < udHeight ? udRowBoundaryEnd : udHeight;
+
+
+  /* Start with the luminance channel. Start at the top of the block above
+  ** the first boundary.
+  */
+
+  if( bColor )
+  {
+    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icp, pi->ic, udWidth, udHeight,
+      sdRowStride );
+    COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icp, (COSTELLA_SD) ( udRowTop - 8 
+      ) * sdRowStride );
+  }
+  else
+  {
+    COSTELLA_IMAGE_GRAY_PIXEL_SET_TOP_LEFT( igp, pi->ig, udWidth, udHeight, 
+      sdRowStride );
+    COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igp, (COSTELLA_SD) ( udRowTop - 8 )
+      * sdRowStride );
+  }
+
+
+  /* Walk through all horizontal boundaries, correcting the two blocks 
+  ** either side of each one across the full width of the image. Since the 
+  ** image is corrected in place, the next boundary sees the corrected 
+  ** values, just as the values arrays carry them over in the strip code. 
+  */
+
+  for( udRowBoundaryBottom = udRowTop; udRowBoundaryBottom < udRowStop; 
+    udRowBoundaryBottom += 8 )
+  {
+    /* Progress callback.
+    */
+
+    if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
+    {
+      COSTELLA_ERROR( "Progress callback" );
+      COSTELLA_RETURN;
+    }
+
+
+    /* Count the rows of the two blocks that lie inside the image.
+    */
+
+    ubNumRows = udHeight - udRowBoundaryBottom >= 8 ? 16 : (COSTELLA_UB) ( 
+      udHeight - udRowBoundaryBottom + 8 );
+
+
+    /* Correct the row segment, and walk down to the next block.
+    */
+
+    costella_unblock_correct_rows_in_place( bColor ? 
+      COSTELLA_IMAGE_COLOR_PIXEL_R_Y_ADDRESS( icp ) : 
+      COSTELLA_IMAGE_GRAY_PIXEL_Y_ADDRESS( igp ), sdRowStride, 1, udWidth, 
+      ubNumRows, aubYAdjustedU, aubYAdjustedV );
+
+    if( bColor )
     {
-      if( bColor )
-      {
-        for( udColumn = 0; udColumn < udWidth; udColumn++, 
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpIn ), 
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpOut ) )
-        {
-          ubY = COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( icpIn );
-          COSTELLA_IMAGE_COLOR_PIXEL_SET_R_Y( icpOut, ubY );
-        }
-      }
-      else
-      {
-        for( udColumn = 0; udColumn < udWidth; udColumn++, 
-          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpIn ), 
-          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpOut ) )
-        {
-          ubY = COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( igpIn );
-          COSTELLA_IMAGE_GRAY_PIXEL_SET_Y( igpOut, ubY );
-        }
-      }
+      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icp, sdRowStride << 3 );
     }
     else
     {
-      /* There are boundaries. Load the values of the first eight input 
-      ** pixels of the row into the right block of the values array. This 
-      ** will automatically be shifted to the left block in the first step 
-      ** below. Switch on image type.
+      COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igp, sdRowStride << 3 );
+    }
+  }
+
+
+  /* If we have a color image, correct the horizontal boundary discrepancies
+  ** for the downsampled chrominance channels, which lie in the even rows and
+  ** columns.
+  */
+
+  if( bColor )
+  {
+    /* Find the first chrominance boundary in the range, and start at the 
+    ** top of the block above it.
+    */
+
+    udRowTop = ( udRowBoundaryFirst + 15 ) & ~(COSTELLA_UD) 15;
+
+    if( udRowTop < 16 )
+    {
+      udRowTop = 16;
+    }
+
+    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icp, pi->ic, udWidth, udHeight,
+      sdRowStride );
+    COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icp, (COSTELLA_SD) ( ( 
+      udRowTop - 16 ) >> 1 ) * sdDoubleRowStride );
+
+
+    /* Walk through the horizontal boundaries. See above comments.
+    */
+
+    for( udRowBoundaryBottom = udRowTop; udRowBoundaryBottom < udRowStop; 
+      udRowBoundaryBottom += 16 )
+    {
+      /* Progress callback.
       */
 
-      if( bColor )
-      {
-        for( ubPosition = 0, pswBufferY = aswBufferY + 8; ubPosition < 8; 
-          ubPosition++, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpIn ) )
-        {
-          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( 
-            icpIn );
-        }
-      }
-      else
+      if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
       {
-        for( ubPosition = 0, pswBufferY = aswBufferY + 8; ubPosition < 8; 
-          ubPosition++, COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpIn ) )
-        {
-          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( 
-            igpIn );
-        }
+        COSTELLA_ERROR( "Progress callback" );
+        COSTELLA_RETURN;
       }
 
 
-      /* Walk through all vertical boundaries. See above comments.
+      /* Count the downsampled rows of the two blocks that lie inside the 
+      ** image.
       */
 
-      for( udColumnBoundaryRight = 8; udColumnBoundaryRight < udWidth; 
-        udColumnBoundaryRight += 8 )
-      {
-        /* Shift the right block in the array to the left block. 
-        */
+      ubNumRows = udHeight - udRowBoundaryBottom >= 15 ? 16 : (COSTELLA_UB) 
+        ( ( udHeight - udRowBoundaryBottom + 17 ) >> 1 );
 
-        for( ubPosition = 0, pswBufferY = aswBufferY, pswBufferYOld = 
-          aswBufferY + 8; ubPosition < 8; ubPosition++ )
-        {
-          *pswBufferY++ = *pswBufferYOld++;
-        }
 
+      /* Correct the row segments, and walk down to the next block.
+      */
 
-        /* Extract the next eight pixels from the image. Switch on image 
-        ** type.
-        */
+      costella_unblock_correct_rows_in_place( 
+        COSTELLA_IMAGE_COLOR_PIXEL_G_CB_ADDRESS( icp ), sdDoubleRowStride, 2, ( 
+        udWidth + 1 ) >> 1, ubNumRows, aubCbAdjustedU, aubCbAdjustedV );
+      costella_unblock_correct_rows_in_place( 
+        COSTELLA_IMAGE_COLOR_PIXEL_B_CR_ADDRESS( icp ), sdDoubleRowStride, 2, ( 
+        udWidth + 1 ) >> 1, ubNumRows, aubCrAdjustedU, aubCrAdjustedV );
 
-        if( bColor )
-        {
-          for( udColumn = udColumnBoundaryRight; ubPosition < 16 && udColumn
-            < udWidth; udColumn++, ubPosition++, 
-            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpIn ) )
-          {
-            *pswBufferY++ = (COSTELLA_SW) 
-              COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( icpIn ); 
-          }
-        }
-        else
-        {
-          for( udColumn = udColumnBoundaryRight; ubPosition < 16 && udColumn
-            < udWidth; udColumn++, ubPosition++, 
-            COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpIn ) )
-          {
-            *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( 
-              igpIn );
-          }
-        }
+      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icp, sdDoubleRowStride << 3 
+        );
+    }
+  }
+}
+COSTELLA_END_FUNCTION
 
+#endif
 
-        /* Fill any unfilled entries with -1, which the discrepancy and
-        ** correction functions recognize as missing entries.
-        */
 
-        for( ; ubPosition < 16; ubPosition++ )
-        {
-          *pswBufferY++ = -1;
-        }
 
+/* costella_unblock_compute_discrepancies:
+**
+**   Compute the discrepancies u and v. 
+**
+**   aswValues:  Array containing the six intensity values. If any of the 
+**     last two values are -1, it indicates missing pixels; alternative 
+**     formulas are used. 
+**
+**   pswU:  Pointer into which the value of u will be stored. Must be valid.
+**
+**   pswV:  Pointer into which the value of v will be stored. If pswV is 
+**     zero, we do not want to compute v.
+*/
+
+static COSTELLA_INLINE void costella_unblock_compute_discrepancies( COSTELLA_SW*
+  aswValues, COSTELLA_SW* pswU, COSTELLA_SW* pswV )
+{
+  COSTELLA_SW sw6, sw7, sw8, sw9, sw10, swU, swV=0;
+  const COSTELLA_UNBLOCK_TABLES* ptbl = &gtblCostellaUnblock;
 
-        /* Compute discrepancies at the boundary.
-        */
 
-        if( COSTELLA_CALL( CostellaUnblockComputeDiscrepancies( aswBufferY +
-          5, &swYU, &swYV ) ) )
-        {
-          COSTELLA_ERROR( "Computing Y discrepancies" );
-          COSTELLA_RETURN;
-        }
+  /* If all six pixels are present, use the regular formulas.
+  */
 
+  if( aswValues[ 5 ] >= 0 )
+  {
+    costella_unblock_compute_complete_discrepancies( aswValues, pswU, pswV );
+    return;
+  }
 
-        /* Adjust the discrepancies.
-        */
 
-        swYU = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swYU, aubYAdjustedU );
-        swYV = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swYV, aubYAdjustedV );
+  /* Extract pixel values. The last pixel is missing.
+  */
 
+  sw6 = *aswValues++;
+  sw7 = *aswValues++;
+  sw8 = *aswValues++;
+  sw9 = *aswValues++;
+  sw10 = *aswValues;
 
-        /* Correct the sixteen values for these adjusted discrepancies.
-        */
 
-        if( COSTELLA_CALL( CostellaUnblockCorrectDiscrepancies( aswBufferY, 
-          swYU, swYV ) ) )
-        {
-          COSTELLA_ERROR( "Correcting Y discrepancies" );
-          COSTELLA_RETURN;
-        }
+  /* Check if the second-last pixel is missing.
+  */
 
+  if( sw10 >= 0 )
+  {
+    /* Have five pixels. Use modified formulas.
+    */
 
-        /* Write the left block pixels to the output image. Switch on image 
-        ** type.
-        */
+    swU = COSTELLA_SHIFT_RIGHT_FLOOR( -(COSTELLA_SW) ptbl->auwMult3[ sw6 ] + 
+      (COSTELLA_SW) ptbl->auwMult10[ sw7 ] - (COSTELLA_SW) ptbl->auwMult15[ 
+      sw8 ] + (COSTELLA_SW) ptbl->auwMult12Add4[ sw9 ] - ( sw10 << 2 ), 3 );
 
-        if( bColor )
-        {
-          for( ubPosition = 0, pswBufferY = aswBufferY; ubPosition < 8; 
-            ubPosition++, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpOut ) )
-          {
-            ubY = (COSTELLA_UB) *pswBufferY++;
-            COSTELLA_IMAGE_COLOR_PIXEL_SET_R_Y( icpOut, ubY );
-          }
-        }
-        else
-        {
-          for( ubPosition = 0, pswBufferY = aswBufferY; ubPosition < 8; 
-            ubPosition++, COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpOut ) )
-          {
-            ubY = (COSTELLA_UB) *pswBufferY++;
-            COSTELLA_IMAGE_GRAY_PIXEL_SET_Y( igpOut, ubY );
-          }
-        }
-      }
+    if( pswV )
+    {
+      swV = -sw6 + (COSTELLA_SW) ptbl->auwMult3[ sw7 ] - ( sw8 << 1 ) - sw9
+        + sw10;
+    }
+  }
+  else
+  {
+    /* Must have four pixels. Use modified formulas.
+    */
 
+    swU = COSTELLA_SHIFT_RIGHT_FLOOR( -(COSTELLA_SW) ptbl->auwMult3[ sw6 ] + 
+      (COSTELLA_SW) ptbl->auwMult10[ sw7 ] - (COSTELLA_SW) ptbl->auwMult15[ 
+      sw8 ] + ( sw9 << 3 ) + 4, 3 );
 
-      /* Write out any remaining pixels in the row. We subtract 8 from the 
-      ** right boundary x value because it was incremented before the above 
-      ** loop dropped out. Switch on image type.
-      */
+    swV = 0;
+  }
 
-      if( bColor )
-      {
-        for( udColumn = udColumnBoundaryRight - 8; ubPosition < 16 && 
-          udColumn < udWidth; udColumn++, ubPosition++, 
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpOut ) )
-        {
-          ubY = (COSTELLA_UB) *pswBufferY++;
-          COSTELLA_IMAGE_COLOR_PIXEL_SET_R_Y( icpOut, ubY );
-        }
-      }
-      else
-      {
-        for( udColumn = udColumnBoundaryRight - 8; ubPosition < 16 && 
-          udColumn < udWidth; udColumn++, ubPosition++, 
-          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpOut ) )
-        {
-          ubY = (COSTELLA_UB) *pswBufferY++;
-          COSTELLA_IMAGE_GRAY_PIXEL_SET_Y( igpOut, ubY );
-        }
-      }
-    }
 
+  /* Bound u and v to the range [-255,+255].
+  */
 
-    /* Walk down to the next row.
-    */
+  if( swU < -255 )
+  {
+    swU = -255;
+  }
+  else if( swU > +255 )
+  {
+    swU = +255;
+  }
 
-    if( bColor )
+  if( pswV )
+  {
+    if( swV < -255 )
     {
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpInStart, sdRowStrideIn );
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpOutStart, sdRowStrideOut );
+      swV = -255;
     }
-    else
+    else if( swV > +255 )
     {
-      COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpInStart, sdRowStrideIn );
-      COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpOutStart, sdRowStrideOut );
+      swV = +255;
     }
+  }
 
-    if( bCopyAlpha )
-    {
-      COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_DOWN( iapInStart, sdAlphaRowStrideIn 
-        );
-      COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_DOWN( iapOutStart, sdAlphaRowStrideOut
-        );
-    }
+
+  /* Store u and v.
+  */
+
+  *pswU = swU;
+
+  if( pswV )
+  {
+    *pswV = swV;
   }
+}
+
+
+
+/* costella_unblock_compute_complete_discrepancies:
+**
+**   Compute the discrepancies u and v when all six pixels are present, 
+**   without the checks for missing pixels. The results are those of 
+**   costella_unblock_compute_discrepancies(). Every boundary but the last 
+**   in each row or column has all six pixels, so the passes use this for 
+**   their interior loops, and costella_unblock_compute_discrepancies() only
+**   for the last boundary.
+**
+**   aswValues:  Array containing the six intensity values, none of which 
+**     may be -1.
+**
+**   psw{U,V}:  As for costella_unblock_compute_discrepancies().
+*/
+
+static COSTELLA_INLINE void costella_unblock_compute_complete_discrepancies( 
+  COSTELLA_SW* aswValues, COSTELLA_SW* pswU, COSTELLA_SW* pswV )
+{
+  COSTELLA_SW sw6, sw7, sw8, sw9, sw10, sw11, swU, swV;
+  const COSTELLA_UNBLOCK_TABLES* ptbl = &gtblCostellaUnblock;
 
 
-  /* If we have a color image, we now correct the vertical boundaries of
-  ** the chrominance channels. 
+  /* Extract pixel values.
   */
 
-  if( bColor )
-  {
-    /* Start at the top-left of the image. 
-    */
-
-    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpInStart, *picIn, udWidth, 
-      udHeight, sdRowStrideIn );
-    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpOutStart, *picOut, udWidth, 
-      udHeight, sdRowStrideOut );
-    
-
-    /* Walk through those rows of the image that contain chrominance data.
-    */
+  sw6 = *aswValues++;
+  sw7 = *aswValues++;
+  sw8 = *aswValues++;
+  sw9 = *aswValues++;
+  sw10 = *aswValues++;
+  sw11 = *aswValues;
 
-    for( udRow = 0; udRow < udHeight; udRow += 2 )
-    {
-      /* Progress callback.
-      */
 
-      if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
-      {
-        COSTELLA_ERROR( "Progress callback" );
-        COSTELLA_RETURN;
-      }
+  /* Compute u, bounded to the range [-255,+255].
+  */
 
+  swU = COSTELLA_SHIFT_RIGHT_FLOOR( (COSTELLA_SW) ptbl->auwMult15Add4[ sw9 ] 
+    - (COSTELLA_SW) ptbl->auwMult15[ sw8 ] - (COSTELLA_SW) ptbl->auwMult10[ 
+    sw10 ] + (COSTELLA_SW) ptbl->auwMult10[ sw7 ] + (COSTELLA_SW) 
+    ptbl->auwMult3[ sw11 ] - (COSTELLA_SW) ptbl->auwMult3[ sw6 ], 3 );
 
-      /* Start off at the leftmost downsampled pixel of the row, for both 
-      ** the input and the output.
-      */
+  swU = swU < -255 ? -255 : swU > +255 ? +255 : swU;
 
-      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpInStart, icpIn );
-      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpOutStart, icpOut );
+  *pswU = swU;
 
 
-      /* If the width of the image is less than 17 pixels, then there are no
-      ** boundaries. Simply copy the row across.
-      */
+  /* Compute v likewise, if wanted.
+  */
 
-      if( udWidth < 17 )
-      {
-        for( udColumn = 0; udColumn < udWidth; udColumn += 2, 
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpIn ), 
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpOut ) )
-        {
-          ubCb = COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icpIn );
-          ubCr = COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icpIn );
+  if( pswV )
+  {
+    swV = (COSTELLA_SW) ptbl->auwMult3[ sw10 ] + (COSTELLA_SW) 
+      ptbl->auwMult3[ sw7 ] - sw11 - sw6 - ( ( sw9 + sw8 ) << 1 );
 
-          COSTELLA_IMAGE_COLOR_PIXEL_SET_G_CB( icpOut, ubCb );
-          COSTELLA_IMAGE_COLOR_PIXEL_SET_B_CR( icpOut, ubCr );
-        }
-      }
-      else
-      {
-        /* There are boundaries. Load the values of the first eight 
-        ** downsampled pixels of the row into the right blocks of the values
-        ** arrays. This will automatically be shifted to the left block in 
-        ** the first step below. Switch on image type.
-        */
+    *pswV = swV < -255 ? -255 : swV > +255 ? +255 : swV;
+  }
+}
 
-        for( ubPosition = 0, pswBufferCb = aswBufferCb + 8, pswBufferCr = 
-          aswBufferCr + 8; ubPosition < 8; ubPosition++,      
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpIn ) )
-        {
-          *pswBufferCb++ = (COSTELLA_SW) 
-            COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icpIn );
-          *pswBufferCr++ = (COSTELLA_SW) 
-            COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icpIn );
-        }
 
 
-        /* Walk through all vertical boundaries. See above comments.
-        */
+/* costella_unblock_count_discrepancies:
+**
+**   Compute the discrepancies at a boundary, and in the middle of the block
+**   to its left or above it, and add their absolute values to the 
+**   frequency tables.
+**
+**   asw:  Array of ten intensity values: the last seven of the block before
+**     the boundary, and the first three after it. The last two may be -1 
+**     if bComplete is false.
+**
+**   bComplete:  Whether all ten values are present. Callers pass a 
+**     constant, so that the checks for missing pixels are only compiled 
+**     into their edge handlers.
+**
+**   aud{Boundary,Internal}{U,V}:  Frequency tables of the absolute value of
+**     {u,v} at the boundary and in the middle of the block.
+*/
 
-        for( udColumnBoundaryRight = 16; udColumnBoundaryRight < udWidth; 
-          udColumnBoundaryRight += 16 )
-        {
-          /* Shift the right block in the array to the left block. 
-          */
+static COSTELLA_INLINE void costella_unblock_count_discrepancies( COSTELLA_SW* 
+  asw, COSTELLA_B bComplete, COSTELLA_UD* audBoundaryU, COSTELLA_UD* 
+  audBoundaryV, COSTELLA_UD* audInternalU, COSTELLA_UD* audInternalV )
+{
+  COSTELLA_SW swBoundaryU, swBoundaryV, swInternalU, swInternalV;
 
-          for( ubPosition = 0, pswBufferCb = aswBufferCb, pswBufferCbOld = 
-            aswBufferCb + 8, pswBufferCr = aswBufferCr, pswBufferCrOld = 
-            aswBufferCr + 8; ubPosition < 8; ubPosition++ )
-          {
-            *pswBufferCb++ = *pswBufferCbOld++;
-            *pswBufferCr++ = *pswBufferCrOld++;
-          }
 
+  /* Compute discrepancies. The six pixels in the middle of the block are 
+  ** always present.
+  */
 
-          /* Extract the next eight downsampled pixels from the image. Need 
-          ** to make sure that we don't go past the right edge of the image. 
-          ** Switch on image type.
-          */
+  if( bComplete )
+  {
+    costella_unblock_compute_complete_discrepancies( asw + 4, &swBoundaryU, 
+      &swBoundaryV );
+  }
+  else
+  {
+    costella_unblock_compute_discrepancies( asw + 4, &swBoundaryU, 
+      &swBoundaryV );
+  }
 
-          for( udColumn = udColumnBoundaryRight; ubPosition < 16 && 
-            udColumn < udWidth; udColumn += 2, ubPosition++, 
-            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpIn ) )
-          {
-            *pswBufferCb++ = (COSTELLA_SW) 
-              COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icpIn );
-            *pswBufferCr++ = (COSTELLA_SW) 
-              COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icpIn );
-          }
+  costella_unblock_compute_complete_discrepancies( asw, &swInternalU, 
+    &swInternalV );
 
 
-          /* Fill any unfilled entries with -1, which the discrepancy and
-          ** correction functions recognize as missing entries.
-          */
+  /* Update frequency tables.
+  */
 
-          for( ; ubPosition < 16; ubPosition++ )
-          {
-            *pswBufferCb++ = -1;
-            *pswBufferCr++ = -1;
-          }
+  audBoundaryU[ abs( swBoundaryU ) ]++;
+  audBoundaryV[ abs( swBoundaryV ) ]++;
 
+  audInternalU[ abs( swInternalU ) ]++;
+  audInternalV[ abs( swInternalV ) ]++;
+}
 
-          /* Now compute the boundary discrepancies.
-          */
 
-          if( COSTELLA_CALL( CostellaUnblockComputeDiscrepancies( 
-            aswBufferCb + 5, &swCbU, &swCbV ) ) || COSTELLA_CALL(
-            CostellaUnblockComputeDiscrepancies( aswBufferCr + 5, &swCrU, 
-            &swCrV ) ) )
-          {
-            COSTELLA_ERROR( "Computing Cb or Cr discrepancies" );
-            COSTELLA_RETURN;
-          }
 
+/* costella_unblock_compute_strip_discrepancies:
+**
+**   Compute the absolute values of the discrepancies u and v for a row of
+**   adjacent boundaries at once, bounded to the range [0,255]. The results 
+**   are identical to those of costella_unblock_compute_discrepancies(), which 
+**   is used for any columns not handled by the vector code.
+**
+**   aswValues:  Array containing the six rows of intensity values, row k of
+**     which starts at aswValues + k * udStride. Missing pixels are marked 
+**     by -1, as for costella_unblock_compute_discrepancies().
+**
+**   udStride:  Distance between the rows of aswValues.
+**
+**   udCount:  Number of columns.
+**
+**   aub{U,V}:  Array into which the absolute values of {u,v} will be 
+**     stored.
+*/
 
-          /* Adjust the discrepancies.
-          */
+static COSTELLA_INLINE void costella_unblock_compute_strip_discrepancies( 
+  COSTELLA_SW* aswValues, COSTELLA_UD udStride, COSTELLA_UD udCount, 
+  COSTELLA_UB* aubU, COSTELLA_UB* aubV )
+{
+  COSTELLA_UB ubPosition;
+  COSTELLA_SW swU, swV;
+  COSTELLA_SW asw[ 6 ];
+  COSTELLA_UD udColumn;
 
-          swCbU = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swCbU, aubCbAdjustedU
-            );
-          swCbV = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swCbV, aubCbAdjustedV
-            );
 
-          swCrU = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swCrU, aubCrAdjustedU
-            );
-          swCrV = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swCrV, aubCrAdjustedV
-            );
+  /* Start at the leftmost column.
+  */
 
+  udColumn = 0;
 
-          /* Correct the sixteen values for these adjusted discrepancies.
-          */
 
-          if( COSTELLA_CALL( CostellaUnblockCorrectDiscrepancies( 
-            aswBufferCb, swCbU, swCbV ) ) || COSTELLA_CALL(
-            CostellaUnblockCorrectDiscrepancies( aswBufferCr, swCrU, swCrV )
-            ) )
-          {
-            COSTELLA_ERROR( "Correcting Cb or Cr discrepancies" );
-            COSTELLA_RETURN;
-          }
+  /* Use the vector code of the tier chosen at run time for as many 
+  ** columns as it handles. Each tier leaves any columns left over for the 
+  ** tiers below it.
+  */
 
+  #ifdef COSTELLA_CPU_HAS_SSE2
+  {
+    COSTELLA_UB ubTier;
 
-          /* Write the left block pixels back to the image. Switch on image 
-          ** type.
-          */
+    ubTier = costella_cpu_tier();
 
-          for( ubPosition = 0, pswBufferCb = aswBufferCb, pswBufferCr = 
-            aswBufferCr; ubPosition < 8; ubPosition++, 
-            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpOut ) )
-          {
-            ubCb = (COSTELLA_UB) *pswBufferCb++;
-            ubCr = (COSTELLA_UB) *pswBufferCr++;
+    #ifdef COSTELLA_CPU_HAS_AVX512
+    if( ubTier >= COSTELLA_CPU_AVX512 )
+    {
+      udColumn = costella_unblock_strip_avx512( aswValues, udStride, 
+        udColumn, udCount, aubU, aubV );
+    }
+    #endif
 
-            COSTELLA_IMAGE_COLOR_PIXEL_SET_G_CB( icpOut, ubCb );
-            COSTELLA_IMAGE_COLOR_PIXEL_SET_B_CR( icpOut, ubCr );
-          }
-        }
+    #ifdef COSTELLA_CPU_HAS_AVX2
+    if( ubTier >= COSTELLA_CPU_AVX2 )
+    {
+      udColumn = costella_unblock_strip_avx2( aswValues, udStride, udColumn,
+        udCount, aubU, aubV );
+    }
+    #endif
 
+    if( ubTier >= COSTELLA_CPU_SSE2 )
+    {
+      udColumn = costella_unblock_strip_sse2( aswValues, udStride, udColumn,
+        udCount, aubU, aubV );
+    }
+  }
+  #endif
 
-        /* Write out any remaining pixels in the row. Walk through the 
-        ** remaining pixels. We subtract 16 from the right boundary x value 
-        ** because it was incremented before the above loop dropped out.
-        ** Switch on image type.
-        */
 
-        for( udColumn = udColumnBoundaryRight - 16; ubPosition < 16 && 
-          udColumn < udWidth; udColumn += 2, ubPosition++,             
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpOut ) )
-        {
-          ubCb = (COSTELLA_UB) *pswBufferCb++;
-          ubCr = (COSTELLA_UB) *pswBufferCr++;
+  /* Any remaining columns use the reference code.
+  */
 
-          COSTELLA_IMAGE_COLOR_PIXEL_SET_G_CB( icpOut, ubCb );
-          COSTELLA_IMAGE_COLOR_PIXEL_SET_B_CR( icpOut, ubCr );
-        }
-      }
-    
+  for( ; udColumn < udCount; udColumn++ )
+  {
+    for( ubPosition = 0; ubPosition < 6; ubPosition++ )
+    {
+      asw[ ubPosition ] = aswValues[ ubPosition * udStride + udColumn ];
+    }
 
-      /* Walk down to the next downsampled row.
-      */
+    costella_unblock_compute_discrepancies( asw, &swU, &swV );
 
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpInStart, 
-        sdDoubleRowStrideIn );
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpOutStart, 
-        sdDoubleRowStrideOut );
-    }
+    aubU[ udColumn ] = (COSTELLA_UB) abs( swU );
+    aubV[ udColumn ] = (COSTELLA_UB) abs( swV );
   }
 }
-COSTELLA_END_FUNCTION
 
 
 
-/* CostellaUnblockCorrectHorizontalDiscrepancies: 
+/* costella_unblock_strip_avx512:
 **
-**   Internal function that corrects the horizontal discrepancies in an 
-**   image, based on the supplied adjustment tables. 
+**   Compute the discrepancies for thirty-two columns at a time with 
+**   AVX-512, as costella_unblock_compute_strip_discrepancies() does. The 
+**   formula for each column is selected with masks.
 **
-**   aub{Y,Cb,Cr}Adjusted{U,V}:  Adjustment tables.
+**   udColumn:  First column to compute.
 **
-**   pi{In,Out}:  Pointer to the {in,out}put image.
+**   Other arguments are as for costella_unblock_compute_strip_discrepancies().
+**
+**   Returns the first column not computed.
 */
 
-static COSTELLA_FUNCTION( CostellaUnblockCorrectHorizontalDiscrepancies, ( 
-  COSTELLA_SW* aswBufferY, COSTELLA_SW* aswBufferCb, COSTELLA_SW* 
-  aswBufferCr, COSTELLA_UB* aubYAdjustedU, COSTELLA_UB* aubYAdjustedV, 
-  COSTELLA_UB* aubCbAdjustedU, COSTELLA_UB* aubCbAdjustedV, COSTELLA_UB* 
-  aubCrAdjustedU, COSTELLA_UB* aubCrAdjustedV, COSTELLA_IMAGE* piIn, 
-  COSTELLA_IMAGE* piOut, COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* 
-  poPassback ) )
-{
-  COSTELLA_B bAlpha, bCopyAlpha, bColor;
-  COSTELLA_UB ubPosition, ubY, ubCb, ubCr, ubA;
-  COSTELLA_SW swYU, swYV, swCbU, swCbV, swCrU, swCrV;
-  COSTELLA_SW* pswBufferY, * pswBufferYOld, * pswBufferCb, * pswBufferCbOld,
-    * pswBufferCr, * pswBufferCrOld;
-  COSTELLA_SD sdRowStrideIn, sdRowStrideOut, sdDoubleRowStrideIn, 
-    sdDoubleRowStrideOut, sdAlphaRowStrideIn, sdAlphaRowStrideOut;
-  COSTELLA_UD udWidth, udHeight, udRow, udColumn, udRowBoundaryBottom;
-  COSTELLA_IMAGE_ALPHA* piaIn, * piaOut;
-  COSTELLA_IMAGE_GRAY* pigIn, * pigOut;
-  COSTELLA_IMAGE_COLOR* picIn, * picOut;
-  COSTELLA_IMAGE_ALPHA_PIXEL iapInStart, iapOutStart, iapIn, iapOut;
-  COSTELLA_IMAGE_GRAY_PIXEL igpInStart=NULL, igpOutStart=NULL, igpIn=NULL, igpOut=NULL;
-  COSTELLA_IMAGE_COLOR_PIXEL icpInStart={0}, icpOutStart={0}, icpIn={0}, icpOut={0};
-  
-
-  /* Extract information.
-  */
-
-  bAlpha = piIn->bAlpha;
-  bColor = piIn->bColor;
+#ifdef COSTELLA_CPU_HAS_AVX512
 
-  udWidth = piIn->udWidth;
-  udHeight = piIn->udHeight;
+static COSTELLA_CPU_TARGET_AVX512 COSTELLA_UD costella_unblock_strip_avx512( 
+  COSTELLA_SW* aswValues, COSTELLA_UD udStride, COSTELLA_UD udColumn, 
+  COSTELLA_UD udCount, COSTELLA_UB* aubU, COSTELLA_UB* aubV )
+{
+  __m512i x6, x7, x8, x9, x10, x11, xC, xW, xU, xV, xU5, xU4, xV5, xMax;
+  __mmask32 mMissing11, mMissing10;
 
-  sdRowStrideIn = piIn->sdRowStride;
-  sdRowStrideOut = piOut->sdRowStride;
+  xMax = _mm512_set1_epi16( 255 );
 
-  sdAlphaRowStrideIn = piIn->sdAlphaRowStride;
-  sdAlphaRowStrideOut = piOut->sdAlphaRowStride;
+  for( ; udColumn + 32 <= udCount; udColumn += 32 )
+  {
+    x6 = _mm512_loadu_si512( aswValues + udColumn );
+    x7 = _mm512_loadu_si512( aswValues + udStride + udColumn );
+    x8 = _mm512_loadu_si512( aswValues + 2 * udStride + udColumn );
+    x9 = _mm512_loadu_si512( aswValues + 3 * udStride + udColumn );
+    x10 = _mm512_loadu_si512( aswValues + 4 * udStride + udColumn );
+    x11 = _mm512_loadu_si512( aswValues + 5 * udStride + udColumn );
+
+    mMissing11 = _mm512_movepi16_mask( x11 );
+    mMissing10 = _mm512_movepi16_mask( x10 );
+
+    xC = _mm512_add_epi16( _mm512_mullo_epi16( _mm512_sub_epi16( x7, x8 ), 
+      _mm512_set1_epi16( 10 ) ), _mm512_sub_epi16( _mm512_set1_epi16( 4 ), 
+      _mm512_add_epi16( _mm512_mullo_epi16( x8, _mm512_set1_epi16( 5 ) ), 
+      _mm512_mullo_epi16( x6, _mm512_set1_epi16( 3 ) ) ) ) );
+    xW = _mm512_sub_epi16( _mm512_sub_epi16( _mm512_mullo_epi16( x7, 
+      _mm512_set1_epi16( 3 ) ), x6 ), _mm512_add_epi16( x8, x8 ) );
+
+    xU = _mm512_srai_epi16( _mm512_add_epi16( _mm512_add_epi16( xC, 
+      _mm512_mullo_epi16( x9, _mm512_set1_epi16( 15 ) ) ), 
+      _mm512_sub_epi16( _mm512_mullo_epi16( x11, _mm512_set1_epi16( 3 ) ), 
+      _mm512_mullo_epi16( x10, _mm512_set1_epi16( 10 ) ) ) ), 3 );
+    xU5 = _mm512_srai_epi16( _mm512_add_epi16( xC, _mm512_slli_epi16( 
+      _mm512_sub_epi16( _mm512_mullo_epi16( x9, _mm512_set1_epi16( 3 ) ), 
+      x10 ), 2 ) ), 3 );
+    xU4 = _mm512_srai_epi16( _mm512_add_epi16( xC, _mm512_slli_epi16( x9, 3
+      ) ), 3 );
+
+    xV = _mm512_sub_epi16( _mm512_add_epi16( xW, _mm512_mullo_epi16( x10, 
+      _mm512_set1_epi16( 3 ) ) ), _mm512_add_epi16( x11, _mm512_add_epi16( 
+      x9, x9 ) ) );
+    xV5 = _mm512_maskz_add_epi16( (__mmask32) ~mMissing10, _mm512_sub_epi16(
+      xW, x9 ), x10 );
+
+    xU = _mm512_mask_blend_epi16( mMissing11, xU, _mm512_mask_blend_epi16( 
+      mMissing10, xU5, xU4 ) );
+    xV = _mm512_mask_blend_epi16( mMissing11, xV, xV5 );
+
+    xU = _mm512_min_epi16( _mm512_abs_epi16( xU ), xMax );
+    xV = _mm512_min_epi16( _mm512_abs_epi16( xV ), xMax );
+
+    _mm256_storeu_si256( (__m256i*) ( aubU + udColumn ), 
+      _mm512_cvtepi16_epi8( xU ) );
+    _mm256_storeu_si256( (__m256i*) ( aubV + udColumn ), 
+      _mm512_cvtepi16_epi8( xV ) );
+  }
 
-  piaIn = &piIn->ia;
-  piaOut = &piOut->ia;
+  return udColumn;
+}
 
-  pigIn = &piIn->ig;
-  pigOut = &piOut->ig;
+#endif
 
-  picIn = &piIn->ic;
-  picOut = &piOut->ic;
 
 
-  /* Check that the output image is consistent.
-  */
+/* costella_unblock_strip_avx2:
+**
+**   Compute the discrepancies for sixteen columns at a time with AVX2, as
+**   costella_unblock_compute_strip_discrepancies() does. The regular
+**   formulas and the two modified formulas are all computed,
+**   and the right one is selected for each column according to which
+**   pixels are missing.
+**
+**   udColumn:  First column to compute.
+**
+**   Other arguments are as for costella_unblock_compute_strip_discrepancies().
+**
+**   Returns the first column not computed.
+*/
 
-  #ifdef COSTELLA_DEBUG
-  {
-    if( !piOut->bAlpha != !bAlpha )
-    {
-      COSTELLA_FUNDAMENTAL_ERROR( "Alpha flag disagrees" );
-      COSTELLA_RETURN;
-    }
+#ifdef COSTELLA_CPU_HAS_AVX2
 
-    if( !piOut->bColor != !bColor )
-    {
-      COSTELLA_FUNDAMENTAL_ERROR( "Color flag disagrees" );
-      COSTELLA_RETURN;
-    }
+static COSTELLA_CPU_TARGET_AVX2 COSTELLA_UD costella_unblock_strip_avx2( 
+  COSTELLA_SW* aswValues, COSTELLA_UD udStride, COSTELLA_UD udColumn, 
+  COSTELLA_UD udCount, COSTELLA_UB* aubU, COSTELLA_UB* aubV )
+{
+  __m256i x6, x7, x8, x9, x10, x11, xC, xW, xU, xV, xU5, xU4, xV5, 
+    xMissing11, xMissing10, xMax;
 
-    if( piOut->udWidth != udWidth )
-    {
-      COSTELLA_FUNDAMENTAL_ERROR( "Width disagrees" );
-      COSTELLA_RETURN;
-    }
+  xMax = _mm256_set1_epi16( 255 );
 
-    if( piOut->udHeight != udHeight )
-    {
-      COSTELLA_FUNDAMENTAL_ERROR( "Height disagrees" );
-      COSTELLA_RETURN;
-    }
+  for( ; udColumn + 16 <= udCount; udColumn += 16 )
+  {
+    x6 = _mm256_loadu_si256( (__m256i*) ( aswValues + udColumn ) );
+    x7 = _mm256_loadu_si256( (__m256i*) ( aswValues + udStride + 
+      udColumn ) );
+    x8 = _mm256_loadu_si256( (__m256i*) ( aswValues + 2 * udStride + 
+      udColumn ) );
+    x9 = _mm256_loadu_si256( (__m256i*) ( aswValues + 3 * udStride + 
+      udColumn ) );
+    x10 = _mm256_loadu_si256( (__m256i*) ( aswValues + 4 * udStride + 
+      udColumn ) );
+    x11 = _mm256_loadu_si256( (__m256i*) ( aswValues + 5 * udStride + 
+      udColumn ) );
+
+    xMissing11 = _mm256_srai_epi16( x11, 15 );
+    xMissing10 = _mm256_srai_epi16( x10, 15 );
+
+    /* Terms common to all formulas: -3 x6 + 10 x7 - 15 x8 + 4 for u, and
+    ** -x6 + 3 x7 - 2 x8 for v.
+    */
+
+    xC = _mm256_add_epi16( _mm256_mullo_epi16( _mm256_sub_epi16( x7, x8 
+      ), _mm256_set1_epi16( 10 ) ), _mm256_sub_epi16( _mm256_set1_epi16( 4
+      ), _mm256_add_epi16( _mm256_mullo_epi16( x8, _mm256_set1_epi16( 5 ) 
+      ), _mm256_mullo_epi16( x6, _mm256_set1_epi16( 3 ) ) ) ) );
+    xW = _mm256_sub_epi16( _mm256_sub_epi16( _mm256_mullo_epi16( x7, 
+      _mm256_set1_epi16( 3 ) ), x6 ), _mm256_add_epi16( x8, x8 ) );
+
+    xU = _mm256_srai_epi16( _mm256_add_epi16( _mm256_add_epi16( xC, 
+      _mm256_mullo_epi16( x9, _mm256_set1_epi16( 15 ) ) ), 
+      _mm256_sub_epi16( _mm256_mullo_epi16( x11, _mm256_set1_epi16( 3 ) ),
+      _mm256_mullo_epi16( x10, _mm256_set1_epi16( 10 ) ) ) ), 3 );
+    xU5 = _mm256_srai_epi16( _mm256_add_epi16( xC, _mm256_slli_epi16( 
+      _mm256_sub_epi16( _mm256_mullo_epi16( x9, _mm256_set1_epi16( 3 ) ), 
+      x10 ), 2 ) ), 3 );
+    xU4 = _mm256_srai_epi16( _mm256_add_epi16( xC, _mm256_slli_epi16( x9,
+      3 ) ), 3 );
+
+    xV = _mm256_sub_epi16( _mm256_add_epi16( xW, _mm256_mullo_epi16( 
+      x10, _mm256_set1_epi16( 3 ) ) ), _mm256_add_epi16( x11, 
+      _mm256_add_epi16( x9, x9 ) ) );
+    xV5 = _mm256_add_epi16( _mm256_sub_epi16( xW, x9 ), x10 );
+
+    xU = _mm256_blendv_epi8( xU, _mm256_blendv_epi8( xU5, xU4, 
+      xMissing10 ), xMissing11 );
+    xV = _mm256_blendv_epi8( xV, _mm256_andnot_si256( xMissing10, xV5 ), 
+      xMissing11 );
+
+    xU = _mm256_min_epi16( _mm256_abs_epi16( xU ), xMax );
+    xV = _mm256_min_epi16( _mm256_abs_epi16( xV ), xMax );
+
+    xU = _mm256_permute4x64_epi64( _mm256_packus_epi16( xU, xV ), 0xd8 );
+
+    _mm_storeu_si128( (__m128i*) ( aubU + udColumn ), 
+      _mm256_castsi256_si128( xU ) );
+    _mm_storeu_si128( (__m128i*) ( aubV + udColumn ), 
+      _mm256_extracti128_si256( xU, 1 ) );
   }
-  #endif
 
+  return udColumn;
+}
 
-  /* Determine whether we need to copy across alpha values.
-  */
+#endif
 
-  bCopyAlpha = bAlpha && !COSTELLA_IMAGE_ALPHA_IS_SAME( piaIn, piaOut );
 
 
-  /* Compute the double row strides.
-  */
+/* costella_unblock_strip_sse2:
+**
+**   Compute the discrepancies for eight columns at a time with SSE2, as
+**   costella_unblock_compute_strip_discrepancies() does. See
+**   costella_unblock_strip_avx2().
+**
+**   udColumn:  First column to compute.
+**
+**   Other arguments are as for costella_unblock_compute_strip_discrepancies().
+**
+**   Returns the first column not computed.
+*/
 
-  sdDoubleRowStrideIn = sdRowStrideIn << 1;
-  sdDoubleRowStrideOut = sdRowStrideOut << 1;
+#ifdef COSTELLA_CPU_HAS_SSE2
 
+static COSTELLA_CPU_TARGET_SSE2 COSTELLA_UD costella_unblock_strip_sse2( 
+  COSTELLA_SW* aswValues, COSTELLA_UD udStride, COSTELLA_UD udColumn, 
+  COSTELLA_UD udCount, COSTELLA_UB* aubU, COSTELLA_UB* aubV )
+{
+  __m128i x6, x7, x8, x9, x10, x11, xC, xW, xU, xV, xU5, xU4, xV5, 
+    xMissing11, xMissing10, xMax;
 
-  /* Start with the luminance channel. Start at the top-left of the image. 
-  */
+  xMax = _mm_set1_epi16( 255 );
 
-  if( bColor )
-  {
-    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpInStart, *picIn, udWidth, 
-      udHeight, sdRowStrideIn );
-    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpOutStart, *picOut, udWidth,
-      udHeight, sdRowStrideOut );
-  }
-  else
+  for( ; udColumn + 8 <= udCount; udColumn += 8 )
   {
-    COSTELLA_IMAGE_GRAY_PIXEL_SET_TOP_LEFT( igpInStart, *pigIn, udWidth, 
-      udHeight, sdRowStrideIn );
-    COSTELLA_IMAGE_GRAY_PIXEL_SET_TOP_LEFT( igpOutStart, *pigOut, udWidth, 
-      udHeight, sdRowStrideOut );
+    x6 = _mm_loadu_si128( (__m128i*) ( aswValues + udColumn ) );
+    x7 = _mm_loadu_si128( (__m128i*) ( aswValues + udStride + udColumn ) 
+      );
+    x8 = _mm_loadu_si128( (__m128i*) ( aswValues + 2 * udStride + 
+      udColumn ) );
+    x9 = _mm_loadu_si128( (__m128i*) ( aswValues + 3 * udStride + 
+      udColumn ) );
+    x10 = _mm_loadu_si128( (__m128i*) ( aswValues + 4 * udStride + 
+      udColumn ) );
+    x11 = _mm_loadu_si128( (__m128i*) ( aswValues + 5 * udStride + 
+      udColumn ) );
+
+    xMissing11 = _mm_srai_epi16( x11, 15 );
+    xMissing10 = _mm_srai_epi16( x10, 15 );
+
+    xC = _mm_add_epi16( _mm_mullo_epi16( _mm_sub_epi16( x7, x8 ), 
+      _mm_set1_epi16( 10 ) ), _mm_sub_epi16( _mm_set1_epi16( 4 ), 
+      _mm_add_epi16( _mm_mullo_epi16( x8, _mm_set1_epi16( 5 ) ), 
+      _mm_mullo_epi16( x6, _mm_set1_epi16( 3 ) ) ) ) );
+    xW = _mm_sub_epi16( _mm_sub_epi16( _mm_mullo_epi16( x7, 
+      _mm_set1_epi16( 3 ) ), x6 ), _mm_add_epi16( x8, x8 ) );
+
+    xU = _mm_srai_epi16( _mm_add_epi16( _mm_add_epi16( xC, 
+      _mm_mullo_epi16( x9, _mm_set1_epi16( 15 ) ) ), _mm_sub_epi16( 
+      _mm_mullo_epi16( x11, _mm_set1_epi16( 3 ) ), _mm_mullo_epi16( x10, 
+      _mm_set1_epi16( 10 ) ) ) ), 3 );
+    xU5 = _mm_srai_epi16( _mm_add_epi16( xC, _mm_slli_epi16( 
+      _mm_sub_epi16( _mm_mullo_epi16( x9, _mm_set1_epi16( 3 ) ), x10 ), 2 
+      ) ), 3 );
+    xU4 = _mm_srai_epi16( _mm_add_epi16( xC, _mm_slli_epi16( x9, 3 ) ), 
+      3 );
+
+    xV = _mm_sub_epi16( _mm_add_epi16( xW, _mm_mullo_epi16( x10, 
+      _mm_set1_epi16( 3 ) ) ), _mm_add_epi16( x11, _mm_add_epi16( x9, x9 )
+      ) );
+    xV5 = _mm_add_epi16( _mm_sub_epi16( xW, x9 ), x10 );
+
+    xU5 = _mm_or_si128( _mm_and_si128( xMissing10, xU4 ), 
+      _mm_andnot_si128( xMissing10, xU5 ) );
+    xV5 = _mm_andnot_si128( xMissing10, xV5 );
+
+    xU = _mm_or_si128( _mm_and_si128( xMissing11, xU5 ), 
+      _mm_andnot_si128( xMissing11, xU ) );
+    xV = _mm_or_si128( _mm_and_si128( xMissing11, xV5 ), 
+      _mm_andnot_si128( xMissing11, xV ) );
+
+    xU = _mm_min_epi16( _mm_max_epi16( xU, _mm_sub_epi16( 
+      _mm_setzero_si128(), xU ) ), xMax );
+    xV = _mm_min_epi16( _mm_max_epi16( xV, _mm_sub_epi16( 
+      _mm_setzero_si128(), xV ) ), xMax );
+
+    _mm_storel_epi64( (__m128i*) ( aubU + udColumn ), _mm_packus_epi16( 
+      xU, xU ) );
+    _mm_storel_epi64( (__m128i*) ( aubV + udColumn ), _mm_packus_epi16( 
+      xV, xV ) );
   }
 
-  if( bCopyAlpha )
-  {
-    COSTELLA_IMAGE_ALPHA_PIXEL_SET_TOP_LEFT( iapInStart, *piaIn, udWidth, 
-      udHeight, sdAlphaRowStrideIn );
-    COSTELLA_IMAGE_ALPHA_PIXEL_SET_TOP_LEFT( iapOutStart, *piaOut, udWidth, 
-      udHeight, sdAlphaRowStrideOut );
-  }
+  return udColumn;
+}
 
-  
-  /* Walk through the columns of the image.
+#endif
+
+
+
+/* costella_unblock_accumulate_strip:
+**
+**   Add a row of absolute discrepancies into a multi-lane frequency table.
+**   Column i is counted in lane i modulo COSTELLA_UNBLOCK_HISTOGRAM_LANES, 
+**   so that neighbouring columns with the same value do not wait on each 
+**   other's increments.
+**
+**   aubValues:  Array of absolute discrepancies.
+**
+**   udCount:  Number of entries in aubValues.
+**
+**   audLanes:  Array of COSTELLA_UNBLOCK_HISTOGRAM_LANES frequency tables 
+**     of 256 entries each.
+*/
+
+static COSTELLA_INLINE void costella_unblock_accumulate_strip( COSTELLA_UB* 
+  aubValues, COSTELLA_UD udCount, COSTELLA_UD* audLanes )
+{
+  COSTELLA_UD ud;
+
+
+  /* Walk through the values.
   */
 
-  for( udColumn = 0; udColumn < udWidth; udColumn++ )
+  for( ud = 0; ud < udCount; ud++ )
   {
-    /* Progress callback.
-    */
+    audLanes[ ( ud & ( COSTELLA_UNBLOCK_HISTOGRAM_LANES - 1 ) ) << 8 | 
+      aubValues[ ud ] ]++;
+  }
+}
 
-    if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
-    {
-      COSTELLA_ERROR( "Progress callback" );
-      COSTELLA_RETURN;
-    }
 
 
-    /* If there is an alpha channel, copy it across for the whole column 
-    ** now.
-    */
+/* costella_unblock_merge_lanes:
+**
+**   Sum the lanes of a multi-lane frequency table into a single table.
+**
+**   audLanes:  Array of COSTELLA_UNBLOCK_HISTOGRAM_LANES frequency tables 
+**     of 256 entries each.
+**
+**   aud:  Frequency table of 256 entries to which the sums are added.
+*/
 
-    if( bCopyAlpha )
-    {
-      COSTELLA_IMAGE_ALPHA_PIXEL_ASSIGN( iapInStart, iapIn );
-      COSTELLA_IMAGE_ALPHA_PIXEL_ASSIGN( iapOutStart, iapOut );
-      
-      for( udRow = 0; udRow < udHeight; udRow++, 
-        COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_DOWN( iapIn, sdAlphaRowStrideIn ), 
-        COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_DOWN( iapOut, sdAlphaRowStrideOut ) 
-        )
-      {
-        ubA = COSTELLA_IMAGE_ALPHA_PIXEL_GET_A( iapIn );
-        COSTELLA_IMAGE_ALPHA_PIXEL_SET_A( iapOut, ubA );
-      }
-    }
+static void costella_unblock_merge_lanes( COSTELLA_UD* audLanes, COSTELLA_UD* 
+  aud )
+{
+  COSTELLA_UB ubLane;
+  COSTELLA_UW uw;
+  COSTELLA_UD udSum;
 
 
-    /* Start off at the topmost pixel of this column, for both input and
-    ** output.
-    */
+  /* Walk through the values.
+  */
 
-    if( bColor )
-    {
-      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpInStart, icpIn );
-      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpOutStart, icpOut );
-    }
-    else
+  for( uw = 0; uw < 256; uw++ )
+  {
+    for( ubLane = 0, udSum = 0; ubLane < COSTELLA_UNBLOCK_HISTOGRAM_LANES; 
+      ubLane++ )
     {
-      COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpInStart, igpIn );
-      COSTELLA_IMAGE_GRAY_PIXEL_ASSIGN( igpOutStart, igpOut );
+      udSum += audLanes[ ( ubLane << 8 ) + uw ];
     }
 
-  
-    /* If the height of the image is less than 9 pixels, then there are no
-    ** boundaries. Simply copy the column across.
-    */
+    aud[ uw ] += udSum;
+  }
+}
 
-    if( udHeight < 9 )
-    {
-      if( bColor )
-      {
-        for( udRow = 0; udRow < udHeight; udRow++, 
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpIn, sdRowStrideIn ), 
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpOut, sdRowStrideOut ) )
-        {
-          ubY = COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( icpIn );
-          COSTELLA_IMAGE_COLOR_PIXEL_SET_R_Y( icpOut, ubY );
-        }
-      }
-      else
-      {
-        for( udRow = 0; udRow < udHeight; udRow++, 
-          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpIn, sdRowStrideIn ), 
-          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpOut, sdRowStrideOut ) )
-        {
-          ubY = COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( igpIn );
-          COSTELLA_IMAGE_GRAY_PIXEL_SET_Y( igpOut, ubY );
-        }
-      }
-    }
-    else
-    {
-      /* There are boundaries. Load the values of the first eight pixels of 
-      ** the column into the right block of the values array. This will 
-      ** automatically be shifted to the left block in the first step below.
-      ** Switch on image type.
-      */
 
-      if( bColor )
-      {
-        for( ubPosition = 0, pswBufferY = aswBufferY + 8; ubPosition < 8; 
-          ubPosition++, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpIn, 
-          sdRowStrideIn ) )
-        {
-          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( 
-            icpIn );
-        }
-      }
-      else
-      {
-        for( ubPosition = 0, pswBufferY = aswBufferY + 8; ubPosition < 8; 
-          ubPosition++, COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpIn, 
-          sdRowStrideIn ) )
-        {
-          *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( 
-            igpIn );
-        }
-      }
 
+/* costella_unblock_correct_rows_in_place:
+**
+**   Correct the discrepancies at one horizontal boundary for a whole row 
+**   segment, working directly on the bytes of one channel of the image. The
+**   results are identical to those of computing the discrepancies with 
+**   costella_unblock_compute_discrepancies(), adjusting them, and correcting 
+**   the sixteen values of each column with 
+**   costella_unblock_correct_discrepancies(), which are used for any columns 
+**   not handled by the vector code. Corrected values are limited to the 
+**   range [0,255].
+**
+**   pubTop:  Pointer to the first column of the top row of the two blocks.
+**
+**   sdRowStride:  Number of bytes between successive rows of the blocks.
+**
+**   ubColumnStep:  Number of bytes between successive columns; 1 or 2.
+**
+**   udCount:  Number of columns.
+**
+**   ubNumRows:  Number of the sixteen rows that lie inside the image. Must 
+**     be at least 9.
+**
+**   aubAdjusted{U,V}:  Adjustment tables.
+*/
 
-      /* Walk through all horizontal boundaries. See above comments.
-      */
+static COSTELLA_INLINE void costella_unblock_correct_rows_in_place( COSTELLA_UB*
+  pubTop, COSTELLA_SD sdRowStride, COSTELLA_UB ubColumnStep, COSTELLA_UD 
+  udCount, COSTELLA_UB ubNumRows, COSTELLA_UB* aubAdjustedU, COSTELLA_UB* 
+  aubAdjustedV )
+{
+  COSTELLA_UB ubPosition;
+  COSTELLA_SW swU, swV;
+  COSTELLA_SW asw[ 16 ];
+  COSTELLA_UD udColumn;
+  COSTELLA_UB* pub;
 
-      for( udRowBoundaryBottom = 8; udRowBoundaryBottom < udHeight; 
-        udRowBoundaryBottom += 8 )
-      {
-        /* Shift the bottom block in the array to the top block. 
-        */
 
-        for( ubPosition = 0, pswBufferY = aswBufferY, pswBufferYOld = 
-          aswBufferY + 8; ubPosition < 8; ubPosition++ )
-        {
-          *pswBufferY++ = *pswBufferYOld++;
-        }
+  /* Start at the leftmost column.
+  */
 
+  udColumn = 0;
 
-        /* Extract the next eight pixels from the image. Need to make sure 
-        ** that we don't go past the bottom edge of the image. Switch on 
-        ** image type.
-        */
 
-        if( bColor )
-        {
-          for( udRow = udRowBoundaryBottom; ubPosition < 16 && udRow < 
-            udHeight; udRow++, ubPosition++, 
-            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpIn, sdRowStrideIn ) )
-          {
-            *pswBufferY++ = (COSTELLA_SW) 
-              COSTELLA_IMAGE_COLOR_PIXEL_GET_R_Y( icpIn );
-          }
-        }
-        else
-        {
-          for( udRow = udRowBoundaryBottom; ubPosition < 16 && udRow < 
-            udHeight; udRow++, ubPosition++, 
-            COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpIn, sdRowStrideIn ) )
-          {
-            *pswBufferY++ = (COSTELLA_SW) COSTELLA_IMAGE_GRAY_PIXEL_GET_Y( 
-              igpIn );
-          }
-        }
+  /* Use the vector code of the tier chosen at run time for as many 
+  ** columns as it handles, as for 
+  ** costella_unblock_compute_strip_discrepancies().
+  */
 
+  #ifdef COSTELLA_CPU_HAS_SSE2
+  {
+    COSTELLA_UB ubTier;
 
-        /* Fill any unfilled entries with -1, which the discrepancy and
-        ** correction functions recognize as missing entries.
-        */
+    ubTier = costella_cpu_tier();
 
-        for( ; ubPosition < 16; ubPosition++ )
-        {
-          *pswBufferY++ = -1;
-        }
+    #ifdef COSTELLA_CPU_HAS_AVX2
+    if( ubTier >= COSTELLA_CPU_AVX2 )
+    {
+      udColumn = costella_unblock_correct_rows_avx2( pubTop, sdRowStride, 
+        ubColumnStep, udColumn, udCount, ubNumRows, aubAdjustedU, 
+        aubAdjustedV );
+    }
+    #endif
 
+    if( ubTier >= COSTELLA_CPU_SSE2 )
+    {
+      udColumn = costella_unblock_correct_rows_sse2( pubTop, sdRowStride, 
+        ubColumnStep, udColumn, udCount, ubNumRows, aubAdjustedU, 
+        aubAdjustedV );
+    }
+  }
+  #endif
 
-        /* Compute the boundary discrepancies.
-        */
 
-        if( COSTELLA_CALL( CostellaUnblockComputeDiscrepancies( aswBufferY +
-          5, &swYU, &swYV ) ) )
-        {
-          COSTELLA_ERROR( "Computing Y discrepancies" );
-          COSTELLA_RETURN;
-        }
+  /* Any remaining columns use the reference code, through a values array
+  ** in which rows outside the image are marked by -1.
+  */
 
+  for( ; udColumn < udCount; udColumn++ )
+  {
+    for( ubPosition = 0, pub = pubTop + udColumn * ubColumnStep; ubPosition 
+      < 16; ubPosition++, pub += sdRowStride )
+    {
+      asw[ ubPosition ] = ubPosition < ubNumRows ? (COSTELLA_SW) *pub : -1;
+    }
 
-        /* Adjust the discrepancies.
-        */
+    costella_unblock_compute_discrepancies( asw + 5, &swU, &swV );
 
-        swYU = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swYU, aubYAdjustedU );
-        swYV = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swYV, aubYAdjustedV );
+    swU = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swU, aubAdjustedU );
+    swV = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swV, aubAdjustedV );
 
+    costella_unblock_correct_discrepancies( asw, swU, swV );
 
-        /* Correct the sixteen values for these adjusted discrepancies.
-        */
+    for( ubPosition = 0, pub = pubTop + udColumn * ubColumnStep; ubPosition 
+      < ubNumRows; ubPosition++, pub += sdRowStride )
+    {
+      *pub = (COSTELLA_UB) asw[ ubPosition ];
+    }
+  }
+}
 
-        if( COSTELLA_CALL( CostellaUnblockCorrectDiscrepancies( aswBufferY, 
-          swYU, swYV ) ) )
-        {
-          COSTELLA_ERROR( "Correcting Y discrepancies" );
-          COSTELLA_RETURN;
-        }
 
 
-        /* Write the left block pixels back to the image. Switch on image 
-        ** type.
-        */
+/* costella_unblock_correct_rows_avx2:
+**
+**   Correct sixteen columns at a time with AVX2, as
+**   costella_unblock_correct_rows_in_place() does. See
+**   costella_unblock_correct_rows_sse2().
+**
+**   udColumn:  First column to correct.
+**
+**   Other arguments are as for costella_unblock_correct_rows_in_place().
+**
+**   Returns the first column not corrected.
+*/
 
-        if( bColor )
-        {
-          for( ubPosition = 0, pswBufferY = aswBufferY; ubPosition < 8; 
-            ubPosition++, COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpOut, 
-            sdRowStrideOut ) )
-          {
-            ubY = (COSTELLA_UB) *pswBufferY++;
-            COSTELLA_IMAGE_COLOR_PIXEL_SET_R_Y( icpOut, ubY );
-          }
-        }
-        else
-        {
-          for( ubPosition = 0, pswBufferY = aswBufferY; ubPosition < 8; 
-            ubPosition++, COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpOut, 
-            sdRowStrideOut ) )
-          {
-            ubY = (COSTELLA_UB) *pswBufferY++;
-            COSTELLA_IMAGE_GRAY_PIXEL_SET_Y( igpOut, ubY );
-          }
-        }
-      }
+#ifdef COSTELLA_CPU_HAS_AVX2
 
+static COSTELLA_CPU_TARGET_AVX2 COSTELLA_UD costella_unblock_correct_rows_avx2( 
+  COSTELLA_UB* pubTop, COSTELLA_SD sdRowStride, COSTELLA_UB ubColumnStep, 
+  COSTELLA_UD udColumn, COSTELLA_UD udCount, COSTELLA_UB ubNumRows, 
+  COSTELLA_UB* aubAdjustedU, COSTELLA_UB* aubAdjustedV )
+{
+  COSTELLA_UB ubPosition;
+  COSTELLA_UB* pub;
 
-      /* Write out any remaining pixels in the row. We subtract 8 from the 
-      ** right boundary x value because it was incremented before the above 
-      ** loop dropped out. Switch on image type.
-      */
+  COSTELLA_UB ub;
+  COSTELLA_SW aswU[ 16 ], aswV[ 16 ];
+  __m256i ax[ 16 ], axDU[ 8 ], axDV[ 8 ];
+  __m256i x, xC, xW, xU, xV, xZero, xEven, xMax;
 
-      if( bColor )
-      {
-        for( udRow = udRowBoundaryBottom - 8; ubPosition < 16 && udRow < 
-          udHeight; udRow++, ubPosition++, 
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN( icpOut, sdRowStrideOut ) )
-        {
-          ubY = (COSTELLA_UB) *pswBufferY++;
-          COSTELLA_IMAGE_COLOR_PIXEL_SET_R_Y( icpOut, ubY );
-        }
-      }
-      else
-      {
-        for( udRow = udRowBoundaryBottom - 8; ubPosition < 16 && udRow < 
-          udHeight; udRow++, ubPosition++, 
-          COSTELLA_IMAGE_GRAY_PIXEL_MOVE_DOWN( igpOut, sdRowStrideOut ) )
-        {
-          ubY = (COSTELLA_UB) *pswBufferY++;
-          COSTELLA_IMAGE_GRAY_PIXEL_SET_Y( igpOut, ubY );
-        }
-      }
+  xZero = _mm256_setzero_si256();
+  xEven = _mm256_set1_epi16( 0x00ff );
+  xMax = _mm256_set1_epi16( 255 );
+
+  for( ; udColumn + 16 + ( ubColumnStep > 1 ) <= udCount; udColumn += 16 )
+  {
+    /* Load the rows that lie inside the image, widening to 16 bits.
+    */
+
+    for( ubPosition = 0, pub = pubTop + udColumn * ubColumnStep; 
+      ubPosition < ubNumRows; ubPosition++, pub += sdRowStride )
+    {
+      ax[ ubPosition ] = ubColumnStep > 1 ? _mm256_and_si256( 
+        _mm256_loadu_si256( (__m256i*) pub ), xEven ) : 
+        _mm256_cvtepu8_epi16( _mm_loadu_si128( (__m128i*) pub ) );
     }
 
 
-    /* Walk across to the next column.
+    /* Compute u and v from positions 5 to 10, as for SSE2.
     */
 
-    if( bColor )
+    xC = _mm256_add_epi16( _mm256_mullo_epi16( _mm256_sub_epi16( ax[ 6 ], 
+      ax[ 7 ] ), _mm256_set1_epi16( 10 ) ), _mm256_sub_epi16( 
+      _mm256_set1_epi16( 4 ), _mm256_add_epi16( _mm256_mullo_epi16( ax[ 7 ],
+      _mm256_set1_epi16( 5 ) ), _mm256_mullo_epi16( ax[ 5 ], 
+      _mm256_set1_epi16( 3 ) ) ) ) );
+    xW = _mm256_sub_epi16( _mm256_sub_epi16( _mm256_mullo_epi16( ax[ 6 ], 
+      _mm256_set1_epi16( 3 ) ), ax[ 5 ] ), _mm256_add_epi16( ax[ 7 ], 
+      ax[ 7 ] ) );
+
+    if( ubNumRows > 10 )
     {
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpInStart );
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT( icpOutStart );
+      xU = _mm256_srai_epi16( _mm256_add_epi16( _mm256_add_epi16( xC, 
+        _mm256_mullo_epi16( ax[ 8 ], _mm256_set1_epi16( 15 ) ) ), 
+        _mm256_sub_epi16( _mm256_mullo_epi16( ax[ 10 ], _mm256_set1_epi16( 
+        3 ) ), _mm256_mullo_epi16( ax[ 9 ], _mm256_set1_epi16( 10 ) ) ) ), 3
+        );
+      xV = _mm256_sub_epi16( _mm256_add_epi16( xW, _mm256_mullo_epi16( 
+        ax[ 9 ], _mm256_set1_epi16( 3 ) ) ), _mm256_add_epi16( ax[ 10 ], 
+        _mm256_add_epi16( ax[ 8 ], ax[ 8 ] ) ) );
     }
-    else
+    else if( ubNumRows > 9 )
     {
-      COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpInStart );
-      COSTELLA_IMAGE_GRAY_PIXEL_MOVE_RIGHT( igpOutStart );
+      xU = _mm256_srai_epi16( _mm256_add_epi16( xC, _mm256_slli_epi16( 
+        _mm256_sub_epi16( _mm256_mullo_epi16( ax[ 8 ], _mm256_set1_epi16( 3
+        ) ), ax[ 9 ] ), 2 ) ), 3 );
+      xV = _mm256_add_epi16( _mm256_sub_epi16( xW, ax[ 8 ] ), ax[ 9 ] );
     }
-
-    if( bCopyAlpha )
+    else
     {
-      COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_RIGHT( iapInStart );
-      COSTELLA_IMAGE_ALPHA_PIXEL_MOVE_RIGHT( iapOutStart );
+      xU = _mm256_srai_epi16( _mm256_add_epi16( xC, _mm256_slli_epi16( 
+        ax[ 8 ], 3 ) ), 3 );
+      xV = xZero;
     }
-  }
 
+    xU = _mm256_min_epi16( _mm256_max_epi16( xU, _mm256_set1_epi16( -255 ) 
+      ), xMax );
+    xV = _mm256_min_epi16( _mm256_max_epi16( xV, _mm256_set1_epi16( -255 ) 
+      ), xMax );
 
-  /* If we have a color image, correct the horizontal boundary discrepancies
-  ** for the chrominance channels. 
-  */
 
-  if( bColor )
-  {
-    /* Start at top-left of image. 
+    /* Adjust the discrepancies with the look-up tables.
     */
 
-    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpInStart, *picIn, udWidth, 
-      udHeight, sdRowStrideIn );
-    COSTELLA_IMAGE_COLOR_PIXEL_SET_TOP_LEFT( icpOutStart, *picOut, udWidth, 
-      udHeight, sdRowStrideOut );
-
-
-    /* Walk through those columns of the image that contain chrominance 
-    ** data.
-    */
+    _mm256_storeu_si256( (__m256i*) aswU, xU );
+    _mm256_storeu_si256( (__m256i*) aswV, xV );
 
-    for( udColumn = 0; udColumn < udWidth; udColumn += 2 )
+    for( ub = 0; ub < 16; ub++ )
     {
-      /* Progress callback.
-      */
-
-      if( pfProgress && COSTELLA_CALL( pfProgress( poPassback ) ) )
-      {
-        COSTELLA_ERROR( "Progress callback" );
-        COSTELLA_RETURN;
-      }
-
+      aswU[ ub ] = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( aswU[ ub ], 
+        aubAdjustedU );
+      aswV[ ub ] = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( aswV[ ub ], 
+        aubAdjustedV );
+    }
 
-      /* Start off at the topmost downsampled pixel of this column, for both
-      ** input and output.
-      */
+    xU = _mm256_loadu_si256( (__m256i*) aswU );
+    xV = _mm256_loadu_si256( (__m256i*) aswV );
 
-      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpInStart, icpIn );
-      COSTELLA_IMAGE_COLOR_PIXEL_ASSIGN( icpOutStart, icpOut );
 
+    /* Compute the corrections for the first eight positions, as for SSE2.
+    */
 
-      /* If the height of the image is less than 17 pixels, then there are 
-      ** no boundaries. Simply copy the column across.
-      */
+    axDU[ 0 ] = xZero;
+    axDU[ 1 ] = _mm256_srai_epi16( _mm256_add_epi16( xU, _mm256_set1_epi16( 
+      32 ) ), 6 );
+    axDU[ 2 ] = _mm256_srai_epi16( _mm256_add_epi16( _mm256_mullo_epi16( 
+      xU, _mm256_set1_epi16( 3 ) ), _mm256_set1_epi16( 32 ) ), 6 );
+    axDU[ 3 ] = _mm256_srai_epi16( _mm256_add_epi16( _mm256_mullo_epi16( 
+      xU, _mm256_set1_epi16( 3 ) ), _mm256_set1_epi16( 16 ) ), 5 );
+    axDU[ 4 ] = _mm256_srai_epi16( _mm256_add_epi16( _mm256_mullo_epi16( 
+      xU, _mm256_set1_epi16( 5 ) ), _mm256_set1_epi16( 16 ) ), 5 );
+    axDU[ 5 ] = _mm256_srai_epi16( _mm256_add_epi16( _mm256_mullo_epi16( 
+      xU, _mm256_set1_epi16( 15 ) ), _mm256_set1_epi16( 32 ) ), 6 );
+    axDU[ 6 ] = _mm256_srai_epi16( _mm256_add_epi16( _mm256_mullo_epi16( 
+      xU, _mm256_set1_epi16( 21 ) ), _mm256_set1_epi16( 32 ) ), 6 );
+    axDU[ 7 ] = _mm256_srai_epi16( _mm256_add_epi16( _mm256_mullo_epi16( 
+      xU, _mm256_set1_epi16( 7 ) ), _mm256_set1_epi16( 8 ) ), 4 );
+
+    axDV[ 0 ] = _mm256_srai_epi16( _mm256_sub_epi16( _mm256_set1_epi16( 128
+      ), xV ), 8 );
+    axDV[ 1 ] = _mm256_srai_epi16( _mm256_add_epi16( _mm256_mullo_epi16( 
+      xV, _mm256_set1_epi16( -11 ) ), _mm256_set1_epi16( 128 ) ), 8 );
+    axDV[ 2 ] = _mm256_srai_epi16( _mm256_add_epi16( _mm256_mullo_epi16( 
+      xV, _mm256_set1_epi16( -31 ) ), _mm256_set1_epi16( 128 ) ), 8 );
+    axDV[ 3 ] = _mm256_srai_epi16( _mm256_add_epi16( _mm256_mullo_epi16( 
+      xV, _mm256_set1_epi16( -58 ) ), _mm256_set1_epi16( 128 ) ), 8 );
+    axDV[ 4 ] = _mm256_srai_epi16( _mm256_add_epi16( _mm256_mullo_epi16( 
+      xV, _mm256_set1_epi16( -57 ) ), _mm256_set1_epi16( 128 ) ), 8 );
+    axDV[ 5 ] = _mm256_srai_epi16( _mm256_add_epi16( _mm256_mullo_epi16( 
+      xV, _mm256_set1_epi16( -22 ) ), _mm256_set1_epi16( 128 ) ), 8 );
+    axDV[ 6 ] = _mm256_srai_epi16( _mm256_add_epi16( _mm256_mullo_epi16( 
+      xV, _mm256_set1_epi16( 42 ) ), _mm256_set1_epi16( 128 ) ), 8 );
+    axDV[ 7 ] = _mm256_srai_epi16( _mm256_add_epi16( _mm256_mullo_epi16( 
+      xV, _mm256_set1_epi16( 138 ) ), _mm256_set1_epi16( 128 ) ), 8 );
+
+
+    /* Apply the corrections and store the results, as for SSE2. Packing 
+    ** works within each half of the register, so the quarters are put
+    ** back in order before the low half is stored.
+    */
 
-      if( udHeight < 17 )
+    for( ubPosition = 0, pub = pubTop + udColumn * ubColumnStep; 
+      ubPosition < ubNumRows; ubPosition++, pub += sdRowStride )
+    {
+      if( ubPosition < 8 )
       {
-        for( udRow = 0; udRow < udHeight; udRow += 2, 
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpIn, 
-          sdDoubleRowStrideIn ), COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( 
-          icpOut, sdDoubleRowStrideOut ) )
-        {
-          ubCb = COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icpIn );
-          ubCr = COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icpIn );
-
-          COSTELLA_IMAGE_COLOR_PIXEL_SET_G_CB( icpOut, ubCb );
-          COSTELLA_IMAGE_COLOR_PIXEL_SET_B_CR( icpOut, ubCr );
-        }
+        x = _mm256_add_epi16( ax[ ubPosition ], _mm256_add_epi16( axDU[ 
+          ubPosition ], axDV[ ubPosition ] ) );
       }
       else
       {
-        /* There are boundaries. Load the values of the first eight 
-        ** downsampled pixels of the column into the bottom block of the 
-        ** values arrays. This will automatically be shifted to the top 
-        ** block in the first step below. Switch on image type.
-        */
-
-        for( ubPosition = 0, pswBufferCb = aswBufferCb + 8, pswBufferCr = 
-          aswBufferCr + 8; ubPosition < 8; ubPosition++, 
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpIn, 
-          sdDoubleRowStrideIn ) )
-        {
-          *pswBufferCb++ = COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icpIn );
-          *pswBufferCr++ = COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icpIn );
-        }
-
+        x = _mm256_add_epi16( ax[ ubPosition ], _mm256_sub_epi16( axDV[ 15 
+          - ubPosition ], axDU[ 15 - ubPosition ] ) );
+      }
 
-        /* Walk through all horizontal boundaries. See above comments.
-        */
+      if( ubColumnStep > 1 )
+      {
+        x = _mm256_min_epi16( _mm256_max_epi16( x, xZero ), xMax );
 
-        for( udRowBoundaryBottom = 16; udRowBoundaryBottom < udHeight; 
-          udRowBoundaryBottom += 16 )
-        {
-          /* Shift the bottom block in the array to the top block. 
-          */
+        _mm256_storeu_si256( (__m256i*) pub, _mm256_or_si256( x, 
+          _mm256_andnot_si256( xEven, _mm256_loadu_si256( (__m256i*) pub ) 
+          ) ) );
+      }
+      else
+      {
+        _mm_storeu_si128( (__m128i*) pub, _mm256_castsi256_si128( 
+          _mm256_permute4x64_epi64( _mm256_packus_epi16( x, x ), 0xd8 ) ) );
+      }
+    }
+  }
 
-          for( ubPosition = 0, pswBufferCb = aswBufferCb, pswBufferCbOld = 
-            aswBufferCb + 8, pswBufferCr = aswBufferCr, pswBufferCrOld = 
-            aswBufferCr + 8; ubPosition < 8; ubPosition++ )
-          {
-            *pswBufferCb++ = *pswBufferCbOld++;
-            *pswBufferCr++ = *pswBufferCrOld++;
-          }
+  return udColumn;
+}
 
+#endif
 
-          /* Extract the next eight pixels from the image. Need to make sure
-          ** that we don't go past the bottom edge of the image. Switch on 
-          ** image type.
-          */
 
-          for( udRow = udRowBoundaryBottom; ubPosition < 16 && udRow < 
-            udHeight; udRow += 2, ubPosition++, 
-            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpIn, 
-            sdDoubleRowStrideIn ) )
-          {
-            *pswBufferCb++ = COSTELLA_IMAGE_COLOR_PIXEL_GET_G_CB( icpIn );
-            *pswBufferCr++ = COSTELLA_IMAGE_COLOR_PIXEL_GET_B_CR( icpIn );
-          }
 
+/* costella_unblock_correct_rows_sse2:
+**
+**   Correct eight columns at a time with SSE2, as
+**   costella_unblock_correct_rows_in_place() does. With a
+**   column step of 2, sixteen bytes are loaded and the odd bytes masked
+**   off, so we stop one column early to stay inside the row.
+**
+**   udColumn:  First column to correct.
+**
+**   Other arguments are as for costella_unblock_correct_rows_in_place().
+**
+**   Returns the first column not corrected.
+*/
 
-          /* Fill any unfilled entries with -1, which the discrepancy and
-          ** correction functions recognize as missing entries.
-          */
+#ifdef COSTELLA_CPU_HAS_SSE2
 
-          for( ; ubPosition < 16; ubPosition++ )
-          {
-            *pswBufferCb++ = -1;
-            *pswBufferCr++ = -1;
-          }
+static COSTELLA_CPU_TARGET_SSE2 COSTELLA_UD costella_unblock_correct_rows_sse2( 
+  COSTELLA_UB* pubTop, COSTELLA_SD sdRowStride, COSTELLA_UB ubColumnStep, 
+  COSTELLA_UD udColumn, COSTELLA_UD udCount, COSTELLA_UB ubNumRows, 
+  COSTELLA_UB* aubAdjustedU, COSTELLA_UB* aubAdjustedV )
+{
+  COSTELLA_UB ubPosition;
+  COSTELLA_UB* pub;
 
+  COSTELLA_UB ub;
+  COSTELLA_SW aswU[ 8 ], aswV[ 8 ];
+  __m128i ax[ 16 ], axDU[ 8 ], axDV[ 8 ];
+  __m128i x, xC, xW, xU, xV, xZero, xEven, xMax;
 
-          /* Compute the boundary discrepancies.
-          */
+  xZero = _mm_setzero_si128();
+  xEven = _mm_set1_epi16( 0x00ff );
+  xMax = _mm_set1_epi16( 255 );
 
-          if( COSTELLA_CALL( CostellaUnblockComputeDiscrepancies( 
-            aswBufferCb + 5, &swCbU, &swCbV ) ) || COSTELLA_CALL(
-            CostellaUnblockComputeDiscrepancies( aswBufferCr + 5, &swCrU, 
-            &swCrV ) ) )
-          {
-            COSTELLA_ERROR( "Computing Cb or Cr discrepancies" );
-            COSTELLA_RETURN;
-          }
+  for( ; udColumn + 8 + ( ubColumnStep > 1 ) <= udCount; udColumn += 8 )
+  {
+    /* Load the rows that lie inside the image, widening to 16 bits.
+    */
 
+    for( ubPosition = 0, pub = pubTop + udColumn * ubColumnStep; 
+      ubPosition < ubNumRows; ubPosition++, pub += sdRowStride )
+    {
+      ax[ ubPosition ] = ubColumnStep > 1 ? _mm_and_si128( 
+        _mm_loadu_si128( (__m128i*) pub ), xEven ) : _mm_unpacklo_epi8( 
+        _mm_loadl_epi64( (__m128i*) pub ), xZero );
+    }
 
-          /* Adjust the discrepancies.
-          */
 
-          swCbU = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swCbU, aubCbAdjustedU
-            );
-          swCbV = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swCbV, aubCbAdjustedV
-            );
+    /* Compute u and v from positions 5 to 10, using the same formulas as
+    ** costella_unblock_compute_discrepancies(). Which formulas apply depends
+    ** only on how many rows are present, which is the same for every 
+    ** column.
+    */
 
-          swCrU = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swCrU, aubCrAdjustedU
-            );
-          swCrV = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swCrV, aubCrAdjustedV
-            );
+    xC = _mm_add_epi16( _mm_mullo_epi16( _mm_sub_epi16( ax[ 6 ], ax[ 7 ] 
+      ), _mm_set1_epi16( 10 ) ), _mm_sub_epi16( _mm_set1_epi16( 4 ), 
+      _mm_add_epi16( _mm_mullo_epi16( ax[ 7 ], _mm_set1_epi16( 5 ) ), 
+      _mm_mullo_epi16( ax[ 5 ], _mm_set1_epi16( 3 ) ) ) ) );
+    xW = _mm_sub_epi16( _mm_sub_epi16( _mm_mullo_epi16( ax[ 6 ], 
+      _mm_set1_epi16( 3 ) ), ax[ 5 ] ), _mm_add_epi16( ax[ 7 ], ax[ 7 ] ) 
+      );
 
+    if( ubNumRows > 10 )
+    {
+      xU = _mm_srai_epi16( _mm_add_epi16( _mm_add_epi16( xC, 
+        _mm_mullo_epi16( ax[ 8 ], _mm_set1_epi16( 15 ) ) ), 
+        _mm_sub_epi16( _mm_mullo_epi16( ax[ 10 ], _mm_set1_epi16( 3 ) ), 
+        _mm_mullo_epi16( ax[ 9 ], _mm_set1_epi16( 10 ) ) ) ), 3 );
+      xV = _mm_sub_epi16( _mm_add_epi16( xW, _mm_mullo_epi16( ax[ 9 ], 
+        _mm_set1_epi16( 3 ) ) ), _mm_add_epi16( ax[ 10 ], _mm_add_epi16( 
+        ax[ 8 ], ax[ 8 ] ) ) );
+    }
+    else if( ubNumRows > 9 )
+    {
+      xU = _mm_srai_epi16( _mm_add_epi16( xC, _mm_slli_epi16( 
+        _mm_sub_epi16( _mm_mullo_epi16( ax[ 8 ], _mm_set1_epi16( 3 ) ), 
+        ax[ 9 ] ), 2 ) ), 3 );
+      xV = _mm_add_epi16( _mm_sub_epi16( xW, ax[ 8 ] ), ax[ 9 ] );
+    }
+    else
+    {
+      xU = _mm_srai_epi16( _mm_add_epi16( xC, _mm_slli_epi16( ax[ 8 ], 3 
+        ) ), 3 );
+      xV = xZero;
+    }
 
-          /* Correct the sixteen values for these adjusted discrepancies.
-          */
+    xU = _mm_min_epi16( _mm_max_epi16( xU, _mm_set1_epi16( -255 ) ), xMax 
+      );
+    xV = _mm_min_epi16( _mm_max_epi16( xV, _mm_set1_epi16( -255 ) ), xMax 
+      );
 
-          if( COSTELLA_CALL( CostellaUnblockCorrectDiscrepancies( 
-            aswBufferCb, swCbU, swCbV ) ) || COSTELLA_CALL(
-            CostellaUnblockCorrectDiscrepancies( aswBufferCr, swCrU, swCrV )
-            ) )
-          {
-            COSTELLA_ERROR( "Correcting Cb or Cr discrepancies" );
-            COSTELLA_RETURN;
-          }
 
+    /* Adjust the discrepancies with the look-up tables.
+    */
 
-          /* Write the left block pixels back to the image. Switch on image
-          ** type.
-          */
+    _mm_storeu_si128( (__m128i*) aswU, xU );
+    _mm_storeu_si128( (__m128i*) aswV, xV );
 
-          for( ubPosition = 0, pswBufferCb = aswBufferCb, pswBufferCr = 
-            aswBufferCr; ubPosition < 8; ubPosition++,
-            COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpOut, 
-            sdDoubleRowStrideOut ) )
-          {
-            ubCb = (COSTELLA_UB) *pswBufferCb++;
-            ubCr = (COSTELLA_UB) *pswBufferCr++;
+    for( ub = 0; ub < 8; ub++ )
+    {
+      aswU[ ub ] = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( aswU[ ub ], 
+        aubAdjustedU );
+      aswV[ ub ] = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( aswV[ ub ], 
+        aubAdjustedV );
+    }
 
-            COSTELLA_IMAGE_COLOR_PIXEL_SET_G_CB( icpOut, ubCb );
-            COSTELLA_IMAGE_COLOR_PIXEL_SET_B_CR( icpOut, ubCr );
-          }
-        }        
+    xU = _mm_loadu_si128( (__m128i*) aswU );
+    xV = _mm_loadu_si128( (__m128i*) aswV );
 
 
-        /* Write out any remaining pixels in the row. We subtract 16 from 
-        ** the right boundary x value because it was incremented before the 
-        ** above loop dropped out. Switch on image type.
-        */
+    /* Compute the corrections for the first eight positions from u and 
+    ** from v, as in costella_unblock_correct_discrepancies(). Like the 
+    ** multiplication tables used there, the products are 16 bits wide, 
+    ** so that 138 v + 128 wraps around in the same way for large v.
+    */
 
-        for( udRow = udRowBoundaryBottom - 16; ubPosition < 16 && udRow < 
-          udHeight; udRow += 2, ubPosition++,
-          COSTELLA_IMAGE_COLOR_PIXEL_MOVE_DOWN_TWO( icpOut, 
-          sdDoubleRowStrideOut ) )
-        {
-          ubCb = (COSTELLA_UB) *pswBufferCb++;
-          ubCr = (COSTELLA_UB) *pswBufferCr++;
+    axDU[ 0 ] = xZero;
+    axDU[ 1 ] = _mm_srai_epi16( _mm_add_epi16( xU, _mm_set1_epi16( 32 ) ),
+      6 );
+    axDU[ 2 ] = _mm_srai_epi16( _mm_add_epi16( _mm_mullo_epi16( xU, 
+      _mm_set1_epi16( 3 ) ), _mm_set1_epi16( 32 ) ), 6 );
+    axDU[ 3 ] = _mm_srai_epi16( _mm_add_epi16( _mm_mullo_epi16( xU, 
+      _mm_set1_epi16( 3 ) ), _mm_set1_epi16( 16 ) ), 5 );
+    axDU[ 4 ] = _mm_srai_epi16( _mm_add_epi16( _mm_mullo_epi16( xU, 
+      _mm_set1_epi16( 5 ) ), _mm_set1_epi16( 16 ) ), 5 );
+    axDU[ 5 ] = _mm_srai_epi16( _mm_add_epi16( _mm_mullo_epi16( xU, 
+      _mm_set1_epi16( 15 ) ), _mm_set1_epi16( 32 ) ), 6 );
+    axDU[ 6 ] = _mm_srai_epi16( _mm_add_epi16( _mm_mullo_epi16( xU, 
+      _mm_set1_epi16( 21 ) ), _mm_set1_epi16( 32 ) ), 6 );
+    axDU[ 7 ] = _mm_srai_epi16( _mm_add_epi16( _mm_mullo_epi16( xU, 
+      _mm_set1_epi16( 7 ) ), _mm_set1_epi16( 8 ) ), 4 );
+
+    axDV[ 0 ] = _mm_srai_epi16( _mm_sub_epi16( _mm_set1_epi16( 128 ), xV ),
+      8 );
+    axDV[ 1 ] = _mm_srai_epi16( _mm_add_epi16( _mm_mullo_epi16( xV, 
+      _mm_set1_epi16( -11 ) ), _mm_set1_epi16( 128 ) ), 8 );
+    axDV[ 2 ] = _mm_srai_epi16( _mm_add_epi16( _mm_mullo_epi16( xV, 
+      _mm_set1_epi16( -31 ) ), _mm_set1_epi16( 128 ) ), 8 );
+    axDV[ 3 ] = _mm_srai_epi16( _mm_add_epi16( _mm_mullo_epi16( xV, 
+      _mm_set1_epi16( -58 ) ), _mm_set1_epi16( 128 ) ), 8 );
+    axDV[ 4 ] = _mm_srai_epi16( _mm_add_epi16( _mm_mullo_epi16( xV, 
+      _mm_set1_epi16( -57 ) ), _mm_set1_epi16( 128 ) ), 8 );
+    axDV[ 5 ] = _mm_srai_epi16( _mm_add_epi16( _mm_mullo_epi16( xV, 
+      _mm_set1_epi16( -22 ) ), _mm_set1_epi16( 128 ) ), 8 );
+    axDV[ 6 ] = _mm_srai_epi16( _mm_add_epi16( _mm_mullo_epi16( xV, 
+      _mm_set1_epi16( 42 ) ), _mm_set1_epi16( 128 ) ), 8 );
+    axDV[ 7 ] = _mm_srai_epi16( _mm_add_epi16( _mm_mullo_epi16( xV, 
+      _mm_set1_epi16( 138 ) ), _mm_set1_epi16( 128 ) ), 8 );
+
+
+    /* Apply the corrections to the rows inside the image: the u 
+    ** corrections are antisymmetric about the boundary and the v 
+    ** corrections symmetric. Store the results back into the image, 
+    ** limited to the range [0,255].
+    */
 
-          COSTELLA_IMAGE_COLOR_PIXEL_SET_G_CB( icpOut, ubCb );
-          COSTELLA_IMAGE_COLOR_PIXEL_SET_B_CR( icpOut, ubCr );
-        }
+    for( ubPosition = 0, pub = pubTop + udColumn * ubColumnStep; 
+      ubPosition < ubNumRows; ubPosition++, pub += sdRowStride )
+    {
+      if( ubPosition < 8 )
+      {
+        x = _mm_add_epi16( ax[ ubPosition ], _mm_add_epi16( axDU[ 
+          ubPosition ], axDV[ ubPosition ] ) );
+      }
+      else
+      {
+        x = _mm_add_epi16( ax[ ubPosition ], _mm_sub_epi16( axDV[ 15 - 
+          ubPosition ], axDU[ 15 - ubPosition ] ) );
       }
 
-    
-      /* Walk across to the next downsampled column.
-      */
+      if( ubColumnStep > 1 )
+      {
+        x = _mm_min_epi16( _mm_max_epi16( x, xZero ), xMax );
 
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpInStart );
-      COSTELLA_IMAGE_COLOR_PIXEL_MOVE_RIGHT_TWO( icpOutStart );
+        _mm_storeu_si128( (__m128i*) pub, _mm_or_si128( x, 
+          _mm_andnot_si128( xEven, _mm_loadu_si128( (__m128i*) pub ) ) ) 
+          );
+      }
+      else
+      {
+        _mm_storel_epi64( (__m128i*) pub, _mm_packus_epi16( x, x ) );
+      }
     }
   }
+
+  return udColumn;
 }
-COSTELLA_END_FUNCTION
+
+#endif
 
 
 
-/* CostellaUnblockComputeDiscrepancies: 
+/* costella_unblock_correct_boundary:
 **
-**   Compute the discrepancies u and v. 
+**   Compute the discrepancies at the boundary between two blocks, adjust 
+**   them, and correct the sixteen pixels of the blocks for them.
 **
-**   aswValues:  Array containing the six intensity values. If any of the 
-**     last two values are -1, it indicates missing pixels; alternative 
-**     formulas are used. 
+**   asw:  Array of sixteen intensity values covering the two blocks. Values
+**     past the edge of the image are -1.
 **
-**   pswU:  Pointer into which the value of u will be stored. Must be valid.
+**   bComplete:  Whether the six values around the boundary are all 
+**     present. Callers pass a constant, as for 
+**     costella_unblock_count_discrepancies().
 **
-**   pswV:  Pointer into which the value of v will be stored. If pswV is 
-**     zero, we do not want to compute v.
+**   aubAdjusted{U,V}:  Adjustment tables.
 */
 
-static COSTELLA_FUNCTION( CostellaUnblockComputeDiscrepancies, ( 
-  COSTELLA_SW* aswValues, COSTELLA_SW* pswU, COSTELLA_SW* pswV ) )
+static COSTELLA_INLINE void costella_unblock_correct_boundary( COSTELLA_SW* 
+  asw, COSTELLA_B bComplete, COSTELLA_UB* aubAdjustedU, COSTELLA_UB* 
+  aubAdjustedV )
 {
-  COSTELLA_SW sw6, sw7, sw8, sw9, sw10, sw11, swU, swV=0;
-
-
-  /* Extract pixel values.
-  */
-
-  sw6 = *aswValues++;
-  sw7 = *aswValues++;
-  sw8 = *aswValues++;
-  sw9 = *aswValues++;
-  sw10 = *aswValues++;
-  sw11 = *aswValues;
+  COSTELLA_SW swU, swV;
 
 
-  /* Check if we have missing pixels.
+  /* Compute the boundary discrepancies.
   */
 
-  if( sw11 >= 0 )
+  if( bComplete )
   {
-    /* All six pixels present. Use the regular formulas. 
-    */
-
-    swU = COSTELLA_SHIFT_RIGHT_FLOOR( (COSTELLA_SW) gauwMult15Add4[ sw9] - 
-      (COSTELLA_SW) gauwMult15[ sw8 ] - (COSTELLA_SW) gauwMult10[ sw10 ] + 
-      (COSTELLA_SW) gauwMult10[ sw7 ] + (COSTELLA_SW) gauwMult3[ sw11 ] - 
-      (COSTELLA_SW) gauwMult3[ sw6 ], 3 );
-
-    if( pswV )
-    {
-      swV = (COSTELLA_SW) gauwMult3[ sw10 ] + (COSTELLA_SW) gauwMult3[ sw7 ]
-        - sw11 - sw6 - ( ( sw9 + sw8 ) << 1 );
-    }
+    costella_unblock_compute_complete_discrepancies( asw + 5, &swU, &swV );
   }
   else
   {
-    /* The last pixel is missing. Check if the second-last pixel is missing.
-    */
-
-    if( sw10 >= 0 )
-    {
-      /* Have five pixels. Use modified formulas.
-      */
-
-      swU = COSTELLA_SHIFT_RIGHT_FLOOR( -(COSTELLA_SW) gauwMult3[ sw6 ] + 
-        (COSTELLA_SW) gauwMult10[ sw7 ] - (COSTELLA_SW) gauwMult15[ sw8 ] + 
-        (COSTELLA_SW) gauwMult12Add4[ sw9 ] - ( sw10 << 2 ), 3 );
-
-      if( pswV )
-      {
-        swV = -sw6 + (COSTELLA_SW) gauwMult3[ sw7 ] - ( sw8 << 1 ) - sw9 + 
-          sw10;
-      }
-    }
-    else
-    {
-      /* Must have four pixels. Use modified formulas.
-      */
-
-      swU = COSTELLA_SHIFT_RIGHT_FLOOR( -(COSTELLA_SW) gauwMult3[ sw6 ] + 
-        (COSTELLA_SW) gauwMult10[ sw7 ] - (COSTELLA_SW) gauwMult15[ sw8 ] + 
-        ( sw9 << 3 ) + 4, 3 );
-
-      swV = 0;
-    }
+    costella_unblock_compute_discrepancies( asw + 5, &swU, &swV );
   }
 
 
-  /* Bound u and v to the range [-255,+255].
+  /* Adjust the discrepancies.
   */
 
-  if( swU < -255 )
-  {
-    swU = -255;
-  }
-  else if( swU > +255 )
-  {
-    swU = +255;
-  }
-
-  if( pswV )
-  {
-    if( swV < -255 )
-    {
-      swV = -255;
-    }
-    else if( swV > +255 )
-    {
-      swV = +255;
-    }
-  }
+  swU = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swU, aubAdjustedU );
+  swV = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swV, aubAdjustedV );
 
 
-  /* Store u and v.
+  /* Correct the sixteen values for these adjusted discrepancies.
   */
 
-  *pswU = swU;
-
-  if( pswV )
-  {
-    *pswV = swV;
-  }
+  costella_unblock_correct_discrepancies( asw, swU, swV );
 }
-COSTELLA_END_FUNCTION
 
 
 
-/* CostellaUnblockCorrectDiscrepancies: 
+/* costella_unblock_correct_discrepancies:
 **
 **   Correct discrepancies across the sixteen pixels in the two blocks.
 **
@@ -3142,12 +7500,13 @@ COSTELLA_END_FUNCTION
 **   sw{U,V}:  The value of {u,v} to correct.
 */
 
-static COSTELLA_FUNCTION( CostellaUnblockCorrectDiscrepancies, ( 
-  COSTELLA_SW* asw, COSTELLA_SW swU, COSTELLA_SW swV ) )
+static COSTELLA_INLINE void costella_unblock_correct_discrepancies( COSTELLA_SW*
+  asw, COSTELLA_SW swU, COSTELLA_SW swV )
 {
   COSTELLA_SW swD1, swD2, swD3, swD4, swD5, swD6, swD7, swD8, swD9, swD10, 
     swD11, swD12, swD13, swD14, swD15, swD16;
   COSTELLA_SW* psw;
+  const COSTELLA_UNBLOCK_TABLES* ptbl = &gtblCostellaUnblock;
 
   /* Compute corrections.
   */
@@ -3155,12 +7514,18 @@ static COSTELLA_FUNCTION( CostellaUnblockCorrectDiscrepancies, (
   if( swU )
   {
     COSTELLA_SW swD2U = COSTELLA_SHIFT_RIGHT_FLOOR( swU + 32, 6 );
-    COSTELLA_SW swD3U = COSTELLA_SHIFT_RIGHT_FLOOR( gaswMult3Add32[ swU ], 6 );
-    COSTELLA_SW swD4U = COSTELLA_SHIFT_RIGHT_FLOOR( gaswMult3Add16[ swU ], 5 );
-    COSTELLA_SW swD5U = COSTELLA_SHIFT_RIGHT_FLOOR( gaswMult5Add16[ swU ], 5 );
-    COSTELLA_SW swD6U = COSTELLA_SHIFT_RIGHT_FLOOR( gaswMult15Add32[ swU ], 6 );
-    COSTELLA_SW swD7U = COSTELLA_SHIFT_RIGHT_FLOOR( gaswMult21Add32[ swU ], 6 );
-    COSTELLA_SW swD8U = COSTELLA_SHIFT_RIGHT_FLOOR( gaswMult7Add8[ swU ], 4 );
+    COSTELLA_SW swD3U = COSTELLA_SHIFT_RIGHT_FLOOR( 
+      ptbl->aswMult3Add32[ 255 + swU ], 6 );
+    COSTELLA_SW swD4U = COSTELLA_SHIFT_RIGHT_FLOOR( 
+      ptbl->aswMult3Add16[ 255 + swU ], 5 );
+    COSTELLA_SW swD5U = COSTELLA_SHIFT_RIGHT_FLOOR( 
+      ptbl->aswMult5Add16[ 255 + swU ], 5 );
+    COSTELLA_SW swD6U = COSTELLA_SHIFT_RIGHT_FLOOR( 
+      ptbl->aswMult15Add32[ 255 + swU ], 6 );
+    COSTELLA_SW swD7U = COSTELLA_SHIFT_RIGHT_FLOOR( 
+      ptbl->aswMult21Add32[ 255 + swU ], 6 );
+    COSTELLA_SW swD8U = COSTELLA_SHIFT_RIGHT_FLOOR( 
+      ptbl->aswMult7Add8[ 255 + swU ], 4 );
 
     swD1 = 0;
     swD2 = swD2U;
@@ -3202,13 +7567,20 @@ static COSTELLA_FUNCTION( CostellaUnblockCorrectDiscrepancies, (
   if( swV )
   {
     COSTELLA_SW swD1V = COSTELLA_SHIFT_RIGHT_FLOOR( -swV + 128, 8 );
-    COSTELLA_SW swD2V = COSTELLA_SHIFT_RIGHT_FLOOR( gaswMultM11Add128[ swV ], 8 );
-    COSTELLA_SW swD3V = COSTELLA_SHIFT_RIGHT_FLOOR( gaswMultM31Add128[ swV ], 8 );
-    COSTELLA_SW swD4V = COSTELLA_SHIFT_RIGHT_FLOOR( gaswMultM58Add128[ swV ], 8 );
-    COSTELLA_SW swD5V = COSTELLA_SHIFT_RIGHT_FLOOR( gaswMultM57Add128[ swV ], 8 );
-    COSTELLA_SW swD6V = COSTELLA_SHIFT_RIGHT_FLOOR( gaswMultM22Add128[ swV ], 8 );
-    COSTELLA_SW swD7V = COSTELLA_SHIFT_RIGHT_FLOOR( gaswMult42Add128[ swV ], 8 );
-    COSTELLA_SW swD8V = COSTELLA_SHIFT_RIGHT_FLOOR( gaswMult138Add128[ swV ], 8 );
+    COSTELLA_SW swD2V = COSTELLA_SHIFT_RIGHT_FLOOR( 
+      ptbl->aswMultM11Add128[ 255 + swV ], 8 );
+    COSTELLA_SW swD3V = COSTELLA_SHIFT_RIGHT_FLOOR( 
+      ptbl->aswMultM31Add128[ 255 + swV ], 8 );
+    COSTELLA_SW swD4V = COSTELLA_SHIFT_RIGHT_FLOOR( 
+      ptbl->aswMultM58Add128[ 255 + swV ], 8 );
+    COSTELLA_SW swD5V = COSTELLA_SHIFT_RIGHT_FLOOR( 
+      ptbl->aswMultM57Add128[ 255 + swV ], 8 );
+    COSTELLA_SW swD6V = COSTELLA_SHIFT_RIGHT_FLOOR( 
+      ptbl->aswMultM22Add128[ 255 + swV ], 8 );
+    COSTELLA_SW swD7V = COSTELLA_SHIFT_RIGHT_FLOOR( 
+      ptbl->aswMult42Add128[ 255 + swV ], 8 );
+    COSTELLA_SW swD8V = COSTELLA_SHIFT_RIGHT_FLOOR( 
+      ptbl->aswMult138Add128[ 255 + swV ], 8 );
 
     swD1 += swD1V;
     swD2 += swD2V;
@@ -3265,7 +7637,6 @@ static COSTELLA_FUNCTION( CostellaUnblockCorrectDiscrepancies, (
   psw++;
   COSTELLA_UNBLOCK_CORRECT( psw, swD16 );
 }
-COSTELLA_END_FUNCTION
 
 
 
@@ -3447,6 +7818,27 @@ COSTELLA_END_FUNCTION
 
 
 
+/* costella_unblock_subband_rows: 
+**
+**   Return the number of rows in each sub-band of a band, which is a 
+**   multiple of 16 chosen so that the pixel data of a sub-band is about 
+**   COSTELLA_UNBLOCK_BAND_BYTES.
+**
+**   pi:  Pointer to the band.
+*/
+
+static COSTELLA_UD costella_unblock_subband_rows( COSTELLA_IMAGE* pi )
+{
+  COSTELLA_UD udRows;
+
+  udRows = COSTELLA_UNBLOCK_BAND_BYTES / ( pi->udWidth * ( pi->bColor ? 3 :
+    1 ) ) & ~(COSTELLA_UD) 15;
+
+  return udRows < 16 ? 16 : udRows;
+}
+
+
+
 /* costella_unblock_approx_square_root: 
 **
 **   Return the approximate square-root of a COSTELLA_UD.
@@ -3473,7 +7865,7 @@ static COSTELLA_UD costella_unblock_approx_square_root( COSTELLA_UD ud )
 
   if( udBitWidth < 9 )
   {
-    return (COSTELLA_UD) gaubSquareRoot[ ud ];
+    return (COSTELLA_UD) gtblCostellaUnblock.aubSquareRoot[ ud ];
   }
 
 
@@ -3495,7 +7887,7 @@ static COSTELLA_UD costella_unblock_approx_square_root( COSTELLA_UD ud )
   /* Square-root the top 7 or 8 bits, respectively.
   */
 
-  ubSquareRoot = gaubSquareRoot[ ud >> ubBitsToHalve ];
+  ubSquareRoot = gtblCostellaUnblock.aubSquareRoot[ ud >> ubBitsToHalve ];
 
 
   /* Shift the result left by half of the number of bits to halve, and 
@@ -3505,6 +7897,36 @@ static COSTELLA_UD costella_unblock_approx_square_root( COSTELLA_UD ud )
   return (COSTELLA_UD) ubSquareRoot << ( ubBitsToHalve >> 1 );
 }
 
+
+
+/* costella_unblock_lap: 
+**
+**   Internal function that adds the time since the last lap to a phase, 
+**   and starts the next lap. Does nothing if timing is off.
+**
+**   bTimed:  Nonzero if timing is on.
+**
+**   adfSeconds:  Array of seconds spent in each phase.
+**
+**   ubPhase:  Phase to which the time is added.
+**
+**   pdfLap:  Pointer to the time at which the lap started, which is set to
+**     the time now.
+*/
+
+static COSTELLA_INLINE void costella_unblock_lap( COSTELLA_B bTimed, 
+  COSTELLA_DF* adfSeconds, COSTELLA_UB ubPhase, COSTELLA_DF* pdfLap )
+{
+  COSTELLA_DF df;
+
+  if( bTimed )
+  {
+    df = costella_thread_seconds();
+    adfSeconds[ ubPhase ] += df - *pdfLap;
+    *pdfLap = df;
+  }
+}
+
 #ifdef COSTELLA_UNBLOCK_DEBUG_DUMP
   /* CostellaUnblockDebugDump: 
   **
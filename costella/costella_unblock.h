@@ -43,6 +43,105 @@
 
 #include "costella_image_chrominance.h"
 #include "costella_image_convert.h"
+#include "costella_thread.h"
+
+
+
+/* Number of rows in the window image used by the streaming interface.
+*/
+
+#define COSTELLA_UNBLOCK_STREAM_ROWS 32
+
+
+
+/* Structures.
+*/
+
+typedef struct
+{
+  COSTELLA_UD udRowFirst;
+  COSTELLA_IMAGE i;
+}
+COSTELLA_UNBLOCK_ROWS;
+
+
+
+/* A context holds the scratch memory used to unblock one image at a time.
+** Its contents are private to costella_unblock.c.
+*/
+
+typedef struct costella_unblock_context costella_unblock_context;
+typedef costella_unblock_context COSTELLA_UNBLOCK_CONTEXT;
+
+
+
+/* Phases of the algorithm that are timed by costella_unblock_stats. 
+*/
+
+#define COSTELLA_UNBLOCK_PHASE_RGB_TO_YCBCR 0
+#define COSTELLA_UNBLOCK_PHASE_DOWNSAMPLE 1
+#define COSTELLA_UNBLOCK_PHASE_VERTICAL_COMPUTE 2
+#define COSTELLA_UNBLOCK_PHASE_VERTICAL_CORRECT 3
+#define COSTELLA_UNBLOCK_PHASE_HORIZONTAL_COMPUTE 4
+#define COSTELLA_UNBLOCK_PHASE_HORIZONTAL_CORRECT 5
+#define COSTELLA_UNBLOCK_PHASE_UPSAMPLE 6
+#define COSTELLA_UNBLOCK_PHASE_YCBCR_TO_RGB 7
+
+#define COSTELLA_UNBLOCK_NUM_PHASES 8
+
+
+
+/* Sweeps over the image that are timed by costella_unblock_stats. Each 
+** runs its bands of the image in threads of their own, and interleaves 
+** the phases within each band. The first sweep converts and downsamples,
+** and analyzes the vertical discrepancies; the second corrects them, and 
+** analyzes the horizontal discrepancies; the third corrects those, and 
+** upsamples and converts back. Only costella_unblock_interleaved() makes 
+** the sweeps that convert from and to its interleaved pixels.
+*/
+
+#define COSTELLA_UNBLOCK_SWEEP_DEINTERLEAVE 0
+#define COSTELLA_UNBLOCK_SWEEP_FIRST 1
+#define COSTELLA_UNBLOCK_SWEEP_SECOND 2
+#define COSTELLA_UNBLOCK_SWEEP_THIRD 3
+#define COSTELLA_UNBLOCK_SWEEP_INTERLEAVE 4
+
+#define COSTELLA_UNBLOCK_NUM_SWEEPS 5
+
+
+
+/* Statistics of the calls made with a context, to which each call adds:
+**
+**   adfSeconds:  Seconds spent in each phase. The phases run by several 
+**     threads at once are timed in each thread, and the times added, so 
+**     that these are thread-seconds. The computation of the adjustment 
+**     tables is counted in the compute phases.
+**
+**   adfSweepWallSeconds:  Seconds of each sweep, from the start of its 
+**     first band to the end of its last, which is how long the caller 
+**     waited for it.
+**
+**   adfSweepThreadSeconds:  Seconds spent in the bands of each sweep, 
+**     added together. Divided by adfSweepWallSeconds, this is the number
+**     of threads that were kept busy.
+**
+**   udBytesAllocated:  Bytes that the context allocated from the heap.
+**
+** costella_unblock_stream() runs in one thread, and so has one band; its 
+** sweeps also include the time spent in its callbacks, which its phases 
+** do not.
+*/
+
+typedef struct
+{
+  double adfSeconds[ COSTELLA_UNBLOCK_NUM_PHASES ];
+  double adfSweepWallSeconds[ COSTELLA_UNBLOCK_NUM_SWEEPS ];
+  double adfSweepThreadSeconds[ COSTELLA_UNBLOCK_NUM_SWEEPS ];
+  unsigned long udBytesAllocated;
+}
+costella_unblock_stats;
+
+typedef costella_unblock_stats COSTELLA_UNBLOCK_STATS;
 
 
 
@@ -55,6 +154,42 @@ int costella_unblock_finalize( FILE* pfileError );
 int costella_unblock( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* piOut, int
   bPhotographic, int bCartoon, int (*pfProgress)( void* pvPassback ), void* 
   pvPassback, FILE* pfileError );
+int costella_unblock_mt( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* piOut, int 
+  bPhotographic, int bCartoon, int iNumThreads, int (*pfProgress)( void* 
+  pvPassback ), void* pvPassback, FILE* pfileError );
+
+int costella_unblock_context_create( costella_unblock_context** ppctx, 
+  void* (*pfMalloc)( unsigned int uiNumBytes ), int (*pfFree)( void* pv ), 
+  FILE* pfileError );
+int costella_unblock_context_destroy( costella_unblock_context** ppctx, 
+  FILE* pfileError );
+int costella_unblock_context_stats( costella_unblock_context* pctx, 
+  costella_unblock_stats* pstats, FILE* pfileError );
+int costella_unblock_ctx( costella_unblock_context* pctx, COSTELLA_IMAGE* 
+  piIn, COSTELLA_IMAGE* piOut, int bPhotographic, int bCartoon, int 
+  iNumThreads, int (*pfProgress)( void* pvPassback ), void* pvPassback, 
+  FILE* pfileError );
+
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+
+  int costella_unblock_quarter( costella_unblock_context* pctx, 
+    COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* piOut, int bPhotographic, int 
+    bCartoon, int iNumThreads, int (*pfProgress)( void* pvPassback ), void*
+    pvPassback, FILE* pfileError );
+
+  int costella_unblock_stream( COSTELLA_IMAGE* piWindow, unsigned long 
+    udHeight, int bPhotographic, int bCartoon, int (*pfRead)( void* 
+    pvPassback, void* pvRows ), int (*pfWrite)( void* pvPassback, void* 
+    pvRows ), void* pvPassback, costella_unblock_stats* pstats, FILE* 
+    pfileError );
+
+  int costella_unblock_interleaved( costella_unblock_context* pctx, unsigned
+    char* aubIn, long sdInRowStride, unsigned char* aubOut, long 
+    sdOutRowStride, unsigned long udWidth, unsigned long udHeight, int bBgr,
+    int bPhotographic, int bCartoon, int iNumThreads, int (*pfProgress)( 
+    void* pvPassback ), void* pvPassback, FILE* pfileError );
+
+#endif
 
 
 
@@ -64,9 +199,49 @@ int costella_unblock( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* piOut, int
 COSTELLA_FUNCTION( CostellaUnblockInitialize, ( void ) )
 COSTELLA_FUNCTION( CostellaUnblockFinalize, ( void ) )
 
+COSTELLA_FUNCTION( CostellaUnblockContextCreate, ( COSTELLA_O* (*pfMalloc)(
+  COSTELLA_MC mc ), COSTELLA_B (*pfFree)( COSTELLA_O* po ), 
+  COSTELLA_UNBLOCK_CONTEXT** ppctx ) )
+COSTELLA_FUNCTION( CostellaUnblockContextDestroy, ( 
+  COSTELLA_UNBLOCK_CONTEXT** ppctx ) )
+COSTELLA_FUNCTION( CostellaUnblockContextStats, ( COSTELLA_UNBLOCK_CONTEXT*
+  pctx, COSTELLA_UNBLOCK_STATS* pstats ) )
+
 COSTELLA_FUNCTION( CostellaUnblock, ( COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* 
   piOut, COSTELLA_B bPhotographic, COSTELLA_B bCartoon, 
   COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* poPassback ) )
+COSTELLA_FUNCTION( CostellaUnblockMt, ( COSTELLA_IMAGE* piIn, 
+  COSTELLA_IMAGE* piOut, COSTELLA_B bPhotographic, COSTELLA_B bCartoon, 
+  COSTELLA_UD udNumThreads, COSTELLA_CALLBACK_FUNCTION pfProgress, 
+  COSTELLA_O* poPassback ) )
+COSTELLA_FUNCTION( CostellaUnblockCtx, ( COSTELLA_UNBLOCK_CONTEXT* pctx, 
+  COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* piOut, COSTELLA_B bPhotographic, 
+  COSTELLA_B bCartoon, COSTELLA_UD udNumThreads, COSTELLA_CALLBACK_FUNCTION
+  pfProgress, COSTELLA_O* poPassback ) )
+
+#ifdef COSTELLA_IMAGE_CHANNELS_CONTIGUOUS
+
+  COSTELLA_FUNCTION( CostellaUnblockQuarter, ( COSTELLA_UNBLOCK_CONTEXT* 
+    pctx, COSTELLA_IMAGE* piIn, COSTELLA_IMAGE* piOut, COSTELLA_B 
+    bPhotographic, COSTELLA_B bCartoon, COSTELLA_UD udNumThreads, 
+    COSTELLA_CALLBACK_FUNCTION pfProgress, COSTELLA_O* poPassback ) )
+
+  COSTELLA_FUNCTION( CostellaUnblockStream, ( COSTELLA_IMAGE* piWindow, 
+    COSTELLA_UD udHeight, COSTELLA_B bPhotographic, COSTELLA_B bCartoon, 
+    COSTELLA_FUNCTION_POINTER( pfRead, ( COSTELLA_O* poPassback, 
+    COSTELLA_O* po ) ), COSTELLA_O* poReadPassback, 
+    COSTELLA_FUNCTION_POINTER( pfWrite, ( COSTELLA_O* poPassback, 
+    COSTELLA_O* po ) ), COSTELLA_O* poWritePassback, 
+    COSTELLA_UNBLOCK_STATS* pstats ) )
+
+  COSTELLA_FUNCTION( CostellaUnblockInterleaved, ( COSTELLA_UNBLOCK_CONTEXT*
+    pctx, COSTELLA_UB* aubIn, COSTELLA_SD sdInRowStride, COSTELLA_UB* 
+    aubOut, COSTELLA_SD sdOutRowStride, COSTELLA_UD udWidth, COSTELLA_UD 
+    udHeight, COSTELLA_B bBgr, COSTELLA_B bPhotographic, COSTELLA_B 
+    bCartoon, COSTELLA_UD udNumThreads, COSTELLA_CALLBACK_FUNCTION 
+    pfProgress, COSTELLA_O* poPassback ) )
+
+#endif
 
 
 
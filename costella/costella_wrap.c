@@ -38,13 +38,6 @@
 
 
 
-/* Internal global variables.
-*/
-
-static COSTELLA_B gbInitialized = COSTELLA_FALSE;
-
-
-
 /* Start function bodies.
 */
 
@@ -59,28 +52,12 @@ static COSTELLA_B gbInitialized = COSTELLA_FALSE;
 
 COSTELLA_FUNCTION( CostellaWrapInitialize, ( void ) )
 {  
-  /* Do nothing if already initialized.
-  */
-
-  if( gbInitialized )
-  {
-    COSTELLA_RETURN;
-  }
-
-
-  /* Set initialized flag.
-  */
-
-  gbInitialized = COSTELLA_TRUE;
-
-
   /* Initialize other libraries.
   */
 
   if( COSTELLA_CALL( CostellaBaseInitialize( 0, 0, 0 ) ) )
   {
     COSTELLA_ERROR( "Initialization" );
-    gbInitialized = COSTELLA_FALSE;
     COSTELLA_RETURN;
   }
 }
@@ -95,21 +72,6 @@ COSTELLA_END_FUNCTION
 
 COSTELLA_FUNCTION( CostellaWrapFinalize, ( void ) )
 {
-  /* Do nothing if not initialized.
-  */
-
-  if( !gbInitialized )
-  {
-    COSTELLA_RETURN;
-  }
-
-
-  /* Clear initialized flag.
-  */
-
-  gbInitialized = COSTELLA_FALSE;
-
-
   /* Finalize other libraries.
   */ 
 
@@ -141,17 +103,11 @@ COSTELLA_FUNCTION( CostellaWrapCallbackNew, ( COSTELLA_WRAP_CALLBACK** ppwc,
   COSTELLA_WRAP_CALLBACK* pwc = 0;
 
 
-  /* Check initialization and pointers.
+  /* Check pointers.
   */
 
   #ifdef COSTELLA_DEBUG
   {
-    if( !gbInitialized )
-    {
-      COSTELLA_FUNDAMENTAL_ERROR( "Initialization" );
-      COSTELLA_RETURN;
-    }
-
     if( !ppwc )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Null ppwc" );
@@ -206,17 +162,11 @@ COSTELLA_FUNCTION( CostellaWrapCallbackDelete, ( COSTELLA_WRAP_CALLBACK**
   COSTELLA_WRAP_CALLBACK* pwc;
 
 
-  /* Check initialization and pointers.
+  /* Check pointers.
   */
 
   #ifdef COSTELLA_DEBUG
   {
-    if( !gbInitialized )
-    {
-      COSTELLA_FUNDAMENTAL_ERROR( "Initialization" );
-      COSTELLA_RETURN;
-    }
-
     if( !ppwc )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Null ppwc" );
@@ -267,17 +217,11 @@ COSTELLA_FUNCTION( CostellaWrapCallback, ( COSTELLA_O* poPassback,
   void* pvPassback;
 
 
-  /* Check initialization and pointers.
+  /* Check pointers.
   */
 
   #ifdef COSTELLA_DEBUG
   {
-    if( !gbInitialized )
-    {
-      COSTELLA_FUNDAMENTAL_ERROR( "Initialization" );
-      COSTELLA_RETURN;
-    }
-
     if( !poPassback )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Null poPassback" );
@@ -326,17 +270,11 @@ COSTELLA_FUNCTION( CostellaWrapProgress, ( COSTELLA_O* poPassback ) )
   void* pvPassback;
 
 
-  /* Check initialization and pointers.
+  /* Check pointers.
   */
 
   #ifdef COSTELLA_DEBUG
   {
-    if( !gbInitialized )
-    {
-      COSTELLA_FUNDAMENTAL_ERROR( "Initialization" );
-      COSTELLA_RETURN;
-    }
-
     if( !poPassback )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Null poPassback" );
@@ -399,17 +337,11 @@ COSTELLA_FUNCTION( CostellaWrapNewCopy, ( COSTELLA_O**
   void* (*pfNewCopy)( void* pvExisting );
 
 
-  /* Check initialization and pointers.
+  /* Check pointers.
   */
 
   #ifdef COSTELLA_DEBUG
   {
-    if( !gbInitialized )
-    {
-      COSTELLA_FUNDAMENTAL_ERROR( "Initialization" );
-      COSTELLA_RETURN;
-    }
-
     if( !ppoNewCopy )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Null ppoNewCopy" );
@@ -476,17 +408,11 @@ COSTELLA_FUNCTION( CostellaWrapDelete, ( COSTELLA_O** ppo, COSTELLA_O*
   int (*pfDelete)( void* pv );
 
 
-  /* Check initialization and pointers.
+  /* Check pointers.
   */
 
   #ifdef COSTELLA_DEBUG
   {
-    if( !gbInitialized )
-    {
-      COSTELLA_FUNDAMENTAL_ERROR( "Initialization" );
-      COSTELLA_RETURN;
-    }
-
     if( !ppo )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Null ppo" );
@@ -555,17 +481,11 @@ COSTELLA_FUNCTION( CostellaWrapCompare, ( COSTELLA_SB* psbCompare,
   int (*pfCompare)( void* pv1, void* pv2 );
 
 
-  /* Check initialization and pointers.
+  /* Check pointers.
   */
 
   #ifdef COSTELLA_DEBUG
   {
-    if( !gbInitialized )
-    {
-      COSTELLA_FUNDAMENTAL_ERROR( "Initialization" );
-      COSTELLA_RETURN;
-    }
-
     if( !psbCompare )
     {
       COSTELLA_FUNDAMENTAL_ERROR( "Null psbCompare" );
@@ -143,12 +143,12 @@ RGBApixel BMP::GetPixel( int i, int j ) const
        << "                 Truncating request to fit in the range [0,"
        << Width-1 << "] x [0," << Height-1 << "]." << endl;
  }	
- return Pixels[i][j];
+ return Pixels[j*Width+i];
 }
 
 bool BMP::SetPixel( int i, int j, RGBApixel NewPixel )
 {
- Pixels[i][j] = NewPixel;
+ Pixels[j*Width+i] = NewPixel;
  return true;
 }
 
@@ -235,8 +235,7 @@ BMP::BMP()
  Width = 1;
  Height = 1;
  BitDepth = 24;
- Pixels = new RGBApixel* [Width];
- Pixels[0] = new RGBApixel [Height];
+ Pixels = new RGBApixel [Width*Height];
  Colors = NULL;
  
  XPelsPerMeter = 0;
@@ -256,8 +255,7 @@ BMP::BMP( BMP& Input )
  Width = 1;
  Height = 1;
  BitDepth = 24;
- Pixels = new RGBApixel* [Width];
- Pixels[0] = new RGBApixel [Height];
+ Pixels = new RGBApixel [Width*Height];
  Colors = NULL; 
  XPelsPerMeter = 0;
  YPelsPerMeter = 0;
@@ -293,20 +291,11 @@ BMP::BMP( BMP& Input )
  // get all the pixels 
  
  for( int j=0; j < Height ; j++ )
- {
-  for( int i=0; i < Width ; i++ )
-  {
-   Pixels[i][j] = *Input(i,j);
-//   Pixels[i][j] = Input.GetPixel(i,j); // *Input(i,j);
-  }
- }
+ { memcpy( (char*) GetRow(j), (char*) Input.GetRow(j), Width*sizeof(RGBApixel) ); }
 }
 
 BMP::~BMP()
 {
- int i;
- for(i=0;i<Width;i++)
- { delete [] Pixels[i]; }
  delete [] Pixels;
  if( Colors )
  { delete [] Colors; }
@@ -334,7 +323,35 @@ RGBApixel* BMP::operator()(int i, int j)
        << "                 Truncating request to fit in the range [0,"
        << Width-1 << "] x [0," << Height-1 << "]." << endl;
  }	
- return &(Pixels[i][j]);
+ return &(Pixels[j*Width+i]);
+}
+
+// Pixels are stored row by row, top row first, so a row is Width 
+// contiguous pixels. Row j is not range-checked.
+
+RGBApixel* BMP::GetRow( int j )
+{ return Pixels + j*Width; }
+
+void BMP::GetRow24( int j, ebmpBYTE* Output )
+{
+ const RGBApixel* Row = Pixels + j*Width;
+ for( int i=0 ; i < Width ; i++ )
+ {
+  Output[3*i]   = Row[i].Blue;
+  Output[3*i+1] = Row[i].Green;
+  Output[3*i+2] = Row[i].Red;
+ }
+}
+
+void BMP::SetRow24( int j, const ebmpBYTE* Input )
+{
+ RGBApixel* Row = Pixels + j*Width;
+ for( int i=0 ; i < Width ; i++ )
+ {
+  Row[i].Blue  = Input[3*i];
+  Row[i].Green = Input[3*i+1];
+  Row[i].Red   = Input[3*i+2];
+ }
 }
 
 // int BMP::TellBitDepth( void ) const
@@ -401,28 +418,20 @@ bool BMP::SetSize(int NewWidth , int NewHeight )
   return false;
  }
 
- int i,j; 
+ int i; 
 
- for(i=0;i<Width;i++)
- { delete [] Pixels[i]; }
  delete [] Pixels;
 
  Width = NewWidth;
  Height = NewHeight;
- Pixels = new RGBApixel* [ Width ]; 
- 
- for(i=0; i<Width; i++)
- { Pixels[i] = new RGBApixel [ Height ]; }
+ Pixels = new RGBApixel [ Width*Height ]; 
  
- for( i=0 ; i < Width ; i++)
+ for( i=0 ; i < Width*Height ; i++)
  {
-  for( j=0 ; j < Height ; j++ )
-  {
-   Pixels[i][j].Red = 255; 
-   Pixels[i][j].Green = 255; 
-   Pixels[i][j].Blue = 255; 
-   Pixels[i][j].Alpha = 0;    
-  }
+  Pixels[i].Red = 255; 
+  Pixels[i].Green = 255; 
+  Pixels[i].Blue = 255; 
+  Pixels[i].Alpha = 0;    
  }
 
  return true; 
@@ -640,9 +649,9 @@ bool BMP::WriteToFile( const char* FileName )
    int WriteNumber = 0;
    while( WriteNumber < DataBytes )
    {
-	ebmpWORD RedWORD = (ebmpWORD) ((Pixels[i][j]).Red / 8);
-	ebmpWORD GreenWORD = (ebmpWORD) ((Pixels[i][j]).Green / 4);
-	ebmpWORD BlueWORD = (ebmpWORD) ((Pixels[i][j]).Blue / 8);
+	ebmpWORD RedWORD = (ebmpWORD) (Pixels[j*Width+i].Red / 8);
+	ebmpWORD GreenWORD = (ebmpWORD) (Pixels[j*Width+i].Green / 4);
+	ebmpWORD BlueWORD = (ebmpWORD) (Pixels[j*Width+i].Blue / 8);
     ebmpWORD TempWORD = (RedWORD<<11) + (GreenWORD<<5) + BlueWORD;
 	if( IsBigEndian )
 	{ TempWORD = FlipWORD( TempWORD ); }
@@ -1052,9 +1061,9 @@ bool BMP::ReadFromFile( const char* FileName )
     ebmpBYTE GreenBYTE = (ebmpBYTE) 8*(Green>>GreenShift);
     ebmpBYTE RedBYTE = (ebmpBYTE) 8*(Red>>RedShift);
 		
-	(Pixels[i][j]).Red = RedBYTE;
-	(Pixels[i][j]).Green = GreenBYTE;
-	(Pixels[i][j]).Blue = BlueBYTE;
+	Pixels[j*Width+i].Red = RedBYTE;
+	Pixels[j*Width+i].Green = GreenBYTE;
+	Pixels[j*Width+i].Blue = BlueBYTE;
 	
 	i++;
    }
@@ -1524,11 +1533,9 @@ bool CreateGrayscaleColorTable( BMP& InputImage )
 
 bool BMP::Read32bitRow( ebmpBYTE* Buffer, int BufferSize, int Row )
 { 
- int i;
  if( Width*4 > BufferSize )
  { return false; }
- for( i=0 ; i < Width ; i++ )
- { memcpy( (char*) &(Pixels[i][Row]), (char*) Buffer+4*i, 4 ); }
+ memcpy( (char*) GetRow(Row), (char*) Buffer, 4*Width );
  return true;
 }
 
@@ -1537,8 +1544,14 @@ bool BMP::Read24bitRow( ebmpBYTE* Buffer, int BufferSize, int Row )
  int i;
  if( Width*3 > BufferSize )
  { return false; }
+ // the file stores blue, green, red, the same order as RGBApixel
+ RGBApixel* Output = GetRow(Row);
  for( i=0 ; i < Width ; i++ )
- { memcpy( (char*) &(Pixels[i][Row]), Buffer+3*i, 3 ); }
+ {
+  Output[i].Blue  = Buffer[3*i];
+  Output[i].Green = Buffer[3*i+1];
+  Output[i].Red   = Buffer[3*i+2];
+ }
  return true;
 }
 
@@ -1601,21 +1614,17 @@ bool BMP::Read1bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row )
 
 bool BMP::Write32bitRow( ebmpBYTE* Buffer, int BufferSize, int Row )
 { 
- int i;
  if( Width*4 > BufferSize )
  { return false; }
- for( i=0 ; i < Width ; i++ )
- { memcpy( (char*) Buffer+4*i, (char*) &(Pixels[i][Row]), 4 ); }
+ memcpy( (char*) Buffer, (char*) GetRow(Row), 4*Width );
  return true;
 }
 
 bool BMP::Write24bitRow( ebmpBYTE* Buffer, int BufferSize, int Row )
 { 
- int i;
  if( Width*3 > BufferSize )
  { return false; }
- for( i=0 ; i < Width ; i++ )
- { memcpy( (char*) Buffer+3*i,  (char*) &(Pixels[i][Row]), 3 ); }
+ GetRow24( Row, Buffer );
  return true;
 }
 
@@ -1625,7 +1634,7 @@ bool BMP::Write8bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row )
  if( Width > BufferSize )
  { return false; }
  for( i=0 ; i < Width ; i++ )
- { Buffer[i] = FindClosestColor( Pixels[i][Row] ); }
+ { Buffer[i] = FindClosestColor( Pixels[Row*Width+i] ); }
  return true;
 }
 
@@ -1643,7 +1652,7 @@ bool BMP::Write4bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row )
   int Index = 0;
   while( j < 2 && i < Width )
   {
-   Index += ( PositionWeights[j]* (int) FindClosestColor( Pixels[i][Row] ) ); 
+   Index += ( PositionWeights[j]* (int) FindClosestColor( Pixels[Row*Width+i] ) ); 
    i++; j++;   
   }
   Buffer[k] = (ebmpBYTE) Index;
@@ -1666,7 +1675,7 @@ bool BMP::Write1bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row )
   int Index = 0;
   while( j < 8 && i < Width )
   {
-   Index += ( PositionWeights[j]* (int) FindClosestColor( Pixels[i][Row] ) ); 
+   Index += ( PositionWeights[j]* (int) FindClosestColor( Pixels[Row*Width+i] ) ); 
    i++; j++;   
   }
   Buffer[k] = (ebmpBYTE) Index;
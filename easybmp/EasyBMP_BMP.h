@@ -30,7 +30,7 @@ class BMP
  int BitDepth;
  int Width;
  int Height;
- RGBApixel** Pixels;
+ RGBApixel* Pixels; // Width*Height, row by row
  RGBApixel* Colors;
  int XPelsPerMeter;
  int YPelsPerMeter;
@@ -75,6 +75,10 @@ class BMP
  RGBApixel GetPixel( int i, int j ) const;
  bool SetPixel( int i, int j, RGBApixel NewPixel );
  
+ RGBApixel* GetRow( int j );
+ void GetRow24( int j, ebmpBYTE* Output );
+ void SetRow24( int j, const ebmpBYTE* Input );
+ 
  bool CreateStandardColorTable( void );
  
  bool SetSize( int NewWidth, int NewHeight );
@@ -6,35 +6,149 @@ extern "C" {
 }
 #include "EasyBMP.h"
 #include <png.h>
+#include <zlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 using u8 = uint8_t;
 
-// Actually YCbCr, not YUV.
-// From https://web.archive.org/web/20180423091842/http://www.equasys.de/colorconversion.html YCbCr - RGB.
-void YUVfromRGB(u8& Y, u8& U, u8& V, const double R, const double G, const double B)
+// Phases timed by --stats json: decoding, the library's phases, and encoding.
+// The color conversion and chroma resampling done here are added to the library's phases.
+// Each is summed over the threads that run it.
+enum { phaseDecode, phaseLib, phaseEncode = phaseLib + COSTELLA_UNBLOCK_NUM_PHASES, cPhase };
+static const char* const namePhase[cPhase] = {"decode", "rgb_to_ycbcr", "downsample",
+  "v_compute", "v_correct", "h_compute", "h_correct", "upsample", "ycbcr_to_rgb", "encode"};
+// The library's sweeps, each timed both by the clock on the wall and summed over its threads.
+static const char* const nameSweep[COSTELLA_UNBLOCK_NUM_SWEEPS] = {"deinterleave", "sweep1", "sweep2", "sweep3", "interleave"};
+
+struct Stats {
+  double seconds[cPhase] = {};
+  double secondsUnblock = 0.0; // In the library call, less the time of its callbacks.
+  costella_unblock_stats lib = {};
+  // Add the phases of another thread's frames, as for --y4m.
+  void add(const Stats& s) {
+    for (int i = 0; i < cPhase; ++i)
+      seconds[i] += s.seconds[i];
+    for (int i = 0; i < COSTELLA_UNBLOCK_NUM_PHASES; ++i)
+      lib.adfSeconds[i] += s.lib.adfSeconds[i];
+    for (int i = 0; i < COSTELLA_UNBLOCK_NUM_SWEEPS; ++i) {
+      lib.adfSweepWallSeconds[i] += s.lib.adfSweepWallSeconds[i];
+      lib.adfSweepThreadSeconds[i] += s.lib.adfSweepThreadSeconds[i];
+    }
+    lib.udBytesAllocated += s.lib.udBytesAllocated;
+  }
+  // Count the library's phases with those timed here.
+  void addLib() {
+    for (int i = 0; i < COSTELLA_UNBLOCK_NUM_PHASES; ++i)
+      seconds[phaseLib + i] += lib.adfSeconds[i];
+  }
+};
+
+// Each lap adds the time since the previous lap to a phase.
+// Without an array of seconds, laps cost only a test.
+struct Lap {
+  double* seconds;
+  std::chrono::steady_clock::time_point t;
+  explicit Lap(double* s = NULL) : seconds(s) { start(); }
+  void start() {
+    if (seconds)
+      t = std::chrono::steady_clock::now();
+  }
+  void operator()(int phase) {
+    if (!seconds)
+      return;
+    const auto t1 = std::chrono::steady_clock::now();
+    seconds[phase] += std::chrono::duration<double>(t1 - t).count();
+    t = t1;
+  }
+};
+
+// Convert a row of interleaved RGB pixels (BGR in a .bmp) to Y.
+// For an even row, also fill a row of quarter-size U and V from the even pixels.
+// The library's integer conversion uses scratch, 2*w bytes, for full-width U and V.
+static bool rowToYUV(u8* rgb, unsigned w, bool fBGR, u8* pY, u8* pU, u8* pV, u8* scratch, Lap* lap = NULL)
 {
-  const auto y =  0.257 * R + 0.504 * G + 0.098 * B +  16.0;
-  const auto u = -0.148 * R - 0.291 * G + 0.439 * B + 128.0;
-  const auto v =  0.439 * R - 0.368 * G - 0.071 * B + 128.0;
-  // Clamp to [0, 255].
-  Y = COSTELLA_IMAGE_LIMIT_RANGE(y);
-  U = COSTELLA_IMAGE_LIMIT_RANGE(u);
-  V = COSTELLA_IMAGE_LIMIT_RANGE(v);
+  if (!costella_image_convert_rgb_row_to_ycbcr(rgb, w, fBGR, pY, pU ? scratch : NULL, pU ? scratch + w : NULL, stderr))
+    return false;
+  if (lap)
+    (*lap)(phaseLib + COSTELLA_UNBLOCK_PHASE_RGB_TO_YCBCR);
+  for (unsigned x = 0u; pU && x < w; x += 2) {
+    pU[x/2] = scratch[x];
+    pV[x/2] = scratch[w + x];
+  }
+  if (lap)
+    (*lap)(phaseLib + COSTELLA_UNBLOCK_PHASE_DOWNSAMPLE);
+  return true;
 }
-void RGBfromYUV(u8& R, u8& G, u8& B, double Y, double U, double V)
+
+// Inverse of rowToYUV(): replicate quarter-size U and V, and convert a row back to RGB.
+static bool rowFromYUV(const u8* pY, const u8* pU, const u8* pV, unsigned w, bool fBGR, u8* rgb, u8* scratch, Lap* lap = NULL)
 {
-  Y -=  16.0;
-  U -= 128.0;
-  V -= 128.0;
-  const auto r = 1.164 * Y             + 1.596 * V;
-  const auto g = 1.164 * Y - 0.392 * U - 0.813 * V;
-  const auto b = 1.164 * Y + 2.017 * U;
-  // Clamp to [0, 255].
-  R = COSTELLA_IMAGE_LIMIT_RANGE(r);
-  G = COSTELLA_IMAGE_LIMIT_RANGE(g);
-  B = COSTELLA_IMAGE_LIMIT_RANGE(b);
+  for (unsigned x = 0u; x < w; ++x) {
+    scratch[x] = pU[x/2];
+    scratch[w + x] = pV[x/2];
+  }
+  if (lap)
+    (*lap)(phaseLib + COSTELLA_UNBLOCK_PHASE_UPSAMPLE);
+  const auto ok = costella_image_convert_ycbcr_row_to_rgb((u8*)pY, scratch, scratch + w, w, fBGR, rgb, stderr);
+  if (lap)
+    (*lap)(phaseLib + COSTELLA_UNBLOCK_PHASE_YCBCR_TO_RGB);
+  return ok;
+}
+
+// Print the --stats of unblocking nameIn, of cFrame images of w by h, as one line of JSON on stderr,
+// apart from the messages on stdout.  Fields ending in _cpu_s are summed over threads, _wall_s aren't.
+static void printStats(const char* nameIn, unsigned w, unsigned h, unsigned long cFrame, int cThread, const Stats& stats, double secondsTotal)
+{
+  std::string s = "{\"file\":\"";
+  for (const char* p = nameIn; *p; ++p) {
+    char esc[8];
+    if (*p == '"' || *p == '\\')
+      s += '\\';
+    if (u8(*p) < 0x20) {
+      snprintf(esc, sizeof esc, "\\u%04x", *p);
+      s += esc;
+    } else
+      s += *p;
+  }
+  char buf[256];
+  snprintf(buf, sizeof buf, "\",\"width\":%u,\"height\":%u,\"frames\":%lu,\"threads\":%d,\"phases\":{", w, h, cFrame, cThread);
+  s += buf;
+  for (int i = 0; i < cPhase; ++i) {
+    snprintf(buf, sizeof buf, "%s\"%s_cpu_s\":%.6f", i ? "," : "", namePhase[i], stats.seconds[i]);
+    s += buf;
+  }
+  s += "},\"sweeps\":{";
+  for (int i = 0; i < COSTELLA_UNBLOCK_NUM_SWEEPS; ++i) {
+    snprintf(buf, sizeof buf, "%s\"%s_wall_s\":%.6f,\"%s_cpu_s\":%.6f", i ? "," : "",
+      nameSweep[i], stats.lib.adfSweepWallSeconds[i], nameSweep[i], stats.lib.adfSweepThreadSeconds[i]);
+    s += buf;
+  }
+  // ru_maxrss is in kilobytes, and is the peak of the whole process so far.
+  struct rusage ru;
+  const long cbRSS = getrusage(RUSAGE_SELF, &ru) ? 0L : ru.ru_maxrss * 1024L;
+  snprintf(buf, sizeof buf, "},\"unblock_wall_s\":%.6f,\"total_wall_s\":%.6f,\"bytes_allocated\":%lu,\"peak_rss_bytes\":%ld,\"megapixels_per_second\":%.3f}\n",
+    stats.secondsUnblock, secondsTotal, stats.lib.udBytesAllocated, cbRSS, secondsTotal > 0.0 ? 1e-6 * w * h * cFrame / secondsTotal : 0.0);
+  s += buf;
+  fputs(s.c_str(), stderr);
 }
 
 std::string filenameExtension(const std::string& s)
@@ -47,40 +161,825 @@ std::string filenameExtension(const std::string& s)
   return ext;
 }
 
-int main(int argc, char** argv)
+// Streaming mode: the image is read and written a few rows at a time,
+// so memory use grows with the width of the image but not its height.
+// Only 24-bit uncompressed .bmp and 8- or 16-bit RGB .png are supported.
+struct Stream {
+  bool fBMP;
+  const char* nameIn;
+  unsigned w, h;
+  std::vector<u8> row;
+  // Input.  The image is read from the top down three times.
+  FILE* fpIn = NULL;
+  png_structp pPNGIn = NULL;
+  png_infop pInfoPNGIn = NULL;
+  long offsetBMP;    // Start of pixel data.
+  bool fTopDownBMP;
+  unsigned cbRowBMP; // Including padding.
+  // Output.
+  FILE* fpOut = NULL;
+  png_structp pPNGOut = NULL;
+  png_infop pInfoPNGOut = NULL;
+  // For --stats, the callbacks time what they do, but not the library between them.
+  Lap lap;
+};
+
+static unsigned readLE(const u8* p, int cb)
 {
-  if (argc != 3) {
-LUsage:
-    printf("usage: %s in.[bmp|png] out.[bmp|png]\n", argv[0]);
+  unsigned u = 0;
+  while (cb--)
+    u = (u << 8) | p[cb];
+  return u;
+}
+
+static void writeLE(u8* p, unsigned u, int cb)
+{
+  while (cb--) {
+    *p++ = u & 0xff;
+    u >>= 8;
+  }
+}
+
+// The same 54-byte header as EasyBMP writes for a 24-bit image of bottom-up rows.
+static void writeHeaderBMP(u8* hdr, unsigned w, unsigned h, unsigned cbRow, unsigned xPels = 3780, unsigned yPels = 3780)
+{
+  std::fill(hdr, hdr + 54, 0);
+  hdr[0] = 'B';
+  hdr[1] = 'M';
+  writeLE(hdr + 2, 54 + h * cbRow, 4);
+  writeLE(hdr + 10, 54, 4);
+  writeLE(hdr + 14, 40, 4);
+  writeLE(hdr + 18, w, 4);
+  writeLE(hdr + 22, h, 4);
+  writeLE(hdr + 26, 1, 2);
+  writeLE(hdr + 28, 24, 2);
+  writeLE(hdr + 34, h * cbRow, 4);
+  writeLE(hdr + 38, xPels, 4);
+  writeLE(hdr + 42, yPels, 4);
+}
+
+static void closeStreamIn(Stream& s)
+{
+  if (s.pPNGIn)
+    png_destroy_read_struct(&s.pPNGIn, &s.pInfoPNGIn, NULL);
+  if (s.fpIn)
+    fclose(s.fpIn);
+  s.fpIn = NULL;
+}
+
+// (Re)open the input file, and read its header.
+static bool openStreamIn(Stream& s)
+{
+  closeStreamIn(s);
+  s.fpIn = fopen(s.nameIn, "rb");
+  if (!s.fpIn)
+    return false;
+  if (s.fBMP) {
+    u8 hdr[54];
+    if (fread(hdr, 1, sizeof hdr, s.fpIn) != sizeof hdr || hdr[0] != 'B' || hdr[1] != 'M')
+      return false;
+    const int height = int(readLE(hdr + 22, 4));
+    if (readLE(hdr + 28, 2) != 24 || readLE(hdr + 30, 4) != 0) {
+      printf("bmp file %s isn't 24-bit uncompressed, so it can't be streamed.\n", s.nameIn);
+      return false;
+    }
+    s.offsetBMP = readLE(hdr + 10, 4);
+    s.w = readLE(hdr + 18, 4);
+    s.fTopDownBMP = height < 0;
+    s.h = s.fTopDownBMP ? -height : height;
+    s.cbRowBMP = (3*s.w + 3) & ~3u;
+  } else {
+    s.pPNGIn = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    s.pInfoPNGIn = png_create_info_struct(s.pPNGIn);
+    png_init_io(s.pPNGIn, s.fpIn);
+    png_read_info(s.pPNGIn, s.pInfoPNGIn);
+    if (png_get_color_type(s.pPNGIn, s.pInfoPNGIn) != PNG_COLOR_TYPE_RGB ||
+        png_get_interlace_type(s.pPNGIn, s.pInfoPNGIn) != PNG_INTERLACE_NONE) {
+      printf("png file %s isn't noninterlaced RGB, so it can't be streamed.\n", s.nameIn);
+      return false;
+    }
+    if (png_get_bit_depth(s.pPNGIn, s.pInfoPNGIn) == 16) {
+      png_set_strip_16(s.pPNGIn);
+      png_read_update_info(s.pPNGIn, s.pInfoPNGIn);
+    }
+    s.w = png_get_image_width(s.pPNGIn, s.pInfoPNGIn);
+    s.h = png_get_image_height(s.pPNGIn, s.pInfoPNGIn);
+  }
+  s.row.resize(std::max<size_t>(3*s.w + 3, s.fBMP ? 0 : png_get_rowbytes(s.pPNGIn, s.pInfoPNGIn)));
+  return true;
+}
+
+// Callback for costella_unblock_stream(): read rows into the window.
+static int readStreamRows(void* pvStream, void* pvRows)
+{
+  auto& s = *(Stream*)pvStream;
+  const auto& r = *(COSTELLA_UNBLOCK_ROWS*)pvRows;
+  s.lap.start();
+  if (r.udRowFirst == 0 && !openStreamIn(s))
+    return 0;
+  for (unsigned j = 0; j < r.i.udHeight; ++j) {
+    const auto y = r.udRowFirst + j;
+    if (s.fBMP) {
+      const auto yFile = s.fTopDownBMP ? y : s.h - 1 - y;
+      if (fseek(s.fpIn, s.offsetBMP + long(yFile) * s.cbRowBMP, SEEK_SET) ||
+          fread(s.row.data(), 3, s.w, s.fpIn) != s.w)
+        return 0;
+    } else
+      png_read_row(s.pPNGIn, s.row.data(), NULL);
+    s.lap(phaseDecode);
+    // The window has full-size chroma planes.
+    const auto i = j * r.i.sdRowStride;
+    if (!costella_image_convert_rgb_row_to_ycbcr(s.row.data(), s.w, s.fBMP,
+          r.i.ic.aubRY + i, r.i.ic.aubGCb + i, r.i.ic.aubBCr + i, stderr))
+      return 0;
+    s.lap(phaseLib + COSTELLA_UNBLOCK_PHASE_RGB_TO_YCBCR);
+  }
+  return 1;
+}
+
+// Callback for costella_unblock_stream(): write finished rows.
+static int writeStreamRows(void* pvStream, void* pvRows)
+{
+  auto& s = *(Stream*)pvStream;
+  const auto& r = *(COSTELLA_UNBLOCK_ROWS*)pvRows;
+  s.lap.start();
+  for (unsigned j = 0; j < r.i.udHeight; ++j) {
+    const auto y = r.udRowFirst + j;
+    const auto i = j * r.i.sdRowStride;
+    std::fill(s.row.begin(), s.row.end(), 0);
+    if (!costella_image_convert_ycbcr_row_to_rgb(r.i.ic.aubRY + i,
+          r.i.ic.aubGCb + i, r.i.ic.aubBCr + i, s.w, s.fBMP, s.row.data(), stderr))
+      return 0;
+    s.lap(phaseLib + COSTELLA_UNBLOCK_PHASE_YCBCR_TO_RGB);
+    if (s.fBMP) {
+      // Like EasyBMP, write bottom-up rows.
+      if (fseek(s.fpOut, 54 + long(s.h - 1 - y) * s.cbRowBMP, SEEK_SET) ||
+          fwrite(s.row.data(), 1, s.cbRowBMP, s.fpOut) != s.cbRowBMP)
+        return 0;
+    } else
+      png_write_row(s.pPNGOut, s.row.data());
+    s.lap(phaseEncode);
+  }
+  return 1;
+}
+
+// A 24-bit uncompressed .bmp file, memory-mapped.
+// The library unblocks the pixels straight from the file's pages into those of the output,
+// with no intermediate image.  Other .bmp files are read by EasyBMP.
+struct MapBMP {
+  int fd = -1;
+  u8* p = NULL; // The whole file.
+  size_t cb = 0;
+  unsigned w = 0, h = 0;
+  size_t offset = 0;  // Start of pixel data.
+  bool fTopDown = false;
+  unsigned cbRow = 0; // Including padding.
+  unsigned xPels = 0, yPels = 0; // Pixels per meter.
+
+  // Row y, counting from the top of the image.
+  u8* row(unsigned y) const { return p + offset + size_t(fTopDown ? y : h - 1 - y) * cbRow; }
+  // Bytes from one row to the one below it.
+  long stride() const { return fTopDown ? long(cbRow) : -long(cbRow); }
+};
+
+static void unmapBMP(MapBMP& m)
+{
+  if (m.p)
+    munmap(m.p, m.cb);
+  if (m.fd >= 0)
+    close(m.fd);
+  m.p = NULL;
+  m.fd = -1;
+}
+
+// On success, m owns fd.
+static bool mapBMP(MapBMP& m, int fd, size_t cb, int prot)
+{
+  const auto p = mmap(NULL, cb, prot, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+    return false;
+  m.fd = fd;
+  m.p = (u8*)p;
+  m.cb = cb;
+  return true;
+}
+
+// Map nameIn, if it's a 24-bit uncompressed .bmp file.
+// With fWrite, map it for writing too, to unblock it in place.
+static bool mapBMPIn(const char* nameIn, MapBMP& m, bool fWrite = false)
+{
+  const auto fd = open(nameIn, fWrite ? O_RDWR : O_RDONLY);
+  struct stat st;
+  if (fd < 0)
+    return false;
+  if (fstat(fd, &st) || st.st_size < 54 || !mapBMP(m, fd, st.st_size, fWrite ? PROT_READ | PROT_WRITE : PROT_READ)) {
+    close(fd);
+    return false;
+  }
+  const auto hdr = m.p;
+  const int height = int(readLE(hdr + 22, 4));
+  m.w = readLE(hdr + 18, 4);
+  m.fTopDown = height < 0;
+  m.h = m.fTopDown ? -height : height;
+  m.offset = readLE(hdr + 10, 4);
+  m.cbRow = (3*m.w + 3) & ~3u;
+  m.xPels = readLE(hdr + 38, 4);
+  m.yPels = readLE(hdr + 42, 4);
+  if (hdr[0] != 'B' || hdr[1] != 'M' || readLE(hdr + 28, 2) != 24 || readLE(hdr + 30, 4) != 0 ||
+      int(m.w) <= 0 || m.h == 0 || m.offset < 54 || m.offset + uint64_t(m.h) * m.cbRow > m.cb) {
+    unmapBMP(m);
+    return false;
+  }
+  return true;
+}
+
+// Whether a and b name the same existing file.
+static bool sameFile(const char* a, const char* b)
+{
+  struct stat sa, sb;
+  return !stat(a, &sa) && !stat(b, &sb) && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+// Create nameOut as a 24-bit .bmp file, and map it for writing its rows.
+static bool mapBMPOut(const char* nameOut, unsigned w, unsigned h, unsigned xPels, unsigned yPels, MapBMP& m)
+{
+  m.w = w;
+  m.h = h;
+  m.offset = 54;
+  m.fTopDown = false;
+  m.cbRow = (3*w + 3) & ~3u;
+  m.xPels = xPels ? xPels : 3780;
+  m.yPels = yPels ? yPels : 3780;
+  const auto cb = m.offset + size_t(h) * m.cbRow;
+  const auto fd = open(nameOut, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0)
+    return false;
+  // ftruncate() zeroes the file, and thus the padding at the end of each row.
+  if (ftruncate(fd, cb) || !mapBMP(m, fd, cb, PROT_READ | PROT_WRITE)) {
+    close(fd);
+    return false;
+  }
+  writeHeaderBMP(m.p, w, h, m.cbRow, m.xPels, m.yPels);
+  return true;
+}
+
+// Unblock in.[bmp|png] to out.[bmp|png] with memory proportional to the width.
+static int unblockStream(const char* argv0, const char* nameIn, const char* nameOut, bool fBMP, int pngLevel, Stats* stats)
+{
+  const auto tStart = std::chrono::steady_clock::now();
+  Stream s;
+  s.fBMP = fBMP;
+  s.nameIn = nameIn;
+  s.lap = Lap(stats ? stats->seconds : NULL);
+  if (!openStreamIn(s)) {
+    printf("%s: failed to read %s.\n", argv0, nameIn);
+    closeStreamIn(s);
+    return 1;
+  }
+  const auto w = s.w;
+  const auto h = s.h;
+  s.fpOut = fopen(nameOut, "wb");
+  if (!s.fpOut) {
+    printf("%s: failed to write %s.\n", argv0, nameOut);
+    closeStreamIn(s);
+    return 1;
+  }
+  if (fBMP) {
+    u8 hdr[54];
+    writeHeaderBMP(hdr, w, h, s.cbRowBMP);
+    fwrite(hdr, 1, sizeof hdr, s.fpOut);
+  } else {
+    s.pPNGOut = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    s.pInfoPNGOut = png_create_info_struct(s.pPNGOut);
+    png_init_io(s.pPNGOut, s.fpOut);
+    // Rows are written one at a time, so there's no parallel encoding, just the level.
+    if (pngLevel >= 0)
+      png_set_compression_level(s.pPNGOut, pngLevel);
+    png_set_IHDR(s.pPNGOut, s.pInfoPNGOut, w, h, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(s.pPNGOut, s.pInfoPNGOut);
+  }
+  s.lap(phaseDecode);
+
+  // The window holds COSTELLA_UNBLOCK_STREAM_ROWS rows of each color plane.
+  const auto cb = w * COSTELLA_UNBLOCK_STREAM_ROWS;
+  std::vector<u8> bufY(cb), bufU(cb), bufV(cb);
+  COSTELLA_IMAGE im = {};
+  im.bAlpha = 0;
+  im.bRgb = 0;
+  im.udHeight = COSTELLA_UNBLOCK_STREAM_ROWS;
+  im.udWidth = w;
+  im.sdRowStride = w;
+  im.sdAlphaRowStride = 0;
+  im.sdChrominanceRowStride = 0;
+  im.bColor = im.bDownsampledChrominance = im.bNonreplicatedDownsampledChrominance = 1;
+  im.ic.aubRY = bufY.data();
+  im.ic.aubGCb = bufU.data();
+  im.ic.aubBCr = bufV.data();
+
+  const auto fPhoto = 0; // As in unblockFile().
+  double secondsCallbacks = 0.0;
+  if (stats)
+    for (auto t: stats->seconds)
+      secondsCallbacks -= t;
+  const auto t0 = std::chrono::steady_clock::now();
+  const auto ok = costella_unblock_stream(&im, h, fPhoto, 0, readStreamRows, writeStreamRows, &s, stats ? &stats->lib : NULL, stdout);
+  if (!ok)
+    printf("%s: costella_unblock_stream() failed.\n", argv0);
+  if (stats) {
+    for (auto t: stats->seconds)
+      secondsCallbacks += t;
+    stats->secondsUnblock = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() - secondsCallbacks;
+    stats->addLib();
+  }
+
+  s.lap.start();
+  closeStreamIn(s);
+  if (!fBMP) {
+    if (ok)
+      png_write_end(s.pPNGOut, NULL);
+    png_destroy_write_struct(&s.pPNGOut, &s.pInfoPNGOut);
+  }
+  fclose(s.fpOut);
+  s.lap(phaseEncode);
+  if (stats && ok)
+    printStats(nameIn, w, h, 1, 1, *stats, std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count());
+  return ok ? 0 : 1;
+}
+
+// Each thread keeps one unblock context, so its scratch memory is reused from image to image.
+static costella_unblock_context* threadContext()
+{
+  struct Holder {
+    costella_unblock_context* p = NULL;
+    ~Holder() { costella_unblock_context_destroy(&p, NULL); }
+  };
+  thread_local Holder h;
+  if (!h.p)
+    costella_unblock_context_create(&h.p, NULL, NULL, stderr);
+  return h.p;
+}
+
+// YUV4MPEG2 mode: unblock each frame of a .y4m video.
+// The Y, Cb and Cr planes go straight into the COSTELLA_IMAGE, with no RGB step.
+// Each worker reads a frame, unblocks it, and then waits its turn to write it,
+// so several frames are in flight at once but the output keeps their order.
+// A truncated input still has every complete frame before it written.
+struct Y4M {
+  FILE* fpIn;
+  FILE* fpOut;
+  unsigned w, h;
+  bool f420; // Otherwise 4:4:4.
+  // Guarded by mutexIn.  Once fEnd is set, iFrameIn is the number of complete frames.
+  std::mutex mutexIn;
+  unsigned long iFrameIn = 0;
+  bool fEnd = false, fTruncated = false;
+  // Guarded by mutexOut, and set while holding it, but also read by readers to stop early.
+  std::mutex mutexOut;
+  std::condition_variable cvOut;
+  unsigned long iFrameOut = 0;
+  std::atomic<bool> fFailOut{false}; // Unblocking or writing failed, so no later frame can be written.
+  // For --stats, guarded by mutexStats: the phases of every worker,
+  // and when the first frame's unblocking began and the last one's ended.
+  Stats* stats = NULL;
+  std::mutex mutexStats;
+  std::chrono::steady_clock::time_point tUnblockFirst = std::chrono::steady_clock::time_point::max();
+  std::chrono::steady_clock::time_point tUnblockLast = std::chrono::steady_clock::time_point::min();
+};
+
+// Read a header line, without its '\n'.
+static bool readY4MLine(FILE* fp, std::string& line)
+{
+  line.clear();
+  for (int c; (c = getc(fp)) != '\n'; ) {
+    if (c == EOF || line.size() > 4096)
+      return false;
+    line += char(c);
+  }
+  return true;
+}
+
+// Read, unblock and write frames until the stream ends or fails.
+// With stats, time the reading and writing, and the span of the unblocking.
+static void y4mFrames(Y4M& v, const char* argv0, Stats* stats,
+  std::chrono::steady_clock::time_point& tUnblockFirst, std::chrono::steady_clock::time_point& tUnblockLast)
+{
+  Lap lap(stats ? stats->seconds : NULL);
+  const auto cb = size_t(v.w) * v.h;
+  // A 4:2:0 frame fills quarter-size chroma planes directly, a 4:4:4 frame full-size ones.
+  const auto wC = (v.w + 1) / 2;
+  const auto cbC = v.f420 ? size_t(wC) * ((v.h + 1) / 2) : cb;
+  std::vector<u8> bufY(cb), bufU(cbC), bufV(cbC);
+  std::vector<u8>* planes[2] = {&bufU, &bufV};
+
+  // A 4:2:0 frame is one color image with quarter-size chroma.
+  // The planes of a 4:4:4 frame are three grayscale images, each in blocks of 8x8 pixels,
+  // so that the chroma keeps its full resolution.
+  std::vector<COSTELLA_IMAGE> images(v.f420 ? 1 : 3);
+  for (auto& im: images) {
+    im = COSTELLA_IMAGE();
+    im.bAlpha = 0;
+    im.bRgb = 0;
+    im.udHeight = v.h;
+    im.udWidth = v.w;
+    im.sdRowStride = v.w;
+    im.sdAlphaRowStride = 0;
+  }
+  if (v.f420) {
+    auto& im = images[0];
+    im.sdChrominanceRowStride = wC;
+    im.bColor = im.bDownsampledChrominance = im.bNonreplicatedDownsampledChrominance = 1;
+    im.ic.aubRY = bufY.data();
+    im.ic.aubGCb = bufU.data();
+    im.ic.aubBCr = bufV.data();
+  } else {
+    images[0].ig = bufY.data();
+    images[1].ig = bufU.data();
+    images[2].ig = bufV.data();
+  }
+
+  std::string frame;
+  for (;;) {
+    unsigned long iFrame;
+    {
+      std::lock_guard<std::mutex> lock(v.mutexIn);
+      if (v.fEnd || v.fFailOut)
+        return;
+      lap.start();
+      if (!readY4MLine(v.fpIn, frame)) {
+        if (!frame.empty() || !feof(v.fpIn)) {
+          fprintf(stderr, "%s: truncated y4m frame header.\n", argv0);
+          v.fTruncated = true;
+        }
+        v.fEnd = true;
+        return;
+      }
+      bool ok = frame.compare(0, 5, "FRAME") == 0 && fread(bufY.data(), 1, cb, v.fpIn) == cb;
+      for (auto plane: planes)
+        ok = ok && fread(plane->data(), 1, cbC, v.fpIn) == cbC;
+      if (!ok) {
+        fprintf(stderr, "%s: truncated y4m frame %lu.\n", argv0, v.iFrameIn);
+        v.fTruncated = v.fEnd = true;
+        return;
+      }
+      iFrame = v.iFrameIn++;
+      lap(phaseDecode);
+    }
+
+    const auto fPhoto = 0; // As in unblockFile().
+    const auto ctx = threadContext();
+    auto ok = ctx != NULL;
+    // A 4:2:0 frame's quarter-size chroma needs costella_unblock_quarter().
+    const auto unblock = v.f420 ? costella_unblock_quarter : costella_unblock_ctx;
+    if (stats)
+      tUnblockFirst = std::min(tUnblockFirst, std::chrono::steady_clock::now());
+    for (auto& im: images)
+      ok = ok && unblock(ctx, &im, &im, fPhoto, 0, 1, NULL, NULL, stderr);
+    if (stats)
+      tUnblockLast = std::chrono::steady_clock::now();
+    if (!ok)
+      fprintf(stderr, "%s: costella_unblock() failed on frame %lu.\n", argv0, iFrame);
+
+    std::unique_lock<std::mutex> lock(v.mutexOut);
+    v.cvOut.wait(lock, [&] { return v.iFrameOut == iFrame || v.fFailOut; });
+    if (v.fFailOut)
+      return;
+    lap.start();
+    ok = ok && fprintf(v.fpOut, "%s\n", frame.c_str()) > 0 && fwrite(bufY.data(), 1, cb, v.fpOut) == cb;
+    for (auto plane: planes)
+      ok = ok && fwrite(plane->data(), 1, cbC, v.fpOut) == cbC;
+    lap(phaseEncode);
+    if (!ok)
+      v.fFailOut = true;
+    ++v.iFrameOut;
+    v.cvOut.notify_all();
+  }
+}
+
+static void y4mWorker(Y4M& v, const char* argv0)
+{
+  auto tUnblockFirst = std::chrono::steady_clock::time_point::max();
+  auto tUnblockLast = std::chrono::steady_clock::time_point::min();
+  if (!v.stats) {
+    y4mFrames(v, argv0, NULL, tUnblockFirst, tUnblockLast);
+    return;
+  }
+  // This thread's context adds to this thread's stats, which are then added to the stream's.
+  Stats stats;
+  const auto ctx = threadContext();
+  if (ctx)
+    costella_unblock_context_stats(ctx, &stats.lib, stderr);
+  y4mFrames(v, argv0, &stats, tUnblockFirst, tUnblockLast);
+  if (ctx)
+    costella_unblock_context_stats(ctx, NULL, stderr);
+  std::lock_guard<std::mutex> lock(v.mutexStats);
+  v.stats->add(stats);
+  v.tUnblockFirst = std::min(v.tUnblockFirst, tUnblockFirst);
+  v.tUnblockLast = std::max(v.tUnblockLast, tUnblockLast);
+}
+
+// Unblock a .y4m video, cThread frames at a time.  "-" means stdin or stdout.
+// fStats prints the time of each phase, summed over the frames, as JSON.
+static int unblockY4M(const char* argv0, const char* nameIn, const char* nameOut, int cThread, bool fStats)
+{
+  const auto tStart = std::chrono::steady_clock::now();
+  Stats stats;
+  Y4M v;
+  if (fStats)
+    v.stats = &stats;
+  v.fpIn = strcmp(nameIn, "-") ? fopen(nameIn, "rb") : stdin;
+  if (!v.fpIn) {
+    fprintf(stderr, "%s: failed to read %s.\n", argv0, nameIn);
     return 1;
   }
-  const auto ext1 = filenameExtension(argv[1]);
-  const auto ext2 = filenameExtension(argv[2]);
+  std::string header;
+  if (!readY4MLine(v.fpIn, header) || header.compare(0, 10, "YUV4MPEG2 ")) {
+    fprintf(stderr, "%s: %s isn't a y4m stream.\n", argv0, nameIn);
+    return 1;
+  }
+  v.w = v.h = 0;
+  v.f420 = true; // The default colorspace.
+  size_t i = 9;
+  while ((i = header.find(' ', i)) != std::string::npos) {
+    const auto tag = header.substr(i + 1, header.find(' ', i + 1) - i - 1);
+    ++i;
+    if (tag.empty())
+      continue;
+    if (tag[0] == 'W')
+      v.w = atoi(tag.c_str() + 1);
+    else if (tag[0] == 'H')
+      v.h = atoi(tag.c_str() + 1);
+    else if (tag[0] == 'C') {
+      // Only the 8-bit colorspaces: C420p10, C444p12 and so on have 16-bit samples.
+      v.f420 = tag == "C420" || tag == "C420jpeg" || tag == "C420paldv" || tag == "C420mpeg2";
+      if (!v.f420 && tag != "C444") {
+        fprintf(stderr, "%s: y4m colorspace %s isn't 4:2:0 or 4:4:4.\n", argv0, tag.c_str() + 1);
+        return 1;
+      }
+    }
+  }
+  if (!v.w || !v.h) {
+    fprintf(stderr, "%s: y4m stream %s has no size.\n", argv0, nameIn);
+    return 1;
+  }
+  v.fpOut = strcmp(nameOut, "-") ? fopen(nameOut, "wb") : stdout;
+  if (!v.fpOut) {
+    fprintf(stderr, "%s: failed to write %s.\n", argv0, nameOut);
+    return 1;
+  }
+  fprintf(v.fpOut, "%s\n", header.c_str());
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < cThread; ++i)
+    threads.emplace_back(y4mWorker, std::ref(v), argv0);
+  y4mWorker(v, argv0);
+  for (auto& t: threads)
+    t.join();
+
+  if (v.fpIn != stdin)
+    fclose(v.fpIn);
+  const auto fFail = fflush(v.fpOut) || v.fTruncated || v.fFailOut;
+  if (v.fpOut != stdout)
+    fclose(v.fpOut);
+  if (fStats && !fFail) {
+    if (v.iFrameOut)
+      stats.secondsUnblock = std::chrono::duration<double>(v.tUnblockLast - v.tUnblockFirst).count();
+    stats.addLib();
+    printStats(nameIn, v.w, v.h, v.iFrameOut, cThread, stats, std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count());
+  }
+  return fFail ? 1 : 0;
+}
+
+static bool isImageName(const char* name)
+{
+  const auto ext = filenameExtension(name);
+  return ext == "bmp" || ext == "png";
+}
+
+// Parallel .png encoder, for --png-level.
+// Like pigz, it splits the filtered rows into chunks and deflates each chunk on its own,
+// ending all but the last with a sync flush so that they join into one zlib stream.
+// Each chunk is primed with the 32 KB of filtered rows before it, to keep the compression ratio.
+
+// Filter a row of RGB pixels with libpng's default heuristic:
+// of the five filters, choose the one whose output has the smallest sum of absolute values.
+static void filterRowPNG(const u8* prev, const u8* row, unsigned cb, u8* out, u8* trial)
+{
+  unsigned long sumBest = ~0ul;
+  for (u8 filter = 0; filter < 5; ++filter) {
+    // Separate loops, which the compiler can vectorize.
+    unsigned i;
+    switch (filter) {
+      case 0:
+        memcpy(trial, row, cb);
+        break;
+      case 1:
+        for (i = 0; i < cb; ++i)
+          trial[i] = row[i] - (i >= 3 ? row[i-3] : 0);
+        break;
+      case 2:
+        for (i = 0; i < cb; ++i)
+          trial[i] = row[i] - prev[i];
+        break;
+      case 3:
+        for (i = 0; i < cb; ++i)
+          trial[i] = row[i] - ((i >= 3 ? row[i-3] : 0) + prev[i]) / 2;
+        break;
+      case 4:
+        for (i = 0; i < cb; ++i) {
+          const int a = i >= 3 ? row[i-3] : 0;
+          const int b = prev[i];
+          const int c = i >= 3 ? prev[i-3] : 0;
+          const int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2*c);
+          trial[i] = row[i] - (pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+        }
+        break;
+    }
+    unsigned long sum = 0;
+    for (i = 0; i < cb; ++i)
+      sum += trial[i] < 128 ? trial[i] : 256 - trial[i];
+    if (sum < sumBest) {
+      sumBest = sum;
+      out[0] = filter;
+      memcpy(out + 1, trial, cb);
+    }
+  }
+}
+
+static void putBE(std::vector<u8>& v, uint32_t u)
+{
+  for (int i = 24; i >= 0; i -= 8)
+    v.push_back(u8(u >> i));
+}
+
+static bool writeChunkPNG(FILE* fp, const char* type, const std::vector<u8>& data)
+{
+  std::vector<u8> v;
+  putBE(v, data.size());
+  v.insert(v.end(), type, type + 4);
+  auto crc = crc32(crc32(0, NULL, 0), (const u8*)type, 4);
+  if (!data.empty()) // crc32() of NULL is 0.
+    crc = crc32(crc, data.data(), data.size());
+  std::vector<u8> t;
+  putBE(t, crc);
+  return fwrite(v.data(), 1, v.size(), fp) == v.size() &&
+    fwrite(data.data(), 1, data.size(), fp) == data.size() &&
+    fwrite(t.data(), 1, t.size(), fp) == t.size();
+}
+
+// Write a w by h RGB .png to fp, getting row y from getRow(y, rgb).
+// getRow is called from cThread threads at once.
+static bool writePNGParallel(FILE* fp, unsigned w, unsigned h, int level, int cThread, const std::function<bool(unsigned, u8*)>& getRow)
+{
+  const unsigned cbRow = 3*w;
+  const unsigned cbLine = cbRow + 1; // With the filter byte.
+  const unsigned cbWindow = 32768;
+  const auto cRowChunk = std::max(1u, (1u << 18) / cbLine);
+  const auto cRowWindow = (cbWindow + cbLine - 1) / cbLine;
+  const auto cChunk = (h + cRowChunk - 1) / cRowChunk;
+  struct Chunk {
+    std::vector<u8> z;
+    uLong adler;
+    bool ok = false;
+  };
+  std::vector<Chunk> chunks(cChunk);
+  std::atomic<unsigned> iNext(0);
+  const auto worker = [&]() {
+    std::vector<u8> prev, row(cbRow), trial(cbRow), filtered;
+    for (unsigned k; (k = iNext++) < cChunk; ) {
+      auto& chunk = chunks[k];
+      const auto y0 = k * cRowChunk;
+      const auto y1 = std::min(h, y0 + cRowChunk);
+      const auto yWindow = y0 - std::min(y0, cRowWindow);
+      prev.assign(cbRow, 0);
+      if (yWindow > 0 && !getRow(yWindow - 1, prev.data()))
+        continue;
+      filtered.resize(size_t(y1 - yWindow) * cbLine);
+      auto fRows = true;
+      for (auto y = yWindow; y < y1 && fRows; ++y) {
+        fRows = getRow(y, row.data());
+        filterRowPNG(prev.data(), row.data(), cbRow, filtered.data() + size_t(y - yWindow) * cbLine, trial.data());
+        std::swap(prev, row);
+      }
+      if (!fRows)
+        continue;
+      const auto pIn = filtered.data() + size_t(y0 - yWindow) * cbLine;
+      const auto cbIn = size_t(y1 - y0) * cbLine;
+      chunk.adler = adler32(adler32(0, NULL, 0), pIn, cbIn);
+      z_stream z = {};
+      if (deflateInit2(&z, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        continue;
+      const auto cbDict = std::min<size_t>(pIn - filtered.data(), cbWindow);
+      if (cbDict)
+        deflateSetDictionary(&z, pIn - cbDict, cbDict);
+      chunk.z.resize(deflateBound(&z, cbIn) + 16);
+      z.next_in = pIn;
+      z.avail_in = cbIn;
+      z.next_out = chunk.z.data();
+      z.avail_out = chunk.z.size();
+      const auto flush = k + 1 < cChunk ? Z_SYNC_FLUSH : Z_FINISH;
+      int err;
+      while ((err = deflate(&z, flush)) == Z_OK && z.avail_out == 0) {
+        const auto cb = chunk.z.size();
+        chunk.z.resize(2 * cb);
+        z.next_out = chunk.z.data() + cb;
+        z.avail_out = cb;
+      }
+      chunk.z.resize(z.total_out);
+      chunk.ok = flush == Z_FINISH ? err == Z_STREAM_END : err == Z_OK;
+      deflateEnd(&z);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < cThread && unsigned(i) < cChunk; ++i)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& t: threads)
+    t.join();
+
+  // The zlib stream is a 2-byte header, the chunks, and the Adler-32 of all the filtered rows.
+  const u8 flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+  const u8 cmf = 0x78;
+  u8 flg = flevel << 6;
+  flg += (31 - (cmf * 256 + flg) % 31) % 31;
+  auto adler = adler32(0, NULL, 0);
+  for (unsigned k = 0; k < cChunk; ++k) {
+    if (!chunks[k].ok)
+      return false;
+    adler = adler32_combine(adler, chunks[k].adler, size_t(std::min(h, (k + 1) * cRowChunk) - k * cRowChunk) * cbLine);
+  }
+  chunks.front().z.insert(chunks.front().z.begin(), {cmf, flg});
+  putBE(chunks.back().z, adler);
+
+  // No other chunks, as in unblockFile().
+  std::vector<u8> ihdr;
+  putBE(ihdr, w);
+  putBE(ihdr, h);
+  ihdr.insert(ihdr.end(), {8, PNG_COLOR_TYPE_RGB, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT, PNG_INTERLACE_NONE});
+  static const u8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  auto ok = fwrite(signature, 1, sizeof signature, fp) == sizeof signature && writeChunkPNG(fp, "IHDR", ihdr);
+  for (unsigned k = 0; k < cChunk && ok; ++k)
+    ok = writeChunkPNG(fp, "IDAT", chunks[k].z);
+  return ok && writeChunkPNG(fp, "IEND", {});
+}
+
+// Unblock in.[bmp|png] to out.[bmp|png].  Returns 0 on success.
+// pngLevel is -1 for libpng's default compression.
+// fStats prints the time of each phase as JSON.
+static int unblockFile(const char* argv0, const char* nameIn, const char* nameOut, int cThread, bool fStream, int pngLevel, bool fStats)
+{
+  const auto tStart = std::chrono::steady_clock::now();
+  Stats stats;
+  Lap lap(fStats ? stats.seconds : NULL);
+  const auto ext1 = filenameExtension(nameIn);
+  const auto ext2 = filenameExtension(nameOut);
   const bool fBMP = ext1 == "bmp";
-  const bool fPNG = ext1 == "png";
-  if (!fBMP && !fPNG)
-    goto LUsage;
+  if (!isImageName(nameIn)) {
+    printf("%s: %s is neither .bmp nor .png.\n", argv0, nameIn);
+    return 1;
+  }
   if (ext2 != ext1)
-    printf("%s: warning: filenames %s and %s have different extensions.\nFile %s will get the same format as %s.\n", argv[0], argv[1], argv[2], argv[2], argv[1]);
+    printf("%s: warning: filenames %s and %s have different extensions.\nFile %s will get the same format as %s.\n", argv0, nameIn, nameOut, nameOut, nameIn);
+  if (fStream)
+    return unblockStream(argv0, nameIn, nameOut, fBMP, pngLevel, fStats ? &stats : NULL);
 
-  FILE *fp;
+  FILE *fp = NULL;
   unsigned w, h;
+  MapBMP mapIn, mapOut;
+  // If nameOut is nameIn, a mapped .bmp file is unblocked in place.
+  const auto fInPlace = fBMP && sameFile(nameIn, nameOut);
+  const auto fMap = fBMP && mapBMPIn(nameIn, mapIn, fInPlace);
   BMP bmp;
-  png_bytep *pRows = NULL;
+  png_structp pPNG = NULL;
+  png_infop pInfoPNG = NULL;
+  png_bytep *pRows = NULL; // Only for an interlaced .png.
+  png_bytep pixels = NULL; // All of pRows, one after another.
+  size_t cbRowPNG = 0;
 
-  if (fBMP) {
-    bmp.ReadFromFile(argv[1]);
+  if (fMap) {
+    w = mapIn.w;
+    h = mapIn.h;
+  } else if (fBMP) {
+    if (!bmp.ReadFromFile(nameIn)) {
+      printf("%s: failed to read %s.\n", argv0, nameIn);
+      return 1;
+    }
     w = bmp.TellWidth();
     h = bmp.TellHeight();
   } else {
-    fp = fopen(argv[1], "rb");
-    auto pPNG = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    auto pInfoPNG = png_create_info_struct(pPNG);
+    fp = fopen(nameIn, "rb");
+    if (!fp) {
+      printf("%s: failed to read %s.\n", argv0, nameIn);
+      return 1;
+    }
+    pPNG = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    pInfoPNG = png_create_info_struct(pPNG);
     png_init_io(pPNG, fp);
     png_read_info(pPNG, pInfoPNG);
     if (png_get_color_type(pPNG, pInfoPNG) != PNG_COLOR_TYPE_RGB) {
       // Alpha, grayscale, and palette formats wouldn't have come from a JPG.
-      printf("%s: png file %s isn't in RGB format.\n", argv[0], argv[1]);
+      printf("%s: png file %s isn't in RGB format.\n", argv0, nameIn);
+      fclose(fp);
+      png_destroy_read_struct(&pPNG, &pInfoPNG, NULL);
       return 1;
     }
     // Transform 16 bit to 8 bit.
@@ -90,48 +989,61 @@ LUsage:
     }
     w = png_get_image_width(pPNG, pInfoPNG);
     h = png_get_image_height(pPNG, pInfoPNG);
-    pRows = new png_bytep[h];
-    const auto cb = png_get_rowbytes(pPNG, pInfoPNG);
-    for (unsigned y = 0u; y < h; ++y)
-      pRows[y] = new png_byte[cb];
-    png_read_image(pPNG, pRows);
-    fclose(fp);
-    png_destroy_read_struct(&pPNG, &pInfoPNG, NULL);
+    // The rows of an interlaced image arrive over several passes, so read it whole,
+    // into one array that the library unblocks in place.
+    // Otherwise each row is converted as soon as it's decoded.
+    if (png_get_interlace_type(pPNG, pInfoPNG) != PNG_INTERLACE_NONE) {
+      pRows = new png_bytep[h];
+      cbRowPNG = png_get_rowbytes(pPNG, pInfoPNG);
+      pixels = new png_byte[h * cbRowPNG];
+      for (unsigned y = 0u; y < h; ++y)
+        pRows[y] = pixels + y * cbRowPNG;
+      png_read_image(pPNG, pRows);
+    }
   }
 
-  // Convert bmp.rgb_data or pRows to YUV color planes.
+  // A whole image of interleaved pixels, from a mapped .bmp file or an interlaced .png file,
+  // is converted and unblocked by the library, in place or into mapOut.
+  const bool fWhole = fMap || pRows;
+
+  // Otherwise, convert bmp or the .png file, a row at a time, to YUV color planes.
   // On the heap, because even a 3 megapixel image overflows the stack.
+  // The chroma planes are quarter size, taken from the even pixels.
   const auto cb = w * h;
-  auto bufY = new u8[cb];
-  auto bufU = new u8[cb];
-  auto bufV = new u8[cb];
-  unsigned y, x;
-  auto i = 0;
-  for (y = 0u; y < h; ++y) {
-    for (x = 0u; x < w; ++x,++i) {
-      double R,G,B;
-      if (fBMP) {
-	const auto rgb = bmp(x,y);
-	R = rgb->Red;
-	G = rgb->Green;
-	B = rgb->Blue;
-      } else {
-	const auto rgb = pRows[y] + 3*x;
-	R = rgb[0];
-	G = rgb[1];
-	B = rgb[2];
-      }
-      YUVfromRGB(bufY[i],bufU[i],bufV[i], R,G,B);
-    }
+  const auto wC = (w + 1) / 2;
+  const auto cbC = wC * ((h + 1) / 2);
+  u8* bufY = fWhole ? NULL : new u8[cb];
+  u8* bufU = fWhole ? NULL : new u8[cbC];
+  u8* bufV = fWhole ? NULL : new u8[cbC];
+  std::vector<u8> row(fWhole ? 0 : 3*w), scratch(fWhole ? 0 : 2*w);
+  auto fConverted = true;
+  unsigned y;
+  lap(phaseDecode);
+  for (y = 0u; y < h && !fWhole; ++y) {
+    auto rgb = row.data();
+    if (fBMP) {
+      // Pack each row of EasyBMP's RGBA pixels in BGR order.
+      bmp.GetRow24(y, rgb);
+    } else
+      png_read_row(pPNG, rgb, NULL);
+    lap(phaseDecode);
+    const auto iC = (y/2)*wC;
+    fConverted = rowToYUV(rgb, w, fBMP, bufY + y*w, y % 2 ? NULL : bufU + iC, bufV + iC, scratch.data(), &lap) && fConverted;
   }
+  if (pPNG) {
+    fclose(fp);
+    png_destroy_read_struct(&pPNG, &pInfoPNG, NULL);
+  }
+  lap(phaseDecode);
 
-  COSTELLA_IMAGE im;
+  COSTELLA_IMAGE im = {};
   im.bAlpha = 0;
   im.bRgb = 0;
   im.udHeight = h;
   im.udWidth = w; // may fail if not a multiple of 16
   im.sdRowStride = w; // maybe something about bufPitch, width bumped up to multiple of 16.
   im.sdAlphaRowStride = 0;
+  im.sdChrominanceRowStride = wC;
 #if 0
   // Unblock only luma (bufY).
   im.bColor = im.bDownsampledChrominance = im.bNonreplicatedDownsampledChrominance = 0;
@@ -144,55 +1056,256 @@ LUsage:
   im.ic.aubBCr = bufV;
 #endif
 
-  costella_unblock_initialize(stdout);
   const auto fPhoto = 0; // API docs suggest 1, but that boosts ringing of high-contrast detail (timestamps, windows of buildings).
   // (Internal mucking about, in costella_unblock.c bConservativePhotographic tweaking udCumMeasuredConservative,
   // had either no effect or caused a segfault.)
-  if (!costella_unblock(&im, &im, fPhoto, 0, NULL, NULL, 0))
-    printf("%s: costella_unblock() failed.\n", argv[0]);
-  costella_unblock_finalize(stdout);
-
-  // Convert bufY, bufU, bufV back into a bmp.
-  // (Or, set im.bRgb=1 to avoid this conversion?  That sets bOutYCbCr in CostellaUnblock(),
-  // which causes calls to CostellaImageConvertRgbToYcbcr() and CostellaImageConvertYcbcrToRgb().
-  // Those call macros like COSTELLA_IMAGE_CONVERT_RGB_TO_YCBCR(),
-  // which lookup tables like gasdCostellaImageConvertRCb[] for Red to Cb.)
-  i = 0;
-  for (y = 0u; y < h; ++y) {
-    for (x = 0u; x < w; ++x,++i) {
-      u8 R,G,B;
-      RGBfromYUV(R,G,B, bufY[i],bufU[i],bufV[i]);
-      if (fBMP) {
-	auto rgb = bmp(x,y);
-	rgb->Red   = R;
-	rgb->Green = G;
-	rgb->Blue  = B;
-      } else {
-	auto rgb = pRows[y] + 3*x;
-	rgb[0] = R;
-	rgb[1] = G;
-	rgb[2] = B;
-      }
-    }
+  const auto ctx = threadContext();
+  if (ctx)
+    costella_unblock_context_stats(ctx, fStats ? &stats.lib : NULL, stderr);
+  auto fOpen = true;
+  if (fMap && !fInPlace) {
+    fOpen = mapBMPOut(nameOut, w, h, mapIn.xPels, mapIn.yPels, mapOut);
+    lap(phaseEncode);
   }
-  if (fBMP) {
-    bmp.WriteToFile(argv[2]);
-  } else {
-    fp = fopen(argv[2], "wb");
-    auto pPNG = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    auto pInfoPNG = png_create_info_struct(pPNG);
+  const auto tUnblock = std::chrono::steady_clock::now();
+  auto ok = fConverted && ctx;
+  if (!fWhole)
+    // Only costella_unblock_quarter() reads the quarter-size bufU and bufV.
+    ok = ok && (im.bColor ? costella_unblock_quarter : costella_unblock_ctx)(ctx, &im, &im, fPhoto, 0, cThread, NULL, NULL, 0);
+  else if (fMap && fOpen)
+    ok = ok && costella_unblock_interleaved(ctx, mapIn.row(0), mapIn.stride(), fInPlace ? mapIn.row(0) : mapOut.row(0),
+      fInPlace ? mapIn.stride() : mapOut.stride(), w, h, true, fPhoto, 0, cThread, NULL, NULL, 0);
+  else if (pRows)
+    ok = ok && costella_unblock_interleaved(ctx, pixels, cbRowPNG, pixels, cbRowPNG, w, h, false, fPhoto, 0, cThread, NULL, NULL, 0);
+  if (!ok && fOpen)
+    printf("%s: costella_unblock() failed.\n", argv0);
+  if (fStats) {
+    stats.secondsUnblock = std::chrono::duration<double>(std::chrono::steady_clock::now() - tUnblock).count();
+    stats.addLib();
+  }
+  lap.start();
+
+  // A mapped .bmp file is finished.  Otherwise convert bufY, bufU, bufV,
+  // or copy pRows, back into bmp or the .png file, a row at a time.
+  unmapBMP(mapIn);
+  unmapBMP(mapOut);
+  // With --png-level, the .png encoder's threads convert the rows themselves.
+  const auto fParallelPNG = !fBMP && pngLevel >= 0;
+  if (!fBMP && (fOpen = (fp = fopen(nameOut, "wb")) != NULL) && !fParallelPNG) {
+    pPNG = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    pInfoPNG = png_create_info_struct(pPNG);
     png_init_io(pPNG, fp);
     png_set_IHDR(pPNG, pInfoPNG, w, h, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
     // Don't call png_set_tIME, so no tIME chunk is written, no %tEXtdate:create, %tEXtdate:modify, gAMA, cHRM, bKGD.
     // Then the output has no timestamp, so it can be diffed against a known-good test output.
     png_write_info(pPNG, pInfoPNG);
-    png_write_image(pPNG, pRows);
+  }
+  if (!fOpen) {
+    printf("%s: failed to write %s.\n", argv0, nameOut);
+    ok = 0;
+  }
+  lap(phaseEncode);
+  for (y = 0u; y < h && fOpen && !fMap && !fParallelPNG; ++y) {
+    auto rgb = pRows ? pRows[y] : row.data();
+    if (!pRows) {
+      const auto iC = (y/2)*wC;
+      ok = rowFromYUV(bufY + y*w, bufU + iC, bufV + iC, w, fBMP, rgb, scratch.data(), &lap) && ok;
+    }
+    if (!fBMP)
+      png_write_row(pPNG, rgb);
+    else
+      bmp.SetRow24(y, rgb);
+    lap(phaseEncode);
+  }
+  if (fBMP) {
+    if (!fMap)
+      ok = bmp.WriteToFile(nameOut) && ok;
+  } else if (fOpen && fParallelPNG) {
+    // The encoder's threads convert the rows too, so that's counted as encoding.
+    const auto getRow = [&](unsigned y, u8* rgb) {
+      if (pRows) {
+        memcpy(rgb, pRows[y], 3*w);
+        return true;
+      }
+      thread_local std::vector<u8> scratchRow;
+      scratchRow.resize(2*w);
+      const auto iC = (y/2)*wC;
+      return rowFromYUV(bufY + y*w, bufU + iC, bufV + iC, w, false, rgb, scratchRow.data());
+    };
+    ok = writePNGParallel(fp, w, h, pngLevel, cThread, getRow) && ok;
+    ok = fclose(fp) == 0 && ok;
+  } else if (fOpen) {
     png_write_end(pPNG, NULL);
     fclose(fp);
     png_destroy_write_struct(&pPNG, &pInfoPNG);
   }
+  lap(phaseEncode);
   delete [] bufY;
   delete [] bufU;
   delete [] bufV;
-  return 0;
+  delete [] pRows;
+  delete [] pixels;
+  if (fStats && ok)
+    printStats(nameIn, w, h, 1, cThread, stats, std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count());
+  return ok ? 0 : 1;
+}
+
+
+// Batch mode: unblock many files in one process, cThread files at a time.
+// Each worker decodes, unblocks and encodes a whole file,
+// so the stages of different files overlap.
+static int unblockBatch(const char* argv0, const std::vector<std::pair<std::string, std::string>>& files, int cThread, bool fStream, int pngLevel, bool fStats)
+{
+  std::atomic<size_t> iNext(0);
+  std::atomic<unsigned> cFail(0);
+  const auto worker = [&]() {
+    for (size_t i; (i = iNext++) < files.size(); )
+      if (unblockFile(argv0, files[i].first.c_str(), files[i].second.c_str(), 1, fStream, pngLevel, fStats))
+        ++cFail;
+  };
+  const auto t0 = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 1; i < cThread && size_t(i) < files.size(); ++i)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& t: threads)
+    t.join();
+  const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+  const auto cDone = files.size() - cFail;
+  printf("%s: %zu of %zu frames in %.2f s, %.1f frames/s.\n", argv0, cDone, files.size(), dt.count(), dt.count() > 0.0 ? cDone / dt.count() : 0.0);
+  return cFail ? 1 : 0;
+}
+
+// Split a line of a --batch list into its two filenames.
+// They are separated by a tab if the line has one, so that names may contain spaces,
+// and otherwise by spaces.  Blank lines are skipped.  Returns false for any other number of fields.
+static bool splitBatchLine(std::string line, std::string& nameIn, std::string& nameOut)
+{
+  if (!line.empty() && line.back() == '\r')
+    line.pop_back();
+  const char* sep = line.find('\t') != std::string::npos ? "\t" : " ";
+  std::vector<std::string> fields;
+  for (size_t i = 0; i <= line.size(); ) {
+    const auto j = std::min(line.find(sep, i), line.size());
+    if (j > i)
+      fields.push_back(line.substr(i, j - i));
+    i = j + 1;
+  }
+  if (fields.empty()) {
+    nameIn.clear();
+    return true;
+  }
+  if (fields.size() != 2)
+    return false;
+  nameIn = fields[0];
+  nameOut = fields[1];
+  return true;
+}
+
+// The pairs of filenames for --batch: either each line of a list file holds "in out",
+// or every .bmp and .png in a directory goes to the same name in another directory.
+static bool batchFiles(const char* argv0, int argc, char** argv, std::vector<std::pair<std::string, std::string>>& files)
+{
+  namespace fs = std::filesystem;
+  if (argc == 2) {
+    std::ifstream list(argv[1]);
+    if (!list) {
+      printf("%s: failed to read %s.\n", argv0, argv[1]);
+      return false;
+    }
+    std::string line, nameIn, nameOut;
+    for (unsigned long iLine = 1; std::getline(list, line); ++iLine) {
+      if (!splitBatchLine(line, nameIn, nameOut)) {
+        printf("%s: line %lu of %s isn't a pair of filenames.\n", argv0, iLine, argv[1]);
+        return false;
+      }
+      if (!nameIn.empty())
+        files.emplace_back(nameIn, nameOut);
+    }
+    if (list.bad()) {
+      printf("%s: failed to read %s.\n", argv0, argv[1]);
+      return false;
+    }
+    return true;
+  }
+  std::error_code ec;
+  fs::create_directories(argv[2], ec);
+  for (const auto& entry: fs::directory_iterator(argv[1], ec))
+    if (entry.is_regular_file() && isImageName(entry.path().c_str()))
+      files.emplace_back(entry.path().string(), (fs::path(argv[2]) / entry.path().filename()).string());
+  if (ec) {
+    printf("%s: failed to read directory %s.\n", argv0, argv[1]);
+    return false;
+  }
+  std::sort(files.begin(), files.end());
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  // Threads for the vertical passes, or files or frames at a time for --batch or --y4m.
+  // Any count gives the same output.
+  int cThread = 0;
+  bool fStream = false;
+  bool fBatch = false;
+  bool fY4M = false;
+  bool fStats = false;
+  int pngLevel = -1;
+  const char* argv0 = argv[0];
+  while (argc > 1 && argv[1][0] == '-' && argv[1][1] == '-') {
+    if (!strcmp(argv[1], "--threads") && argc > 2) {
+      cThread = atoi(argv[2]);
+      if (cThread < 1)
+        goto LUsage;
+      argc -= 2;
+      argv += 2;
+    } else if (!strcmp(argv[1], "--png-level") && argc > 2) {
+      pngLevel = atoi(argv[2]);
+      if (pngLevel < 0 || pngLevel > 9 || !isdigit(argv[2][0]))
+        goto LUsage;
+      argc -= 2;
+      argv += 2;
+    } else if (!strcmp(argv[1], "--stats") && argc > 2 && !strcmp(argv[2], "json")) {
+      fStats = true;
+      argc -= 2;
+      argv += 2;
+    } else if (!strcmp(argv[1], "--stream")) {
+      fStream = true;
+      --argc;
+      ++argv;
+    } else if (!strcmp(argv[1], "--batch")) {
+      fBatch = true;
+      --argc;
+      ++argv;
+    } else if (!strcmp(argv[1], "--y4m")) {
+      fY4M = true;
+      --argc;
+      ++argv;
+    } else
+      goto LUsage;
+  }
+  if ((fBatch ? argc != 2 && argc != 3 : argc != 3 || (!fY4M && !isImageName(argv[1])))) {
+LUsage:
+    printf("usage: %s [--threads N | --stream] [--png-level 0-9] [--stats json] in.[bmp|png] out.[bmp|png]\n", argv0);
+    printf("       %s --batch [--threads N] [--stream] [--png-level 0-9] [--stats json] list.txt|indir outdir\n", argv0);
+    printf("       %s --y4m [--threads N] [--stats json] in.y4m|- out.y4m|-\n", argv0);
+    return 1;
+  }
+
+  std::vector<std::pair<std::string, std::string>> files;
+  if (fBatch && !batchFiles(argv0, argc, argv, files))
+    return 1;
+  // Keep stdout clean for a y4m stream.
+  const auto fileMsg = fY4M ? stderr : stdout;
+  costella_unblock_initialize(fileMsg);
+  const auto cCore = std::max(1u, std::thread::hardware_concurrency());
+  int ret;
+  if (fBatch)
+    ret = unblockBatch(argv0, files, cThread ? cThread : cCore, fStream, pngLevel, fStats);
+  else if (fY4M)
+    ret = unblockY4M(argv0, argv[1], argv[2], cThread ? cThread : cCore, fStats);
+  else
+    ret = unblockFile(argv0, argv[1], argv[2], cThread ? cThread : 1, fStream, pngLevel, fStats);
+  costella_unblock_finalize(fileMsg);
+  return ret;
 }
@@ -0,0 +1,1246 @@
+/* Copyright (c) 2026 The unblock authors.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a
+** copy of this software and associated documentation files (the "Software")
+** to deal in the Software without restriction, including without limitation
+** the rights to use, copy, modify, merge, publish, distribute, sublicense,
+** and/or sell copies of the Software, and to permit persons to whom the
+** Software is furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included
+** in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT, OR OTHERWISE, ARISING
+** FROM, OUT OF, OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+** DEALINGS IN THE SOFTWARE.
+**
+**
+** test/kernels.c:
+**
+**   Check every variant of the per-pixel kernels of the UnBlock algorithm
+**   and of the color conversion against an oracle, then time each variant.
+**
+**   The oracle is written from the formulas themselves, with plain
+**   arithmetic and no lookup tables, so it does not share the reference
+**   code's mistakes. The variants are the reference ANSI C code and the
+**   code of every instruction set tier the processor supports, each
+**   chosen in turn with CostellaCpuSetTier(). The inputs are every
+**   combination of values near the ends of the range, for each of the
+**   6-, 5- and 4-pixel cases that the -1 sentinels select, plus many
+**   random ones; the color conversion is checked for every pixel value.
+**
+**   With no arguments, check and then time. With --check, only check.
+**
+**   This version: October 18, 2026.
+**
+**   Written in ANSI C, plus POSIX clock_gettime.
+*/
+
+
+
+/* Include files.
+*/
+
+#include "../costella/costella_unblock.c"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+
+
+/* Number of random cases for each check, and columns in each strip of
+** them.
+*/
+
+#define KERNELS_CASES 50000
+#define KERNELS_WIDTH 256
+
+
+/* Number of calls of each variant in one timing, and number of timings of
+** which the best is reported.
+*/
+
+#define KERNELS_CALLS 10000
+#define KERNELS_REPEATS 5
+
+
+
+/* Values near the ends of the range, where clamping and saturation happen,
+** and near the middle, where rounding changes sign.
+*/
+
+static const COSTELLA_SW gaswKernelsEdges[ 8 ] =
+{
+  0, 1, 2, 127, 128, 253, 254, 255
+};
+
+
+
+/* The coefficients of the corrections at positions 1 to 8 of the sixteen,
+** from the top or left. The correction at position k is the floor of
+** ( mult * u + add ) / 2^bits for u, and likewise for v; positions 9 to 16
+** mirror them, with the sign of the u term reversed.
+*/
+
+static const COSTELLA_SW gaswKernelsUMult[ 8 ] =
+{
+  0, 1, 3, 3, 5, 15, 21, 7
+};
+
+static const COSTELLA_SW gaswKernelsUAdd[ 8 ] =
+{
+  0, 32, 32, 16, 16, 32, 32, 8
+};
+
+static const COSTELLA_UB gaubKernelsUBits[ 8 ] =
+{
+  6, 6, 6, 5, 5, 6, 6, 4
+};
+
+static const COSTELLA_SW gaswKernelsVMult[ 8 ] =
+{
+  -1, -11, -31, -58, -57, -22, 42, 138
+};
+
+
+
+/* Inputs and outputs shared by the variants that are timed.
+*/
+
+typedef struct
+{
+  COSTELLA_SW aswStrip[ 6 * KERNELS_WIDTH ];
+  COSTELLA_UB aubU[ KERNELS_WIDTH ], aubV[ KERNELS_WIDTH ];
+  COSTELLA_UB aubBlocks[ 16 * KERNELS_WIDTH ], aubWork[ 16 * KERNELS_WIDTH
+    ];
+  COSTELLA_UB aubAdjustedU[ 256 ], aubAdjustedV[ 256 ];
+  COSTELLA_UD audReference[ 256 ], audMeasured[ 256 ];
+  COSTELLA_UB aubRgb[ 3 * KERNELS_WIDTH ], aubY[ KERNELS_WIDTH ], aubCb[
+    KERNELS_WIDTH ], aubCr[ KERNELS_WIDTH ];
+  COSTELLA_UD udColumns, udSum;
+}
+KERNELS_DATA;
+
+
+/* A variant that is timed. If acVariant is null, the variant is timed at
+** every vector tier the processor supports, and named after it.
+*/
+
+typedef struct
+{
+  COSTELLA_C* acKernel;
+  COSTELLA_C* acVariant;
+  COSTELLA_FUNCTION_POINTER( pf, ( KERNELS_DATA* pdata ) );
+  COSTELLA_UD udItems;
+}
+KERNELS_VARIANT;
+
+
+
+/* kernels_floor:
+**
+**   Return the floor of sd / 2^ubBits, by division rather than by shifting.
+*/
+
+static COSTELLA_SD kernels_floor( COSTELLA_SD sd, COSTELLA_UB ubBits )
+{
+  COSTELLA_SD sdDivisor = (COSTELLA_SD) 1 << ubBits;
+
+  return sd >= 0 ? sd / sdDivisor : -( ( -sd + sdDivisor - 1 ) / sdDivisor
+    );
+}
+
+
+
+/* kernels_clamp:
+**
+**   Return sd limited to the range [sdMin,sdMax].
+*/
+
+static COSTELLA_SD kernels_clamp( COSTELLA_SD sd, COSTELLA_SD sdMin,
+  COSTELLA_SD sdMax )
+{
+  return sd < sdMin ? sdMin : sd > sdMax ? sdMax : sd;
+}
+
+
+
+/* kernels_random:
+**
+**   Return a pseudo-random pixel value, biased towards the ends of the
+**   range.
+*/
+
+static COSTELLA_SW kernels_random( void )
+{
+  switch( rand() % 4 )
+  {
+    case 0:
+      return 0;
+
+    case 1:
+      return 255;
+
+    default:
+      return (COSTELLA_SW) ( rand() % 256 );
+  }
+}
+
+
+
+/* kernels_oracle_discrepancies:
+**
+**   Compute the discrepancies u and v of six pixels, as
+**   costella_unblock_compute_discrepancies() does. A value of -1 in either
+**   of the last two marks a missing pixel.
+*/
+
+static void kernels_oracle_discrepancies( const COSTELLA_SW* asw,
+  COSTELLA_SW* pswU, COSTELLA_SW* pswV )
+{
+  COSTELLA_SD sd6 = asw[ 0 ], sd7 = asw[ 1 ], sd8 = asw[ 2 ], sd9 = asw[ 3
+    ], sd10 = asw[ 4 ], sd11 = asw[ 5 ], sdU, sdV;
+
+  if( sd11 >= 0 )
+  {
+    sdU = kernels_floor( -3 * sd6 + 10 * sd7 - 15 * sd8 + 15 * sd9 - 10 *
+      sd10 + 3 * sd11 + 4, 3 );
+    sdV = -sd6 + 3 * sd7 - 2 * sd8 - 2 * sd9 + 3 * sd10 - sd11;
+  }
+  else if( sd10 >= 0 )
+  {
+    sdU = kernels_floor( -3 * sd6 + 10 * sd7 - 15 * sd8 + 12 * sd9 - 4 *
+      sd10 + 4, 3 );
+    sdV = -sd6 + 3 * sd7 - 2 * sd8 - sd9 + sd10;
+  }
+  else
+  {
+    sdU = kernels_floor( -3 * sd6 + 10 * sd7 - 15 * sd8 + 8 * sd9 + 4, 3 );
+    sdV = 0;
+  }
+
+  *pswU = (COSTELLA_SW) kernels_clamp( sdU, -255, 255 );
+  *pswV = (COSTELLA_SW) kernels_clamp( sdV, -255, 255 );
+}
+
+
+
+/* kernels_oracle_correct:
+**
+**   Correct the sixteen values of two blocks for the discrepancies u and v,
+**   as costella_unblock_correct_discrepancies() does.
+**
+**   The term 138 v + 128 is truncated to 16 bits, because Costella's
+**   original table held it in a COSTELLA_SW, so that it wraps for v above
+**   236. The library keeps that, and so does the oracle.
+*/
+
+static void kernels_oracle_correct( COSTELLA_SW* asw, COSTELLA_SW swU,
+  COSTELLA_SW swV )
+{
+  COSTELLA_UB ub;
+  COSTELLA_SD sdU, sdV;
+
+  for( ub = 0; ub < 8; ub++ )
+  {
+    sdU = kernels_floor( gaswKernelsUMult[ ub ] * swU + gaswKernelsUAdd[ ub
+      ], gaubKernelsUBits[ ub ] );
+    sdV = kernels_floor( (COSTELLA_SW) ( gaswKernelsVMult[ ub ] * swV + 128
+      ), 8 );
+
+    asw[ ub ] = (COSTELLA_SW) kernels_clamp( asw[ ub ] + sdU + sdV, 0, 255
+      );
+    asw[ 15 - ub ] = (COSTELLA_SW) kernels_clamp( asw[ 15 - ub ] - sdU +
+      sdV, 0, 255 );
+  }
+}
+
+
+
+/* kernels_oracle_column:
+**
+**   Correct one column of two blocks in place, as
+**   costella_unblock_correct_rows_in_place() does: compute the
+**   discrepancies from its middle six pixels, adjust them, and correct.
+*/
+
+static void kernels_oracle_column( COSTELLA_UB* pubTop, COSTELLA_SD
+  sdRowStride, COSTELLA_UB ubNumRows, COSTELLA_UB* aubAdjustedU,
+  COSTELLA_UB* aubAdjustedV )
+{
+  COSTELLA_UB ub;
+  COSTELLA_SW swU, swV;
+  COSTELLA_SW asw[ 16 ];
+
+  for( ub = 0; ub < 16; ub++ )
+  {
+    asw[ ub ] = ub < ubNumRows ? (COSTELLA_SW) pubTop[ ub * sdRowStride ] :
+      -1;
+  }
+
+  kernels_oracle_discrepancies( asw + 5, &swU, &swV );
+
+  swU = (COSTELLA_SW) ( swU < 0 ? -aubAdjustedU[ -swU ] : aubAdjustedU[ swU
+    ] );
+  swV = (COSTELLA_SW) ( swV < 0 ? -aubAdjustedV[ -swV ] : aubAdjustedV[ swV
+    ] );
+
+  kernels_oracle_correct( asw, swU, swV );
+
+  for( ub = 0; ub < ubNumRows; ub++ )
+  {
+    pubTop[ ub * sdRowStride ] = (COSTELLA_UB) asw[ ub ];
+  }
+}
+
+
+
+/* kernels_oracle_adjustments:
+**
+**   Compute the adjustment table as CostellaUnblockComputeAdjustments()
+**   does without either conservative bound: each measured discrepancy is
+**   reduced by the reference discrepancy at the same cumulative frequency.
+*/
+
+static void kernels_oracle_adjustments( COSTELLA_UD* audReference,
+  COSTELLA_UD* audMeasured, COSTELLA_UB* aubAdjusted )
+{
+  COSTELLA_UW uwMeasured, uwReference;
+  COSTELLA_UD udCumMeasured, udCumReference;
+
+  for( uwMeasured = 0, udCumMeasured = 0; uwMeasured < 256; uwMeasured++ )
+  {
+    /* Find the first reference value at which the cumulative reference
+    ** frequency reaches the cumulative measured frequency, and step back
+    ** one if it overshoots.
+    */
+
+    udCumMeasured += audMeasured[ uwMeasured ];
+
+    for( uwReference = 0, udCumReference = 0; udCumReference <
+      udCumMeasured; uwReference++ )
+    {
+      udCumReference += audReference[ uwReference ];
+    }
+
+    if( udCumReference > udCumMeasured )
+    {
+      uwReference--;
+    }
+
+    aubAdjusted[ uwMeasured ] = (COSTELLA_UB) ( !uwReference ? uwMeasured :
+      uwMeasured >= uwReference ? uwMeasured + 1 - uwReference : 0 );
+  }
+}
+
+
+
+/* kernels_oracle_rgb_to_ycbcr, kernels_oracle_ycbcr_to_rgb:
+**
+**   Convert one pixel between RGB and YCbCr, in 16-bit fixed point.
+*/
+
+static void kernels_oracle_rgb_to_ycbcr( COSTELLA_SD sdR, COSTELLA_SD sdG,
+  COSTELLA_SD sdB, COSTELLA_UB* pubY, COSTELLA_UB* pubCb, COSTELLA_UB*
+  pubCr )
+{
+  *pubY = (COSTELLA_UB) kernels_floor( 19595L * sdR + 38470L * sdG + 7471L
+    * sdB + 32768L, 16 );
+  *pubCb = (COSTELLA_UB) kernels_floor( -11058L * sdR - 21709L * sdG +
+    32767L * sdB + 8421376L, 16 );
+  *pubCr = (COSTELLA_UB) kernels_floor( 32767L * sdR - 27438L * sdG - 5329L
+    * sdB + 8421376L, 16 );
+}
+
+
+static void kernels_oracle_ycbcr_to_rgb( COSTELLA_SD sdY, COSTELLA_SD sdCb,
+  COSTELLA_SD sdCr, COSTELLA_UB* pubR, COSTELLA_UB* pubG, COSTELLA_UB*
+  pubB )
+{
+  *pubR = (COSTELLA_UB) kernels_clamp( sdY + kernels_floor( 91885L * sdCr -
+    11728512L, 16 ), 0, 255 );
+  *pubG = (COSTELLA_UB) kernels_clamp( sdY + kernels_floor( 8910464L -
+    22554L * sdCb - 46803L * sdCr, 16 ), 0, 255 );
+  *pubB = (COSTELLA_UB) kernels_clamp( sdY + kernels_floor( 116134L * sdCb
+    - 14832384L, 16 ), 0, 255 );
+}
+
+
+
+/* kernels_check_strip:
+**
+**   Compare the reference and vector discrepancies of the first udCount
+**   columns of a strip of six rows with the oracle. Return the number of
+**   mismatches, printing the first unless udFailures, the number found
+**   before, is nonzero.
+*/
+
+static COSTELLA_UD kernels_check_strip( COSTELLA_SW* aswStrip, COSTELLA_UD
+  udCount, COSTELLA_UD udFailures )
+{
+  COSTELLA_UB ubPosition;
+  COSTELLA_UB aubU[ KERNELS_WIDTH ], aubV[ KERNELS_WIDTH ];
+  COSTELLA_SW swU, swV, swOracleU, swOracleV, swOnlyU;
+  COSTELLA_SW asw[ 6 ];
+  COSTELLA_UD udColumn, udMismatches = 0;
+
+  costella_unblock_compute_strip_discrepancies( aswStrip, KERNELS_WIDTH,
+    udCount, aubU, aubV );
+
+  for( udColumn = 0; udColumn < udCount; udColumn++ )
+  {
+    for( ubPosition = 0; ubPosition < 6; ubPosition++ )
+    {
+      asw[ ubPosition ] = aswStrip[ ubPosition * KERNELS_WIDTH + udColumn ];
+    }
+
+    kernels_oracle_discrepancies( asw, &swOracleU, &swOracleV );
+    costella_unblock_compute_discrepancies( asw, &swU, &swV );
+    costella_unblock_compute_discrepancies( asw, &swOnlyU, 0 );
+
+    if( swU != swOracleU || swV != swOracleV || swOnlyU != swOracleU ||
+      aubU[ udColumn ] != abs( swOracleU ) || aubV[ udColumn ] != abs(
+      swOracleV ) )
+    {
+      if( !udFailures && !udMismatches )
+      {
+        printf( "Discrepancy mismatch: values %d %d %d %d %d %d, oracle u "
+          "%d v %d, reference u %d v %d u alone %d, %s |u| %d |v| %d\n",
+          asw[ 0 ], asw[ 1 ], asw[ 2 ], asw[ 3 ], asw[ 4 ], asw[ 5 ],
+          swOracleU, swOracleV, swU, swV, swOnlyU, costella_cpu_name(
+          costella_cpu_tier() ), aubU[ udColumn ], aubV[ udColumn ] );
+      }
+
+      udMismatches++;
+    }
+  }
+
+  return udMismatches;
+}
+
+
+
+/* KernelsDiscrepancies:
+**
+**   Check the discrepancy kernels on every combination of the edge values
+**   for six, five and four pixels, and on random columns of random
+**   strips.
+*/
+
+static COSTELLA_FUNCTION( KernelsDiscrepancies, ( COSTELLA_UD* pudFailures
+  ) )
+{
+  COSTELLA_UB ubPosition, ubPresent;
+  COSTELLA_SW aswStrip[ 6 * KERNELS_WIDTH ];
+  COSTELLA_UD udCase, udCombinations, udCode, udColumn, udCount, udFailures
+    = 0;
+
+
+  /* Every combination of edge values, with the missing pixels marked by
+  ** -1, filling one strip after another.
+  */
+
+  for( ubPresent = 6; ubPresent >= 4; ubPresent-- )
+  {
+    udCombinations = (COSTELLA_UD) 1 << 3 * ubPresent;
+
+    for( udCase = 0, udColumn = 0; udCase < udCombinations; udCase++ )
+    {
+      for( ubPosition = 0, udCode = udCase; ubPosition < 6; ubPosition++,
+        udCode >>= 3 )
+      {
+        aswStrip[ ubPosition * KERNELS_WIDTH + udColumn ] = ubPosition <
+          ubPresent ? gaswKernelsEdges[ udCode & 7 ] : -1;
+      }
+
+      if( ++udColumn == KERNELS_WIDTH || udCase + 1 == udCombinations )
+      {
+        udFailures += kernels_check_strip( aswStrip, udColumn, udFailures );
+        udColumn = 0;
+      }
+    }
+  }
+
+
+  /* Random strips of random width, each column with its own number of
+  ** pixels present, so that the vector code sees all three cases mixed.
+  */
+
+  for( udCase = 0; udCase < KERNELS_CASES; udCase += udCount )
+  {
+    udCount = 1 + (COSTELLA_UD) rand() % KERNELS_WIDTH;
+
+    for( udColumn = 0; udColumn < udCount; udColumn++ )
+    {
+      ubPresent = (COSTELLA_UB) ( rand() % 4 ? 6 : 4 + rand() % 2 );
+
+      for( ubPosition = 0; ubPosition < 6; ubPosition++ )
+      {
+        aswStrip[ ubPosition * KERNELS_WIDTH + udColumn ] = ubPosition <
+          ubPresent ? kernels_random() : -1;
+      }
+    }
+
+    udFailures += kernels_check_strip( aswStrip, udCount, udFailures );
+  }
+
+  *pudFailures += udFailures;
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* KernelsCorrection:
+**
+**   Check costella_unblock_correct_discrepancies() for every pair of u and
+**   v, and costella_unblock_correct_rows_in_place() on random blocks with
+**   9 to 16 rows inside the image.
+*/
+
+static COSTELLA_FUNCTION( KernelsCorrection, ( COSTELLA_UD* pudFailures ) )
+{
+  COSTELLA_UB ubPosition, ubNumRows, ubColumnStep;
+  COSTELLA_UB aubAdjustedU[ 256 ], aubAdjustedV[ 256 ];
+  static COSTELLA_UB aubBlocks[ 16 * 2 * KERNELS_WIDTH ], aubOracle[ 16 * 2
+    * KERNELS_WIDTH ];
+  COSTELLA_SW swU, swV;
+  COSTELLA_SW asw[ 16 ], aswOracle[ 16 ];
+  COSTELLA_UD udCase, udColumn, udCount, udByte, udFailures = 0;
+
+
+  /* Every pair of discrepancies, on a random column each time.
+  */
+
+  for( swU = -255; swU <= 255; swU++ )
+  {
+    for( swV = -255; swV <= 255; swV++ )
+    {
+      for( ubPosition = 0; ubPosition < 16; ubPosition++ )
+      {
+        asw[ ubPosition ] = aswOracle[ ubPosition ] = kernels_random();
+      }
+
+      costella_unblock_correct_discrepancies( asw, swU, swV );
+      kernels_oracle_correct( aswOracle, swU, swV );
+
+      if( memcmp( asw, aswOracle, sizeof( asw ) ) )
+      {
+        if( !udFailures++ )
+        {
+          printf( "Correction mismatch: u %d, v %d\n", swU, swV );
+        }
+      }
+    }
+  }
+
+
+  /* Random row segments, with tables that are the identity, zero, or
+  ** random.
+  */
+
+  for( udCase = 0; udCase < KERNELS_CASES / 50; udCase++ )
+  {
+    if( !( udCase % 100 ) )
+    {
+      for( udByte = 0; udByte < 256; udByte++ )
+      {
+        switch( udCase / 100 % 3 )
+        {
+          case 0:
+            aubAdjustedU[ udByte ] = aubAdjustedV[ udByte ] = (COSTELLA_UB)
+              udByte;
+            break;
+
+          case 1:
+            aubAdjustedU[ udByte ] = aubAdjustedV[ udByte ] = 0;
+            break;
+
+          default:
+            aubAdjustedU[ udByte ] = (COSTELLA_UB) ( rand() % ( udByte + 1 )
+              );
+            aubAdjustedV[ udByte ] = (COSTELLA_UB) ( rand() % ( udByte + 1 )
+              );
+            break;
+        }
+      }
+    }
+
+    ubColumnStep = (COSTELLA_UB) ( 1 + rand() % 2 );
+    udCount = 1 + (COSTELLA_UD) rand() % KERNELS_WIDTH;
+    ubNumRows = (COSTELLA_UB) ( 9 + rand() % 8 );
+
+    for( udByte = 0; udByte < 16 * 2 * KERNELS_WIDTH; udByte++ )
+    {
+      aubBlocks[ udByte ] = aubOracle[ udByte ] = (COSTELLA_UB)
+        kernels_random();
+    }
+
+    costella_unblock_correct_rows_in_place( aubBlocks, 2 * KERNELS_WIDTH,
+      ubColumnStep, udCount, ubNumRows, aubAdjustedU, aubAdjustedV );
+
+    for( udColumn = 0; udColumn < udCount; udColumn++ )
+    {
+      kernels_oracle_column( aubOracle + udColumn * ubColumnStep, 2 *
+        KERNELS_WIDTH, ubNumRows, aubAdjustedU, aubAdjustedV );
+    }
+
+    for( udByte = 0; udByte < 16 * 2 * KERNELS_WIDTH; udByte++ )
+    {
+      if( aubBlocks[ udByte ] != aubOracle[ udByte ] )
+      {
+        if( !udFailures++ )
+        {
+          printf( "Row correction mismatch: step %d, rows %d, columns %lu, "
+            "row %lu, byte %lu, %s %d, oracle %d\n", ubColumnStep,
+            ubNumRows, udCount, udByte / ( 2 * KERNELS_WIDTH ), udByte % ( 2
+            * KERNELS_WIDTH ), costella_cpu_name( costella_cpu_tier() ),
+            aubBlocks[ udByte ], aubOracle[ udByte ] );
+        }
+
+        break;
+      }
+    }
+  }
+
+  *pudFailures += udFailures;
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* KernelsAdjustments:
+**
+**   Check CostellaUnblockComputeAdjustments() against the oracle on random
+**   pairs of frequency tables with the same total, sparse and dense, and
+**   check that the conservative tables never exceed the measured
+**   discrepancy.
+*/
+
+static COSTELLA_FUNCTION( KernelsAdjustments, ( COSTELLA_UD* pudFailures )
+  )
+{
+  COSTELLA_UB ubMode;
+  COSTELLA_UB aubAdjusted[ 256 ], aubOracle[ 256 ];
+  COSTELLA_UW uw, uwSpread;
+  COSTELLA_UD udCase, udTotal, ud, udFailures = 0;
+  COSTELLA_UD audReference[ 256 ], audMeasured[ 256 ];
+
+
+  /* Run the random cases.
+  */
+
+  for( udCase = 0; udCase < KERNELS_CASES / 200; udCase++ )
+  {
+    /* Measured discrepancies spread further than the reference ones, as
+    ** they are in a blocky image.
+    */
+
+    COSTELLA_INITIALIZE_ARRAY( audReference, 256, COSTELLA_UD );
+    COSTELLA_INITIALIZE_ARRAY( audMeasured, 256, COSTELLA_UD );
+
+    udTotal = 1 + (COSTELLA_UD) rand() % ( udCase % 2 ? 50 : 50000 );
+    uwSpread = (COSTELLA_UW) ( 1 + rand() % 256 );
+
+    for( ud = 0; ud < udTotal; ud++ )
+    {
+      audReference[ rand() % ( 1 + uwSpread / 4 ) ]++;
+      audMeasured[ rand() % uwSpread ]++;
+    }
+
+
+    /* Compare each mode.
+    */
+
+    for( ubMode = 0; ubMode < 3; ubMode++ )
+    {
+      if( COSTELLA_CALL( CostellaUnblockComputeAdjustments( audReference,
+        audMeasured, udTotal, ubMode == 1, ubMode == 2, aubAdjusted ) ) )
+      {
+        COSTELLA_ERROR( "Computing adjustments" );
+        COSTELLA_RETURN;
+      }
+
+      if( !ubMode )
+      {
+        kernels_oracle_adjustments( audReference, audMeasured, aubOracle );
+      }
+
+      for( uw = 0; uw < 256; uw++ )
+      {
+        if( ubMode ? aubAdjusted[ uw ] > uw : aubAdjusted[ uw ] !=
+          aubOracle[ uw ] )
+        {
+          if( !udFailures++ )
+          {
+            printf( "Adjustment mismatch: mode %d, total %lu, spread %d, "
+              "discrepancy %d, %d/%d\n", ubMode, udTotal, uwSpread, uw,
+              aubAdjusted[ uw ], ubMode ? uw : aubOracle[ uw ] );
+          }
+
+          break;
+        }
+      }
+    }
+  }
+
+  *pudFailures += udFailures;
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* KernelsConvert:
+**
+**   Check the conversion macros and CostellaImageConvert{RgbRowToYcbcr,
+**   YcbcrRowToRgb}() against the oracle for every value of a pixel, in
+**   rows of 256 whose first two channels are fixed, then on rows of random
+**   width.
+*/
+
+static COSTELLA_FUNCTION( KernelsConvert, ( COSTELLA_UD* pudFailures ) )
+{
+  COSTELLA_B bBgr;
+  COSTELLA_UB ubR, ubB, ubY, ubCb, ubCr, ubOracleY, ubOracleCb,
+    ubOracleCr;
+  COSTELLA_UB aubIn[ 3 * 256 ], aubOut[ 3 * 256 ], aubY[ 256 ], aubCb[ 256
+    ], aubCr[ 256 ];
+  COSTELLA_UD udCase, udColumn, udWidth, udFailures = 0;
+
+  for( udCase = 0; udCase < 65536 + KERNELS_CASES / 10; udCase++ )
+  {
+    /* Fill the row.
+    */
+
+    if( udCase < 65536 )
+    {
+      udWidth = 256;
+
+      for( udColumn = 0; udColumn < 256; udColumn++ )
+      {
+        aubIn[ 3 * udColumn ] = (COSTELLA_UB) ( udCase >> 8 );
+        aubIn[ 3 * udColumn + 1 ] = (COSTELLA_UB) udCase;
+        aubIn[ 3 * udColumn + 2 ] = (COSTELLA_UB) udColumn;
+      }
+    }
+    else
+    {
+      udWidth = 1 + (COSTELLA_UD) rand() % 256;
+
+      for( udColumn = 0; udColumn < 3 * udWidth; udColumn++ )
+      {
+        aubIn[ udColumn ] = (COSTELLA_UB) kernels_random();
+      }
+    }
+
+    bBgr = (COSTELLA_B) ( udCase & 1 );
+    ubR = (COSTELLA_UB) ( bBgr ? 2 : 0 );
+    ubB = (COSTELLA_UB) ( 2 - ubR );
+
+
+    /* Treat the row as RGB.
+    */
+
+    if( COSTELLA_CALL( CostellaImageConvertRgbRowToYcbcr( aubIn, udWidth,
+      bBgr, aubY, aubCb, aubCr ) ) )
+    {
+      COSTELLA_ERROR( "Converting row to YCbCr" );
+      COSTELLA_RETURN;
+    }
+
+    for( udColumn = 0; udColumn < udWidth; udColumn++ )
+    {
+      kernels_oracle_rgb_to_ycbcr( aubIn[ 3 * udColumn + ubR ], aubIn[ 3 *
+        udColumn + 1 ], aubIn[ 3 * udColumn + ubB ], &ubOracleY,
+        &ubOracleCb, &ubOracleCr );
+      COSTELLA_IMAGE_CONVERT_RGB_TO_YCBCR( aubIn[ 3 * udColumn + ubR ],
+        aubIn[ 3 * udColumn + 1 ], aubIn[ 3 * udColumn + ubB ], &ubY, &ubCb,
+        &ubCr );
+
+      if( ubY != ubOracleY || ubCb != ubOracleCb || ubCr != ubOracleCr ||
+        aubY[ udColumn ] != ubOracleY || aubCb[ udColumn ] != ubOracleCb ||
+        aubCr[ udColumn ] != ubOracleCr )
+      {
+        if( !udFailures++ )
+        {
+          printf( "RGB to YCbCr mismatch: %d %d %d, oracle %d %d %d, macro "
+            "%d %d %d, %s row %d %d %d\n", aubIn[ 3 * udColumn + ubR ],
+            aubIn[ 3 * udColumn + 1 ], aubIn[ 3 * udColumn + ubB ],
+            ubOracleY, ubOracleCb, ubOracleCr, ubY, ubCb, ubCr,
+            costella_cpu_name( costella_cpu_tier() ), aubY[ udColumn ],
+            aubCb[ udColumn ], aubCr[ udColumn ] );
+        }
+      }
+    }
+
+
+    /* Treat the row as YCbCr.
+    */
+
+    for( udColumn = 0; udColumn < udWidth; udColumn++ )
+    {
+      aubY[ udColumn ] = aubIn[ 3 * udColumn ];
+      aubCb[ udColumn ] = aubIn[ 3 * udColumn + 1 ];
+      aubCr[ udColumn ] = aubIn[ 3 * udColumn + 2 ];
+    }
+
+    if( COSTELLA_CALL( CostellaImageConvertYcbcrRowToRgb( aubY, aubCb,
+      aubCr, udWidth, bBgr, aubOut ) ) )
+    {
+      COSTELLA_ERROR( "Converting row to RGB" );
+      COSTELLA_RETURN;
+    }
+
+    for( udColumn = 0; udColumn < udWidth; udColumn++ )
+    {
+      kernels_oracle_ycbcr_to_rgb( aubY[ udColumn ], aubCb[ udColumn ],
+        aubCr[ udColumn ], &ubOracleY, &ubOracleCb, &ubOracleCr );
+      COSTELLA_IMAGE_CONVERT_YCBCR_TO_RGB( aubY[ udColumn ], aubCb[ udColumn
+        ], aubCr[ udColumn ], &ubY, &ubCb, &ubCr );
+
+      if( ubY != ubOracleY || ubCb != ubOracleCb || ubCr != ubOracleCr ||
+        aubOut[ 3 * udColumn + ubR ] != ubOracleY || aubOut[ 3 * udColumn +
+        1 ] != ubOracleCb || aubOut[ 3 * udColumn + ubB ] != ubOracleCr )
+      {
+        if( !udFailures++ )
+        {
+          printf( "YCbCr to RGB mismatch: %d %d %d, oracle %d %d %d, macro "
+            "%d %d %d, %s row %d %d %d\n", aubY[ udColumn ], aubCb[
+            udColumn ], aubCr[ udColumn ], ubOracleY, ubOracleCb,
+            ubOracleCr, ubY, ubCb, ubCr, costella_cpu_name(
+            costella_cpu_tier() ), aubOut[ 3 * udColumn + ubR ], aubOut[ 3 *
+            udColumn + 1 ], aubOut[ 3 * udColumn + ubB ] );
+        }
+      }
+    }
+  }
+
+  *pudFailures += udFailures;
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* Kernels{Discrepancies,Correction,Adjustments,Convert}{Oracle,Reference,
+** Vector}:
+**
+**   The variants that are timed. Each processes one strip of
+**   KERNELS_WIDTH columns or pixels, or one adjustment table, and adds
+**   something from its results into pdata->udSum so that the work cannot be
+**   discarded.
+*/
+
+static COSTELLA_FUNCTION( KernelsDiscrepanciesOracle, ( KERNELS_DATA* pdata
+  ) )
+{
+  COSTELLA_UB ubPosition;
+  COSTELLA_SW swU, swV;
+  COSTELLA_SW asw[ 6 ];
+  COSTELLA_UD udColumn;
+
+  for( udColumn = 0; udColumn < KERNELS_WIDTH; udColumn++ )
+  {
+    for( ubPosition = 0; ubPosition < 6; ubPosition++ )
+    {
+      asw[ ubPosition ] = pdata->aswStrip[ ubPosition * KERNELS_WIDTH +
+        udColumn ];
+    }
+
+    kernels_oracle_discrepancies( asw, &swU, &swV );
+
+    pdata->udSum += (COSTELLA_UD) ( abs( swU ) + abs( swV ) );
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+static COSTELLA_FUNCTION( KernelsDiscrepanciesReference, ( KERNELS_DATA*
+  pdata ) )
+{
+  COSTELLA_UB ubPosition;
+  COSTELLA_SW swU, swV;
+  COSTELLA_SW asw[ 6 ];
+  COSTELLA_UD udColumn;
+
+  for( udColumn = 0; udColumn < KERNELS_WIDTH; udColumn++ )
+  {
+    for( ubPosition = 0; ubPosition < 6; ubPosition++ )
+    {
+      asw[ ubPosition ] = pdata->aswStrip[ ubPosition * KERNELS_WIDTH +
+        udColumn ];
+    }
+
+    costella_unblock_compute_discrepancies( asw, &swU, &swV );
+
+    pdata->udSum += (COSTELLA_UD) ( abs( swU ) + abs( swV ) );
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+static COSTELLA_FUNCTION( KernelsDiscrepanciesVector, ( KERNELS_DATA* pdata
+  ) )
+{
+  costella_unblock_compute_strip_discrepancies( pdata->aswStrip,
+    KERNELS_WIDTH, pdata->udColumns, pdata->aubU, pdata->aubV );
+
+  pdata->udSum += (COSTELLA_UD) ( pdata->aubU[ 0 ] + pdata->aubV[
+    KERNELS_WIDTH - 1 ] );
+}
+COSTELLA_END_FUNCTION
+
+
+static COSTELLA_FUNCTION( KernelsCorrectionOracle, ( KERNELS_DATA* pdata ) )
+{
+  COSTELLA_UD udColumn;
+
+  memcpy( pdata->aubWork, pdata->aubBlocks, sizeof( pdata->aubWork ) );
+
+  for( udColumn = 0; udColumn < KERNELS_WIDTH; udColumn++ )
+  {
+    kernels_oracle_column( pdata->aubWork + udColumn, KERNELS_WIDTH, 16,
+      pdata->aubAdjustedU, pdata->aubAdjustedV );
+  }
+
+  pdata->udSum += pdata->aubWork[ 7 * KERNELS_WIDTH ];
+}
+COSTELLA_END_FUNCTION
+
+
+static COSTELLA_FUNCTION( KernelsCorrectionReference, ( KERNELS_DATA* pdata
+  ) )
+{
+  COSTELLA_UB ubPosition;
+  COSTELLA_SW swU, swV;
+  COSTELLA_SW asw[ 16 ];
+  COSTELLA_UD udColumn;
+
+  memcpy( pdata->aubWork, pdata->aubBlocks, sizeof( pdata->aubWork ) );
+
+  for( udColumn = 0; udColumn < KERNELS_WIDTH; udColumn++ )
+  {
+    for( ubPosition = 0; ubPosition < 16; ubPosition++ )
+    {
+      asw[ ubPosition ] = pdata->aubWork[ ubPosition * KERNELS_WIDTH +
+        udColumn ];
+    }
+
+    costella_unblock_compute_discrepancies( asw + 5, &swU, &swV );
+
+    swU = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swU, pdata->aubAdjustedU );
+    swV = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swV, pdata->aubAdjustedV );
+
+    costella_unblock_correct_discrepancies( asw, swU, swV );
+
+    for( ubPosition = 0; ubPosition < 16; ubPosition++ )
+    {
+      pdata->aubWork[ ubPosition * KERNELS_WIDTH + udColumn ] =
+        (COSTELLA_UB) asw[ ubPosition ];
+    }
+  }
+
+  pdata->udSum += pdata->aubWork[ 7 * KERNELS_WIDTH ];
+}
+COSTELLA_END_FUNCTION
+
+
+static COSTELLA_FUNCTION( KernelsCorrectionVector, ( KERNELS_DATA* pdata ) )
+{
+  memcpy( pdata->aubWork, pdata->aubBlocks, sizeof( pdata->aubWork ) );
+
+  costella_unblock_correct_rows_in_place( pdata->aubWork, KERNELS_WIDTH, 1,
+    KERNELS_WIDTH, 16, pdata->aubAdjustedU, pdata->aubAdjustedV );
+
+  pdata->udSum += pdata->aubWork[ 7 * KERNELS_WIDTH ];
+}
+COSTELLA_END_FUNCTION
+
+
+static COSTELLA_FUNCTION( KernelsAdjustmentsOracle, ( KERNELS_DATA* pdata ) )
+{
+  kernels_oracle_adjustments( pdata->audReference, pdata->audMeasured,
+    pdata->aubAdjustedU );
+
+  pdata->udSum += pdata->aubAdjustedU[ 255 ];
+}
+COSTELLA_END_FUNCTION
+
+
+static COSTELLA_FUNCTION( KernelsAdjustmentsReference, ( KERNELS_DATA*
+  pdata ) )
+{
+  if( COSTELLA_CALL( CostellaUnblockComputeAdjustments( pdata->audReference,
+    pdata->audMeasured, KERNELS_WIDTH * KERNELS_WIDTH, COSTELLA_FALSE,
+    COSTELLA_FALSE, pdata->aubAdjustedU ) ) )
+  {
+    COSTELLA_ERROR( "Computing adjustments" );
+    COSTELLA_RETURN;
+  }
+
+  pdata->udSum += pdata->aubAdjustedU[ 255 ];
+}
+COSTELLA_END_FUNCTION
+
+
+static COSTELLA_FUNCTION( KernelsConvertOracle, ( KERNELS_DATA* pdata ) )
+{
+  COSTELLA_UB* pub;
+  COSTELLA_UD udColumn;
+
+  for( udColumn = 0, pub = pdata->aubRgb; udColumn < KERNELS_WIDTH;
+    udColumn++, pub += 3 )
+  {
+    kernels_oracle_rgb_to_ycbcr( pub[ 0 ], pub[ 1 ], pub[ 2 ], pdata->aubY +
+      udColumn, pdata->aubCb + udColumn, pdata->aubCr + udColumn );
+  }
+
+  pdata->udSum += pdata->aubCr[ KERNELS_WIDTH - 1 ];
+}
+COSTELLA_END_FUNCTION
+
+
+static COSTELLA_FUNCTION( KernelsConvertReference, ( KERNELS_DATA* pdata ) )
+{
+  COSTELLA_UB* pub;
+  COSTELLA_UD udColumn;
+
+  for( udColumn = 0, pub = pdata->aubRgb; udColumn < KERNELS_WIDTH;
+    udColumn++, pub += 3 )
+  {
+    COSTELLA_IMAGE_CONVERT_RGB_TO_YCBCR( pub[ 0 ], pub[ 1 ], pub[ 2 ],
+      pdata->aubY + udColumn, pdata->aubCb + udColumn, pdata->aubCr +
+      udColumn );
+  }
+
+  pdata->udSum += pdata->aubCr[ KERNELS_WIDTH - 1 ];
+}
+COSTELLA_END_FUNCTION
+
+
+static COSTELLA_FUNCTION( KernelsConvertVector, ( KERNELS_DATA* pdata ) )
+{
+  if( COSTELLA_CALL( CostellaImageConvertRgbRowToYcbcr( pdata->aubRgb,
+    KERNELS_WIDTH, COSTELLA_FALSE, pdata->aubY, pdata->aubCb, pdata->aubCr
+    ) ) )
+  {
+    COSTELLA_ERROR( "Converting row to YCbCr" );
+    COSTELLA_RETURN;
+  }
+
+  pdata->udSum += pdata->aubCr[ KERNELS_WIDTH - 1 ];
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* kernels_seconds:
+**
+**   Return a monotonic time in seconds.
+*/
+
+static double kernels_seconds( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return (double) ts.tv_sec + 1e-9 * (double) ts.tv_nsec;
+}
+
+
+
+/* KernelsTime:
+**
+**   Fill the inputs with blocky data, like that of a heavily compressed
+**   image, and print the best time per item of each variant.
+*/
+
+static COSTELLA_FUNCTION( KernelsTime, ( void ) )
+{
+  static KERNELS_DATA data;
+  static const KERNELS_VARIANT avar[] =
+  {
+    { "discrepancies", "oracle", KernelsDiscrepanciesOracle, KERNELS_WIDTH },
+    { "discrepancies", "reference", KernelsDiscrepanciesReference,
+      KERNELS_WIDTH },
+    { "discrepancies", 0, KernelsDiscrepanciesVector, KERNELS_WIDTH },
+    { "correction", "oracle", KernelsCorrectionOracle, KERNELS_WIDTH },
+    { "correction", "reference", KernelsCorrectionReference, KERNELS_WIDTH },
+    { "correction", 0, KernelsCorrectionVector, KERNELS_WIDTH },
+    { "adjustments", "oracle", KernelsAdjustmentsOracle, 1 },
+    { "adjustments", "reference", KernelsAdjustmentsReference, 1 },
+    { "rgb to ycbcr", "oracle", KernelsConvertOracle, KERNELS_WIDTH },
+    { "rgb to ycbcr", "reference", KernelsConvertReference, KERNELS_WIDTH },
+    { "rgb to ycbcr", 0, KernelsConvertVector, KERNELS_WIDTH }
+  };
+  COSTELLA_UB ubVariant, ubRepeat, ubTier, ubTierInUse, ubTierLast;
+  COSTELLA_UW uw;
+  COSTELLA_UD ud;
+  double dBest, dStart, dTime;
+
+
+  data.udColumns = KERNELS_WIDTH;
+
+
+  /* One random value per block and a little noise, a discrepancy table
+  ** spread four times as wide as the reference one, and tables that halve
+  ** the discrepancies.
+  */
+
+  for( ud = 0; ud < 16 * KERNELS_WIDTH; ud++ )
+  {
+    data.aubBlocks[ ud ] = (COSTELLA_UB) ( ( ( ( ud % KERNELS_WIDTH >> 3 )
+      * 2654435761u ^ ( ud / KERNELS_WIDTH >> 3 ) * 40503u ) >> 25 ) + ( ud
+      * 7 & 3 ) );
+  }
+
+  for( ud = 0; ud < 6 * KERNELS_WIDTH; ud++ )
+  {
+    data.aswStrip[ ud ] = data.aubBlocks[ 5 * KERNELS_WIDTH + ud ];
+  }
+
+  for( ud = 0; ud < 3 * KERNELS_WIDTH; ud++ )
+  {
+    data.aubRgb[ ud ] = data.aubBlocks[ ud ];
+  }
+
+  for( uw = 0; uw < 256; uw++ )
+  {
+    data.aubAdjustedU[ uw ] = data.aubAdjustedV[ uw ] = (COSTELLA_UB) ( uw
+      >> 1 );
+    data.audReference[ uw ] = uw < 64 ? KERNELS_WIDTH * 4 : 0;
+    data.audMeasured[ uw ] = KERNELS_WIDTH;
+  }
+
+
+  /* Time each variant.
+  */
+
+  printf( "kernels: nanoseconds per column, pixel or table, best of %d\n",
+    KERNELS_REPEATS );
+
+  ubTierInUse = costella_cpu_tier();
+
+  for( ubVariant = 0; ubVariant < sizeof( avar ) / sizeof( avar[ 0 ] );
+    ubVariant++ )
+  {
+    ubTier = (COSTELLA_UB) ( avar[ ubVariant ].acVariant ? ubTierInUse :
+      COSTELLA_CPU_C + 1 );
+    ubTierLast = (COSTELLA_UB) ( avar[ ubVariant ].acVariant ? ubTierInUse :
+      costella_cpu_supported_tier() );
+
+    for( ; ubTier <= ubTierLast; ubTier++ )
+    {
+      if( COSTELLA_CALL( CostellaCpuSetTier( ubTier ) ) )
+      {
+        COSTELLA_ERROR( "Setting tier" );
+        COSTELLA_RETURN;
+      }
+
+      dBest = 1e30;
+
+      for( ubRepeat = 0; ubRepeat < KERNELS_REPEATS; ubRepeat++ )
+      {
+        dStart = kernels_seconds();
+
+        for( ud = 0; ud < KERNELS_CALLS; ud++ )
+        {
+          if( COSTELLA_CALL( ( *avar[ ubVariant ].pf )( &data ) ) )
+          {
+            COSTELLA_ERROR( avar[ ubVariant ].acKernel );
+            COSTELLA_RETURN;
+          }
+        }
+
+        dTime = kernels_seconds() - dStart;
+
+        if( dTime < dBest )
+        {
+          dBest = dTime;
+        }
+      }
+
+      printf( "  %-14s %-11s %10.2f\n", avar[ ubVariant ].acKernel, avar[
+        ubVariant ].acVariant ? avar[ ubVariant ].acVariant :
+        costella_cpu_name( ubTier ), 1e9 * dBest / ( KERNELS_CALLS * avar[
+        ubVariant ].udItems ) );
+    }
+  }
+
+  if( COSTELLA_CALL( CostellaCpuSetTier( ubTierInUse ) ) )
+  {
+    COSTELLA_ERROR( "Restoring tier" );
+    COSTELLA_RETURN;
+  }
+
+  printf( "  (checksum %lu)\n", data.udSum );
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* main:
+**
+**   Run the checks at every tier the processor supports, and unless
+**   --check is given, the timings.
+*/
+
+COSTELLA_ANSI_FUNCTION( main, int, ( int argc, char** argv ) )
+{
+  COSTELLA_B bTime;
+  COSTELLA_UB ubTier, ubTierInUse;
+  COSTELLA_UD udFailures = 0;
+
+  srand( 1 );
+
+  bTime = argc < 2 || strcmp( argv[ 1 ], "--check" );
+
+  if( COSTELLA_CALL( CostellaUnblockInitialize() ) || COSTELLA_CALL(
+    KernelsAdjustments( &udFailures ) ) )
+  {
+    COSTELLA_ERROR_FPRINT( stderr );
+    COSTELLA_ANSI_RETURN( 1 );
+  }
+
+  ubTierInUse = costella_cpu_tier();
+
+  printf( "kernels: checking" );
+
+  for( ubTier = 0; ubTier <= costella_cpu_supported_tier() && !udFailures;
+    ubTier++ )
+  {
+    printf( " %s", costella_cpu_name( ubTier ) );
+    fflush( stdout );
+
+    if( COSTELLA_CALL( CostellaCpuSetTier( ubTier ) ) || COSTELLA_CALL(
+      KernelsDiscrepancies( &udFailures ) ) || COSTELLA_CALL(
+      KernelsCorrection( &udFailures ) ) || COSTELLA_CALL( KernelsConvert(
+      &udFailures ) ) )
+    {
+      COSTELLA_ERROR_FPRINT( stderr );
+      COSTELLA_ANSI_RETURN( 1 );
+    }
+  }
+
+  printf( "\n" );
+
+  if( udFailures )
+  {
+    printf( "kernels: %lu failures\n", udFailures );
+    COSTELLA_ANSI_RETURN( 1 );
+  }
+
+  printf( "kernels: ok (%s in use)\n", costella_cpu_name( ubTierInUse ) );
+
+  if( COSTELLA_CALL( CostellaCpuSetTier( ubTierInUse ) ) || ( bTime &&
+    COSTELLA_CALL( KernelsTime() ) ) || COSTELLA_CALL(
+    CostellaUnblockFinalize() ) )
+  {
+    COSTELLA_ERROR_FPRINT( stderr );
+    COSTELLA_ANSI_RETURN( 1 );
+  }
+}
+COSTELLA_END_ANSI_FUNCTION( 0 )
@@ -0,0 +1,390 @@
+/* Copyright (c) 2026 The unblock authors.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a
+** copy of this software and associated documentation files (the "Software")
+** to deal in the Software without restriction, including without limitation
+** the rights to use, copy, modify, merge, publish, distribute, sublicense,
+** and/or sell copies of the Software, and to permit persons to whom the
+** Software is furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included
+** in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT, OR OTHERWISE, ARISING
+** FROM, OUT OF, OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+** DEALINGS IN THE SOFTWARE.
+**
+**
+** test/layout.c:
+**
+**   Check that the library gives the same results in every image layout.
+**   Built with the default layout, this unblocks some synthetic blocky
+**   images and writes the results to stdout, one channel after another.
+**   Built with COSTELLA_IMAGE_TILED, it unblocks the same images in the
+**   tiled layout, and compares the results with those read from stdin:
+**
+**     test/layout | test/layout_tiled
+**
+**   This version: October 18, 2026.
+**
+**   Written in ANSI C.
+*/
+
+
+
+/* Include files.
+*/
+
+#include "costella_unblock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+/* The images: sizes that are and are not multiples of a block, in one or
+** several threads, color and grayscale.
+*/
+
+#define LAYOUT_CASES 5
+
+static const COSTELLA_UD gaudLayoutWidth[ LAYOUT_CASES ] =
+{
+  256, 203, 203, 517, 61
+};
+
+static const COSTELLA_UD gaudLayoutHeight[ LAYOUT_CASES ] =
+{
+  128, 141, 141, 300, 45
+};
+
+static const COSTELLA_UD gaudLayoutThreads[ LAYOUT_CASES ] =
+{
+  1, 1, 3, 4, 2
+};
+
+static const COSTELLA_B gabLayoutColor[ LAYOUT_CASES ] =
+{
+  COSTELLA_TRUE, COSTELLA_TRUE, COSTELLA_TRUE, COSTELLA_TRUE, COSTELLA_FALSE
+};
+
+
+
+/* State of the pseudo-random numbers, the same in every build.
+*/
+
+static COSTELLA_UD gudLayoutSeed = 1;
+
+
+
+/* Start function bodies.
+*/
+
+#include "costella_body.h"
+
+
+
+/* LayoutRandom:
+**
+**   Return a pseudo-random byte.
+*/
+
+static COSTELLA_UB LayoutRandom( void )
+{
+  gudLayoutSeed = ( gudLayoutSeed * 1103515245 + 12345 ) & 0xffffffff;
+  return (COSTELLA_UB) ( gudLayoutSeed >> 16 );
+}
+
+
+
+/* LayoutFrame:
+**
+**   Fill a channel with a blocky image: a random level for each 8 x 8
+**   block, plus a little noise.
+*/
+
+static void LayoutFrame( COSTELLA_UB* aub, COSTELLA_UD udWidth, COSTELLA_UD
+  udHeight )
+{
+  COSTELLA_UD udRow, udColumn, udBlocksAcross;
+  COSTELLA_UB aubLevel[ 1024 ];
+  COSTELLA_SD sd;
+
+  udBlocksAcross = ( udWidth + 7 ) >> 3;
+
+  for( udRow = 0; udRow < udHeight; udRow++ )
+  {
+    if( !( udRow & 7 ) )
+    {
+      for( udColumn = 0; udColumn < udBlocksAcross; udColumn++ )
+      {
+        aubLevel[ udColumn ] = LayoutRandom();
+      }
+    }
+
+    for( udColumn = 0; udColumn < udWidth; udColumn++ )
+    {
+      sd = (COSTELLA_SD) aubLevel[ udColumn >> 3 ] + ( LayoutRandom() & 15 )
+        - 8;
+      *aub++ = (COSTELLA_UB) COSTELLA_IMAGE_LIMIT_RANGE( sd );
+    }
+  }
+}
+
+
+
+/* LayoutCase:
+**
+**   Unblock one image, and write its channels to stdout, or compare them
+**   with those read from stdin.
+*/
+
+static COSTELLA_FUNCTION( LayoutCase, ( COSTELLA_UNBLOCK_CONTEXT* pctx,
+  COSTELLA_UD udCase, COSTELLA_UD* pudFailures ) )
+{
+  COSTELLA_B bColor;
+  COSTELLA_UB ubChannel, ubNumChannels;
+  COSTELLA_UB* aaubRows[ 3 ];
+  COSTELLA_UB* pubExpected;
+  COSTELLA_UD udWidth, udHeight, udBytes, udPixel, udDiffering;
+  COSTELLA_IMAGE i;
+  #ifdef COSTELLA_IMAGE_TILED
+    COSTELLA_UB* aaubAllocated[ 3 ];
+    COSTELLA_UB* aaubTiles[ 3 ];
+    COSTELLA_UD udTiledBytes;
+  #endif
+
+
+  /* Make the image, one array per channel.
+  */
+
+  udWidth = gaudLayoutWidth[ udCase ];
+  udHeight = gaudLayoutHeight[ udCase ];
+  bColor = gabLayoutColor[ udCase ];
+  ubNumChannels = bColor ? 3 : 1;
+  udBytes = udWidth * udHeight;
+
+  for( ubChannel = 0; ubChannel < ubNumChannels; ubChannel++ )
+  {
+    if( !( aaubRows[ ubChannel ] = malloc( udBytes ) ) )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
+      COSTELLA_RETURN;
+    }
+
+    LayoutFrame( aaubRows[ ubChannel ], udWidth, udHeight );
+  }
+
+  i.bAlpha = COSTELLA_FALSE;
+  i.bColor = bColor;
+  i.bRgb = bColor;
+  i.bDownsampledChrominance = COSTELLA_FALSE;
+  i.bNonreplicatedDownsampledChrominance = COSTELLA_FALSE;
+  i.udWidth = udWidth;
+  i.udHeight = udHeight;
+  i.sdAlphaRowStride = 0;
+  i.sdChrominanceRowStride = 0;
+
+
+  /* In the tiled layout, copy each channel into aligned tiles.
+  */
+
+  #ifdef COSTELLA_IMAGE_TILED
+  {
+    i.sdRowStride = COSTELLA_IMAGE_TILED_ROW_STRIDE( udWidth );
+    udTiledBytes = COSTELLA_IMAGE_TILED_BYTES( udWidth, udHeight );
+
+    for( ubChannel = 0; ubChannel < ubNumChannels; ubChannel++ )
+    {
+      if( !( aaubAllocated[ ubChannel ] = malloc( udTiledBytes +
+        COSTELLA_IMAGE_TILED_ALIGNMENT ) ) )
+      {
+        COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
+        COSTELLA_RETURN;
+      }
+
+      aaubTiles[ ubChannel ] = aaubAllocated[ ubChannel ] +
+        COSTELLA_IMAGE_TILED_ALIGNMENT - (COSTELLA_UD) aaubAllocated[
+        ubChannel ] % COSTELLA_IMAGE_TILED_ALIGNMENT;
+
+      if( COSTELLA_CALL( CostellaImageTilePlane( aaubRows[ ubChannel ],
+        (COSTELLA_SD) udWidth, udWidth, udHeight, aaubTiles[ ubChannel ],
+        i.sdRowStride ) ) )
+      {
+        COSTELLA_ERROR( "Tiling" );
+        COSTELLA_RETURN;
+      }
+    }
+
+    if( bColor )
+    {
+      i.ic.aubRY = aaubTiles[ 0 ];
+      i.ic.aubGCb = aaubTiles[ 1 ];
+      i.ic.aubBCr = aaubTiles[ 2 ];
+    }
+    else
+    {
+      i.ig = aaubTiles[ 0 ];
+    }
+  }
+  #else
+  {
+    i.sdRowStride = (COSTELLA_SD) udWidth;
+
+    if( bColor )
+    {
+      i.ic.aubRY = aaubRows[ 0 ];
+      i.ic.aubGCb = aaubRows[ 1 ];
+      i.ic.aubBCr = aaubRows[ 2 ];
+    }
+    else
+    {
+      i.ig = aaubRows[ 0 ];
+    }
+  }
+  #endif
+
+
+  /* Unblock the image in place.
+  */
+
+  if( COSTELLA_CALL( CostellaUnblockCtx( pctx, &i, &i, COSTELLA_FALSE,
+    COSTELLA_FALSE, gaudLayoutThreads[ udCase ], 0, 0 ) ) )
+  {
+    COSTELLA_ERROR( "Unblocking" );
+    COSTELLA_RETURN;
+  }
+
+
+  /* In the tiled layout, copy the channels back out of the tiles, and
+  ** compare them with the default layout's. Otherwise write them out.
+  */
+
+  #ifdef COSTELLA_IMAGE_TILED
+  {
+    if( !( pubExpected = malloc( udBytes ) ) )
+    {
+      COSTELLA_FUNDAMENTAL_ERROR( "Allocating" );
+      COSTELLA_RETURN;
+    }
+
+    for( ubChannel = 0; ubChannel < ubNumChannels; ubChannel++ )
+    {
+      if( COSTELLA_CALL( CostellaImageUntilePlane( aaubTiles[ ubChannel ],
+        i.sdRowStride, udWidth, udHeight, aaubRows[ ubChannel ],
+        (COSTELLA_SD) udWidth ) ) )
+      {
+        COSTELLA_ERROR( "Untiling" );
+        COSTELLA_RETURN;
+      }
+
+      if( fread( pubExpected, 1, udBytes, stdin ) != udBytes )
+      {
+        COSTELLA_FUNDAMENTAL_ERROR( "Reading the default layout's results"
+          );
+        COSTELLA_RETURN;
+      }
+
+      for( udPixel = 0, udDiffering = 0; udPixel < udBytes; udPixel++ )
+      {
+        udDiffering += aaubRows[ ubChannel ][ udPixel ] != pubExpected[
+          udPixel ];
+      }
+
+      if( udDiffering )
+      {
+        printf( "%lu x %lu image, %lu threads, channel %d: %lu pixels "
+          "differ\n", udWidth, udHeight, gaudLayoutThreads[ udCase ],
+          ubChannel, udDiffering );
+        ++*pudFailures;
+      }
+
+      free( aaubAllocated[ ubChannel ] );
+    }
+
+    free( pubExpected );
+  }
+  #else
+  {
+    (void) pubExpected;
+    (void) udPixel;
+    (void) udDiffering;
+    (void) pudFailures;
+
+    for( ubChannel = 0; ubChannel < ubNumChannels; ubChannel++ )
+    {
+      if( fwrite( aaubRows[ ubChannel ], 1, udBytes, stdout ) != udBytes )
+      {
+        COSTELLA_FUNDAMENTAL_ERROR( "Writing" );
+        COSTELLA_RETURN;
+      }
+    }
+  }
+  #endif
+
+  for( ubChannel = 0; ubChannel < ubNumChannels; ubChannel++ )
+  {
+    free( aaubRows[ ubChannel ] );
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* main:
+**
+**   Run the cases.
+*/
+
+COSTELLA_ANSI_FUNCTION( main, int, ( void ) )
+{
+  COSTELLA_UD udCase, udFailures = 0;
+  COSTELLA_UNBLOCK_CONTEXT* pctx = 0;
+
+  if( COSTELLA_CALL( CostellaUnblockInitialize() ) || COSTELLA_CALL(
+    CostellaUnblockContextCreate( 0, 0, &pctx ) ) )
+  {
+    COSTELLA_ERROR_FPRINT( stderr );
+    COSTELLA_ANSI_RETURN( 1 );
+  }
+
+  for( udCase = 0; udCase < LAYOUT_CASES; udCase++ )
+  {
+    if( COSTELLA_CALL( LayoutCase( pctx, udCase, &udFailures ) ) )
+    {
+      COSTELLA_ERROR_FPRINT( stderr );
+      COSTELLA_ANSI_RETURN( 1 );
+    }
+  }
+
+  if( COSTELLA_CALL( CostellaUnblockContextDestroy( &pctx ) ) ||
+    COSTELLA_CALL( CostellaUnblockFinalize() ) )
+  {
+    COSTELLA_ERROR_FPRINT( stderr );
+    COSTELLA_ANSI_RETURN( 1 );
+  }
+
+  #ifdef COSTELLA_IMAGE_TILED
+  {
+    if( udFailures )
+    {
+      printf( "layout: tiled, %lu failures\n", udFailures );
+      COSTELLA_ANSI_RETURN( 1 );
+    }
+
+    printf( "layout: tiled ok\n" );
+  }
+  #endif
+}
+COSTELLA_END_ANSI_FUNCTION( 0 )
+
+
+
+/* Copyright (c) 2026 The unblock authors.
+**
+** End of file.
+*/
@@ -0,0 +1,1011 @@
+/* Copyright (c) 2026 The unblock authors.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a
+** copy of this software and associated documentation files (the "Software")
+** to deal in the Software without restriction, including without limitation
+** the rights to use, copy, modify, merge, publish, distribute, sublicense,
+** and/or sell copies of the Software, and to permit persons to whom the
+** Software is furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included 
+** in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT, OR OTHERWISE, ARISING
+** FROM, OUT OF, OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+** DEALINGS IN THE SOFTWARE.
+**
+**
+** test/parity.c: 
+**
+**   Check that the vector kernels of the UnBlock algorithm and of the color
+**   conversion give exactly the same results as the ANSI C reference code, 
+**   over many random inputs, that the lookup tables computed by the 
+**   compiler hold what their formulas give, that a context allocates 
+**   nothing once it has unblocked an image, and that an image of 
+**   interleaved pixels is unblocked as if its rows were converted one at a
+**   time, and that images with mismatched or invalid chrominance layouts 
+**   are rejected. The library source is included here so that its internal 
+**   functions can be called.
+**
+**   This version: October 18, 2026.
+**
+**   Written in ANSI C.
+*/
+
+
+
+/* Include files.
+*/
+
+#include "../costella/costella_unblock.c"
+#include <stdio.h>
+#include <math.h>
+
+
+
+/* Number of random cases for each check.
+*/
+
+#define PARITY_CASES 20000
+
+
+
+/* Allocations made through the library's memory functions, which are 
+** replaced by counting versions.
+*/
+
+static COSTELLA_UD gudParityAllocations = 0;
+
+
+
+/* Parity{Malloc,Realloc,Free}: 
+**
+**   Memory functions for CostellaBaseInitialize() that count allocations.
+*/
+
+static COSTELLA_O* ParityMalloc( COSTELLA_MC mc )
+{
+  gudParityAllocations++;
+  return malloc( mc );
+}
+
+
+static COSTELLA_O* ParityRealloc( COSTELLA_O* po, COSTELLA_MC mc )
+{
+  gudParityAllocations++;
+  return realloc( po, mc );
+}
+
+
+static COSTELLA_B ParityFree( COSTELLA_O* po )
+{
+  free( po );
+  return COSTELLA_TRUE;
+}
+
+
+
+/* ParityRandom: 
+**
+**   Return a pseudo-random pixel value, or -1 for a missing pixel if 
+**   bMissing is nonzero.
+*/
+
+static COSTELLA_SW ParityRandom( COSTELLA_B bMissing )
+{
+  COSTELLA_SW sw;
+
+
+  /* Bias the values towards the ends of the range, where clamping and 
+  ** saturation happen.
+  */
+
+  switch( rand() % 4 )
+  {
+    case 0:
+      sw = 0;
+      break;
+
+    case 1:
+      sw = 255;
+      break;
+
+    default:
+      sw = (COSTELLA_SW) ( rand() % 256 );
+      break;
+  }
+
+  return bMissing ? -1 : sw;
+}
+
+
+
+/* ParityDiscrepancies: 
+**
+**   Compare costella_unblock_compute_strip_discrepancies() against 
+**   costella_unblock_compute_discrepancies(), and the multi-lane frequency
+**   tables against a direct count.
+*/
+
+static COSTELLA_FUNCTION( ParityDiscrepancies, ( COSTELLA_UD* pudFailures ) 
+  )
+{
+  COSTELLA_UB ubPosition, ubMissing;
+  COSTELLA_UB aubU[ 64 ], aubV[ 64 ];
+  COSTELLA_SW swU, swV;
+  COSTELLA_SW aswStrip[ 6 * 64 ], asw[ 6 ];
+  COSTELLA_UD udCase, udColumn, udCount, udFailures;
+  COSTELLA_UD audLanes[ COSTELLA_UNBLOCK_HISTOGRAM_LANES * 256 ], aud[ 256 ],
+    audDirect[ 256 ];
+
+
+  /* Run the random cases.
+  */
+
+  udFailures = 0;
+
+  COSTELLA_INITIALIZE_ARRAY( audLanes, COSTELLA_UNBLOCK_HISTOGRAM_LANES * 
+    256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( audDirect, 256, COSTELLA_UD );
+  COSTELLA_INITIALIZE_ARRAY( aud, 256, COSTELLA_UD );
+
+  for( udCase = 0; udCase < PARITY_CASES; udCase++ )
+  {
+    /* Fill a strip of random width. Each strip has zero, one or two missing
+    ** rows at the bottom, as at the bottom of an image.
+    */
+
+    udCount = 1 + (COSTELLA_UD) rand() % 64;
+    ubMissing = (COSTELLA_UB) ( rand() % 3 );
+
+    for( ubPosition = 0; ubPosition < 6; ubPosition++ )
+    {
+      for( udColumn = 0; udColumn < udCount; udColumn++ )
+      {
+        aswStrip[ ubPosition * 64 + udColumn ] = ParityRandom( ubPosition >=
+          6 - ubMissing );
+      }
+    }
+
+
+    /* Compute the whole strip at once.
+    */
+
+    costella_unblock_compute_strip_discrepancies( aswStrip, 64, udCount, aubU, 
+      aubV );
+    costella_unblock_accumulate_strip( aubU, udCount, audLanes );
+
+
+    /* Compare each column with the reference code.
+    */
+
+    for( udColumn = 0; udColumn < udCount; udColumn++ )
+    {
+      for( ubPosition = 0; ubPosition < 6; ubPosition++ )
+      {
+        asw[ ubPosition ] = aswStrip[ ubPosition * 64 + udColumn ];
+      }
+
+      costella_unblock_compute_discrepancies( asw, &swU, &swV );
+
+      audDirect[ abs( swU ) ]++;
+
+      if( aubU[ udColumn ] != abs( swU ) || aubV[ udColumn ] != abs( swV ) )
+      {
+        if( !udFailures++ )
+        {
+          printf( "Discrepancy mismatch: values %d %d %d %d %d %d, u %d/%d,"
+            " v %d/%d\n", asw[ 0 ], asw[ 1 ], asw[ 2 ], asw[ 3 ], asw[ 4 ], 
+            asw[ 5 ], aubU[ udColumn ], abs( swU ), aubV[ udColumn ], abs( 
+            swV ) );
+        }
+      }
+    }
+  }
+
+
+  /* Compare the frequency tables.
+  */
+
+  costella_unblock_merge_lanes( audLanes, aud );
+
+  for( udColumn = 0; udColumn < 256; udColumn++ )
+  {
+    if( aud[ udColumn ] != audDirect[ udColumn ] )
+    {
+      if( !udFailures++ )
+      {
+        printf( "Frequency mismatch at %lu: %lu/%lu\n", udColumn, aud[ 
+          udColumn ], audDirect[ udColumn ] );
+      }
+    }
+  }
+
+  *pudFailures += udFailures;
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* ParityCorrection: 
+**
+**   Compare costella_unblock_correct_rows_in_place() against correcting 
+**   each column with costella_unblock_correct_discrepancies(), for both 
+**   full and downsampled columns.
+*/
+
+static COSTELLA_FUNCTION( ParityCorrection, ( COSTELLA_UD* pudFailures ) )
+{
+  COSTELLA_UB ubPosition, ubNumRows, ubColumnStep;
+  COSTELLA_UB aubAdjustedU[ 256 ], aubAdjustedV[ 256 ];
+  COSTELLA_UB aubBlocks[ 16 * 128 ], aubOriginal[ 16 * 128 ];
+  COSTELLA_SW swU, swV;
+  COSTELLA_SW asw[ 16 ];
+  COSTELLA_UD udCase, udColumn, udCount, udByte, udFailures;
+
+
+  /* Run the random cases.
+  */
+
+  udFailures = 0;
+
+  for( udCase = 0; udCase < PARITY_CASES; udCase++ )
+  {
+    /* Draw fresh adjustment tables every so often.
+    */
+
+    if( !( udCase % 1000 ) )
+    {
+      for( udByte = 0; udByte < 256; udByte++ )
+      {
+        aubAdjustedU[ udByte ] = (COSTELLA_UB) ( rand() % ( udByte + 1 ) );
+        aubAdjustedV[ udByte ] = (COSTELLA_UB) ( rand() % ( udByte + 1 ) );
+      }
+    }
+
+
+    /* Fill two blocks of random width, with between 9 and 16 rows inside
+    ** the image, as at the bottom of an image.
+    */
+
+    ubColumnStep = (COSTELLA_UB) ( 1 + rand() % 2 );
+    udCount = 1 + (COSTELLA_UD) rand() % ( 128 / ubColumnStep );
+    ubNumRows = (COSTELLA_UB) ( 9 + rand() % 8 );
+
+    for( udByte = 0; udByte < 16 * 128; udByte++ )
+    {
+      aubBlocks[ udByte ] = aubOriginal[ udByte ] = (COSTELLA_UB) 
+        ParityRandom( COSTELLA_FALSE );
+    }
+
+
+    /* Correct the whole row segment in place.
+    */
+
+    costella_unblock_correct_rows_in_place( aubBlocks, 128, ubColumnStep, 
+      udCount, ubNumRows, aubAdjustedU, aubAdjustedV );
+
+
+    /* Compare each column with the reference code, and check that no other
+    ** bytes were touched.
+    */
+
+    for( udColumn = 0; udColumn < udCount; udColumn++ )
+    {
+      for( ubPosition = 0; ubPosition < 16; ubPosition++ )
+      {
+        asw[ ubPosition ] = ubPosition < ubNumRows ? aubOriginal[ ubPosition
+          * 128 + udColumn * ubColumnStep ] : -1;
+      }
+
+      costella_unblock_compute_discrepancies( asw + 5, &swU, &swV );
+
+      swU = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swU, aubAdjustedU );
+      swV = COSTELLA_UNBLOCK_ADJUST_DISCREPANCY( swV, aubAdjustedV );
+
+      costella_unblock_correct_discrepancies( asw, swU, swV );
+
+      for( ubPosition = 0; ubPosition < ubNumRows; ubPosition++ )
+      {
+        aubOriginal[ ubPosition * 128 + udColumn * ubColumnStep ] = 
+          (COSTELLA_UB) asw[ ubPosition ];
+      }
+    }
+
+    for( udByte = 0; udByte < 16 * 128; udByte++ )
+    {
+      if( aubBlocks[ udByte ] != aubOriginal[ udByte ] )
+      {
+        if( !udFailures++ )
+        {
+          printf( "Correction mismatch: step %d, rows %d, row %lu, byte %lu,"
+            " %d/%d\n", ubColumnStep, ubNumRows, udByte / 128, udByte % 128,
+            aubBlocks[ udByte ], aubOriginal[ udByte ] );
+        }
+      }
+    }
+  }
+
+  *pudFailures += udFailures;
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* ParityConvert: 
+**
+**   Compare CostellaImageConvertRgbRowToYcbcr() and 
+**   CostellaImageConvertYcbcrRowToRgb() against the conversion macros, for
+**   every combination of channel values, and for rows of random width.
+*/
+
+static COSTELLA_FUNCTION( ParityConvert, ( COSTELLA_UD* pudFailures ) )
+{
+  COSTELLA_B bBgr, bChrominance;
+  COSTELLA_UB ubR, ubB, ubY, ubCb, ubCr;
+  COSTELLA_UB aubIn[ 3 * 256 ], aubOut[ 3 * 256 ], aubY[ 256 ], 
+    aubCb[ 256 ], aubCr[ 256 ];
+  COSTELLA_UD udCase, udColumn, udWidth, udFailures;
+
+
+  /* Each case is a row of 256 pixels whose first two channels are fixed, 
+  ** and whose third takes every value, followed by a row of random width 
+  ** and random pixels.
+  */
+
+  udFailures = 0;
+
+  for( udCase = 0; udCase < 2 * 65536; udCase++ )
+  {
+    if( udCase < 65536 )
+    {
+      udWidth = 256;
+
+      for( udColumn = 0; udColumn < 256; udColumn++ )
+      {
+        aubIn[ 3 * udColumn ] = (COSTELLA_UB) ( udCase >> 8 );
+        aubIn[ 3 * udColumn + 1 ] = (COSTELLA_UB) udCase;
+        aubIn[ 3 * udColumn + 2 ] = (COSTELLA_UB) udColumn;
+      }
+    }
+    else
+    {
+      udWidth = 1 + (COSTELLA_UD) rand() % 256;
+
+      for( udColumn = 0; udColumn < 3 * udWidth; udColumn++ )
+      {
+        aubIn[ udColumn ] = (COSTELLA_UB) ParityRandom( COSTELLA_FALSE );
+      }
+    }
+
+    bBgr = (COSTELLA_B) ( udCase & 1 );
+    bChrominance = (COSTELLA_B) ( udCase % 7 != 0 );
+    ubR = (COSTELLA_UB) ( bBgr ? 2 : 0 );
+    ubB = (COSTELLA_UB) ( 2 - ubR );
+
+
+    /* Treat the row as RGB.
+    */
+
+    if( COSTELLA_CALL( CostellaImageConvertRgbRowToYcbcr( aubIn, udWidth, 
+      bBgr, aubY, bChrominance ? aubCb : 0, bChrominance ? aubCr : 0 ) ) )
+    {
+      COSTELLA_ERROR( "Converting row to YCbCr" );
+      COSTELLA_RETURN;
+    }
+
+    for( udColumn = 0; udColumn < udWidth; udColumn++ )
+    {
+      COSTELLA_IMAGE_CONVERT_RGB_TO_YCBCR( aubIn[ 3 * udColumn + ubR ], 
+        aubIn[ 3 * udColumn + 1 ], aubIn[ 3 * udColumn + ubB ], &ubY, &ubCb,
+        &ubCr );
+
+      if( aubY[ udColumn ] != ubY || ( bChrominance && ( aubCb[ udColumn ] 
+        != ubCb || aubCr[ udColumn ] != ubCr ) ) )
+      {
+        if( !udFailures++ )
+        {
+          printf( "RGB to YCbCr mismatch: width %lu, column %lu\n", udWidth,
+            udColumn );
+        }
+      }
+    }
+
+
+    /* Treat the row as YCbCr.
+    */
+
+    for( udColumn = 0; udColumn < udWidth; udColumn++ )
+    {
+      aubY[ udColumn ] = aubIn[ 3 * udColumn ];
+      aubCb[ udColumn ] = aubIn[ 3 * udColumn + 1 ];
+      aubCr[ udColumn ] = aubIn[ 3 * udColumn + 2 ];
+    }
+
+    if( COSTELLA_CALL( CostellaImageConvertYcbcrRowToRgb( aubY, aubCb, 
+      aubCr, udWidth, bBgr, aubOut ) ) )
+    {
+      COSTELLA_ERROR( "Converting row to RGB" );
+      COSTELLA_RETURN;
+    }
+
+    for( udColumn = 0; udColumn < udWidth; udColumn++ )
+    {
+      COSTELLA_IMAGE_CONVERT_YCBCR_TO_RGB( aubY[ udColumn ], aubCb[ udColumn
+        ], aubCr[ udColumn ], &ubR, &ubY, &ubB );
+
+      if( aubOut[ 3 * udColumn + ( bBgr ? 2 : 0 ) ] != ubR || aubOut[ 3 * 
+        udColumn + 1 ] != ubY || aubOut[ 3 * udColumn + ( bBgr ? 0 : 2 ) ] 
+        != ubB )
+      {
+        if( !udFailures++ )
+        {
+          printf( "YCbCr to RGB mismatch: width %lu, column %lu\n", udWidth,
+            udColumn );
+        }
+      }
+    }
+  }
+
+  *pudFailures += udFailures;
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* ParityTables: 
+**
+**   Compare every entry of the lookup tables with the formula for it.
+*/
+
+static COSTELLA_FUNCTION( ParityTables, ( COSTELLA_UD* pudFailures ) )
+{
+  COSTELLA_SW sw;
+  COSTELLA_SD sd;
+  COSTELLA_UD udFailures = 0;
+  const COSTELLA_UNBLOCK_TABLES* ptbl = &gtblCostellaUnblock;
+  const COSTELLA_IMAGE_CONVERT_TABLES* ptblConvert = 
+    &gtblCostellaImageConvert;
+
+
+  /* The [0,255] tables.
+  */
+
+  for( sw = 0; sw < 256; sw++ )
+  {
+    sd = sw;
+
+    udFailures += ptbl->aubSquareRoot[ sw ] != (COSTELLA_UB) floor( sqrt( 
+      (double) sw ) + 0.5 ) || ptbl->auwMult3[ sw ] != 3 * sw || 
+      ptbl->auwMult15Add4[ sw ] != 15 * sw + 4 || ptbl->auwMult15[ sw ] != 
+      15 * sw || ptbl->auwMult10[ sw ] != 10 * sw || ptbl->auwMult12Add4[ 
+      sw ] != 12 * sw + 4;
+
+    udFailures += ptblConvert->asdRY[ sw ] != 19595L * sd + 32768L || 
+      ptblConvert->asdGY[ sw ] != 38470L * sd || ptblConvert->asdBY[ sw ] 
+      != 7471L * sd || ptblConvert->asdRCb[ sw ] != -11058L * sd || 
+      ptblConvert->asdGCb[ sw ] != -21709L * sd || ptblConvert->asdBCb[ sw
+      ] != 32767L * sd + 8421376L || ptblConvert->asdRCr[ sw ] != 
+      ptblConvert->asdBCb[ sw ] || ptblConvert->asdGCr[ sw ] != -27438L * 
+      sd || ptblConvert->asdBCr[ sw ] != -5329L * sd || 
+      ptblConvert->asdCbG[ sw ] != 8910464L - 22554L * sd || 
+      ptblConvert->asdCrG[ sw ] != -46803L * sd || ptblConvert->aswCrR[ sw
+      ] != (COSTELLA_SW) COSTELLA_SHIFT_RIGHT_FLOOR( 91885L * sd - 
+      11728512L, 16 ) || ptblConvert->aswCbB[ sw ] != (COSTELLA_SW) 
+      COSTELLA_SHIFT_RIGHT_FLOOR( 116134L * sd - 14832384L, 16 );
+  }
+
+
+  /* The [-255,255] tables.
+  */
+
+  for( sw = -255; sw < 256; sw++ )
+  {
+    udFailures += ptbl->aswMult3Add32[ 255 + sw ] != 3 * sw + 32 || 
+      ptbl->aswMult3Add16[ 255 + sw ] != 3 * sw + 16 || 
+      ptbl->aswMult5Add16[ 255 + sw ] != 5 * sw + 16 || 
+      ptbl->aswMult15Add32[ 255 + sw ] != 15 * sw + 32 || 
+      ptbl->aswMult21Add32[ 255 + sw ] != 21 * sw + 32 || 
+      ptbl->aswMult7Add8[ 255 + sw ] != 7 * sw + 8 || 
+      ptbl->aswMultM11Add128[ 255 + sw ] != -11 * sw + 128 || 
+      ptbl->aswMultM31Add128[ 255 + sw ] != -31 * sw + 128 || 
+      ptbl->aswMultM58Add128[ 255 + sw ] != -58 * sw + 128 || 
+      ptbl->aswMultM57Add128[ 255 + sw ] != -57 * sw + 128 || 
+      ptbl->aswMultM22Add128[ 255 + sw ] != -22 * sw + 128 || 
+      ptbl->aswMult42Add128[ 255 + sw ] != 42 * sw + 128 || 
+      ptbl->aswMult138Add128[ 255 + sw ] != (COSTELLA_SW) ( 138 * sw + 128
+      );
+  }
+
+  if( udFailures )
+  {
+    printf( "%lu lookup table entries differ from their formulas\n", 
+      udFailures );
+    *pudFailures += udFailures;
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* ParityAllocations: 
+**
+**   Unblock RGB images with a context, in several threads, smoothly 
+**   upsampling the chrominance of the output. After the first image, 
+**   which sizes the context's arena, no image may allocate any memory.
+*/
+
+#define PARITY_WIDTH 256
+#define PARITY_HEIGHT 128
+
+static COSTELLA_FUNCTION( ParityAllocations, ( COSTELLA_UD* pudFailures ) )
+{
+  static COSTELLA_UB aubR[ PARITY_WIDTH * PARITY_HEIGHT ], aubG[ 
+    PARITY_WIDTH * PARITY_HEIGHT ], aubB[ PARITY_WIDTH * PARITY_HEIGHT ];
+  COSTELLA_UD udFrame, udPixel, udAllocations = 0;
+  COSTELLA_IMAGE i;
+  COSTELLA_UNBLOCK_CONTEXT* pctx = 0;
+
+
+  /* Create the context.
+  */
+
+  if( COSTELLA_CALL( CostellaUnblockContextCreate( 0, 0, &pctx ) ) )
+  {
+    COSTELLA_ERROR( "Creating context" );
+    COSTELLA_RETURN;
+  }
+
+
+  /* Unblock a few random images, counting the allocations after the 
+  ** first.
+  */
+
+  for( udFrame = 0; udFrame < 5; udFrame++ )
+  {
+    for( udPixel = 0; udPixel < PARITY_WIDTH * PARITY_HEIGHT; udPixel++ )
+    {
+      aubR[ udPixel ] = (COSTELLA_UB) ParityRandom( COSTELLA_FALSE );
+      aubG[ udPixel ] = (COSTELLA_UB) ParityRandom( COSTELLA_FALSE );
+      aubB[ udPixel ] = (COSTELLA_UB) ParityRandom( COSTELLA_FALSE );
+    }
+
+    i.bAlpha = COSTELLA_FALSE;
+    i.bColor = COSTELLA_TRUE;
+    i.bRgb = COSTELLA_TRUE;
+    i.bDownsampledChrominance = COSTELLA_FALSE;
+    i.bNonreplicatedDownsampledChrominance = COSTELLA_FALSE;
+    i.udWidth = PARITY_WIDTH;
+    i.udHeight = PARITY_HEIGHT;
+    i.sdRowStride = PARITY_WIDTH;
+    i.sdAlphaRowStride = 0;
+    i.sdChrominanceRowStride = 0;
+    i.ic.aubRY = aubR;
+    i.ic.aubGCb = aubG;
+    i.ic.aubBCr = aubB;
+
+    if( udFrame == 1 )
+    {
+      udAllocations = gudParityAllocations;
+    }
+
+    if( COSTELLA_CALL( CostellaUnblockCtx( pctx, &i, &i, COSTELLA_FALSE, 
+      COSTELLA_FALSE, 4, 0, 0 ) ) )
+    {
+      COSTELLA_ERROR( "Unblocking" );
+
+      if( COSTELLA_CLEANUP_CALL( CostellaUnblockContextDestroy( &pctx ) ) )
+      {
+        COSTELLA_CLEANUP_ERROR( "Destroying context" );
+      }
+
+      COSTELLA_RETURN;
+    }
+  }
+
+  if( gudParityAllocations != udAllocations )
+  {
+    printf( "Context made %lu allocations after the first image\n", 
+      gudParityAllocations - udAllocations );
+    ++*pudFailures;
+  }
+
+
+  /* Destroy the context.
+  */
+
+  if( COSTELLA_CALL( CostellaUnblockContextDestroy( &pctx ) ) )
+  {
+    COSTELLA_ERROR( "Destroying context" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* ParityInterleaved: 
+**
+**   Unblock an image of interleaved BGR pixels, stored from the bottom up 
+**   with padded rows, with CostellaUnblockInterleaved() in several 
+**   threads, both into another image and in place. Each must give exactly
+**   what converting its rows one at a time and unblocking them with 
+**   quarter-size chrominance gives, and the second call may allocate no 
+**   memory.
+*/
+
+#define PARITY_INTERLEAVED_WIDTH 203
+#define PARITY_INTERLEAVED_HEIGHT 141
+#define PARITY_INTERLEAVED_STRIDE ( 3 * PARITY_INTERLEAVED_WIDTH + 1 )
+#define PARITY_INTERLEAVED_CHROMINANCE_WIDTH ( ( PARITY_INTERLEAVED_WIDTH +\
+  1 ) >> 1 )
+
+static COSTELLA_FUNCTION( ParityInterleaved, ( COSTELLA_UD* pudFailures ) )
+{
+  static COSTELLA_UB aubIn[ PARITY_INTERLEAVED_STRIDE * 
+    PARITY_INTERLEAVED_HEIGHT ], aubOut[ PARITY_INTERLEAVED_STRIDE * 
+    PARITY_INTERLEAVED_HEIGHT ], aubExpected[ PARITY_INTERLEAVED_STRIDE * 
+    PARITY_INTERLEAVED_HEIGHT ], aubY[ PARITY_INTERLEAVED_WIDTH * 
+    PARITY_INTERLEAVED_HEIGHT ], aubCb[ 
+    PARITY_INTERLEAVED_CHROMINANCE_WIDTH * PARITY_INTERLEAVED_HEIGHT ], 
+    aubCr[ PARITY_INTERLEAVED_CHROMINANCE_WIDTH * PARITY_INTERLEAVED_HEIGHT
+    ], aubScratch[ 2 * PARITY_INTERLEAVED_WIDTH ];
+  COSTELLA_UD udRow, udColumn, udByte, udStep, udAllocations, udFailures =
+    0;
+  COSTELLA_UB* aubTop;
+  COSTELLA_SD sdStride;
+  COSTELLA_IMAGE i;
+  COSTELLA_UNBLOCK_CONTEXT* pctx = 0;
+
+
+  /* Fill the input image with blocks of random levels, plus noise. The
+  ** top row is the last in memory.
+  */
+
+  for( udByte = 0; udByte < PARITY_INTERLEAVED_STRIDE * 
+    PARITY_INTERLEAVED_HEIGHT; udByte++ )
+  {
+    aubIn[ udByte ] = (COSTELLA_UB) ( ( ParityRandom( COSTELLA_FALSE ) & 
+      15 ) + ( ( udByte / 24 ) % 7 ) * 32 );
+  }
+
+  sdStride = -(COSTELLA_SD) PARITY_INTERLEAVED_STRIDE;
+  aubTop = aubIn + PARITY_INTERLEAVED_STRIDE * ( PARITY_INTERLEAVED_HEIGHT
+    - 1 );
+
+
+  /* Compute the expected output a row at a time.
+  */
+
+  for( udRow = 0; udRow < PARITY_INTERLEAVED_HEIGHT; udRow++ )
+  {
+    if( COSTELLA_CALL( CostellaImageConvertRgbRowToYcbcr( aubTop + 
+      (COSTELLA_SD) udRow * sdStride, PARITY_INTERLEAVED_WIDTH, 
+      COSTELLA_TRUE, aubY + udRow * PARITY_INTERLEAVED_WIDTH, aubScratch, 
+      aubScratch + PARITY_INTERLEAVED_WIDTH ) ) )
+    {
+      COSTELLA_ERROR( "Converting row" );
+      COSTELLA_RETURN;
+    }
+
+    for( udColumn = 0; !( udRow & 1 ) && udColumn < 
+      PARITY_INTERLEAVED_WIDTH; udColumn += 2 )
+    {
+      aubCb[ ( udRow >> 1 ) * PARITY_INTERLEAVED_CHROMINANCE_WIDTH + ( 
+        udColumn >> 1 ) ] = aubScratch[ udColumn ];
+      aubCr[ ( udRow >> 1 ) * PARITY_INTERLEAVED_CHROMINANCE_WIDTH + ( 
+        udColumn >> 1 ) ] = aubScratch[ PARITY_INTERLEAVED_WIDTH + udColumn
+        ];
+    }
+  }
+
+  i.bAlpha = COSTELLA_FALSE;
+  i.bColor = COSTELLA_TRUE;
+  i.bRgb = COSTELLA_FALSE;
+  i.bDownsampledChrominance = COSTELLA_TRUE;
+  i.bNonreplicatedDownsampledChrominance = COSTELLA_TRUE;
+  i.udWidth = PARITY_INTERLEAVED_WIDTH;
+  i.udHeight = PARITY_INTERLEAVED_HEIGHT;
+  i.sdRowStride = PARITY_INTERLEAVED_WIDTH;
+  i.sdAlphaRowStride = 0;
+  i.sdChrominanceRowStride = PARITY_INTERLEAVED_CHROMINANCE_WIDTH;
+  i.ic.aubRY = aubY;
+  i.ic.aubGCb = aubCb;
+  i.ic.aubBCr = aubCr;
+
+  if( COSTELLA_CALL( CostellaUnblockContextCreate( 0, 0, &pctx ) ) )
+  {
+    COSTELLA_ERROR( "Creating context" );
+    COSTELLA_RETURN;
+  }
+
+  if( COSTELLA_CALL( CostellaUnblockQuarter( pctx, &i, &i, COSTELLA_FALSE,
+    COSTELLA_FALSE, 1, 0, 0 ) ) )
+  {
+    COSTELLA_ERROR( "Unblocking" );
+
+    if( COSTELLA_CLEANUP_CALL( CostellaUnblockContextDestroy( &pctx ) ) )
+    {
+      COSTELLA_CLEANUP_ERROR( "Destroying context" );
+    }
+
+    COSTELLA_RETURN;
+  }
+
+  memcpy( aubExpected, aubIn, sizeof( aubExpected ) );
+
+  for( udRow = 0; udRow < PARITY_INTERLEAVED_HEIGHT; udRow++ )
+  {
+    for( udColumn = 0; udColumn < PARITY_INTERLEAVED_WIDTH; udColumn++ )
+    {
+      aubScratch[ udColumn ] = aubCb[ ( udRow >> 1 ) * 
+        PARITY_INTERLEAVED_CHROMINANCE_WIDTH + ( udColumn >> 1 ) ];
+      aubScratch[ PARITY_INTERLEAVED_WIDTH + udColumn ] = aubCr[ ( udRow >> 
+        1 ) * PARITY_INTERLEAVED_CHROMINANCE_WIDTH + ( udColumn >> 1 ) ];
+    }
+
+    if( COSTELLA_CALL( CostellaImageConvertYcbcrRowToRgb( aubY + udRow * 
+      PARITY_INTERLEAVED_WIDTH, aubScratch, aubScratch + 
+      PARITY_INTERLEAVED_WIDTH, PARITY_INTERLEAVED_WIDTH, COSTELLA_TRUE, 
+      aubExpected + ( aubTop - aubIn ) + (COSTELLA_SD) udRow * sdStride ) ) )
+    {
+      COSTELLA_ERROR( "Converting row" );
+
+      if( COSTELLA_CLEANUP_CALL( CostellaUnblockContextDestroy( &pctx ) ) )
+      {
+        COSTELLA_CLEANUP_ERROR( "Destroying context" );
+      }
+
+      COSTELLA_RETURN;
+    }
+  }
+
+
+  /* Unblock the image into another, then in place, with the same context.
+  */
+
+  memcpy( aubOut, aubIn, sizeof( aubOut ) );
+  udAllocations = 0;
+
+  for( udStep = 0; udStep < 2; udStep++ )
+  {
+    if( udStep )
+    {
+      udAllocations = gudParityAllocations;
+    }
+
+    if( COSTELLA_CALL( CostellaUnblockInterleaved( pctx, udStep ? aubOut + 
+      ( aubTop - aubIn ) : aubTop, sdStride, aubOut + ( aubTop - aubIn ), 
+      sdStride, PARITY_INTERLEAVED_WIDTH, PARITY_INTERLEAVED_HEIGHT, 
+      COSTELLA_TRUE, COSTELLA_FALSE, COSTELLA_FALSE, 3, 0, 0 ) ) )
+    {
+      COSTELLA_ERROR( "Unblocking interleaved image" );
+
+      if( COSTELLA_CLEANUP_CALL( CostellaUnblockContextDestroy( &pctx ) ) )
+      {
+        COSTELLA_CLEANUP_ERROR( "Destroying context" );
+      }
+
+      COSTELLA_RETURN;
+    }
+
+    for( udByte = 0; udByte < PARITY_INTERLEAVED_STRIDE * 
+      PARITY_INTERLEAVED_HEIGHT; udByte++ )
+    {
+      udFailures += aubOut[ udByte ] != aubExpected[ udByte ];
+    }
+
+    if( udFailures )
+    {
+      printf( "Interleaved mismatch: %s, %lu bytes\n", udStep ? "in place"
+        : "into another image", udFailures );
+      ++*pudFailures;
+      udFailures = 0;
+    }
+
+    memcpy( aubOut, aubIn, sizeof( aubOut ) );
+  }
+
+  if( gudParityAllocations != udAllocations )
+  {
+    printf( "Interleaved image made %lu allocations after the first\n", 
+      gudParityAllocations - udAllocations );
+    ++*pudFailures;
+  }
+
+
+  /* Destroy the context.
+  */
+
+  if( COSTELLA_CALL( CostellaUnblockContextDestroy( &pctx ) ) )
+  {
+    COSTELLA_ERROR( "Destroying context" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* ParityLayout: 
+**
+**   Check that CostellaUnblockQuarter() accepts a YCbCr image with 
+**   quarter-size nonreplicated chrominance and rejects any other, and that
+**   CostellaUnblockCtx() ignores the chrominance row stride, so that a 
+**   caller that leaves it uninitialized gets what it always got.
+*/
+
+#define PARITY_LAYOUT_SIZE 16
+#define PARITY_LAYOUT_PIXELS ( PARITY_LAYOUT_SIZE * PARITY_LAYOUT_SIZE )
+
+static COSTELLA_FUNCTION( ParityLayout, ( COSTELLA_UD* pudFailures ) )
+{
+  static COSTELLA_UB aubY[ PARITY_LAYOUT_PIXELS ], aubCb[ 
+    PARITY_LAYOUT_PIXELS ], aubCr[ PARITY_LAYOUT_PIXELS ], aubExpected[ 3 *
+    PARITY_LAYOUT_PIXELS ];
+  COSTELLA_UD udPixel, udStep;
+  COSTELLA_IMAGE iIn, iOut;
+  COSTELLA_UNBLOCK_CONTEXT* pctx = 0;
+
+
+  /* Create the context, and describe a YCbCr image with quarter-size 
+  ** chrominance.
+  */
+
+  if( COSTELLA_CALL( CostellaUnblockContextCreate( 0, 0, &pctx ) ) )
+  {
+    COSTELLA_ERROR( "Creating context" );
+    COSTELLA_RETURN;
+  }
+
+  iIn.bAlpha = COSTELLA_FALSE;
+  iIn.bColor = COSTELLA_TRUE;
+  iIn.bRgb = COSTELLA_FALSE;
+  iIn.bDownsampledChrominance = COSTELLA_TRUE;
+  iIn.bNonreplicatedDownsampledChrominance = COSTELLA_TRUE;
+  iIn.udWidth = PARITY_LAYOUT_SIZE;
+  iIn.udHeight = PARITY_LAYOUT_SIZE;
+  iIn.sdRowStride = PARITY_LAYOUT_SIZE;
+  iIn.sdAlphaRowStride = 0;
+  iIn.sdChrominanceRowStride = PARITY_LAYOUT_SIZE >> 1;
+  iIn.ic.aubRY = aubY;
+  iIn.ic.aubGCb = aubCb;
+  iIn.ic.aubBCr = aubCr;
+
+
+  /* An RGB image, replicated chrominance, and a grayscale output.
+  */
+
+  iOut = iIn;
+  iOut.bRgb = iIn.bRgb = COSTELLA_TRUE;
+
+  if( costella_unblock_quarter( pctx, &iIn, &iOut, 0, 0, 1, 0, 0, 0 ) )
+  {
+    printf( "Layout: quarter-size chrominance accepted for RGB\n" );
+    ++*pudFailures;
+  }
+
+  iOut.bRgb = iIn.bRgb = COSTELLA_FALSE;
+  iIn.bNonreplicatedDownsampledChrominance = COSTELLA_FALSE;
+
+  if( costella_unblock_quarter( pctx, &iIn, &iOut, 0, 0, 1, 0, 0, 0 ) )
+  {
+    printf( "Layout: replicated quarter-size chrominance accepted\n" );
+    ++*pudFailures;
+  }
+
+  iIn.bNonreplicatedDownsampledChrominance = COSTELLA_TRUE;
+  iOut.bColor = COSTELLA_FALSE;
+  iOut.ig = aubY;
+
+  if( costella_unblock_quarter( pctx, &iIn, &iOut, 0, 0, 1, 0, 0, 0 ) )
+  {
+    printf( "Layout: quarter-size chrominance unblocked into gray\n" );
+    ++*pudFailures;
+  }
+
+
+  /* A valid image with quarter-size chrominance.
+  */
+
+  iOut = iIn;
+
+  if( !costella_unblock_quarter( pctx, &iIn, &iOut, 0, 0, 1, 0, 0, 0 ) )
+  {
+    printf( "Layout: quarter-size chrominance rejected\n" );
+    ++*pudFailures;
+  }
+
+
+  /* The same full-size image unblocked with a chrominance row stride of 
+  ** zero, and then with a garbage one, must match.
+  */
+
+  for( udStep = 0; udStep < 2; udStep++ )
+  {
+    for( udPixel = 0; udPixel < PARITY_LAYOUT_PIXELS; udPixel++ )
+    {
+      aubY[ udPixel ] = (COSTELLA_UB) ( ( udPixel * 37 ) & 255 );
+      aubCb[ udPixel ] = (COSTELLA_UB) ( ( udPixel * 11 ) & 255 );
+      aubCr[ udPixel ] = (COSTELLA_UB) ( ( udPixel * 5 ) & 255 );
+    }
+
+    iIn.sdChrominanceRowStride = udStep ? -12345 : 0;
+    iOut = iIn;
+
+    if( !costella_unblock_ctx( pctx, &iIn, &iOut, 0, 0, 1, 0, 0, 0 ) )
+    {
+      printf( "Layout: full-size chrominance rejected\n" );
+      ++*pudFailures;
+    }
+
+    if( !udStep )
+    {
+      memcpy( aubExpected, aubY, PARITY_LAYOUT_PIXELS );
+      memcpy( aubExpected + PARITY_LAYOUT_PIXELS, aubCb, 
+        PARITY_LAYOUT_PIXELS );
+      memcpy( aubExpected + 2 * PARITY_LAYOUT_PIXELS, aubCr, 
+        PARITY_LAYOUT_PIXELS );
+    }
+    else if( memcmp( aubExpected, aubY, PARITY_LAYOUT_PIXELS ) || memcmp(
+      aubExpected + PARITY_LAYOUT_PIXELS, aubCb, PARITY_LAYOUT_PIXELS ) ||
+      memcmp( aubExpected + 2 * PARITY_LAYOUT_PIXELS, aubCr, 
+      PARITY_LAYOUT_PIXELS ) )
+    {
+      printf( "Layout: chrominance row stride changed the result\n" );
+      ++*pudFailures;
+    }
+  }
+
+
+  /* Destroy the context.
+  */
+
+  if( COSTELLA_CALL( CostellaUnblockContextDestroy( &pctx ) ) )
+  {
+    COSTELLA_ERROR( "Destroying context" );
+    COSTELLA_RETURN;
+  }
+}
+COSTELLA_END_FUNCTION
+
+
+
+/* main: 
+**
+**   Run the checks.
+*/
+
+COSTELLA_ANSI_FUNCTION( main, int, ( void ) )
+{
+  COSTELLA_UD udFailures = 0;
+
+  srand( 1 );
+
+  if( COSTELLA_CALL( CostellaBaseInitialize( ParityMalloc, ParityRealloc, 
+    ParityFree ) ) || COSTELLA_CALL( CostellaUnblockInitialize() ) || 
+    COSTELLA_CALL( ParityDiscrepancies( &udFailures ) ) || COSTELLA_CALL( 
+    ParityCorrection( &udFailures ) ) || COSTELLA_CALL( ParityConvert( 
+    &udFailures ) ) || COSTELLA_CALL( ParityTables( &udFailures ) ) || 
+    COSTELLA_CALL( ParityAllocations( &udFailures ) ) || 
+    COSTELLA_CALL( ParityInterleaved( &udFailures ) ) || 
+    COSTELLA_CALL( ParityLayout( &udFailures ) ) || 
+    COSTELLA_CALL( CostellaUnblockFinalize() ) )
+  {
+    COSTELLA_ERROR_FPRINT( stderr );
+    COSTELLA_ANSI_RETURN( 1 );
+  } 
+
+  if( udFailures )
+  {
+    printf( "parity: %lu failures\n", udFailures );
+    COSTELLA_ANSI_RETURN( 1 );
+  }
+
+  printf( "parity: ok\n" );
+}
+COSTELLA_END_ANSI_FUNCTION( 0 )
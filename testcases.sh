@@ -7,9 +7,12 @@ die() { echo "$1"; exit 1; }
 
 # unblock's output as of 2021 Jan 31 is the test case's expected output.
 # That reassures us that the 8x8 case hasn't been broken.
+# (Regenerated when main.cpp switched from its own floating-point color conversion
+# to the library's integer one, which changes the output slightly.)
 
+# Optional third argument: flags for unblock.
 run() {
-  cmd="../unblock $1 $2"
+  cmd="../unblock $3 $1 $2"
   eval "$cmd" || die "Command failed: $cmd"
   [ ! -f "$2" ] && die "No output from: $cmd"
   [ ! -s "$2" ] && die "Empty output from: $cmd"
@@ -28,6 +31,61 @@ for i in 1 2; do
   run "../test-ok/in$i.png" "out$i.png"
 done
 
+# Any number of threads must give exactly the same output.
+for i in 1 2; do
+  run "../test-ok/in$i.bmp" "out$i.bmp" "--threads 3"
+  run "../test-ok/in$i.png" "out$i.png" "--threads 8"
+done
+
+# Streaming a few rows at a time must also give exactly the same output.
+for i in 1 2; do
+  run "../test-ok/in$i.bmp" "out$i.bmp" "--stream"
+  run "../test-ok/in$i.png" "out$i.png" "--stream"
+done
+
+# The parallel .png encoder must give the same pixels, at any level and number of threads.
+for i in 1 2; do
+  run "../test-ok/in$i.png" "out$i.png" "--png-level 1 --threads 4"
+  run "../test-ok/in$i.png" "out$i.png" "--png-level 9"
+done
+
+# Batch mode must give the same output as one file at a time.
+for i in 1 2; do
+  echo "../test-ok/in$i.bmp out$i.bmp"
+  echo "../test-ok/in$i.png out$i.png"
+done > batch.txt
+../unblock --batch --threads 2 batch.txt || die "Command failed: unblock --batch"
+for i in 1 2; do
+  for ext in bmp png; do
+    convert "../test-ok/out$i.$ext" 1.ppm
+    convert           "out$i.$ext" 2.ppm
+    cmp -s 1.ppm 2.ppm || die "Batch output out$i.$ext differs from expected"
+  done
+done
+rm -f 1.ppm 2.ppm batch.txt
+
+# Video frames, in 4:2:0 and 4:4:4, with one or several frames at a time.
+# in3.y4m and in4.y4m each hold three 64x48 frames.
+for i in 3 4; do
+  for threads in 1 3; do
+    cmd="../unblock --y4m --threads $threads ../test-ok/in$i.y4m out$i.y4m"
+    eval "$cmd" || die "Command failed: $cmd"
+    cmp -s "../test-ok/out$i.y4m" "out$i.y4m" || die "Output out$i.y4m differs from expected, with --threads $threads"
+  done
+done
+
+# A stream cut off in its third frame must be rejected,
+# but still hold exactly the first two frames of the expected output.
+for i in 3 4; do
+  header=$(head -1 "../test-ok/in$i.y4m" | wc -c)
+  cbFrame=$(( ( $(wc -c < "../test-ok/in$i.y4m") - header ) / 3 ))
+  head -c $(( header + 2 * cbFrame + 100 )) "../test-ok/in$i.y4m" > trunc$i.y4m
+  ../unblock --y4m --threads 3 trunc$i.y4m out$i.y4m 2> /dev/null && die "Truncated in$i.y4m wasn't rejected"
+  [ "$(wc -c < out$i.y4m)" -eq $(( header + 2 * cbFrame )) ] || die "Truncated in$i.y4m didn't give two frames"
+  cmp -s -n $(( header + 2 * cbFrame )) "../test-ok/out$i.y4m" "out$i.y4m" || die "Truncated in$i.y4m gave different frames"
+  rm -f trunc$i.y4m
+done
+
 # upscale x2 will be a separate test case, for 16x16.
 # That lets us check if 16x16 outperforms 8x8, as it should.
 